@@ -0,0 +1,100 @@
+#include "rmpch.h"
+#include "Adjoint.h"
+
+#include <Eigen/SparseLU>
+
+using namespace std;
+using namespace Eigen;
+
+typedef Triplet<double> T;
+
+void AdjointTape::clear() {
+	m_steps.clear();
+	m_njoints = 0;
+	m_valid = true;
+}
+
+void AdjointTape::push(const AdjointStep &step, int njoints) {
+	m_steps.push_back(step);
+	m_njoints = max(m_njoints, njoints);
+}
+
+bool AdjointTape::backward(const vector<VectorXd> &dLdy, AdjointGradients &grad) const {
+	if (!m_valid || m_steps.empty()) {
+		cerr << "AdjointTape: nothing to differentiate" << endl;
+		return false;
+	}
+	int n = (int)m_steps.size();
+	int nr = (int)m_steps[0].A.rows();
+	grad.tau.setZero(nr, n);
+	grad.stiffness.setZero(m_njoints);
+	grad.damping.setZero(m_njoints);
+
+	// Adjoints of q and qdot after the step being processed
+	VectorXd aq = VectorXd::Zero(nr);
+	VectorXd av = VectorXd::Zero(nr);
+	SparseLU<SparseMatrix<double>, COLAMDOrdering<int> > lu;
+	vector<T> triplets;
+	for (int k = n - 1; k >= 0; --k) {
+		const AdjointStep &s = m_steps[k];
+		if (k < (int)dLdy.size() && dLdy[k].size() == 2 * nr) {
+			aq += dLdy[k].head(nr);
+			av += dLdy[k].tail(nr);
+		}
+		int ne = (int)s.G.rows();
+
+		// The transpose of [A G'; G 0]
+		triplets.clear();
+		for (int j = 0; j < s.A.outerSize(); ++j) {
+			for (SparseMatrix<double>::InnerIterator it(s.A, j); it; ++it) {
+				triplets.push_back(T(it.col(), it.row(), it.value()));
+			}
+		}
+		for (int i = 0; i < ne; ++i) {
+			for (int j = 0; j < nr; ++j) {
+				if (s.G(i, j) != 0.0) {
+					triplets.push_back(T(j, nr + i, s.G(i, j)));
+					triplets.push_back(T(nr + i, j, s.G(i, j)));
+				}
+			}
+		}
+		SparseMatrix<double> Kt(nr + ne, nr + ne);
+		Kt.setFromTriplets(triplets.begin(), triplets.end());
+		lu.compute(Kt);
+		if (lu.info() != Success) {
+			cerr << "AdjointTape: the system of step " << k << " is singular" << endl;
+			return false;
+		}
+
+		// q1 = q0 + h qdot1, so qdot1 gets the adjoint of q1 as well
+		VectorXd rhs = VectorXd::Zero(nr + ne);
+		rhs.head(nr) = av + s.h * aq;
+		VectorXd mu = lu.solve(rhs);
+		VectorXd mv = mu.head(nr);
+		VectorXd ml = mu.tail(ne);
+
+		for (int d = 0; d < nr; ++d) {
+			int j = s.joint(d);
+			if (j < 0) {
+				continue;
+			}
+			// b has h (tau - Kr q0) and A has h^2 Kr + h Dr on the DOFs of the joint
+			grad.tau(d, k) = s.h * mv(d);
+			grad.stiffness(j) -= s.h * mv(d) * (s.q0(d) + s.h * s.qdot1(d));
+			grad.damping(j) -= s.h * mv(d) * s.qdot1(d);
+		}
+
+		// The constraint rows are -G qdot0 - 5 G q0
+		VectorXd aq0 = aq + s.Bq.transpose() * mv;
+		VectorXd av0 = s.Bv.transpose() * mv;
+		if (ne > 0) {
+			aq0 -= 5.0 * (s.G.transpose() * ml);
+			av0 -= s.G.transpose() * ml;
+		}
+		aq = aq0;
+		av = av0;
+	}
+	grad.q0 = aq;
+	grad.qdot0 = av;
+	return true;
+}
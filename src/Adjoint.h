@@ -0,0 +1,74 @@
+#pragma once
+// Adjoint Reverse-mode gradients of a run of REDMAX_EULER steps
+//    When SolverSparse has a tape, every step records its system: the matrix A = MDKr, the active
+//    equality rows G, the Jacobians Bq and Bv of the right hand side b with respect to q0 and qdot0,
+//    and the state around the step. A step is then
+//        [A G'; G 0] [qdot1; lambda] = [b; -G qdot0 - 5 G q0],    q1 = q0 + h qdot1
+//    with b = Bq q0 + Bv qdot0 + h (tau - Kr q0) + ... . The step is linearized around the recorded
+//    trajectory with J, M and the force Jacobians frozen, the same approximation the implicit
+//    step makes, so the gradients are exact for the linear parts and first order otherwise.
+//    backward() solves one transposed system per step, from the last one to the first, and
+//    returns dL/dq0, dL/dqdot0, dL/dtau of every step and dL/d the stiffness and damping of every
+//    joint, for the loss gradients given after each step.
+//
+//    Steps with active inequalities (the QP), matrix-free, hyper-reduced or substepped steps are
+//    not differentiable; they mark the tape invalid.
+
+#ifndef REDUCEDCOORD_SRC_ADJOINT_H_
+#define REDUCEDCOORD_SRC_ADJOINT_H_
+
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+struct AdjointStep
+{
+	double h;
+	Eigen::SparseMatrix<double> A;		// MDKr, nr x nr
+	Eigen::MatrixXd G;					// active equality rows, ne x nr
+	Eigen::SparseMatrix<double> Bq;		// db/dq0
+	Eigen::SparseMatrix<double> Bv;		// db/dqdot0
+	Eigen::VectorXd q0;
+	Eigen::VectorXd qdot1;
+	Eigen::VectorXi joint;				// joint of each DOF in the order of the chain, -1 when not
+										// driven by a torque (prescribed joints, soft body nodes)
+};
+
+struct AdjointGradients
+{
+	Eigen::VectorXd q0;
+	Eigen::VectorXd qdot0;
+	Eigen::MatrixXd tau;				// nr x nsteps, column k for the torques of step k
+	Eigen::VectorXd stiffness;			// per joint, m_Kr
+	Eigen::VectorXd damping;			// per joint, m_Dr
+};
+
+class AdjointTape
+{
+public:
+	AdjointTape() : m_njoints(0), m_valid(true) {}
+	virtual ~AdjointTape() {}
+
+	// Starts a new run
+	void clear();
+	void push(const AdjointStep &step, int njoints);
+	// For the steps that cannot be differentiated
+	void invalidate() { m_valid = false; }
+
+	int getCount() const { return (int)m_steps.size(); }
+	bool isValid() const { return m_valid; }
+	const AdjointStep & getStep(int k) const { return m_steps[k]; }
+
+	// dLdy[k] is dL/d[q; qdot] after step k, an empty vector stands for zero. Returns false
+	// when the tape is invalid or a system is singular.
+	bool backward(const std::vector<Eigen::VectorXd> &dLdy, AdjointGradients &grad) const;
+
+private:
+	std::vector<AdjointStep> m_steps;
+	int m_njoints;
+	bool m_valid;
+};
+
+#endif // REDUCEDCOORD_SRC_ADJOINT_H_
@@ -0,0 +1,190 @@
+#include "rmpch.h"
+#include "AssetCache.h"
+
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+void AssetCache::hashBytes(unsigned long long &hash, const void *data, size_t n) {
+	// FNV-1a
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < n; ++i) {
+		hash ^= p[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+bool AssetCache::hashFile(unsigned long long &hash, const string &FILE) {
+	ifstream in(FILE.c_str(), ios::binary);
+	if (!in) {
+		return false;
+	}
+	char buf[1 << 16];
+	while (in) {
+		in.read(buf, sizeof(buf));
+		hashBytes(hash, buf, (size_t)in.gcount());
+	}
+	return true;
+}
+
+static string getCacheDir() {
+	const char *env = getenv("REDMAX_CACHE_DIR");
+	if (env != nullptr) {
+		return env;
+	}
+#ifdef _WIN32
+	env = getenv("LOCALAPPDATA");
+	if (env != nullptr) {
+		return string(env) + "\\redmax";
+	}
+#else
+	env = getenv("XDG_CACHE_HOME");
+	if (env != nullptr && env[0] != '\0') {
+		return string(env) + "/redmax";
+	}
+	env = getenv("HOME");
+	if (env != nullptr && env[0] != '\0') {
+		return string(env) + "/.cache/redmax";
+	}
+#endif
+	return "";
+}
+
+bool AssetCache::makeDirectory(const string &DIR) {
+	for (size_t i = 1; i <= DIR.size(); ++i) {
+		if (i == DIR.size() || DIR[i] == '/' || DIR[i] == '\\') {
+			string sub = DIR.substr(0, i);
+#ifdef _WIN32
+			_mkdir(sub.c_str());
+#else
+			mkdir(sub.c_str(), 0755);
+#endif
+		}
+	}
+	struct stat st;
+	return stat(DIR.c_str(), &st) == 0;
+}
+
+bool AssetCache::truncateFile(const string &FILE, unsigned long long size) {
+#ifdef _WIN32
+	int fd = _open(FILE.c_str(), _O_RDWR | _O_BINARY);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = _chsize_s(fd, (__int64)size) == 0;
+	_close(fd);
+	return ok;
+#else
+	return truncate(FILE.c_str(), (off_t)size) == 0;
+#endif
+}
+
+string AssetCache::getDirectory() {
+	return getCacheDir();
+}
+
+string AssetCache::getFile(unsigned long long key, const string &EXT) {
+	string dir = getCacheDir();
+	if (dir.empty()) {
+		return "";
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", key);
+	return dir + "/" + name + EXT;
+}
+
+bool AssetCache::write(const string &FILE, const vector<pair<const void *, size_t> > &blocks) {
+	size_t slash = FILE.find_last_of("/\\");
+	if (slash != string::npos && !makeDirectory(FILE.substr(0, slash))) {
+		return false;
+	}
+
+	size_t id = std::hash<std::thread::id>()(this_thread::get_id()) ^ (size_t)chrono::steady_clock::now().time_since_epoch().count();
+	string tmp = FILE + "." + to_string(id) + ".tmp";
+	{
+		ofstream out(tmp.c_str(), ios::binary);
+		if (!out) {
+			return false;
+		}
+		for (int i = 0; i < (int)blocks.size(); ++i) {
+			out.write((const char *)blocks[i].first, blocks[i].second);
+		}
+		if (!out) {
+			out.close();
+			remove(tmp.c_str());
+			return false;
+		}
+	}
+	// Replaces an existing FILE in one step, so a reader sees either the old or the new one
+#ifdef _WIN32
+	if (!MoveFileExA(tmp.c_str(), FILE.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+	if (rename(tmp.c_str(), FILE.c_str()) != 0) {
+#endif
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::open(const string &FILE) {
+	close();
+#ifdef _WIN32
+	ifstream in(FILE.c_str(), ios::binary);
+	if (!in) {
+		return false;
+	}
+	in.seekg(0, ios::end);
+	m_buf.resize((size_t)in.tellg());
+	in.seekg(0);
+	if (!in.read(m_buf.data(), m_buf.size())) {
+		m_buf.clear();
+		return false;
+	}
+	m_size = m_buf.size();
+	return true;
+#else
+	int fd = ::open(FILE.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		return false;
+	}
+	m_map = p;
+	m_size = (size_t)st.st_size;
+	return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if (m_map != nullptr) {
+		munmap(m_map, m_size);
+	}
+#endif
+	m_map = nullptr;
+	m_size = 0;
+	m_buf.clear();
+}
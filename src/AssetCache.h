@@ -0,0 +1,62 @@
+#pragma once
+// AssetCache Binary files derived from resources, keyed by a hash of their inputs
+//    Keys are FNV-1a hashes of everything the derived data depends on. The files live in
+//    $REDMAX_CACHE_DIR, or a "redmax" directory in the user cache directory, and are written
+//    under a temporary name and renamed so that concurrent runs never read a partial file.
+//    Nothing is written into the resource directory.
+
+#ifndef REDUCEDCOORD_SRC_ASSETCACHE_H_
+#define REDUCEDCOORD_SRC_ASSETCACHE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class AssetCache
+{
+public:
+	static const unsigned long long HASH_INIT = 14695981039346656037ULL;
+
+	static void hashBytes(unsigned long long &hash, const void *data, size_t n);
+	static bool hashFile(unsigned long long &hash, const std::string &FILE);
+
+	// The cache directory, empty when there is none
+	static std::string getDirectory();
+
+	// Cache file for the key, empty when there is no cache directory
+	static std::string getFile(unsigned long long key, const std::string &EXT);
+
+	// Writes the blocks one after the other through a temporary file that then replaces FILE,
+	// creating the cache directory if needed
+	static bool write(const std::string &FILE, const std::vector<std::pair<const void *, size_t> > &blocks);
+
+	// Creates DIR and its parents, existing ones are fine
+	static bool makeDirectory(const std::string &DIR);
+
+	// Cuts FILE down to its first size bytes
+	static bool truncateFile(const std::string &FILE, unsigned long long size);
+};
+
+// Read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile
+{
+public:
+	MappedFile() : m_map(nullptr), m_size(0) {}
+	virtual ~MappedFile() { close(); }
+
+	bool open(const std::string &FILE);
+	void close();
+
+	const char * data() const { return m_map != nullptr ? (const char *)m_map : m_buf.data(); }
+	size_t size() const { return m_size; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	void *m_map;
+	size_t m_size;
+	std::vector<char> m_buf;
+};
+
+#endif // REDUCEDCOORD_SRC_ASSETCACHE_H_
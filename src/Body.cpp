@@ -53,8 +53,7 @@ void Body::load(const string &RESOURCE_DIR, string box_shape) {
 	//string box_shape = js[box_shape];
 
 	// Inits shape
-	bodyShape = make_shared<Shape>();
-	bodyShape->loadMesh(RESOURCE_DIR + box_shape);
+	bodyShape = MeshRegistry::getShape(RESOURCE_DIR + box_shape);
 }
 
 Json::Value Body::exportJson() {
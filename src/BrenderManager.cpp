@@ -6,48 +6,75 @@
 #include "rmpch.h"
 
 #include "BrenderManager.h"
+#include "AssetCache.h"
 #include "Brenderable.h"
+#include "Profiler.h"
 
 
 using namespace std;
 
-bool BrenderManager::instanceFlag_ = false;
-BrenderManager* BrenderManager::manager_ = NULL;
-BrenderManager* BrenderManager::getInstance()
+int BrenderManager::getFrame() const
 {
-	if (!instanceFlag_)
-	{
-		manager_ = new BrenderManager();
-		instanceFlag_ = true;
-		return manager_;
-	}
-	else
-	{
-		return manager_;
+	return frame_;
+}
+
+void BrenderManager::getAppendSizes(map<string, double> &sizes)
+{
+	flush();
+	sizes.clear();
+	for (auto it = appends_.begin(); it != appends_.end(); ++it) {
+		ifstream in(it->c_str(), ios::binary | ios::ate);
+		if (in) {
+			sizes[*it] = (double)in.tellg();
+		}
 	}
 }
 
-int BrenderManager::getFrame() const
+void BrenderManager::resume(int frame, const map<string, double> &sizes)
 {
-	return frame_;
+	flush();
+	frame_ = frame;
+	resume_ = frame;
+	for (auto it = sizes.begin(); it != sizes.end(); ++it) {
+		if (!AssetCache::truncateFile(it->first, (unsigned long long)it->second)) {
+			cerr << "BrenderManager: cannot cut " << it->first << " back to frame " << frame << endl;
+		}
+		appends_.insert(it->first);
+	}
 }
 
 void BrenderManager::exportBrender(double time)
 {
+	PROFILE_ZONE("BrenderManager::exportBrender");
+	if (isAsync_ && queue_ == nullptr) {
+		queue_ = make_shared<BrenderQueue>([this](BrenderFrame &frame) { write(frame); });
+	}
+
+	// Snapshot of what the brenderables export, the files are written by write()
+	BrenderFrame &snapshot = (queue_ != nullptr) ? queue_->acquire() : buffer_;
+	snapshot.frame = frame_;
+	snapshot.time = time;
+	snapshot.count = 0;
+
 	int objNum = 1;
 	for (auto brenderable : brenderables_) {
 		vector<string> names = brenderable->getBrenderNames();
 		vector<string> extensions = brenderable->getBrenderExtensions();
 		vector<int> types = brenderable->getBrenderTypes();
-		vector< shared_ptr< ofstream > > outfiles;
+		vector< shared_ptr< ostream > > outfiles;
+		bool isFiles = false;
 		// Initialize files
 		for (int i = 0; i < brenderable->getBrenderCount(); ++i) {
-			auto outfile = make_shared<ofstream>();
-			outfiles.push_back(outfile);
+			BrenderOutput &output = snapshot.add();
+			output.type = types[i];
+			output.isTopology = false;
+			output.text->str("");
+			output.text->clear();
+			outfiles.push_back(output.text);
 
 			char filename[512];
 
-			if (extensions[i].compare("") == 0) extensions[i] = "obj";
+			if (extensions[i].compare("") == 0) extensions[i] = (types[i] == Brenderable::Trajectory) ? "rmtraj" : "obj";
 
 			if (types[i] == Brenderable::Truncate) {
 				// if object has not been given name
@@ -58,56 +85,104 @@ void BrenderManager::exportBrender(double time)
 				else {
 					sprintf(filename, "%s/%06d_%s.%s", EXPORT_DIR_.c_str(), frame_, names[i].c_str(), extensions[i].c_str());
 				}
+			}
+			else {
+				// One file for all frames
+				if (names[i].compare("") == 0) {
+					sprintf(filename, "%s/Object%d.%s", EXPORT_DIR_.c_str(), objNum, extensions[i].c_str());
+				}
+				else {
+					sprintf(filename, "%s/%s.%s", EXPORT_DIR_.c_str(), names[i].c_str(), extensions[i].c_str());
+				}
+			}
+			output.filename = filename;
 
-				// open file
-				outfile->open(filename, ofstream::out | ofstream::trunc);
+			if (types[i] == Brenderable::Trajectory) {
+				// The triangles are only needed once per trajectory
+				if (topologies_.insert(output.filename).second) {
+					brenderable->getTrajectoryTopology(i, output.nverts, output.tris);
+					output.isTopology = true;
+				}
+				brenderable->getTrajectoryPositions(i, output.x);
+				continue;
+			}
+			isFiles = true;
 
+			if (types[i] == Brenderable::Truncate) {
+				ostream &outfile = *output.text;
 				// frame string
 				char framestring[50];
 				sprintf(framestring, "# frame %06d \n", frame_);
-				*outfile << framestring;
+				outfile << framestring;
 				// frame time
 				char timeval[50];
 				sprintf(timeval, "# time %f \n", time);
-				*outfile << timeval;
+				outfile << timeval;
 				// obj name
 				// if object has not been given name
 				if (names[i].compare("") == 0) {
-					*outfile << "# name Object" + to_string(objNum) + " \n";
+					outfile << "# name Object" + to_string(objNum) + " \n";
 				}
 				// if object has been given specific name
 				else {
-					*outfile << "# name " + names[i] + " \n";
+					outfile << "# name " + names[i] + " \n";
 				}
 			}
-			else if (types[i] == Brenderable::Append || types[i] == Brenderable::ResetAppend) {
-				// if object has not been given name
-				if (names[i].compare("") == 0) {
-					sprintf(filename, "%s/Object%d.%s", EXPORT_DIR_.c_str(), objNum, extensions[i].c_str());
-				}
-				// if object has been given specific name
-				else {
-					sprintf(filename, "%s/%s.%s", EXPORT_DIR_.c_str(), names[i].c_str(), extensions[i].c_str());
-				}
+		}
+		// Write to buffers
+		if (isFiles) {
+			brenderable->exportBrender(outfiles, frame_, time);
+		}
+		objNum++;
+	}
+
+	if (queue_ != nullptr) {
+		queue_->push();
+	}
+	else {
+		write(snapshot);
+	}
+	//Only time frame should be changed/modified
+	frame_++;
+}
 
-				if (types[i] == Brenderable::Append) {
-					outfile->open(filename, ofstream::out | ofstream::app);
+void BrenderManager::write(BrenderFrame &frame)
+{
+	PROFILE_ZONE("BrenderManager::write");
+	for (int k = 0; k < frame.count; ++k) {
+		BrenderOutput &output = *frame.outputs[k];
+		if (output.type == Brenderable::Trajectory) {
+			// Opened on the first frame
+			shared_ptr<TrajectoryWriter> &writer = trajectories_[output.filename];
+			if (writer == nullptr) {
+				writer = make_shared<TrajectoryWriter>();
+				if (resume_ >= 0) {
+					writer->resume(output.filename, resume_, encoding_, quantum_);
 				}
 				else {
-					outfile->open(filename, ofstream::out | ofstream::trunc);
+					writer->open(output.filename, encoding_, quantum_);
 				}
 			}
+			if (output.isTopology && !writer->hasTopology()) {
+				writer->writeTopology(output.nverts, output.tris);
+			}
+			writer->writeFrame(frame.frame, frame.time, output.x);
+			continue;
 		}
-		// Write to files
-		brenderable->exportBrender(outfiles, frame_, time);
-		// Close files
-		for (int i = 0; i < brenderable->getBrenderCount(); ++i) {
-			outfiles[i]->close();
+
+		ofstream outfile;
+		if (output.type == Brenderable::Append || output.type == Brenderable::ResetAppend) {
+			appends_.insert(output.filename);
 		}
-		objNum++;
+		if (output.type == Brenderable::Append) {
+			outfile.open(output.filename.c_str(), ofstream::out | ofstream::app);
+		}
+		else {
+			outfile.open(output.filename.c_str(), ofstream::out | ofstream::trunc);
+		}
+		const string text = output.text->str();
+		outfile.write(text.data(), text.size());
 	}
-	//Only time frame should be changed/modified
-	frame_++;
 }
 
 void BrenderManager::add(shared_ptr<Brenderable> brenderable)
@@ -120,3 +195,37 @@ void BrenderManager::setExportDir(string export_dir)
 	EXPORT_DIR_ = export_dir;
 }
 
+void BrenderManager::setTrajectoryEncoding(TrajectoryWriter::Encoding encoding, double quantum)
+{
+	// The writer thread reads them when it opens a trajectory
+	flush();
+	encoding_ = encoding;
+	quantum_ = quantum;
+}
+
+void BrenderManager::setAsync(bool isAsync)
+{
+	flush();
+	isAsync_ = isAsync;
+	if (!isAsync_) {
+		queue_ = nullptr;
+	}
+}
+
+void BrenderManager::flush()
+{
+	if (queue_ != nullptr) {
+		queue_->flush();
+	}
+}
+
+void BrenderManager::close()
+{
+	flush();
+	for (auto it = trajectories_.begin(); it != trajectories_.end(); ++it) {
+		it->second->close();
+	}
+	trajectories_.clear();
+	topologies_.clear();
+	resume_ = -1;
+}
\ No newline at end of file
@@ -6,35 +6,68 @@
 
 #pragma once
 
+#include <map>
+#include <set>
 #include <vector>
 #include <memory>
 #include <string>
 #include <ostream>
 
+#include "BrenderQueue.h"
+#include "Trajectory.h"
+
 class Brenderable;
 
 class BrenderManager
 {
 private:
-	static bool instanceFlag_;
-	static BrenderManager *manager_;
 	int frame_;
+	int resume_;	// frame the trajectories are resumed from, -1 for new files
 	std::string EXPORT_DIR_;
 	std::vector<std::shared_ptr<Brenderable> > brenderables_;
+	std::map<std::string, std::shared_ptr<TrajectoryWriter> > trajectories_;	// used by the writer thread
+	std::set<std::string> topologies_;	// trajectories whose triangles have been snapshotted
+	std::set<std::string> appends_;	// files the frames are appended to, used by the writer thread
+	TrajectoryWriter::Encoding encoding_;
+	double quantum_;
+	bool isAsync_;
+	std::shared_ptr<BrenderQueue> queue_;
+	BrenderFrame buffer_;	// snapshot of the synchronous export
+	BrenderManager(const BrenderManager &);
+	BrenderManager & operator=(const BrenderManager &);
+	// Writes a snapshot to the files
+	void write(BrenderFrame &frame);
+public:
+	// One per simulation, each with its own export directory
 	BrenderManager()
 	{
-		//private constructor
 		EXPORT_DIR_ = ".";
 		frame_ = 0;
+		resume_ = -1;
+		encoding_ = TrajectoryWriter::FLOAT32;
+		quantum_ = 1.0e-5;
+		isAsync_ = true;
 	}
-public:
-	static BrenderManager* getInstance();
 	void setExportDir(std::string export_dir);
 	int getFrame() const;
+	// Flushes and returns the size of every file the frames are appended to
+	void getAppendSizes(std::map<std::string, double> &sizes);
+	// Continues the exports of an earlier run from frame, e.g. after a restart. The appended
+	// files are cut back to the sizes they had at that frame, the trajectories keep their
+	// frames before it.
+	void resume(int frame, const std::map<std::string, double> &sizes);
 	void exportBrender(double time = 0.0);
 	void add(std::shared_ptr<Brenderable> brenderable);
+	// Applies to trajectories opened afterwards
+	void setTrajectoryEncoding(TrajectoryWriter::Encoding encoding, double quantum = 1.0e-5);
+	// Exports on a writer thread, the simulation only waits when the writer falls behind
+	void setAsync(bool isAsync);
+	// Waits until the frames exported so far are written
+	void flush();
+	// Flushes and finishes the trajectories, they get their frame index
+	void close();
 	~BrenderManager()
 	{
-		instanceFlag_ = false;
+		close();
 	}
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "rmpch.h"
+#include "BrenderQueue.h"
+
+using namespace std;
+
+BrenderQueue::BrenderQueue(const function<void(BrenderFrame &)> &write, int capacity) :
+	m_write(write),
+	m_head(0),
+	m_tail(0),
+	m_stop(false)
+{
+	for (int i = 0; i < max(1, capacity); ++i) {
+		m_slots.push_back(unique_ptr<BrenderFrame>(new BrenderFrame()));
+	}
+	m_thread = thread(&BrenderQueue::run, this);
+}
+
+BrenderQueue::~BrenderQueue() {
+	m_stop = true;
+	notify();
+	m_thread.join();
+}
+
+void BrenderQueue::notify() {
+	// Taking the lock orders the wake up after the check of a thread about to sleep
+	{
+		lock_guard<mutex> lock(m_mtx);
+	}
+	m_cv.notify_all();
+}
+
+BrenderFrame & BrenderQueue::acquire() {
+	unsigned long long head = m_head.load(memory_order_relaxed);
+	unsigned long long n = m_slots.size();
+	if (head - m_tail.load(memory_order_acquire) >= n) {
+		unique_lock<mutex> lock(m_mtx);
+		m_cv.wait(lock, [&] { return head - m_tail.load(memory_order_acquire) < n; });
+	}
+	return *m_slots[head % n];
+}
+
+void BrenderQueue::push() {
+	m_head.store(m_head.load(memory_order_relaxed) + 1, memory_order_release);
+	notify();
+}
+
+void BrenderQueue::flush() {
+	unsigned long long head = m_head.load(memory_order_relaxed);
+	if (m_tail.load(memory_order_acquire) != head) {
+		unique_lock<mutex> lock(m_mtx);
+		m_cv.wait(lock, [&] { return m_tail.load(memory_order_acquire) == head; });
+	}
+}
+
+void BrenderQueue::run() {
+	unsigned long long tail = 0;
+	for (;;) {
+		if (m_head.load(memory_order_acquire) == tail) {
+			unique_lock<mutex> lock(m_mtx);
+			m_cv.wait(lock, [&] { return m_head.load(memory_order_acquire) != tail || m_stop; });
+			if (m_head.load(memory_order_acquire) == tail) {
+				// Stopped with nothing left to write
+				return;
+			}
+		}
+		m_write(*m_slots[tail % m_slots.size()]);
+		m_tail.store(++tail, memory_order_release);
+		notify();
+	}
+}
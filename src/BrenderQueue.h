@@ -0,0 +1,85 @@
+#pragma once
+// BrenderQueue Bounded queue of exported frames between the simulation and a writer thread
+//    The slots are allocated once and reused, so their buffers keep their capacity from frame
+//    to frame. There is one producer and one consumer, and a slot is handed over by advancing an
+//    atomic counter; the slots themselves are never locked. The mutex and condition variable
+//    are only used to sleep: the producer waits while every slot is in use (back-pressure) and
+//    the writer waits while the queue is empty. Frames still queued are written on destruction.
+
+#ifndef REDUCEDCOORD_SRC_BRENDERQUEUE_H_
+#define REDUCEDCOORD_SRC_BRENDERQUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Snapshot of one output of a Brenderable
+struct BrenderOutput
+{
+	BrenderOutput() : type(0), nverts(0), isTopology(false), text(std::make_shared<std::ostringstream>()) {}
+
+	int type;
+	std::string filename;
+
+	// Trajectory outputs: the triangles on the first frame, then the positions
+	int nverts;
+	bool isTopology;
+	std::vector<int> tris;
+	std::vector<double> x;
+
+	// Other outputs: the text of the file
+	std::shared_ptr<std::ostringstream> text;
+};
+
+struct BrenderFrame
+{
+	BrenderFrame() : frame(0), time(0.0), count(0) {}
+
+	// Next output, reusing the ones of earlier frames
+	BrenderOutput & add() {
+		if (count == (int)outputs.size()) {
+			outputs.push_back(std::unique_ptr<BrenderOutput>(new BrenderOutput()));
+		}
+		return *outputs[count++];
+	}
+
+	int frame;
+	double time;
+	int count;
+	std::vector<std::unique_ptr<BrenderOutput> > outputs;
+};
+
+class BrenderQueue
+{
+public:
+	BrenderQueue(const std::function<void(BrenderFrame &)> &write, int capacity = 4);
+	virtual ~BrenderQueue();
+
+	// Next free slot, waits for the writer while all slots are in use
+	BrenderFrame & acquire();
+	// Hands the slot returned by acquire() to the writer
+	void push();
+	// Waits until every frame pushed so far has been written
+	void flush();
+
+private:
+	void run();
+	void notify();
+
+	std::function<void(BrenderFrame &)> m_write;
+	std::vector<std::unique_ptr<BrenderFrame> > m_slots;
+	std::atomic<unsigned long long> m_head;	// frames pushed
+	std::atomic<unsigned long long> m_tail;	// frames written
+	std::atomic<bool> m_stop;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+};
+
+#endif // REDUCEDCOORD_SRC_BRENDERQUEUE_H_
@@ -16,7 +16,7 @@ class Brenderable
 {
 public:
 	enum BranderableType {
-		Truncate, Append, ResetAppend
+		Truncate, Append, ResetAppend, Trajectory
 	};
 
 	Brenderable() {};
@@ -25,7 +25,11 @@ public:
 	virtual std::vector<std::string> getBrenderNames() const { return std::vector<std::string>(1, ""); }
 	virtual std::vector<std::string> getBrenderExtensions() const { return std::vector<std::string>(1, ""); }
 	virtual std::vector<int> getBrenderTypes() const { return std::vector<int>(1, Truncate); }
-	virtual void exportBrender(std::vector< std::shared_ptr< std::ofstream > > outfiles, int frame, double time) const = 0;
+	// The streams are buffers, the files are written on the export thread
+	virtual void exportBrender(std::vector< std::shared_ptr< std::ostream > > outfiles, int frame, double time) const = 0;
+	// Outputs of type Trajectory are a snapshot of positions, encoded and written on the export thread
+	virtual void getTrajectoryTopology(int i, int &nverts, std::vector<int> &tris) const {}
+	virtual void getTrajectoryPositions(int i, std::vector<double> &x) const {}
 private:
 
 };
\ No newline at end of file
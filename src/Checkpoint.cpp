@@ -0,0 +1,139 @@
+#include "rmpch.h"
+#include "Checkpoint.h"
+#include "AssetCache.h"
+
+using namespace std;
+using namespace Eigen;
+
+// Bumped whenever the layout of the file or of a saveState() changes
+static const uint32_t CHECKPOINT_VERSION = 1;
+
+struct CheckpointHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t size;			// bytes of the sections
+	uint64_t checksum;		// FNV-1a of the sections
+};
+
+static uint64_t checksum(const string &bytes) {
+	unsigned long long hash = AssetCache::HASH_INIT;
+	AssetCache::hashBytes(hash, bytes.data(), bytes.size());
+	return (uint64_t)hash;
+}
+
+static void append(string &bytes, const void *data, size_t size) {
+	bytes.append((const char *)data, size);
+}
+
+void Checkpoint::set(const string &NAME, const VectorXd &v) {
+	m_sections[NAME].assign(v.data(), v.data() + v.size());
+}
+
+bool Checkpoint::get(const string &NAME, vector<double> &values) const {
+	map<string, vector<double> >::const_iterator it = m_sections.find(NAME);
+	if (it == m_sections.end()) {
+		return false;
+	}
+	values = it->second;
+	return true;
+}
+
+bool Checkpoint::get(const string &NAME, VectorXd &v) const {
+	map<string, vector<double> >::const_iterator it = m_sections.find(NAME);
+	if (it == m_sections.end()) {
+		return false;
+	}
+	v = Map<const VectorXd>(it->second.data(), it->second.size());
+	return true;
+}
+
+bool Checkpoint::write(const string &FILE) const {
+	// Each section is the length of its name, the name, the count and the values
+	string bytes;
+	for (map<string, vector<double> >::const_iterator it = m_sections.begin(); it != m_sections.end(); ++it) {
+		uint32_t length = (uint32_t)it->first.size();
+		uint64_t count = it->second.size();
+		append(bytes, &length, sizeof(length));
+		append(bytes, it->first.data(), length);
+		append(bytes, &count, sizeof(count));
+		append(bytes, it->second.data(), count * sizeof(double));
+	}
+
+	CheckpointHeader header;
+	memcpy(header.magic, "RMCK", 4);
+	header.version = CHECKPOINT_VERSION;
+	header.size = bytes.size();
+	header.checksum = checksum(bytes);
+
+	vector<pair<const void *, size_t> > blocks;
+	blocks.push_back(make_pair((const void *)&header, sizeof(header)));
+	blocks.push_back(make_pair((const void *)bytes.data(), bytes.size()));
+	if (!AssetCache::write(FILE, blocks)) {
+		cerr << "Checkpoint: cannot write " << FILE << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Checkpoint::read(const string &FILE) {
+	ifstream in(FILE.c_str(), ios::binary);
+	if (!in) {
+		cerr << "Checkpoint: cannot open " << FILE << endl;
+		return false;
+	}
+	CheckpointHeader header;
+	if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, "RMCK", 4) != 0) {
+		cerr << "Checkpoint: " << FILE << " is not a checkpoint" << endl;
+		return false;
+	}
+	if (header.version != CHECKPOINT_VERSION) {
+		cerr << "Checkpoint: " << FILE << " has version " << header.version << ", expected " << CHECKPOINT_VERSION << endl;
+		return false;
+	}
+	// The size comes from the file, so it is checked against what is left before allocating
+	streamoff start = in.tellg();
+	in.seekg(0, ios::end);
+	streamoff end = in.tellg();
+	in.seekg(start);
+	if (start < 0 || end < start || header.size > (uint64_t)(end - start)) {
+		cerr << "Checkpoint: " << FILE << " is truncated or corrupt" << endl;
+		return false;
+	}
+	string bytes((size_t)header.size, '\0');
+	if (!in.read(&bytes[0], bytes.size()) || checksum(bytes) != header.checksum) {
+		cerr << "Checkpoint: " << FILE << " is truncated or corrupt" << endl;
+		return false;
+	}
+
+	map<string, vector<double> > sections;
+	size_t pos = 0;
+	while (pos < bytes.size()) {
+		uint32_t length;
+		uint64_t count;
+		if (pos + sizeof(length) > bytes.size()) {
+			break;
+		}
+		memcpy(&length, bytes.data() + pos, sizeof(length));
+		pos += sizeof(length);
+		if (pos + length + sizeof(count) > bytes.size()) {
+			break;
+		}
+		string name = bytes.substr(pos, length);
+		pos += length;
+		memcpy(&count, bytes.data() + pos, sizeof(count));
+		pos += sizeof(count);
+		if (count > (bytes.size() - pos) / sizeof(double)) {
+			break;
+		}
+		vector<double> &values = sections[name];
+		values.resize(count);
+		memcpy(values.data(), bytes.data() + pos, count * sizeof(double));
+		pos += count * sizeof(double);
+	}
+	if (pos != bytes.size()) {
+		cerr << "Checkpoint: " << FILE << " has a malformed section" << endl;
+		return false;
+	}
+	m_sections.swap(sections);
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+// Checkpoint Versioned binary file of the complete state of a run, for restarts
+//    A checkpoint is a set of named sections of doubles: the Scene stores World::saveState(),
+//    SolverSparse::saveState(), its y and its counters, the export frame and the sizes of the
+//    appended export files included. Integers up to 2^53 are exact as doubles. The file is a
+//    header with the magic, the version and an FNV-1a checksum of the sections, then the
+//    sections as a name, a count and the values.
+//    read() rejects a file whose version or checksum does not match. write() goes to FILE.tmp
+//    first and renames it, so a crash while writing keeps the previous checkpoint.
+//
+//    $REDMAX_CHECKPOINT names the file of the Scene, which resumes from it when it exists and
+//    writes it every $REDMAX_CHECKPOINT_EVERY steps (1000). Little-endian only.
+
+#ifndef REDUCEDCOORD_SRC_CHECKPOINT_H_
+#define REDUCEDCOORD_SRC_CHECKPOINT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class Checkpoint
+{
+public:
+	Checkpoint() {}
+	virtual ~Checkpoint() {}
+
+	// The buffer of a section, created empty when missing, for saveState() calls to fill
+	std::vector<double> & get(const std::string &NAME) { return m_sections[NAME]; }
+	void set(const std::string &NAME, const Eigen::VectorXd &v);
+	// Return false when the section is missing
+	bool get(const std::string &NAME, std::vector<double> &values) const;
+	bool get(const std::string &NAME, Eigen::VectorXd &v) const;
+	bool has(const std::string &NAME) const { return m_sections.count(NAME) > 0; }
+	const std::map<std::string, std::vector<double> > & getSections() const { return m_sections; }
+
+	bool write(const std::string &FILE) const;
+	// Replaces the sections with those of the file
+	bool read(const std::string &FILE);
+
+private:
+	std::map<std::string, std::vector<double> > m_sections;
+};
+
+#endif // REDUCEDCOORD_SRC_CHECKPOINT_H_
@@ -36,8 +36,7 @@ void CompCylinder::setTransform(Matrix4d E) {
 }
 
 void CompCylinder::load(const string &RESOURCE_DIR, string shape) {
-	m_shape = make_shared<Shape>();
-	m_shape->loadMesh(RESOURCE_DIR + shape);
+	m_shape = MeshRegistry::getShape(RESOURCE_DIR + shape);
 }
 
 void CompCylinder::draw_(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, shared_ptr<MatrixStack> P)const {
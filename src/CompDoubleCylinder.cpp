@@ -16,11 +16,9 @@ Comp(), m_rA(rA), m_rB(rB), m_parentA(parentA), m_parentB(parentB)
 }
 
 void CompDoubleCylinder::load(const string &RESOURCE_DIR, string shapeA, string shapeB) {
-	m_shapeA = make_shared<Shape>();
-	m_shapeA->loadMesh(RESOURCE_DIR + shapeA);
+	m_shapeA = MeshRegistry::getShape(RESOURCE_DIR + shapeA);
 
-	m_shapeB = make_shared<Shape>();
-	m_shapeB->loadMesh(RESOURCE_DIR + shapeB);
+	m_shapeB = MeshRegistry::getShape(RESOURCE_DIR + shapeB);
 
 	m_OA->r = 0.1;
 	m_OB->r = 0.1;
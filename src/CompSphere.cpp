@@ -26,8 +26,7 @@ void CompSphere::init() {
 }
 
 void CompSphere::load(const string &RESOURCE_DIR) {
-	m_shape = make_shared<Shape>();
-	m_shape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+	m_shape = MeshRegistry::getShape(RESOURCE_DIR + "sphere2.obj");
 	m_O->load(RESOURCE_DIR);
 }
 
@@ -2,6 +2,7 @@
 #include "DeformableSpring.h"
 #include "Body.h"
 #include "Node.h"
+#include "ParallelFor.h"
 
 using namespace std;
 using namespace Eigen;
@@ -160,24 +161,22 @@ void DeformableSpring::gatherDDofs_(VectorXd &ydot, int nr) {
 
 void DeformableSpring::scatterDofs_(VectorXd &y, int nr) {
 	// Scatters q and qdot from y
-#pragma omp parallel for	
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		int idxR = m_nodes[i]->idxR;
 		m_nodes[i]->x = y.segment<3>(idxR);
 		m_nodes[i]->v = y.segment<3>(nr + idxR);
 
-	}
+	});
 }
 
 void DeformableSpring::scatterDDofs_(VectorXd &ydot, int nr) {
 	// Scatters qdot and qddot from ydot
-#pragma omp parallel for
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		int idxR = m_nodes[i]->idxR;
 		m_nodes[i]->v = ydot.segment<3>(idxR);
 		m_nodes[i]->a = ydot.segment<3>(nr + idxR);
 
-	}
+	});
 }
 
 void DeformableSpring::computeMass_(MatrixXd &M) {
@@ -0,0 +1,182 @@
+#include "rmpch.h"
+#include "Ensemble.h"
+#include "AssetCache.h"
+#include "BrenderManager.h"
+#include "Deformable.h"
+#include "GLSL.h"
+#include "Joint.h"
+#include "MeshEmbedding.h"
+#include "ParallelFor.h"
+#include "Profiler.h"
+#include "SoftBody.h"
+#include "SolverSparse.h"
+#include "Telemetry.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+static double getSeconds() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void gatherDofs(const shared_ptr<World> &world, VectorXd &y) {
+	// Same as Scene::init
+	y.resize(2 * world->nr);
+	y.setZero();
+	world->getJoint0()->reparam();
+	world->getJoint0()->gatherDofs(y, world->nr);
+	world->getDeformable0()->gatherDofs(y, world->nr);
+	world->getSoftBody0()->gatherDofs(y, world->nr);
+	world->getMeshEmbedding0()->gatherDofs(y, world->nr);
+}
+
+Ensemble::Ensemble(const string &RESOURCE_DIR, const string &OUTPUT_DIR) :
+	m_resource_dir(RESOURCE_DIR),
+	m_output_dir(OUTPUT_DIR),
+	m_solver(AUTO),
+	m_export_every(0),
+	m_telemetry(false),
+	m_wall(0.0)
+{
+
+}
+
+int Ensemble::add(const EnsembleMember &member) {
+	m_members.push_back(member);
+	return (int)m_members.size() - 1;
+}
+
+void Ensemble::run(int nthreads) {
+	GLSL::setHeadless(true);
+	AssetCache::makeDirectory(m_output_dir);
+
+	int n = (int)m_members.size();
+	m_results.assign(n, EnsembleResult());
+	if (nthreads <= 0) {
+		nthreads = getParallelThreads();
+	}
+	nthreads = max(1, min(nthreads, n));
+	double t0 = getSeconds();
+	// Every thread takes the next member until there is none left
+	atomic<int> next(0);
+	vector<thread> threads;
+	for (int k = 0; k < nthreads; ++k) {
+		threads.push_back(thread([this, n, &next]() {
+			for (int i = next++; i < n; i = next++) {
+				runMember(i);
+			}
+		}));
+	}
+	for (int k = 0; k < nthreads; ++k) {
+		threads[k].join();
+	}
+	m_wall = getSeconds() - t0;
+}
+
+void Ensemble::runMember(int index) {
+	PROFILE_ZONE("Ensemble::member");
+	const EnsembleMember &member = m_members[index];
+	EnsembleResult &result = m_results[index];
+	char name[32];
+	snprintf(name, sizeof(name), "/run_%04d", index);
+	result.index = index;
+	result.dir = m_output_dir + name;
+	result.nsteps = member.nsteps;
+	AssetCache::makeDirectory(result.dir);
+
+	double t0 = getSeconds();
+	auto world = make_shared<World>(member.type);
+	world->setSceneParams(member.params);
+	world->load(m_resource_dir);
+	world->init();
+	if (m_configure) {
+		m_configure(index, member, world);
+	}
+	result.ndofs = world->nr;
+
+	auto solver = make_shared<SolverSparse>(world, REDMAX_EULER, m_solver);
+	solver->setAutoTuning(3, 1e-6, result.dir + "/solver_cache.txt");
+	if (m_telemetry) {
+		auto telemetry = make_shared<Telemetry>();
+		telemetry->openLog(result.dir + "/telemetry.rmtl");
+		solver->setTelemetry(telemetry);
+	}
+	shared_ptr<BrenderManager> brender;
+	if (m_export_every > 0) {
+		brender = make_shared<BrenderManager>();
+		brender->setExportDir(result.dir);
+		brender->add(world);
+		brender->exportBrender(world->getTime());
+	}
+
+	VectorXd y;
+	gatherDofs(world, y);
+	Energy energy = world->computeEnergy();
+	result.energy0 = energy.K + energy.V;
+	for (int k = 0; k < member.nsteps; ++k) {
+		y = solver->dynamics(y);
+		world->update();
+		world->incrementTime();
+		if (brender != nullptr && (k + 1) % m_export_every == 0) {
+			brender->exportBrender(world->getTime());
+		}
+	}
+	if (brender != nullptr) {
+		brender->close();
+	}
+	energy = world->computeEnergy();
+	result.energy = energy.K + energy.V;
+	result.y = y;
+	result.seconds = getSeconds() - t0;
+	result.sps = result.seconds > 0.0 ? member.nsteps / result.seconds : 0.0;
+}
+
+bool Ensemble::writeSummary() const {
+	json js;
+	js["members"] = json::array();
+	double total = 0.0;
+	double minSps = 0.0, maxSps = 0.0, sumSps = 0.0;
+	double minDrift = 0.0, maxDrift = 0.0, sumDrift = 0.0;
+	for (int i = 0; i < (int)m_results.size(); ++i) {
+		const EnsembleResult &r = m_results[i];
+		double drift = r.energy - r.energy0;
+		json m;
+		m["index"] = r.index;
+		m["dir"] = r.dir;
+		m["seed"] = m_members[i].seed;
+		m["dofs"] = r.ndofs;
+		m["steps"] = r.nsteps;
+		m["seconds"] = r.seconds;
+		m["steps_per_second"] = r.sps;
+		m["energy_drift"] = drift;
+		js["members"].push_back(m);
+
+		total += r.seconds;
+		sumSps += r.sps;
+		sumDrift += drift;
+		minSps = (i == 0) ? r.sps : min(minSps, r.sps);
+		maxSps = (i == 0) ? r.sps : max(maxSps, r.sps);
+		minDrift = (i == 0) ? drift : min(minDrift, drift);
+		maxDrift = (i == 0) ? drift : max(maxDrift, drift);
+	}
+	int n = max(1, (int)m_results.size());
+	js["wall_s"] = m_wall;
+	js["member_s"] = total;
+	// How many members ran at once on average
+	js["concurrency"] = m_wall > 0.0 ? total / m_wall : 0.0;
+	js["steps_per_second"] = { { "mean", sumSps / n }, { "min", minSps }, { "max", maxSps } };
+	js["energy_drift"] = { { "mean", sumDrift / n }, { "min", minDrift }, { "max", maxDrift } };
+
+	string file = m_output_dir + "/summary.json";
+	ofstream out(file.c_str());
+	if (!out) {
+		cerr << "Ensemble: cannot open " << file << endl;
+		return false;
+	}
+	out << js.dump(1, '\t') << endl;
+	return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+// Ensemble Independent simulations run concurrently on threads of their own
+//    Every member loads its own World and SolverSparse and steps them on one of the member
+//    threads; the assembly of the steps still goes to the pool of parallelFor(). A member never
+//    runs inside another one, so its time is its own. A member writes into its own directory,
+//    run_<index> under the output directory: the Brender exports when enabled, the AUTO cache
+//    and the telemetry log. The meshes are shared through the MeshRegistry, so N members cost
+//    less memory than N processes. The configure callback, called after init() and before the
+//    state is gathered, lets a member perturb its World for a parameter sweep or a stochastic
+//    rollout; it calls World::update() when it moves the joints. The worlds of an ensemble are
+//    never drawn.
+
+#ifndef REDUCEDCOORD_SRC_ENSEMBLE_H_
+#define REDUCEDCOORD_SRC_ENSEMBLE_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+#include "MLCommon.h"
+#include "World.h"
+
+struct EnsembleMember
+{
+	WorldType type;
+	SceneParams params;
+	int nsteps;
+	unsigned int seed;	// for the configure callback
+};
+
+struct EnsembleResult
+{
+	int index;
+	std::string dir;
+	int ndofs;
+	int nsteps;
+	double seconds;		// wall time of the member, load included
+	double sps;			// steps per second
+	double energy0;		// K + V before the first step
+	double energy;		// K + V after the last step
+	Eigen::VectorXd y;	// final state
+};
+
+class Ensemble
+{
+public:
+	Ensemble(const std::string &RESOURCE_DIR, const std::string &OUTPUT_DIR);
+	virtual ~Ensemble() {}
+
+	// Returns the index of the member
+	int add(const EnsembleMember &member);
+	int getCount() const { return (int)m_members.size(); }
+
+	void setSolver(SparseSolver solver) { m_solver = solver; }
+	// Exports every few steps, 0 exports nothing
+	void setExportEvery(int every) { m_export_every = every; }
+	void setTelemetry(bool isTelemetry) { m_telemetry = isTelemetry; }
+	void setConfigure(std::function<void(int, const EnsembleMember &, std::shared_ptr<World>)> configure) { m_configure = configure; }
+
+	// Runs every member and waits for them, nthreads members at a time, as many as
+	// getParallelThreads() when nthreads <= 0
+	void run(int nthreads = 0);
+
+	// In the order of the members
+	const std::vector<EnsembleResult> & getResults() const { return m_results; }
+	double getWallTime() const { return m_wall; }
+
+	// The members and their aggregates in summary.json of the output directory
+	bool writeSummary() const;
+
+private:
+	void runMember(int index);
+
+	std::string m_resource_dir;
+	std::string m_output_dir;
+	std::vector<EnsembleMember> m_members;
+	std::vector<EnsembleResult> m_results;
+	std::function<void(int, const EnsembleMember &, std::shared_ptr<World>)> m_configure;
+	SparseSolver m_solver;
+	int m_export_every;
+	bool m_telemetry;
+	double m_wall;
+};
+
+#endif // REDUCEDCOORD_SRC_ENSEMBLE_H_
@@ -10,6 +10,18 @@ using namespace std;
 
 namespace GLSL {
 
+static bool s_headless = false;
+
+void setHeadless(bool isHeadless)
+{
+	s_headless = isHeadless;
+}
+
+bool isHeadless()
+{
+	return s_headless;
+}
+
 const char * errorString(GLenum err)
 {
 	switch(err) {
@@ -35,6 +35,10 @@ namespace GLSL {
 	void printShaderInfoLog(GLuint shader);
 	int textFileWrite(const char *filename, const char *s);
 	char *textFileRead(const char *filename);
+
+	// Without a GL context the shapes and meshes keep their buffers on the CPU only
+	void setHeadless(bool isHeadless);
+	bool isHeadless();
 }
 
 #endif
@@ -0,0 +1,130 @@
+#include "rmpch.h"
+#include "Islands.h"
+
+using namespace std;
+using namespace Eigen;
+
+Islands::Islands(double threshold, int nsteps) :
+	m_threshold(threshold),
+	m_nsteps(max(1, nsteps)),
+	m_count(0),
+	m_nsleeping(0)
+{
+
+}
+
+int Islands::find(int i) {
+	while (m_parent[i] != i) {
+		m_parent[i] = m_parent[m_parent[i]];
+		i = m_parent[i];
+	}
+	return i;
+}
+
+void Islands::build(const SparseMatrix<double> &A, const MatrixXd &G) {
+	int n = (int)A.rows();
+	m_parent.resize(n);
+	for (int i = 0; i < n; ++i) {
+		m_parent[i] = i;
+	}
+	for (int j = 0; j < A.outerSize(); ++j) {
+		for (SparseMatrix<double>::InnerIterator it(A, j); it; ++it) {
+			if (it.value() != 0.0) {
+				m_parent[find((int)it.row())] = find((int)it.col());
+			}
+		}
+	}
+	for (int i = 0; i < G.rows(); ++i) {
+		int first = -1;
+		for (int j = 0; j < G.cols(); ++j) {
+			if (G(i, j) == 0.0) {
+				continue;
+			}
+			if (first < 0) {
+				first = j;
+			}
+			else {
+				m_parent[find(j)] = find(first);
+			}
+		}
+	}
+
+	// Islands numbered in the order of their first DOF
+	vector<int> label(n, -1);
+	m_labels.resize(n);
+	m_count = 0;
+	for (int i = 0; i < n; ++i) {
+		int root = find(i);
+		if (label[root] < 0) {
+			label[root] = m_count++;
+		}
+		m_labels(i) = label[root];
+	}
+	if (m_still.size() != n) {
+		m_still.setZero(n);
+	}
+	classify();
+}
+
+void Islands::update(const VectorXd &qdot) {
+	for (int i = 0; i < (int)m_still.size(); ++i) {
+		if (fabs(qdot(i)) < m_threshold) {
+			m_still(i) = min(m_still(i) + 1, m_nsteps);
+		}
+		else {
+			m_still(i) = 0;
+		}
+	}
+	classify();
+}
+
+void Islands::wake(int dof) {
+	int island = m_labels(dof);
+	if (!m_sleeping[island]) {
+		return;
+	}
+	for (int i = 0; i < (int)m_labels.size(); ++i) {
+		if (m_labels(i) == island) {
+			m_still(i) = 0;
+		}
+	}
+	classify();
+}
+
+void Islands::wakeAll() {
+	m_still.setZero();
+	classify();
+}
+
+void Islands::classify() {
+	m_sleeping.assign(m_count, true);
+	for (int i = 0; i < (int)m_labels.size(); ++i) {
+		if (m_still(i) < m_nsteps) {
+			m_sleeping[m_labels(i)] = false;
+		}
+	}
+	m_nsleeping = 0;
+	for (int k = 0; k < m_count; ++k) {
+		m_nsleeping += m_sleeping[k] ? 1 : 0;
+	}
+	int nawake = 0;
+	for (int i = 0; i < (int)m_labels.size(); ++i) {
+		nawake += m_sleeping[m_labels(i)] ? 0 : 1;
+	}
+	m_awake.resize(nawake);
+	nawake = 0;
+	for (int i = 0; i < (int)m_labels.size(); ++i) {
+		if (!m_sleeping[m_labels(i)]) {
+			m_awake(nawake++) = i;
+		}
+	}
+}
+
+shared_ptr<Islands> Islands::fromEnvironment() {
+	const char *env = getenv("REDMAX_SLEEP");
+	if (env == nullptr || atof(env) <= 0.0) {
+		return nullptr;
+	}
+	const char *steps = getenv("REDMAX_SLEEP_STEPS");
+	return make_shared<Islands>(atof(env), steps != nullptr ? atoi(steps) : 30);
+}
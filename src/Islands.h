@@ -0,0 +1,62 @@
+#pragma once
+// Islands Groups of coupled DOFs and their sleep state
+//    Two reduced DOFs are in the same island when an entry of the system matrix or a row of the
+//    active equality constraints couples them. Every DOF counts the steps its velocity has stayed
+//    below the threshold; an island sleeps once all its DOFs have counted nsteps. SolverSparse
+//    drops the DOFs of the sleeping islands from the system, so they keep their position at zero
+//    velocity, and wakes an island when a constraint changes, a soft body of it touches the floor,
+//    a torque on it changes or a prescribed motion pulls on it. $REDMAX_SLEEP sets the threshold
+//    and $REDMAX_SLEEP_STEPS the count (30) for the solver of the Scene.
+
+#ifndef REDUCEDCOORD_SRC_ISLANDS_H_
+#define REDUCEDCOORD_SRC_ISLANDS_H_
+
+#include <memory>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+class Islands
+{
+public:
+	Islands(double threshold, int nsteps);
+	virtual ~Islands() {}
+
+	// Labels the DOFs, keeps the counts when the number of DOFs is the same
+	void build(const Eigen::SparseMatrix<double> &A, const Eigen::MatrixXd &G);
+	int getCount() const { return m_count; }
+	const Eigen::VectorXi & getLabels() const { return m_labels; }
+
+	// Counts the steps below the threshold, qdot are the velocities at the end of a step
+	void update(const Eigen::VectorXd &qdot);
+	// Wakes the island of a DOF
+	void wake(int dof);
+	void wakeAll();
+
+	bool isSleeping(int island) const { return m_sleeping[island]; }
+	int getSleepingCount() const { return m_nsleeping; }
+	// The DOFs of the islands that are awake, in increasing order
+	const Eigen::VectorXi & getAwake() const { return m_awake; }
+	double getThreshold() const { return m_threshold; }
+
+	// Sleeps with the settings of $REDMAX_SLEEP, null when it is not set
+	static std::shared_ptr<Islands> fromEnvironment();
+
+private:
+	int find(int i);
+	void classify();
+
+	double m_threshold;
+	int m_nsteps;
+	int m_count;
+	int m_nsleeping;
+	std::vector<int> m_parent;			// union-find forest
+	Eigen::VectorXi m_labels;			// island of each DOF
+	Eigen::VectorXi m_still;			// steps below the threshold of each DOF
+	std::vector<bool> m_sleeping;
+	Eigen::VectorXi m_awake;
+};
+
+#endif // REDUCEDCOORD_SRC_ISLANDS_H_
@@ -3,6 +3,7 @@
 #include "Body.h"
 #include "Constraint.h"
 #include "ConstraintPrescJoint.h"
+#include "Profiler.h"
 
 using namespace std;
 using namespace Eigen;
@@ -54,8 +55,7 @@ m_parent(parent)
 }
 
 void Joint::load(const string &RESOURCE_DIR, string joint_shape) {
-	m_jointShape = make_shared<Shape>();
-	m_jointShape->loadMesh(RESOURCE_DIR + joint_shape);
+	m_jointShape = MeshRegistry::getShape(RESOURCE_DIR + joint_shape);
 
 }
 
@@ -190,6 +190,16 @@ void Joint::computeInertia() {
 	m_I_j.block<3, 3>(3, 3) = m * Matrix3d::Identity();
 }
 
+void Joint::computePostorder(vector<int> &order) const {
+	// Appends the reduced indices of this subtree, children before parents
+	for (int k = 0; k < (int)m_children.size(); k++) {
+		m_children[k]->computePostorder(order);
+	}
+	for (int i = 0; i < m_ndof; ++i) {
+		order.push_back(idxR + i);
+	}
+}
+
 void Joint::reparam() {
 	reparam_();
 	if (next != nullptr) {
@@ -306,6 +316,7 @@ void Joint::gatherDDofs(VectorXd &ydot, int nr) {
 void Joint::scatterDofs(VectorXd y, int nr) {
 	// Scatters q and qdot from y
 	scatterDofsNoUpdate(y, nr);
+	PROFILE_ZONE("Joint::update");
 	update();
 }
 
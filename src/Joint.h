@@ -86,6 +86,7 @@ public:
 	void computeForceDamping(Eigen::VectorXd &fr, Eigen::MatrixXd &Dr);
 	void computeForceDampingSparse(Eigen::VectorXd &fr, std::vector<T> &Dr_);
 	void computeInertia();
+	void computePostorder(std::vector<int> &order) const;
 	void reparam();
 
 	void computeEnergies(Vector3d grav, Energy &ener);
@@ -14,8 +14,7 @@ Joint(body, 1, parent)
 
 void JointRevolute::load(const std::string &RESOURCE_DIR, std::string joint_shape) {
 
-	m_jointShape = make_shared<Shape>();
-	m_jointShape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+	m_jointShape = MeshRegistry::getShape(RESOURCE_DIR + "sphere2.obj");
 
 }
 
@@ -21,10 +21,8 @@ Joint(body, 1, parent)
 
 void JointSplineCurve::load(const string &RESOURCE_DIR, string joint_shape) {
 
-	m_jointShape = make_shared<Shape>();
-	m_jointShape->loadMesh(RESOURCE_DIR + joint_shape);
-	m_jointSphereShape = make_shared<Shape>();
-	m_jointSphereShape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+	m_jointShape = MeshRegistry::getShape(RESOURCE_DIR + joint_shape);
+	m_jointSphereShape = MeshRegistry::getShape(RESOURCE_DIR + "sphere2.obj");
 }
 
 void JointSplineCurve::init(int &nm, int &nr) {
@@ -26,8 +26,7 @@ public:
 	}
 
 	virtual void load(const std::string &RESOURCE_DIR, std::string joint_shape) {
-		m_jointShape = std::make_shared<Shape>();
-		m_jointShape->loadMesh(RESOURCE_DIR + "sphere2.obj");
+		m_jointShape = MeshRegistry::getShape(RESOURCE_DIR + "sphere2.obj");
 
 	}
 
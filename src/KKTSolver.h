@@ -16,11 +16,16 @@
 #include <unsupported/Eigen/IterativeSolvers>
 
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <iostream>
+// KKTMatrix Saddle point operator [A G'; G 0] for the iterative solvers
+//    A is only applied to vectors, either through an assembled matrix (setAMatrix) or a
+//    callback that adds A * x to y (setAOperator), so A never has to be formed. Without a G
+//    matrix the operator is A alone.
 template<
 	typename _Scalar,
-	typename ASolver,
+	typename ASolver = Eigen::IdentityPreconditioner,
 	typename AMatType = Eigen::SparseMatrix<_Scalar>,
 	typename GMatType = Eigen::SparseMatrix<_Scalar>
 >
@@ -30,6 +35,8 @@ public:
 	typedef _Scalar Scalar;
 	typedef Scalar RealScalar;
 	typedef int StorageIndex;
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+	typedef std::function<void(const Vector &, Vector &)> AProduct;	// y += A * x
 	
 	enum {
 		ColsAtCompileTime = Eigen::Dynamic,
@@ -37,13 +44,13 @@ public:
 		IsRowMajor = false
 	};
 
-	KKTMatrix() : m_A_Solver(nullptr), m_A(nullptr), m_G(nullptr) {}
+	KKTMatrix() : m_A(nullptr), m_G(nullptr), m_A_Solver(nullptr), m_nA(0) {}
 	
 	template<typename Rhs>
-	Eigen::Product<KKTMatrix<Scalar, ASolver>, Rhs, Eigen::AliasFreeProduct>
+	Eigen::Product<KKTMatrix, Rhs, Eigen::AliasFreeProduct>
 		operator*(const Eigen::MatrixBase<Rhs> &x) const {
 		return Eigen::Product<
-			KKTMatrix<Scalar, ASolver>,
+			KKTMatrix,
 			Rhs,
 			Eigen::AliasFreeProduct>(*this, x.derived());
 	}
@@ -53,9 +60,23 @@ public:
 		return *this;
 	}
 
+	KKTMatrix & clearGMatrix() {
+		m_G = nullptr;
+		return *this;
+	}
+
 	KKTMatrix & setAMatrix(const AMatType &A, const ASolver & A_Solver) {
 		m_A = &A;
 		m_A_Solver = &A_Solver;
+		m_nA = A.rows();
+		m_A_prod = nullptr;
+		return *this;
+	}
+
+	KKTMatrix & setAOperator(Eigen::Index nA, const AProduct &A_prod) {
+		m_A = nullptr;
+		m_nA = nA;
+		m_A_prod = A_prod;
 		return *this;
 	}
 
@@ -65,64 +86,83 @@ public:
 
 	bool isInitialized() const
 	{
-		return m_A_Solver != nullptr && m_G != nullptr && m_A != nullptr;
+		return m_A != nullptr || m_A_prod;
 	}
 
-	Eigen::Index rows() const { int i = m_A->rows(); return i; }
-	Eigen::Index cols() const { return (m_A->rows()); }
+	Eigen::Index getASize() const { return m_nA; }
+	Eigen::Index getGSize() const { return m_G == nullptr ? 0 : m_G->rows(); }
+	Eigen::Index rows() const { return m_nA + getGSize(); }
+	Eigen::Index cols() const { return m_nA + getGSize(); }
+
+	void applyA(const Vector &x, Vector &y) const {
+		if (m_A_prod) {
+			m_A_prod(x, y);
+		}
+		else {
+			y.noalias() += (*m_A) * x;
+		}
+	}
+
+	// y += [A G'; G 0] * x
+	template<typename Rhs, typename Dest>
+	void addProduct(const Rhs &x, Dest &y) const {
+		Eigen::Index nG = getGSize();
+		Vector xA = x.head(m_nA);
+		Vector yA = Vector::Zero(m_nA);
+		applyA(xA, yA);
+		if (nG > 0) {
+			yA.noalias() += m_G->transpose() * x.tail(nG);
+			y.tail(nG).noalias() += (*m_G) * xA;
+		}
+		y.head(m_nA) += yA;
+	}
 
 private:
 	const AMatType *m_A;
 	const GMatType *m_G;
 	const ASolver *m_A_Solver;
+	Eigen::Index m_nA;
+	AProduct m_A_prod;
 
 };
 
 namespace Eigen {
 	namespace internal {
-		// MatrixReplacement looks-like a SparseMatrix, so let's inherits its traits:
+		// KKTMatrix looks like a SparseMatrix to the solvers, so it inherits its traits
 		template<
 			typename _Scalar,
-			typename ASolver
+			typename ASolver,
+			typename AMatType,
+			typename GMatType
 			>
-			struct traits<KKTMatrix<_Scalar, ASolver>> : public Eigen::internal::traits<Eigen::SparseMatrix<double> >
+			struct traits<KKTMatrix<_Scalar, ASolver, AMatType, GMatType> > : public Eigen::internal::traits<Eigen::SparseMatrix<_Scalar> >
 		{};
 	}
 }
 
-// Implementation of MatrixReplacement * Eigen::DenseVector though a specialization of internal::generic_product_impl:
+// KKTMatrix * Eigen::DenseVector through a specialization of internal::generic_product_impl
 namespace Eigen {
 	namespace internal {
 		template<
 			typename Rhs,
 			typename _Scalar,
-			typename ASolver
-			//typename AMatType = Eigen::SparseMatrix<_Scalar>,
-			//typename GMatType = Eigen::SparseMatrix<_Scalar>
+			typename ASolver,
+			typename AMatType,
+			typename GMatType
 		>
-		struct generic_product_impl<KKTMatrix<_Scalar, ASolver>, Rhs, SparseShape, DenseShape, GemvProduct> // GEMV stands for matrix-vector
-			: generic_product_impl_base<KKTMatrix<_Scalar, ASolver>, Rhs, generic_product_impl<KKTMatrix<_Scalar, ASolver>, Rhs> >
+		struct generic_product_impl<KKTMatrix<_Scalar, ASolver, AMatType, GMatType>, Rhs, SparseShape, DenseShape, GemvProduct> // GEMV stands for matrix-vector
+			: generic_product_impl_base<KKTMatrix<_Scalar, ASolver, AMatType, GMatType>, Rhs, generic_product_impl<KKTMatrix<_Scalar, ASolver, AMatType, GMatType>, Rhs> >
 		{
-			typedef typename Product<KKTMatrix<_Scalar, ASolver>, Rhs>::Scalar Scalar;
+			typedef KKTMatrix<_Scalar, ASolver, AMatType, GMatType> Lhs;
+			typedef typename Product<Lhs, Rhs>::Scalar Scalar;
 			template<typename Dest>
-			static void scaleAndAddTo(Dest& dst, const KKTMatrix<_Scalar, ASolver>& lhs, const Rhs& rhs, const Scalar& alpha)
+			static void scaleAndAddTo(Dest& dst, const Lhs& lhs, const Rhs& rhs, const Scalar& alpha)
 			{
 				// This method should implement "dst += alpha * lhs * rhs" inplace,
 				// however, for iterative solvers, alpha is always equal to 1, so let's not bother about it.
 				assert(alpha == Scalar(1) && "scaling is not implemented");
 				EIGEN_ONLY_USED_FOR_DEBUG(alpha);
-				// Here we could simply call dst.noalias() += lhs.my_matrix() * rhs,
-				// but let's do something fancier (and less efficient):
-				for (Index i = 0; i < lhs.cols(); ++i) {
-					VectorXd acol = lhs.getAMatrix().col(i);
-					//VectorXd gcol = lhs.getGMatrix().col(i);
-					//VectorXd lhscol(acol.size() + gcol.size());
-					//lhscol.topRows(acol.size()) = acol;
-					//lhscol.bottomRows(gcol.size()) = gcol;
-					dst += rhs(i) * acol;
-
-				}
-					//dst += rhs(i) * lhs.my_matrix().col(i);
+				lhs.addProduct(rhs, dst);
 			}
 		};
 	}
@@ -162,10 +202,9 @@ public:
 	{ 
 		// get diag(A)
 		m_diag_precon.compute(kkt_mat.getAMatrix());
-		m_nA = kkt_mat.rows();
-		// init KKT mat
+		m_nA = kkt_mat.getASize();
+		// init KKT mat, the inner solve only sees the A block
 		m_mat.setAMatrix(kkt_mat.getAMatrix(), kkt_mat.getASolver());
-		m_mat.setGMatrix(kkt_mat.getGMatrix());
 
 		m_outer_solver.compute(m_mat);
 
@@ -229,7 +268,7 @@ public:
 		MaxColsAtCompileTime = Eigen::Dynamic
 	};
 
-	SaddlePointPreconditioner() :m_isInitialized(true) {}
+	SaddlePointPreconditioner() :m_isInitialized(true), m_isSchurFactored(false), m_nG(0) {}
 
 	template<typename MatType>
 	SaddlePointPreconditioner& analyzePattern(const MatType&) {
@@ -242,14 +281,18 @@ public:
 	SaddlePointPreconditioner& factorize(const MatType&mat) { 
 		return *this;}
 
-	Eigen::Index rows() const { return m_mat.rows(); }
-	Eigen::Index cols() const { return m_mat.cols(); }
+	Eigen::Index rows() const { return m_nG; }
+	Eigen::Index cols() const { return m_nG; }
 
 	inline const Vector solve(const Vector& b) const
 	{
 		int nA = m_invdiag_A.rows();
 		Vector x(b.rows());
 		x.topRows(nA) = m_invdiag_A.cwiseProduct(b.segment(0, nA));	
+		if (m_isSchurFactored) {
+			x.bottomRows(m_nG) = m_schur_solver.solve(b.bottomRows(m_nG));
+			return x;
+		}
 		Vector lambda = b.bottomRows(m_mat.rows());
 		//x.bottomRows(m_mat_dense.rows()) = m_mat_dense.ldlt().solve(lambda);
 		//x.bottomRows(m_mat.rows()) = lambda; 
@@ -271,7 +314,7 @@ public:
 	solve(const Eigen::MatrixBase<Rhs>& b) const
 		{
 			eigen_assert(m_isInitialized && "SaddlePointPreconditioner is not initialized.");
-			eigen_assert(m_mat.rows() + m_invdiag_A.rows() == b.rows()
+			eigen_assert(m_nG + m_invdiag_A.rows() == b.rows()
 				&& "SaddlePointPreconditioner::solve(): invalid number of rows of the right hand side matrix b");
 			return Eigen::Solve<SaddlePointPreconditioner, Rhs>(*this, b.derived());
 		}
@@ -280,9 +323,27 @@ public:
 	{
 		//m_mat = Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>>(DATA, DATA rows, DATA cols);
 		m_mat = D;
+		m_nG = D.rows();
+		m_isSchurFactored = false;
 		//m_solver.analyzePattern(m_mat);
 	}
 
+	// Factorizes the Schur complement S instead of taking its inverse D, the inverse diagonal
+	// of S is used if it is singular
+	void setSchurMatrix(const Eigen::SparseMatrix<Scalar> &S)
+	{
+		m_nG = S.rows();
+		m_schur_solver.compute(S);
+		m_isSchurFactored = (m_schur_solver.info() == Eigen::Success);
+		if (!m_isSchurFactored) {
+			Vector invdiag = S.diagonal();
+			for (int i = 0; i < invdiag.size(); ++i) {
+				invdiag(i) = (invdiag(i) != Scalar(0)) ? Scalar(1) / invdiag(i) : Scalar(1);
+			}
+			m_mat = Eigen::SparseMatrix<Scalar>(invdiag.asDiagonal());
+		}
+	}
+
 	void setADiagMatrix(const Vector &invdiag_A) {
 		//m_invdiag_A = Eigen::Map<Eigen::VectorXd>(invdiag_A.data(), invdiag_A.size());
 		m_invdiag_A = invdiag_A;
@@ -308,7 +369,10 @@ protected:
 	Eigen::SparseMatrix<Scalar> m_mat;
 	Matrix m_mat_dense;
 	Eigen::SparseLU< Eigen::SparseMatrix<Scalar, Eigen::ColMajor>, Eigen::NaturalOrdering<int >> m_solver;
+	Eigen::SimplicialLDLT<Eigen::SparseMatrix<Scalar> > m_schur_solver;
 	Vector m_invdiag_A;
 	bool m_isInitialized;
+	bool m_isSchurFactored;
+	Eigen::Index m_nG;
 	//Eigen::MINRES<Eigen::SparseMatrix<Scalar>, Eigen::Lower > m_solver;
 };
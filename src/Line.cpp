@@ -21,6 +21,20 @@ m_x0(x0), m_x1(x1)
 void Line::draw() {
 }
 
+static double getInLinePadding(double length) {
+	// isInLine() accepts an ellipsoid around the segment, its half axes are below eps + sqrt((l + eps) eps)
+	double eps = 0.0001;
+	return eps + sqrt((length + eps) * eps);
+}
+
+Vector3d Line::getMin() const {
+	return m_x0.cwiseMin(m_x1).array() - getInLinePadding((m_x0 - m_x1).norm());
+}
+
+Vector3d Line::getMax() const {
+	return m_x0.cwiseMax(m_x1).array() + getInLinePadding((m_x0 - m_x1).norm());
+}
+
 void Line::addSampleNodes(int n, std::vector<std::shared_ptr<Node>> &nodes) {
 	int idx = (int)nodes.size();
 	for (int s = 0; s < n; s++) {
@@ -23,6 +23,9 @@ public:
 	std::shared_ptr<Body> getBody() { return m_body; };
 	bool isInLine(Vector3d x);
 	bool isInLine(std::shared_ptr<Node> n);
+	// Bounding box of the points accepted by isInLine()
+	Vector3d getMin() const;
+	Vector3d getMax() const;
 	void addSampleNodes(int n, std::vector<std::shared_ptr<Node>> &nodes);
 
 protected:
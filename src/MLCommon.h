@@ -73,8 +73,11 @@ struct Energy {
 	double K;
 	double V;
 };
-enum SparseSolver {CG, CG_ILUT, QR, BICG,BICG_ILUT, SLDLT, LU, PARDISO_LU, PARDISO_LDLT, MINRES_SOLVER, GMRES_SOLVER, SUPER_LU
+enum SparseSolver {CG, CG_ILUT, QR, BICG,BICG_ILUT, SLDLT, LU, PARDISO_LU, PARDISO_LDLT, MINRES_SOLVER, GMRES_SOLVER, SUPER_LU, MULTIGRID, MATRIX_FREE, AUTO
 };
+// In the order of SparseSolver, defined in SolverSparse.cpp
+extern const char *const SPARSE_SOLVER_NAMES[];
+const int SPARSE_SOLVER_COUNT = AUTO + 1;
 
 template<typename T>
 using  MatrixType = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
@@ -651,15 +654,4 @@ inline int SVD(Eigen::Matrix3d &F,
 //	}
 //}
 
-//const int MIN_ITERATOR_NUM = 4;
-//inline int getThreadsNumber(int n, int min_n) {
-//    int ncore = omp_get_num_procs();
-//    int max_tn = n / min_n;
-//    int tn = max_tn > 2 * ncore ? 2 * ncore : max_tn;
-//    if (tn < 1) {
-//        tn = 1;
-//    }
-//    return tn;
-//}
-
 #endif // MUSCLEMASS_SRC_MLCOMMON_H_
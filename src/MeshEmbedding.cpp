@@ -9,6 +9,8 @@
 #include "FaceTriangle.h"
 #include "Line.h"
 #include "Surface.h"
+#include "ParallelFor.h"
+#include "SpatialGrid.h"
 
 using namespace std;
 using namespace Eigen;
@@ -35,10 +37,13 @@ MeshEmbedding::MeshEmbedding(double density, double young, double possion, Mater
 	}
 	m_isDenseMesh = true;
 	m_isCoarseMesh = false;
+	m_isDenseDirty = false;
+	m_damping = 0.0;
 }
 
 void MeshEmbedding::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
 	if (m_isDenseMesh) {
+		updateDenseMesh();
 		//m_dense_mesh->draw(MV, prog, progSimple, P);
 		m_dense_mesh->draw(MV, prog, P);
 	}
@@ -107,105 +112,123 @@ void MeshEmbedding::computeStiffnessSparse(vector<T> &K_) {
 	}
 }
 
-void MeshEmbedding::scatterDofs(VectorXd &y, int nr) {
-	m_coarse_mesh->scatterDofs(y, nr);
-
-	const vector<std::shared_ptr<Tetrahedron> > &coarse_mesh_tets = m_coarse_mesh->getTets();
-	bool isCheckingCollision = m_dense_mesh->m_isCollisionWithFloor;
+void MeshEmbedding::computeStiffnessDiagonal(VectorXd &d) {
+	m_coarse_mesh->computeStiffnessDiagonal(d);
+	if (next != nullptr) {
+		next->computeStiffnessDiagonal(d);
+	}
+}
 
-	// update dense mesh using coarse mesh
-	for (int i = 0; i < (int)coarse_mesh_tets.size(); i++) {
-		int update_id = -1;
-		double deep_inside;
-		auto tet = coarse_mesh_tets[i];
-		int num_enclosed = tet->m_enclosed_points.size();
-		for (int j = 0; j < num_enclosed; j++) {
-			// update nodes
-			auto node = tet->m_enclosed_points[j];
-			node->x = tet->computePositionByBarycentricWeight(tet->m_barycentric_weights[j]);
-			if (isCheckingCollision) {
-				if (node->x.y() < m_dense_mesh->m_floor_y) {
-					// there is collision!
-					// compute the penetration
-					deep_inside = m_dense_mesh->m_floor_y - node->x.y();
-
-					// find the lowest node in the coarse tet
-					double y_lowest = 1000.0;
-
-					for (int t = 0; t < 4; t++) {
-						auto pt = tet->m_nodes[t];
-						double ypos = pt->x.y();
-						if (ypos < y_lowest) {
-							y_lowest = ypos;
-							update_id = t;
-						}
-					}
-					// push up that lowest node and kill its velocity
-					//tet->m_nodes[update_id]->x.y() += deep_inside;
-					tet->m_nodes[update_id]->v.y() = 0.0;
-
-					// kill coarse y velocity in y vector
-					int idxR = tet->m_nodes[update_id]->idxR;
-					//y.segment<3>(idxR).y() += deep_inside;
-					y.segment<3>(nr + idxR).y() = 0.0;
-
-					if (update_id == -1) {
-						//y.segment<3>(idxR).y() += deep_inside;
-						//y.segment<3>(nr + idxR).y() = 0.0;
-
-					}
-					
-					// update the node in dense mesh that collides with floor and all the points before that
-					//node->x = tet->computePositionByBarycentricWeight(tet->m_barycentric_weights[j]);
-
-					for (int k = 0; k < j + 1; k++) {
-						//auto node_update = tet->m_enclosed_points[k];
-						//node_update->x = tet->computePositionByBarycentricWeight(tet->m_barycentric_weights[k]);
-					}
-
-					// update this one tet is not enough, neighbor tets that touch this updated node is affected, 
-					// need to update them all?
-				}
-			}
-		}
+void MeshEmbedding::computeStiffnessProd(const VectorXd &x, VectorXd &y) {
+	m_coarse_mesh->computeStiffnessProd(x, y);
+	if (next != nullptr) {
+		next->computeStiffnessProd(x, y);
+	}
+}
 
-		/*if (update_id != -1) {
-			tet->m_nodes[update_id]->x.y() += deep_inside;
-			tet->m_nodes[update_id]->v.y() = 0.0;
-			int idxR = tet->m_nodes[update_id]->idxR;
-			y.segment<3>(idxR).y() += deep_inside;
+void MeshEmbedding::scatterDofs(VectorXd &y, int nr) {
+	m_coarse_mesh->scatterDofs(y, nr);
 
-			y.segment<3>(nr + idxR).y() = 0.0;
+	// The dense mesh is only evaluated when it is drawn or exported, except when it collides
+	m_isDenseDirty = true;
+	vector<int> stopped;
+	collideDenseMesh(stopped);
+	for (int i = 0; i < (int)stopped.size(); ++i) {
+		// also in the y vector
+		y.segment<3>(nr + stopped[i]).y() = 0.0;
+	}
 
-		}*/
+	if (next != nullptr) {
+		next->scatterDofs(y, nr);
+	}
+}
 
+void MeshEmbedding::collideDenseMesh(vector<int> &stopped) const {
+	if (!m_dense_mesh->m_isCollisionWithFloor || m_dense_tets == nullptr) {
+		return;
 	}
+	computeDenseDofs();
 
+	const vector<std::shared_ptr<Tetrahedron> > &coarse_mesh_tets = m_coarse_mesh->getTets();
+	const vector<std::shared_ptr<Node> > &dense_mesh_nodes = m_dense_mesh->getNodes();
+	const vector<int> &dense_tets = *m_dense_tets;
+	for (int i = 0; i < (int)dense_mesh_nodes.size(); i++) {
+		if (dense_tets[i] == -1 || dense_mesh_nodes[i]->x.y() >= m_dense_mesh->m_floor_y) {
+			continue;
+		}
+		// there is collision!
+		// find the lowest node in the coarse tet
+		auto tet = coarse_mesh_tets[dense_tets[i]];
+		int update_id = 0;
+		for (int t = 1; t < 4; t++) {
+			if (tet->m_nodes[t]->x.y() < tet->m_nodes[update_id]->x.y()) {
+				update_id = t;
+			}
+		}
+		// kill its velocity
+		tet->m_nodes[update_id]->v.y() = 0.0;
+		stopped.push_back(tet->m_nodes[update_id]->idxR);
+	}
+}
 
+void MeshEmbedding::scatterDDofs(VectorXd &ydot, int nr) {
+	m_coarse_mesh->scatterDDofs(ydot, nr);
+	m_isDenseDirty = true;
 	if (next != nullptr) {
-		next->scatterDofs(y, nr);
+		next->scatterDDofs(ydot, nr);
 	}
 }
 
-void MeshEmbedding::scatterDDofs(VectorXd &ydot, int nr) {
+void MeshEmbedding::computeDenseDofs() const {
+	const vector<shared_ptr<Node> > &coarse_mesh_nodes = m_coarse_mesh->getNodes();
+	const vector<shared_ptr<Node> > &dense_mesh_nodes = m_dense_mesh->getNodes();
+	if (m_W == nullptr || m_W->rows() != (int)dense_mesh_nodes.size()) {
+		// No weights yet
+		return;
+	}
+	const SparseMatrix<double, RowMajor> &W = *m_W;
+	const vector<int> &dense_tets = *m_dense_tets;
+
+	int nc = (int)coarse_mesh_nodes.size();
+	m_coarse_X.resize(nc, 6);
+	for (int i = 0; i < nc; i++) {
+		m_coarse_X.block<1, 3>(i, 0) = coarse_mesh_nodes[i]->x.transpose();
+		m_coarse_X.block<1, 3>(i, 3) = coarse_mesh_nodes[i]->v.transpose();
+	}
 
-	m_coarse_mesh->scatterDDofs(ydot, nr);
-	//const vector<std::shared_ptr<Tetrahedron> > &coarse_mesh_tets = m_coarse_mesh->getTets();
-	//bool isCheckingCollision = m_dense_mesh->m_isCollisionWithFloor;
-	//// update dense mesh using coarse mesh
-	//for (int i = 0; i < (int)coarse_mesh_tets.size(); i++) {
-	//	auto tet = coarse_mesh_tets[i];
-	//	int num_enclosed = tet->m_enclosed_points.size();
-	//	for (int j = 0; j < num_enclosed; j++) {
-	//		// update nodes
-	//		auto node = tet->m_enclosed_points[j];
-	//		node->x = tet->computePositionByBarycentricWeight(tet->m_barycentric_weights[j]);
-	//	}
-	//}
+	// x_dense = W x_coarse and v_dense = W v_coarse, row by row
+	parallelFor(0, (int)W.rows(), [&](int i) {
+		if (dense_tets[i] == -1) {
+			return;
+		}
+		Matrix<double, 1, 6> xv = Matrix<double, 1, 6>::Zero();
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(W, i); it; ++it) {
+			xv += it.value() * m_coarse_X.row(it.col());
+		}
+		dense_mesh_nodes[i]->x = xv.head<3>().transpose();
+		dense_mesh_nodes[i]->v = xv.tail<3>().transpose();
+	}, 256);
+}
 
+void MeshEmbedding::updateDenseMesh() const {
+	if (!m_isDenseDirty) {
+		return;
+	}
+	computeDenseDofs();
 	m_dense_mesh->updatePosNor();
+	m_isDenseDirty = false;
+}
+
+void MeshEmbedding::subcycle(int nsub, double h, Vector3d grav, const SparseMatrix<double, RowMajor> &G, const VectorXd &rhsG, int nrc,
+	const VectorXd &q0, const VectorXd &qdot0, VectorXd &q1, VectorXd &qdot1, VectorXd &reaction) {
+	// Only the coarse mesh carries DOFs, the dense mesh follows it in scatterDofs(). The
+	// substeps see the damping and the dense mesh collisions of the coupled step.
+	m_coarse_mesh->subcycle_(nsub, h, grav, m_damping, [this]() {
+		vector<int> stopped;
+		collideDenseMesh(stopped);
+	}, G, rhsG, nrc, q0, qdot0, q1, qdot1, reaction);
 	if (next != nullptr) {
-		next->scatterDDofs(ydot, nr);
+		next->subcycle(nsub, h, grav, G, rhsG, nrc, q0, qdot0, q1, qdot1, reaction);
 	}
 }
 
@@ -216,9 +239,29 @@ void MeshEmbedding::gatherDofs(VectorXd &y, int nr) {
 	}
 }
 
+void MeshEmbedding::setRestSource(shared_ptr<const MeshEmbedding> source) {
+	m_rest_source = source;
+	m_coarse_mesh->setRestSource(source != nullptr ? source->m_coarse_mesh : nullptr);
+}
+
 void MeshEmbedding::precomputeWeights() {
 	const vector<shared_ptr<Tetrahedron> > &coarse_mesh_tets = m_coarse_mesh->getTets();
 	const vector<shared_ptr<FaceTriangle> > &dense_mesh_trifaces = m_dense_mesh->getFaces();
+	const vector<shared_ptr<Node> > &dense_mesh_nodes = m_dense_mesh->getNodes();
+
+	// The embedding this one is a clone of went through the same steps
+	shared_ptr<const MeshEmbedding> source = m_rest_source;
+	m_rest_source = nullptr;
+	if (source != nullptr && source->m_W != nullptr && source->m_W->rows() == (int)dense_mesh_nodes.size() &&
+		source->m_W->cols() == (int)m_coarse_mesh->getNodes().size()) {
+		m_W = source->m_W;
+		m_dense_tets = source->m_dense_tets;
+		for (int i = 0; i < (int)dense_mesh_nodes.size(); i++) {
+			dense_mesh_nodes[i]->isEnclosedByTet = ((*m_dense_tets)[i] != -1);
+		}
+		m_isDenseDirty = true;
+		return;
+	}
 	//for (int i = 0; i < (int)coarse_mesh_tets.size(); i++) {
 	//	auto tet = coarse_mesh_tets[i];
 	//	for (int j = 0; j < (int)dense_mesh_nodes.size(); j++) {
@@ -233,20 +276,62 @@ void MeshEmbedding::precomputeWeights() {
 	//	}
 	//}
 
+	// Surface nodes in the order of the faces
+	vector<shared_ptr<Node> > nodes;
+	for (int j = 0; j < (int)dense_mesh_trifaces.size(); j++) {
+		for (int k = 0; k < 3; k++) {
+			auto node = dense_mesh_trifaces[j]->m_nodes[k];
+			if (!node->isEnclosedByTet) {
+				node->isEnclosedByTet = true;
+				nodes.push_back(node);
+			}
+		}
+	}
+
+	// Each node goes to the first coarse tet that encloses it
+	SpatialGrid grid;
+	m_coarse_mesh->computeTetGrid(grid, false);
+	vector<int> enclosing(nodes.size(), -1);
+	parallelFor(0, (int)nodes.size(), [&](int i) {
+		vector<int> candidates;
+		grid.query(nodes[i]->x, candidates);
+		for (int j = 0; j < (int)candidates.size(); j++) {
+			if (coarse_mesh_tets[candidates[j]]->checkPointInside(nodes[i])) {
+				enclosing[i] = candidates[j];
+				break;
+			}
+		}
+	}, 64);
+
+	for (int i = 0; i < (int)nodes.size(); i++) {
+		nodes[i]->isEnclosedByTet = (enclosing[i] != -1);
+		if (enclosing[i] != -1) {
+			// the point is inside the tet
+			auto tet = coarse_mesh_tets[enclosing[i]];
+			tet->addEnclosedPoint(nodes[i]);
+			tet->computeBarycentricWeightAndSave(nodes[i]);
+		}
+	}
+
+	// Store the weights as the rows of W
+	vector<T> W_;
+	auto dense_tets = make_shared<vector<int> >(dense_mesh_nodes.size(), -1);
 	for (int i = 0; i < (int)coarse_mesh_tets.size(); i++) {
 		auto tet = coarse_mesh_tets[i];
-		for (int j = 0; j < (int)dense_mesh_trifaces.size(); j++) {
-			for (int k = 0; k < 3; k++) {
-				auto node = dense_mesh_trifaces[j]->m_nodes[k];
-				if (!node->isEnclosedByTet && tet->checkPointInside(node)) {
-					// the point is inside the tet
-					tet->addEnclosedPoint(node);
-					Vector4d weight = tet->computeBarycentricWeightAndSave(node);
-					node->isEnclosedByTet = true;
-				}
-			}			
+		for (int j = 0; j < (int)tet->m_enclosed_points.size(); j++) {
+			int row = tet->m_enclosed_points[j]->i;
+			(*dense_tets)[row] = i;
+			for (int k = 0; k < 4; k++) {
+				W_.push_back(T(row, tet->m_nodes[k]->i, tet->m_barycentric_weights[j](k)));
+			}
 		}
 	}
+	auto W = make_shared<SparseMatrix<double, RowMajor> >(dense_mesh_nodes.size(), m_coarse_mesh->getNodes().size());
+	W->setFromTriplets(W_.begin(), W_.end());
+	W->makeCompressed();
+	m_W = W;
+	m_dense_tets = dense_tets;
+	m_isDenseDirty = true;
 }
 
 void MeshEmbedding::transformCoarseMesh(Matrix4d E) {
@@ -20,7 +20,7 @@ typedef Eigen::Triplet<double> T;
 
 class MeshEmbedding {
 public:
-	MeshEmbedding() {}
+	MeshEmbedding() : m_damping(0.0), m_isDenseDirty(false) {}
 	MeshEmbedding(double density, double young, double possion, Material material, SoftBodyType type);
 
 	virtual ~MeshEmbedding() {}
@@ -32,7 +32,11 @@ public:
 		const std::string &TETGEN_FLAGS_1);
 	virtual void init();
 	void precomputeWeights();
+	// An embedding built the same way whose coarse tets and weights are shared by the next
+	// load and precomputeWeights(), see World::clone()
+	void setRestSource(std::shared_ptr<const MeshEmbedding> source);
 	void updatePosNor();
+	void updateDenseMesh() const;
 	virtual void countDofs(int &nm, int &nr);
 	void transformCoarseMesh(Matrix4d E);
 	void transformDenseMesh(Matrix4d E);
@@ -41,11 +45,16 @@ public:
 	void setAttachmentsByXZCircle(double y, double range, Vector2d O, double r, std::shared_ptr<Body> body);
 	void setAttachmentsByLine(std::shared_ptr<Line> l);
 	virtual void setDamping(double damping) { m_damping = damping; m_coarse_mesh->setDamping(damping); }
+	void addMultigridLevel(const std::string &TETGEN_FLAGS) { m_coarse_mesh->addMultigridLevel(TETGEN_FLAGS); }
+	virtual void subcycle(int nsub, double h, Vector3d grav, const Eigen::SparseMatrix<double, Eigen::RowMajor> &G, const Eigen::VectorXd &rhsG, int nrc,
+		const Eigen::VectorXd &q0, const Eigen::VectorXd &qdot0, Eigen::VectorXd &q1, Eigen::VectorXd &qdot1, Eigen::VectorXd &reaction);
 	virtual void computeMassSparse(std::vector<T> &M_);
 	virtual void computeJacobianSparse(std::vector<T> &J_);
 
 	virtual void computeForce(Vector3d grav, Eigen::VectorXd &f);
 	virtual void computeStiffnessSparse(std::vector<T> &K_);
+	virtual void computeStiffnessDiagonal(Eigen::VectorXd &d);
+	virtual void computeStiffnessProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
 	virtual void computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D);
 	virtual void computeForceDampingSparse(Eigen::VectorXd &f, std::vector<T> &D_);
 
@@ -65,9 +74,22 @@ public:
 
 	std::shared_ptr<MeshEmbedding> next;
 protected:
+	void computeDenseDofs() const;
+	// Stops the lowest coarse node of the tets of the dense nodes under the floor, stopped gets their idxR
+	void collideDenseMesh(std::vector<int> &stopped) const;
+
 	//std::shared_ptr<SoftBody> m_dense_mesh;
 	std::shared_ptr<Surface> m_dense_mesh;
 	std::shared_ptr<SoftBody> m_coarse_mesh;
 	double m_damping;
 
+	// Coarse-to-dense map, one row per dense node with the barycentric weights of its
+	// enclosing tet in the columns of the tet's coarse nodes. Empty rows are not enclosed.
+	// Immutable once computed, clones share them.
+	std::shared_ptr<const Eigen::SparseMatrix<double, Eigen::RowMajor> > m_W;
+	std::shared_ptr<const std::vector<int> > m_dense_tets;	// enclosing coarse tet of each dense node, -1 if none
+	std::shared_ptr<const MeshEmbedding> m_rest_source;
+	mutable Eigen::MatrixXd m_coarse_X;	// n_coarse x 6, positions and velocities
+	mutable bool m_isDenseDirty;		// dense mesh lags behind the coarse mesh
+
 };
\ No newline at end of file
@@ -20,11 +20,15 @@ public:
 	virtual ~MeshEmbeddingNull() {}
 	void computeForce(Vector3d grav, Eigen::VectorXd &f) {}
 	void computeStiffnessSparse(std::vector<T> &K_) {}
+	void computeStiffnessDiagonal(Eigen::VectorXd &d) {}
+	void computeStiffnessProd(const Eigen::VectorXd &x, Eigen::VectorXd &y) {}
 	void computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D) {}
 	void computeForceDampingSparse(Eigen::VectorXd &f, std::vector<T> &D_) {}
 	void countDofs(int &nm, int &nr) {}
 	void computeMassSparse(std::vector<T> &M_) {}
 	void computeJacobianSparse(std::vector<T> &J_){}
+	void subcycle(int nsub, double h, Vector3d grav, const Eigen::SparseMatrix<double, Eigen::RowMajor> &G, const Eigen::VectorXd &rhsG, int nrc,
+		const Eigen::VectorXd &q0, const Eigen::VectorXd &qdot0, Eigen::VectorXd &q1, Eigen::VectorXd &qdot1, Eigen::VectorXd &reaction) {}
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const {}
 };
 
@@ -0,0 +1,79 @@
+#include "rmpch.h"
+#include "MeshRegistry.h"
+#include "TetMesh.h"
+
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+struct MeshRegistryEntry {
+	once_flag loaded;
+	shared_ptr<Shape> shape;
+};
+
+struct TetMeshRegistryEntry {
+	once_flag loaded;
+	shared_ptr<const TetMesh> mesh;
+};
+
+static mutex s_mtx;
+static map<string, shared_ptr<MeshRegistryEntry> > s_entries;
+static map<string, shared_ptr<TetMeshRegistryEntry> > s_tet_entries;
+
+static shared_ptr<TetMeshRegistryEntry> getTetEntry(const string &key) {
+	lock_guard<mutex> lock(s_mtx);
+	shared_ptr<TetMeshRegistryEntry> &e = s_tet_entries[key];
+	if (e == nullptr) {
+		e = make_shared<TetMeshRegistryEntry>();
+	}
+	return e;
+}
+
+shared_ptr<Shape> MeshRegistry::getShape(const string &meshName) {
+	shared_ptr<MeshRegistryEntry> entry;
+	{
+		lock_guard<mutex> lock(s_mtx);
+		shared_ptr<MeshRegistryEntry> &e = s_entries[meshName];
+		if (e == nullptr) {
+			e = make_shared<MeshRegistryEntry>();
+		}
+		entry = e;
+	}
+
+	// Loads outside of the lock so that different files load in parallel
+	call_once(entry->loaded, [&]() {
+		auto shape = make_shared<Shape>();
+		shape->loadMesh(meshName);
+		entry->shape = shape;
+	});
+	return entry->shape;
+}
+
+shared_ptr<const TetMesh> MeshRegistry::getTetMesh(const string &RESOURCE_DIR, const string &MESH_NAME, const string &TETGEN_FLAGS, bool isAdditionalNodes) {
+	shared_ptr<TetMeshRegistryEntry> entry = getTetEntry(RESOURCE_DIR + MESH_NAME + "|" + TETGEN_FLAGS + (isAdditionalNodes ? "|a" : "|"));
+	call_once(entry->loaded, [&]() {
+		auto mesh = make_shared<TetMesh>();
+		mesh->load(RESOURCE_DIR, MESH_NAME, TETGEN_FLAGS, isAdditionalNodes);
+		entry->mesh = mesh;
+	});
+	return entry->mesh;
+}
+
+shared_ptr<const TetMesh> MeshRegistry::getTetBox(double sx, double sy, double sz, const string &TETGEN_FLAGS) {
+	char key[128];
+	snprintf(key, sizeof(key), "box %.17g %.17g %.17g|", sx, sy, sz);
+	shared_ptr<TetMeshRegistryEntry> entry = getTetEntry(key + TETGEN_FLAGS);
+	call_once(entry->loaded, [&]() {
+		auto mesh = make_shared<TetMesh>();
+		mesh->loadBox(sx, sy, sz, TETGEN_FLAGS);
+		entry->mesh = mesh;
+	});
+	return entry->mesh;
+}
+
+void MeshRegistry::clear() {
+	lock_guard<mutex> lock(s_mtx);
+	s_entries.clear();
+	s_tet_entries.clear();
+}
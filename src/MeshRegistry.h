@@ -0,0 +1,30 @@
+#pragma once
+// MeshRegistry Process-wide table of the loaded shapes and tetrahedralized meshes
+//    Every mesh file is loaded once and the Shape is shared by everything that draws it. Every
+//    TetMesh is tetrahedralized or mapped from the AssetCache once and shared by the soft bodies
+//    built from it, e.g. by the members of an Ensemble and by a World::clone(). Shared objects
+//    must not be modified after loading. Safe to call from several threads; concurrent requests
+//    for the same file wait for a single load.
+
+#ifndef REDUCEDCOORD_SRC_MESHREGISTRY_H_
+#define REDUCEDCOORD_SRC_MESHREGISTRY_H_
+
+#include <memory>
+#include <string>
+
+class Shape;
+class TetMesh;
+
+class MeshRegistry
+{
+public:
+	static std::shared_ptr<Shape> getShape(const std::string &meshName);
+	// See TetMesh::load() and TetMesh::loadBox()
+	static std::shared_ptr<const TetMesh> getTetMesh(const std::string &RESOURCE_DIR, const std::string &MESH_NAME, const std::string &TETGEN_FLAGS, bool isAdditionalNodes);
+	static std::shared_ptr<const TetMesh> getTetBox(double sx, double sy, double sz, const std::string &TETGEN_FLAGS);
+
+	// Drops the registry's references, shapes still in use stay alive
+	static void clear();
+};
+
+#endif // REDUCEDCOORD_SRC_MESHREGISTRY_H_
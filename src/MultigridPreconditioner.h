@@ -0,0 +1,178 @@
+#pragma once
+// MultigridPreconditioner Geometric multigrid V-cycle for the FEM part of the reduced system
+//    The hierarchy is given as a list of prolongation matrices P_l (fine x coarse) built from
+//    barycentric weights of coarser tet meshes. Coarse operators are Galerkin products
+//    A_{l+1} = P_l' * A_l * P_l, smoothing is symmetric Gauss-Seidel and the coarsest level
+//    is factorized directly. If the matrix has trailing constraint rows, they are handled
+//    with the approximate Schur complement S = G diag(A)^-1 G', factorized sparse.
+
+#ifndef REDUCEDCOORD_SRC_MULTIGRIDPRECONDITIONER_H_
+#define REDUCEDCOORD_SRC_MULTIGRIDPRECONDITIONER_H_
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#define EIGEN_USE_MKL_ALL
+
+#include <Eigen/Sparse>
+#include <Eigen/Dense>
+#include <Eigen/SparseCholesky>
+
+#include <vector>
+
+template <typename _Scalar>
+class MultigridPreconditioner
+{
+public:
+	typedef _Scalar Scalar;
+	typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+	typedef Eigen::SparseMatrix<Scalar> SpMat;
+	typedef Eigen::SparseMatrix<Scalar, Eigen::RowMajor> SpMatRow;
+	typedef int StorageIndex;
+
+	enum {
+		ColsAtCompileTime = Eigen::Dynamic,
+		MaxColsAtCompileTime = Eigen::Dynamic
+	};
+
+	MultigridPreconditioner() : m_isInitialized(false), m_isSchurFactored(false), m_nsmooth(2), m_nA_set(0), m_nA(0), m_nG(0) {}
+
+	template<typename MatType>
+	MultigridPreconditioner& analyzePattern(const MatType&) { return *this; }
+
+	template<typename MatType>
+	MultigridPreconditioner& factorize(const MatType &mat) { return compute(mat); }
+
+	template<typename MatType>
+	MultigridPreconditioner& compute(const MatType &mat)
+	{
+		// The reduced block is the leading nA x nA part, the rest are constraint rows
+		m_nA = (m_nA_set > 0) ? m_nA_set : (StorageIndex)mat.rows();
+		m_nG = (StorageIndex)mat.rows() - m_nA;
+
+		int nlevels = (int)m_prolongations.size() + 1;
+		m_A.resize(nlevels);
+		m_invdiag.resize(nlevels);
+
+		SpMat A = SpMat(mat).topLeftCorner(m_nA, m_nA);
+		for (int l = 0; l < nlevels; ++l) {
+			if (l > 0) {
+				const SpMat &P = m_prolongations[l - 1];
+				SpMat PtA = P.transpose() * A;
+				A = PtA * P;
+			}
+			A.makeCompressed();
+			m_A[l] = A;
+			m_invdiag[l] = A.diagonal();
+			for (int i = 0; i < m_invdiag[l].size(); ++i) {
+				m_invdiag[l](i) = (m_invdiag[l](i) != Scalar(0)) ? Scalar(1) / m_invdiag[l](i) : Scalar(1);
+			}
+		}
+
+		m_coarse_solver.compute(A);
+		m_isInitialized = true;
+		return *this;
+	}
+
+	Eigen::Index rows() const { return m_nA + m_nG; }
+	Eigen::Index cols() const { return m_nA + m_nG; }
+
+	inline const Vector solve(const Vector &b) const
+	{
+		Vector x(b.rows());
+		x.topRows(m_nA) = vcycle(0, b.topRows(m_nA));
+		if (m_nG > 0) {
+			if (m_isSchurFactored) {
+				x.bottomRows(m_nG) = m_schur_solver.solve(b.bottomRows(m_nG));
+			}
+			else {
+				x.bottomRows(m_nG) = m_schur_invdiag.cwiseProduct(b.bottomRows(m_nG));
+			}
+		}
+		return x;
+	}
+
+	template<typename Rhs> inline const Eigen::Solve<MultigridPreconditioner, Rhs>
+	solve(const Eigen::MatrixBase<Rhs> &b) const
+	{
+		eigen_assert(m_isInitialized && "MultigridPreconditioner is not initialized.");
+		return Eigen::Solve<MultigridPreconditioner, Rhs>(*this, b.derived());
+	}
+
+	void setProlongations(const std::vector<SpMat> &prolongations) { m_prolongations = prolongations; }
+	void setASize(StorageIndex nA) { m_nA_set = nA; }
+	void setSmoothingSteps(int nsmooth) { m_nsmooth = nsmooth; }
+	// Schur complement of the constraint rows, its inverse diagonal is used if it is singular
+	void setSchurMatrix(const SpMat &S)
+	{
+		m_schur_solver.compute(S);
+		m_isSchurFactored = (m_schur_solver.info() == Eigen::Success);
+		if (!m_isSchurFactored) {
+			m_schur_invdiag = S.diagonal();
+			for (int i = 0; i < m_schur_invdiag.size(); ++i) {
+				m_schur_invdiag(i) = (m_schur_invdiag(i) != Scalar(0)) ? Scalar(1) / m_schur_invdiag(i) : Scalar(1);
+			}
+		}
+	}
+	int getLevelCount() const { return (int)m_A.size(); }
+
+	Eigen::ComputationInfo info() { return m_coarse_solver.info(); }
+
+protected:
+	Vector vcycle(int l, const Vector &b) const
+	{
+		if (l == (int)m_A.size() - 1) {
+			return m_coarse_solver.solve(b);
+		}
+
+		const SpMatRow &A = m_A[l];
+		const SpMat &P = m_prolongations[l];
+		Vector x = Vector::Zero(b.rows());
+
+		// Pre-smoothing, coarse grid correction, post-smoothing in reverse order
+		// so that the cycle stays symmetric for CG and MINRES
+		for (int k = 0; k < m_nsmooth; ++k) {
+			sweep(l, b, x, true);
+		}
+
+		Vector r = b - A * x;
+		Vector rc = P.transpose() * r;
+		x.noalias() += P * vcycle(l + 1, rc);
+
+		for (int k = 0; k < m_nsmooth; ++k) {
+			sweep(l, b, x, false);
+		}
+		return x;
+	}
+
+	void sweep(int l, const Vector &b, Vector &x, bool isForward) const
+	{
+		const SpMatRow &A = m_A[l];
+		const Vector &invdiag = m_invdiag[l];
+		int n = (int)A.rows();
+
+		for (int k = 0; k < n; ++k) {
+			int i = isForward ? k : n - 1 - k;
+			Scalar s = b(i);
+			for (typename SpMatRow::InnerIterator it(A, i); it; ++it) {
+				if (it.col() != i) {
+					s -= it.value() * x(it.col());
+				}
+			}
+			x(i) = s * invdiag(i);
+		}
+	}
+
+	std::vector<SpMat> m_prolongations;
+	std::vector<SpMatRow> m_A;
+	std::vector<Vector> m_invdiag;
+	Eigen::SimplicialLDLT<SpMat> m_coarse_solver;
+	Eigen::SimplicialLDLT<SpMat> m_schur_solver;
+	Vector m_schur_invdiag;
+	bool m_isInitialized;
+	bool m_isSchurFactored;
+	int m_nsmooth;
+	StorageIndex m_nA_set;
+	StorageIndex m_nA;
+	StorageIndex m_nG;
+};
+
+#endif // REDUCEDCOORD_SRC_MULTIGRIDPRECONDITIONER_H_
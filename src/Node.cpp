@@ -40,8 +40,7 @@ Node::Node(const shared_ptr<Shape> s) :
 
 void Node::load(const std::string &RESOURCE_DIR) {
 
-	sphere = make_shared<Shape>();
-	sphere->loadMesh(RESOURCE_DIR + "sphere2.obj");
+	sphere = MeshRegistry::getShape(RESOURCE_DIR + "sphere2.obj");
 
 }
 
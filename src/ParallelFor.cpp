@@ -0,0 +1,47 @@
+#include "rmpch.h"
+#include "ParallelFor.h"
+
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+static atomic<int> s_nthreads(0);
+static shared_ptr<ThreadPool> s_pool;
+static mutex s_mtx;
+
+static int getDefaultThreads() {
+	const char *env = getenv("REDMAX_NUM_THREADS");
+	if (env != nullptr && atoi(env) > 0) {
+		return atoi(env);
+	}
+	return max(1, (int)thread::hardware_concurrency());
+}
+
+void setParallelThreads(int nthreads) {
+	lock_guard<mutex> lock(s_mtx);
+	s_nthreads = (nthreads > 0) ? nthreads : getDefaultThreads();
+	s_pool.reset();
+}
+
+int getParallelThreads() {
+	int nthreads = s_nthreads;
+	if (nthreads == 0) {
+		lock_guard<mutex> lock(s_mtx);
+		if (s_nthreads == 0) {
+			s_nthreads = getDefaultThreads();
+		}
+		nthreads = s_nthreads;
+	}
+	return nthreads;
+}
+
+shared_ptr<ThreadPool> getParallelPool() {
+	int nthreads = getParallelThreads();
+	lock_guard<mutex> lock(s_mtx);
+	if (s_pool == nullptr) {
+		// The thread that waits on a loop runs chunks as well
+		s_pool = make_shared<ThreadPool>(max(1, nthreads - 1));
+	}
+	return s_pool;
+}
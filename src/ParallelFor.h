@@ -0,0 +1,92 @@
+#pragma once
+// ParallelFor Portable parallel loops
+//    Built with OpenMP (REDMAX_OPENMP) a loop becomes an omp parallel for, otherwise its range
+//    is split into chunks that run on the shared ThreadPool. The number of threads comes from
+//    the REDMAX_NUM_THREADS environment variable or the hardware, see setParallelThreads().
+//    With OpenMP a loop called from inside a pool task runs serially.
+
+#ifndef REDUCEDCOORD_SRC_PARALLELFOR_H_
+#define REDUCEDCOORD_SRC_PARALLELFOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#ifdef REDMAX_OPENMP
+#include <omp.h>
+#endif
+
+#include "ThreadPool.h"
+
+// Smallest number of iterations worth handing to a thread
+const int MIN_ITERATOR_NUM = 4;
+
+// nthreads <= 0 restores the default. Must not be called while a loop is running.
+void setParallelThreads(int nthreads);
+int getParallelThreads();
+
+// The pool behind parallelFor(), also used for the step assembly
+std::shared_ptr<ThreadPool> getParallelPool();
+
+// Number of chunks for n iterations of at least min_n iterations each. Up to two chunks
+// per thread so that uneven iterations still balance.
+inline int getThreadsNumber(int n, int min_n) {
+	int nthreads = getParallelThreads();
+	if (nthreads <= 1) {
+		return 1;
+	}
+	int max_tn = n / min_n;
+	int tn = max_tn > 2 * nthreads ? 2 * nthreads : max_tn;
+	if (tn < 1) {
+		tn = 1;
+	}
+	return tn;
+}
+
+// Calls body(i) for i in [begin, end). Iterations must be independent.
+template <typename Func>
+void parallelFor(int begin, int end, const Func &body, int grain = MIN_ITERATOR_NUM)
+{
+	int n = end - begin;
+	int nchunks = getThreadsNumber(n, grain);
+	if (nchunks <= 1) {
+		for (int i = begin; i < end; ++i) {
+			body(i);
+		}
+		return;
+	}
+
+#ifdef REDMAX_OPENMP
+	// Inside a task graph task the other workers are already busy, so do not open an OpenMP
+	// team on top of them
+	if (ThreadPool::isRunningTask()) {
+		for (int i = begin; i < end; ++i) {
+			body(i);
+		}
+		return;
+	}
+	int nthreads = std::min(nchunks, getParallelThreads());
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+	for (int i = begin; i < end; ++i) {
+		body(i);
+	}
+#else
+	std::shared_ptr<ThreadPool> pool = getParallelPool();
+	ThreadPool *p = pool.get();
+	std::atomic<int> remaining(nchunks);
+	for (int c = 0; c < nchunks; ++c) {
+		int b = begin + (int)((long long)n * c / nchunks);
+		int e = begin + (int)((long long)n * (c + 1) / nchunks);
+		p->push([&body, &remaining, p, b, e]() {
+			for (int i = b; i < e; ++i) {
+				body(i);
+			}
+			if (--remaining == 0) {
+				p->notify();
+			}
+		});
+	}
+	p->wait(remaining);
+#endif
+}
+
+#endif // REDUCEDCOORD_SRC_PARALLELFOR_H_
@@ -0,0 +1,301 @@
+#include "rmpch.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+using namespace std;
+
+// Zones are never removed, so the slots below s_nzones are read without the lock
+static const int MAX_ZONES = 256;
+// Per thread cap of the trace, later events are dropped
+static const size_t MAX_EVENTS = 1 << 22;
+
+struct ProfileZone {
+	string name;
+	atomic<long long> time;
+	atomic<long long> count;
+};
+
+struct ProfileEvent {
+	int zone;
+	long long start;
+	long long end;
+};
+
+struct ProfileThread {
+	int tid;
+	vector<ProfileEvent> events;
+};
+
+static ProfileZone s_zones[MAX_ZONES];
+static atomic<int> s_nzones(0);
+static atomic<bool> s_trace(false);
+static mutex s_mtx;
+static string s_prefix;
+static long long s_origin = 0;
+// Totals at the end of the last step, and the time and calls of every step
+static vector<long long> s_last_time;
+static vector<long long> s_last_count;
+static vector<vector<long long> > s_step_time;
+static vector<vector<long long> > s_step_count;
+// Totals at the last reset
+static vector<long long> s_reset_time;
+static vector<long long> s_reset_count;
+static vector<unique_ptr<ProfileThread> > s_threads;
+static thread_local ProfileThread *t_thread = nullptr;
+
+atomic<bool> Profiler::s_enabled(false);
+
+static void writeAtExit() {
+	Profiler::write();
+}
+
+static bool initFromEnvironment() {
+	const char *env = getenv("REDMAX_PROFILE");
+	if (env != nullptr && env[0] != '\0') {
+		const char *trace = getenv("REDMAX_PROFILE_TRACE");
+		Profiler::setOutput(env, trace != nullptr && atoi(trace) != 0);
+	}
+	return true;
+}
+static bool s_init = initFromEnvironment();
+
+long long Profiler::now() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int Profiler::registerZone(const char *name) {
+	lock_guard<mutex> lock(s_mtx);
+	int n = s_nzones.load(memory_order_relaxed);
+	for (int i = 0; i < n; ++i) {
+		if (s_zones[i].name == name) {
+			return i;
+		}
+	}
+	if (n == MAX_ZONES - 1) {
+		// The last slot collects every zone past the limit
+		if (s_zones[n].name.empty()) {
+			s_zones[n].name = "other";
+		}
+		return n;
+	}
+	s_zones[n].name = name;
+	s_zones[n].time = 0;
+	s_zones[n].count = 0;
+	s_nzones.store(n + 1, memory_order_release);
+	return n;
+}
+
+void Profiler::record(int zone, long long start, long long end) {
+	s_zones[zone].time.fetch_add(end - start, memory_order_relaxed);
+	s_zones[zone].count.fetch_add(1, memory_order_relaxed);
+
+	if (s_trace.load(memory_order_relaxed)) {
+		if (t_thread == nullptr) {
+			lock_guard<mutex> lock(s_mtx);
+			s_threads.push_back(unique_ptr<ProfileThread>(new ProfileThread()));
+			t_thread = s_threads.back().get();
+			t_thread->tid = (int)s_threads.size() - 1;
+		}
+		if (t_thread->events.size() < MAX_EVENTS) {
+			ProfileEvent event = { zone, start, end };
+			t_thread->events.push_back(event);
+		}
+	}
+}
+
+// Adds the row of the current step, with s_mtx held
+static void endStepLocked() {
+	int n = min(s_nzones.load(memory_order_acquire) + 1, MAX_ZONES);
+	s_last_time.resize(n, 0);
+	s_last_count.resize(n, 0);
+
+	vector<long long> time(n), count(n);
+	bool isEmpty = true;
+	for (int i = 0; i < n; ++i) {
+		long long t = s_zones[i].time.load(memory_order_relaxed);
+		long long c = s_zones[i].count.load(memory_order_relaxed);
+		time[i] = t - s_last_time[i];
+		count[i] = c - s_last_count[i];
+		s_last_time[i] = t;
+		s_last_count[i] = c;
+		if (count[i] > 0) {
+			isEmpty = false;
+		}
+	}
+	if (!isEmpty) {
+		s_step_time.push_back(time);
+		s_step_count.push_back(count);
+	}
+}
+
+void Profiler::endStep() {
+	if (!isEnabled()) {
+		return;
+	}
+	lock_guard<mutex> lock(s_mtx);
+	endStepLocked();
+}
+
+void Profiler::setOutput(const string &PREFIX, bool isTrace) {
+	static bool isRegistered = false;
+	lock_guard<mutex> lock(s_mtx);
+	s_prefix = PREFIX;
+	s_trace = isTrace && !PREFIX.empty();
+	s_enabled = !PREFIX.empty();
+	if (s_origin == 0) {
+		s_origin = now();
+	}
+	if (!isRegistered && !PREFIX.empty()) {
+		atexit(writeAtExit);
+		isRegistered = true;
+	}
+}
+
+void Profiler::reset() {
+	lock_guard<mutex> lock(s_mtx);
+	int n = min(s_nzones.load(memory_order_acquire) + 1, MAX_ZONES);
+	s_last_time.resize(n);
+	s_last_count.resize(n);
+	for (int i = 0; i < n; ++i) {
+		s_last_time[i] = s_zones[i].time.load(memory_order_relaxed);
+		s_last_count[i] = s_zones[i].count.load(memory_order_relaxed);
+	}
+	s_reset_time = s_last_time;
+	s_reset_count = s_last_count;
+	s_step_time.clear();
+	s_step_count.clear();
+	for (int i = 0; i < (int)s_threads.size(); ++i) {
+		s_threads[i]->events.clear();
+	}
+	s_origin = now();
+}
+
+void Profiler::setEnabled(bool isEnabled) {
+	lock_guard<mutex> lock(s_mtx);
+	s_enabled = isEnabled;
+	if (s_origin == 0) {
+		s_origin = now();
+	}
+}
+
+void Profiler::getTotals(vector<ProfileTotal> &totals) {
+	lock_guard<mutex> lock(s_mtx);
+	totals.clear();
+	int n = min(s_nzones.load(memory_order_acquire) + 1, MAX_ZONES);
+	for (int i = 0; i < n; ++i) {
+		long long t = s_zones[i].time.load(memory_order_relaxed) - (i < (int)s_reset_time.size() ? s_reset_time[i] : 0);
+		long long c = s_zones[i].count.load(memory_order_relaxed) - (i < (int)s_reset_count.size() ? s_reset_count[i] : 0);
+		if (c > 0) {
+			ProfileTotal total;
+			total.name = s_zones[i].name;
+			total.calls = c;
+			total.ms = t * 1e-6;
+			totals.push_back(total);
+		}
+	}
+}
+
+static string escape(const string &s) {
+	string e;
+	for (int i = 0; i < (int)s.size(); ++i) {
+		if (s[i] == '"' || s[i] == '\\') {
+			e += '\\';
+		}
+		e += s[i];
+	}
+	return e;
+}
+
+void Profiler::write() {
+	// Zones still running are not in the files
+	lock_guard<mutex> lock(s_mtx);
+	if (s_prefix.empty()) {
+		return;
+	}
+	endStepLocked();
+
+	int nsteps = (int)s_step_time.size();
+	int nzones = (int)s_last_time.size();
+	vector<int> zones;
+	for (int i = 0; i < nzones; ++i) {
+		if (!s_zones[i].name.empty()) {
+			zones.push_back(i);
+		}
+	}
+
+	// One row per step, milliseconds per zone
+	string file = s_prefix + ".csv";
+	FILE *out = fopen(file.c_str(), "w");
+	if (out == nullptr) {
+		cerr << "Profiler: cannot open " << file << endl;
+		return;
+	}
+	fprintf(out, "step");
+	for (int i : zones) {
+		fprintf(out, ",%s", s_zones[i].name.c_str());
+	}
+	fprintf(out, "\n");
+	for (int k = 0; k < nsteps; ++k) {
+		fprintf(out, "%d", k);
+		for (int i : zones) {
+			long long t = i < (int)s_step_time[k].size() ? s_step_time[k][i] : 0;
+			fprintf(out, ",%.6f", t * 1e-6);
+		}
+		fprintf(out, "\n");
+	}
+	fclose(out);
+
+	// Totals of the run
+	file = s_prefix + ".json";
+	out = fopen(file.c_str(), "w");
+	if (out == nullptr) {
+		cerr << "Profiler: cannot open " << file << endl;
+		return;
+	}
+	fprintf(out, "{\n\t\"steps\": %d,\n\t\"zones\": [", nsteps);
+	for (int j = 0; j < (int)zones.size(); ++j) {
+		int i = zones[j];
+		long long total = 0, calls = 0, maxstep = 0;
+		for (int k = 0; k < nsteps; ++k) {
+			if (i < (int)s_step_time[k].size()) {
+				total += s_step_time[k][i];
+				calls += s_step_count[k][i];
+				maxstep = max(maxstep, s_step_time[k][i]);
+			}
+		}
+		fprintf(out, "%s\n\t\t{\"name\": \"%s\", \"calls\": %lld, \"total_ms\": %.6f, \"mean_ms_per_step\": %.6f, \"max_ms_per_step\": %.6f}",
+			j == 0 ? "" : ",", escape(s_zones[i].name).c_str(), calls, total * 1e-6,
+			nsteps > 0 ? total * 1e-6 / nsteps : 0.0, maxstep * 1e-6);
+	}
+	fprintf(out, "\n\t]\n}\n");
+	fclose(out);
+
+	if (!s_trace) {
+		return;
+	}
+
+	// Complete events in microseconds, one track per thread
+	file = s_prefix + ".trace.json";
+	out = fopen(file.c_str(), "w");
+	if (out == nullptr) {
+		cerr << "Profiler: cannot open " << file << endl;
+		return;
+	}
+	fprintf(out, "{\"traceEvents\": [");
+	bool isFirst = true;
+	for (int t = 0; t < (int)s_threads.size(); ++t) {
+		const vector<ProfileEvent> &events = s_threads[t]->events;
+		for (int k = 0; k < (int)events.size(); ++k) {
+			const ProfileEvent &e = events[k];
+			fprintf(out, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+				isFirst ? "" : ",", escape(s_zones[e.zone].name).c_str(), s_threads[t]->tid,
+				(e.start - s_origin) * 1e-3, (e.end - e.start) * 1e-3);
+			isFirst = false;
+		}
+	}
+	fprintf(out, "\n]}\n");
+	fclose(out);
+}
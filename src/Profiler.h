@@ -0,0 +1,87 @@
+#pragma once
+// Profiler Named zones timed per step and per run
+//    PROFILE_ZONE("name") times the rest of the enclosing scope, PROFILE_STEP() closes the
+//    current simulation step. Zones with the same name are summed, also across threads. At the
+//    end of the run the profile is written as a CSV with a row per step, a JSON summary per
+//    zone, and optionally a Chrome trace (chrome://tracing or Perfetto) with an event per zone
+//    entry. Zones are compiled in with REDMAX_PROFILE; without it the macros are empty. At run
+//    time profiling is off unless $REDMAX_PROFILE names the output prefix (add
+//    $REDMAX_PROFILE_TRACE=1 for the trace) or setOutput() is called, and a zone then costs a
+//    single branch.
+
+#ifndef REDUCEDCOORD_SRC_PROFILER_H_
+#define REDUCEDCOORD_SRC_PROFILER_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct ProfileTotal
+{
+	std::string name;
+	long long calls;
+	double ms;
+};
+
+class Profiler
+{
+public:
+	static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	// Id of the zone with this name, registered on the first call
+	static int registerZone(const char *name);
+
+	static long long now();
+	static void record(int zone, long long start, long long end);
+
+	// Ends the current step, steps in which nothing was timed are skipped
+	static void endStep();
+
+	// Starts profiling into PREFIX.csv, PREFIX.json and with isTrace PREFIX.trace.json,
+	// an empty prefix stops it
+	static void setOutput(const std::string &PREFIX, bool isTrace = false);
+	// Writes the files, also done at exit
+	static void write();
+	// Forgets the steps and events recorded so far
+	static void reset();
+
+	// Times the zones without writing any file, for callers that read the totals
+	static void setEnabled(bool isEnabled);
+	// Zones entered since the last reset
+	static void getTotals(std::vector<ProfileTotal> &totals);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+class ProfileScope
+{
+public:
+	ProfileScope(int zone) : m_zone(zone), m_start(Profiler::isEnabled() ? Profiler::now() : -1) {}
+	~ProfileScope() {
+		if (m_start >= 0) {
+			Profiler::record(m_zone, m_start, Profiler::now());
+		}
+	}
+
+private:
+	ProfileScope(const ProfileScope &);
+	ProfileScope & operator=(const ProfileScope &);
+
+	int m_zone;
+	long long m_start;
+};
+
+#ifdef REDMAX_PROFILE
+#define REDMAX_PROFILE_CONCAT_(a, b) a##b
+#define REDMAX_PROFILE_CONCAT(a, b) REDMAX_PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(NAME) \
+	static const int REDMAX_PROFILE_CONCAT(profile_zone_, __LINE__) = Profiler::registerZone(NAME); \
+	ProfileScope REDMAX_PROFILE_CONCAT(profile_scope_, __LINE__)(REDMAX_PROFILE_CONCAT(profile_zone_, __LINE__))
+#define PROFILE_STEP() Profiler::endStep()
+#else
+#define PROFILE_ZONE(NAME)
+#define PROFILE_STEP()
+#endif
+
+#endif // REDUCEDCOORD_SRC_PROFILER_H_
@@ -217,14 +217,6 @@ static MSKrescodee __setupMosekEnvIfNeeded() {
 	return result;
 }
 
-static MSKtask_t __mosek_task = NULL;
-static MSKtask_t __getMosekTask() {
-	return __mosek_task;
-}
-static void __setMosekTask(const MSKtask_t &task) {
-	__mosek_task = task;
-}
-
 /// Used as logging output for our quadratic program
 static void MSKAPI __mosekLog(void *handle, MSKCONST char str[]) {
 #ifdef _MEX_
@@ -246,9 +238,14 @@ QuadProgMosek::QuadProgMosek() : QuadProg() {
 	numCons = 0;
 	numIneqs = 0;
 	numEqs = 0;
+	task = NULL;
 }
 
-QuadProgMosek::~QuadProgMosek() {}
+QuadProgMosek::~QuadProgMosek() {
+	if (task != NULL) {
+		MSK_deletetask(&task);
+	}
+}
 
 ///
 ///
@@ -359,7 +356,6 @@ bool QuadProgMosek::solve() {
 
 	//MSKrescodee   r = __setupMosekEnvIfNeeded();
 	MSKenv_t      env = __getMosekEnv();
-	MSKtask_t     task = __getMosekTask();
 
 	DoNextTask(true).doNext([&]() {
 		MSKrescodee result = MSK_RES_OK;
@@ -368,9 +364,7 @@ bool QuadProgMosek::solve() {
 		}
 		return result;
 	}).doNext([&]() {
-		MSKrescodee result = MSK_maketask(env, kNumCons, kNumVars, &task);
-		__setMosekTask(task);
-		return result;
+		return MSK_maketask(env, kNumCons, kNumVars, &task);
 	}).doNext([&]() {
 		// Log to stdout, file, or none
 		//return MSK_linkfunctotaskstream(task, MSK_STREAM_LOG, NULL, __mosekLog);
@@ -542,7 +536,6 @@ Eigen::VectorXd QuadProgMosek::getPrimalSolution() {
 
 	Eigen::VectorXd x(numVars);
 
-	MSKtask_t task = __getMosekTask();
 	if (task == NULL) {
 		return x;
 	}
@@ -558,7 +551,6 @@ Eigen::VectorXd QuadProgMosek::getDualInequality() {
 
 	Eigen::VectorXd y(numIneqs);
 
-	MSKtask_t task = __getMosekTask();
 	if (task == NULL) {
 		return y;
 	}
@@ -585,7 +577,6 @@ Eigen::VectorXd QuadProgMosek::getDualEquality() {
 
 	Eigen::VectorXd y(numEqs);
 
-	MSKtask_t task = __getMosekTask();
 	if (task == NULL) {
 		return y;
 	}
@@ -612,7 +603,6 @@ Eigen::VectorXd QuadProgMosek::getDualLower() {
 
 	Eigen::VectorXd y(numVars);
 
-	MSKtask_t task = __getMosekTask();
 	if (task == NULL) {
 		return y;
 	}
@@ -637,7 +627,6 @@ Eigen::VectorXd QuadProgMosek::getDualUpper() {
 
 	Eigen::VectorXd y(numVars);
 
-	MSKtask_t task = __getMosekTask();
 	if (task == NULL) {
 		return y;
 	}
@@ -40,6 +40,10 @@ private:
 	std::map<MSKiparame, MSKint32t> paramsInt;
 	std::map<MSKdparame, MSKrealt> paramsDouble;
 
+	// Kept until the next solve for the solution getters, one per program so that solvers
+	// in different threads do not share it
+	MSKtask_t task;
+
 public:
 
 	QuadProgMosek();
@@ -14,6 +14,11 @@
 #include "DeformableSpring.h"
 #include "SoftBody.h"
 #include "MeshEmbedding.h"
+#include "Profiler.h"
+#include "Telemetry.h"
+#include "SystemCapture.h"
+#include "Checkpoint.h"
+#include "Islands.h"
 
 using namespace std;
 using namespace Eigen;
@@ -21,7 +26,6 @@ using json = nlohmann::json;
 
 #include <unsupported/Eigen/MatrixFunctions> // TODO: avoid using this later, write a func instead
 
-BrenderManager *brender;
 //#define EXPORT_STARFISH_BONES
 //#define EXPORT_RIGIDS
 #define EXPORT_SOFT
@@ -32,7 +36,8 @@ Scene::Scene() :
 	t(0.0),
 	h(1e-2),
 	drawHz(10),
-    grav(0.0, 0.0, 0.0)
+    grav(0.0, 0.0, 0.0),
+	torend(0)
 {
 }
 
@@ -56,16 +61,32 @@ void Scene::load(const string &RESOURCE_DIR)
 	m_world->load(RESOURCE_DIR);
 
 	//m_solver = make_shared<SolverDense>(m_world, REDMAX_EULER);
-	m_solver = make_shared<SolverSparse>(m_world, REDMAX_EULER, LU);
+	auto solver = make_shared<SolverSparse>(m_world, REDMAX_EULER, LU);
+	solver->setTelemetry(Telemetry::fromEnvironment());
+	solver->setCapture(SystemCapture::fromEnvironment());
+	solver->setIslands(Islands::fromEnvironment());
+	m_solver = solver;
+
+	const char *checkpoint = getenv("REDMAX_CHECKPOINT");
+	if (checkpoint != nullptr) {
+		m_checkpoint_file = checkpoint;
+	}
+	const char *every = getenv("REDMAX_CHECKPOINT_EVERY");
+	if (every != nullptr) {
+		m_checkpoint_every = max(1, atoi(every));
+	}
 
-	brender = BrenderManager::getInstance();
+	brender = make_shared<BrenderManager>();
 	brender->add(m_world);	
 	brender->setExportDir("D:/Research/Muscles/Projects/ReducedCoordRigidBodyFEM/resources/brender/");
 #ifdef EXPORT_RIGIDS
 	brender->setExportDir("D:/Research/Muscles/Projects/ReducedCoordRigidBodyFEM/resources/hand/");
 
-	m_world->export_part = 0;
-	brender->exportBrender(t);
+	// A resumed run keeps the header and the frames already in the file, see loadCheckpoint()
+	if (m_checkpoint_file.empty() || !ifstream(m_checkpoint_file.c_str()).good()) {
+		m_world->export_part = 0;
+		brender->exportBrender(t);
+	}
 	m_world->export_part = 1;
 
 #endif // EXPORT_RIGIDS
@@ -98,6 +119,69 @@ void Scene::init()
 	drawH = 1.0 / drawHz;
 	search_idx = 0;
 
+	if (!m_checkpoint_file.empty() && ifstream(m_checkpoint_file.c_str()).good()) {
+		if (!loadCheckpoint()) {
+			exit(1);
+		}
+		cout << "Resumed from " << m_checkpoint_file << " at t = " << t << endl;
+	}
+}
+
+void Scene::saveCheckpoint()
+{
+	PROFILE_ZONE("Scene::checkpoint");
+	Checkpoint checkpoint;
+	vector<double> &scene = checkpoint.get("scene");
+	scene.push_back(t);
+	scene.push_back(count);
+	scene.push_back(torend);
+	scene.push_back(brender->getFrame());
+	checkpoint.set("y", y);
+	// The frames up to the counter must be on disk before the checkpoint says so
+	map<string, double> sizes;
+	brender->getAppendSizes(sizes);
+	for (auto it = sizes.begin(); it != sizes.end(); ++it) {
+		checkpoint.get("append " + it->first).push_back(it->second);
+	}
+	m_world->saveState(checkpoint.get("world"));
+	auto solver = dynamic_pointer_cast<SolverSparse>(m_solver);
+	if (solver != nullptr) {
+		solver->saveState(checkpoint.get("solver"));
+	}
+	checkpoint.write(m_checkpoint_file);
+}
+
+bool Scene::loadCheckpoint()
+{
+	Checkpoint checkpoint;
+	vector<double> scene, world, state;
+	VectorXd y1;
+	if (!checkpoint.read(m_checkpoint_file) || !checkpoint.get("scene", scene) || scene.size() != 4 ||
+		!checkpoint.get("y", y1) || y1.size() != y.size() || !checkpoint.get("world", world) ||
+		!m_world->restoreState(world)) {
+		cerr << "Scene: " << m_checkpoint_file << " does not belong to this scene" << endl;
+		return false;
+	}
+	auto solver = dynamic_pointer_cast<SolverSparse>(m_solver);
+	if (solver != nullptr && checkpoint.get("solver", state) && !solver->restoreState(state)) {
+		return false;
+	}
+	t = scene[0];
+	count = (int)scene[1];
+	torend = (int)scene[2];
+	// The exports continue from the frame of the checkpoint, the frames a crashed run wrote
+	// after it are cut off
+	map<string, double> sizes;
+	const string prefix = "append ";
+	const map<string, vector<double> > &sections = checkpoint.getSections();
+	for (auto it = sections.begin(); it != sections.end(); ++it) {
+		if (it->first.compare(0, prefix.size(), prefix) == 0 && it->second.size() == 1) {
+			sizes[it->first.substr(prefix.size())] = it->second[0];
+		}
+	}
+	brender->resume((int)scene[3], sizes);
+	y = y1;
+	return true;
 }
 
 void Scene::reset()
@@ -110,9 +194,11 @@ void Scene::solve() {
 
 }
 
-int torend = 0;
 void Scene::step()
 {	
+	// A step lasts until the next call, so that the export below is part of it
+	PROFILE_STEP();
+	PROFILE_ZONE("Scene::step");
 	//int n_steps = m_solution->getNsteps();
 #ifdef EXPORT_COARSE_MESH
 	t += 0.1;
@@ -169,6 +255,7 @@ void Scene::step()
 		}
 	 }
 	if (t > 150.0) {
+		brender->close();
 		exit(1);
 	}
 #endif // EXPORT_COARSE_MESH
@@ -183,6 +270,7 @@ void Scene::step()
 	if (t > 50.0) {
 		m_world->export_part = 2;
 		brender->exportBrender(t);
+		brender->close();
 		exit(1);
 	}
 #endif	
@@ -197,10 +285,14 @@ void Scene::step()
 	if (t > 150.0) {
 		m_world->export_part = 2;
 		brender->exportBrender(t);
+		brender->close();
 		exit(1);
 	}
 #endif
 
+	if (!m_checkpoint_file.empty() && torend % m_checkpoint_every == 0) {
+		saveCheckpoint();
+	}
 }
 
 void Scene::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, const shared_ptr<Program> progSoft, shared_ptr<MatrixStack> P) const
@@ -21,6 +21,7 @@ class Joint;
 class Vector;
 class Stepper;
 class World;
+class BrenderManager;
 struct Solution;
 
 class Scene
@@ -40,6 +41,10 @@ public:
 	double getTime() const { return t; }
 	Eigen::VectorXd y;
 private:
+	// See Checkpoint
+	void saveCheckpoint();
+	bool loadCheckpoint();
+
 	int count;
 	double t;
 	double h;
@@ -50,11 +55,15 @@ private:
 	//double tk;
 
 	Eigen::Vector3d grav;
+	int torend;		// steps since load, paces the exports
+	std::string m_checkpoint_file;	// empty when the run is not checkpointed
+	int m_checkpoint_every;
 
 	nlohmann::json js;
 	std::shared_ptr<World> m_world;
 	std::shared_ptr<Solver> m_solver;
 	std::shared_ptr<Solution> m_solution;
+	std::shared_ptr<BrenderManager> brender;
 };
 
 #endif // MUSCLEMASS_SRC_SCENE_H_
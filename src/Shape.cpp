@@ -3,9 +3,25 @@
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "AssetCache.h"
+
+#include <cstdint>
 
 using namespace std;
 
+// Bumped whenever the file layout or the meaning of the cached data changes
+static const uint32_t SHAPE_VERSION = 1;
+
+struct ShapeHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint32_t npos;
+	uint32_t nnor;
+	uint32_t ntex;
+	uint32_t pad;
+};
+
 Shape::Shape() :
 	posBufID(0),
 	norBufID(0),
@@ -18,6 +34,53 @@ Shape::~Shape()
 }
 
 void Shape::loadMesh(const string &meshName)
+{
+	unsigned long long hash = AssetCache::HASH_INIT;
+	AssetCache::hashBytes(hash, &SHAPE_VERSION, sizeof(SHAPE_VERSION));
+	string cache_file;
+	if (AssetCache::hashFile(hash, meshName)) {
+		cache_file = AssetCache::getFile(hash, ".shape");
+	}
+
+	if (!cache_file.empty()) {
+		MappedFile file;
+		ShapeHeader header;
+		if (file.open(cache_file) && file.size() >= sizeof(header)) {
+			memcpy(&header, file.data(), sizeof(header));
+			size_t n = (size_t)header.npos + header.nnor + header.ntex;
+			if (memcmp(header.magic, "RMSH", 4) == 0 && header.version == SHAPE_VERSION && header.hash == hash &&
+				file.size() == sizeof(header) + n * sizeof(float)) {
+				const float *data = (const float *)(file.data() + sizeof(header));
+				posBuf.assign(data, data + header.npos);
+				norBuf.assign(data + header.npos, data + header.npos + header.nnor);
+				texBuf.assign(data + header.npos + header.nnor, data + n);
+				return;
+			}
+		}
+	}
+
+	loadObj(meshName);
+
+	if (!cache_file.empty() && !posBuf.empty()) {
+		ShapeHeader header;
+		memcpy(header.magic, "RMSH", 4);
+		header.version = SHAPE_VERSION;
+		header.hash = hash;
+		header.npos = (uint32_t)posBuf.size();
+		header.nnor = (uint32_t)norBuf.size();
+		header.ntex = (uint32_t)texBuf.size();
+		header.pad = 0;
+
+		vector<pair<const void *, size_t> > blocks;
+		blocks.push_back(make_pair((const void *)&header, sizeof(header)));
+		blocks.push_back(make_pair((const void *)posBuf.data(), posBuf.size() * sizeof(float)));
+		blocks.push_back(make_pair((const void *)norBuf.data(), norBuf.size() * sizeof(float)));
+		blocks.push_back(make_pair((const void *)texBuf.data(), texBuf.size() * sizeof(float)));
+		AssetCache::write(cache_file, blocks);
+	}
+}
+
+void Shape::loadObj(const string &meshName)
 {
 	// Load geometry
 	tinyobj::attrib_t attrib;
@@ -65,6 +128,14 @@ void Shape::loadMesh(const string &meshName)
 
 void Shape::init()
 {
+	if (posBufID != 0) {
+		// Shared shapes are initialized by their first user
+		return;
+	}
+	if (GLSL::isHeadless()) {
+		return;
+	}
+
 	// Send the position array to the GPU
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
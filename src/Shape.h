@@ -20,11 +20,15 @@ class Shape
 public:
 	Shape();
 	virtual ~Shape();
+	// Parses the OBJ file, or reads the binary copy of an earlier run from the AssetCache
 	void loadMesh(const std::string &meshName);
+	// Uploads the buffers once, later calls do nothing
 	void init();
 	void draw(const std::shared_ptr<Program> prog) const;
 	
 private:
+	void loadObj(const std::string &meshName);
+
 	std::vector<float> posBuf;
 	std::vector<float> norBuf;
 	std::vector<float> texBuf;
@@ -1,6 +1,4 @@
 #include "rmpch.h"
-#define TETLIBRARY
-#include <tetgen.h>
 
 #include "SoftBody.h"
 
@@ -12,6 +10,12 @@
 #include "TetrahedronCorotational.h"
 #include "TetrahedronInvertible.h"
 #include "Line.h"
+#include "MeshRegistry.h"
+#include "TetMesh.h"
+#include "ParallelFor.h"
+#include "Profiler.h"
+#include <limits>
+#include <typeinfo>
 
 using namespace std;
 using namespace Eigen;
@@ -22,7 +26,10 @@ SoftBody::SoftBody(): m_isInvertible(true), m_isGravity(false), m_isElasticForce
 	m_isInverted = false;
 	m_isCollisionWithFloor = false;
 	m_isCollided = false;
+	m_damping = 0.0;
 	m_npotentialcols = 0;
+	m_isNodeGridValid = false;
+	m_box_sides.setZero();
 }
 
 SoftBody::SoftBody(double density, double young, double poisson, Material material) :
@@ -33,33 +40,50 @@ SoftBody::SoftBody(double density, double young, double poisson, Material materi
 	m_isInverted = false;
 	m_isCollisionWithFloor = false;
 	m_isCollided = false;
+	m_damping = 0.0;
 
 	//m_isGravity = true;
 	m_type = 0;
 	m_npotentialcols = 0;
+	m_isNodeGridValid = false;
+	m_box_sides.setZero();
 }
 
 void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME, const string &TETGEN_FLAGS) {
+	m_resource_dir = RESOURCE_DIR;
+	m_mesh_name = MESH_NAME;
+	m_box_sides.setZero();
 
-	// Tetrahedralize 3D mesh
-	tetgenio input_mesh, output_mesh, additional_node;
-	input_mesh.load_ply((char *)(RESOURCE_DIR + MESH_NAME).c_str());
-	additional_node.load_node((char *)(RESOURCE_DIR + MESH_NAME + ".a").c_str());
-	tetrahedralize((char *)TETGEN_FLAGS.c_str(), &input_mesh, &output_mesh, &additional_node);//a10.0
+	// Tetrahedralize 3D mesh, or load the cached result
+	shared_ptr<const TetMesh> output_mesh = MeshRegistry::getTetMesh(RESOURCE_DIR, MESH_NAME, TETGEN_FLAGS, true);//a10.0
 		//"pqziVVVYa2.0"
-	output_mesh.save_nodes((char *)(RESOURCE_DIR + MESH_NAME + ".o").c_str());
-	output_mesh.save_elements((char *)(RESOURCE_DIR + MESH_NAME + ".o").c_str());
-	output_mesh.save_faces((char *)(RESOURCE_DIR + MESH_NAME + ".o").c_str());
+	build(RESOURCE_DIR, *output_mesh);
+}
+
+void SoftBody::loadBox(const string &RESOURCE_DIR, Vector3d sides, const string &TETGEN_FLAGS) {
+	m_resource_dir = RESOURCE_DIR;
+	m_mesh_name.clear();
+	m_box_sides = sides;
+
+	shared_ptr<const TetMesh> output_mesh = MeshRegistry::getTetBox(sides(0), sides(1), sides(2), TETGEN_FLAGS);
+	build(RESOURCE_DIR, *output_mesh);
+}
+
+void SoftBody::build(const string &RESOURCE_DIR, const TetMesh &output_mesh) {
+	m_isNodeGridValid = false;
+	const double *pointlist = output_mesh.getPoints();
+	const int *trifacelist = output_mesh.getFaces();
+	const int *tetrahedronlist = output_mesh.getTets();
 
 	double r = 0.01;
 
 	// Create Nodes
-	for (int i = 0; i < output_mesh.numberofpoints; i++) {
+	for (int i = 0; i < output_mesh.getNodeCount(); i++) {
 		auto node = make_shared<Node>();
 		node->r = r;
-		node->x0 << output_mesh.pointlist[3 * i + 0],
-			output_mesh.pointlist[3 * i + 1],
-			output_mesh.pointlist[3 * i + 2];
+		node->x0 << pointlist[3 * i + 0],
+			pointlist[3 * i + 1],
+			pointlist[3 * i + 2];
 
 		node->x = node->x0;
 		node->v0.setZero();
@@ -71,11 +95,11 @@ void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME, const s
 	}
 
 	// Create Faces
-	for (int i = 0; i < output_mesh.numberoftrifaces; i++) {
+	for (int i = 0; i < output_mesh.getFaceCount(); i++) {
 		auto triface = make_shared<FaceTriangle>();
 
 		for (int ii = 0; ii < 3; ii++) {
-			auto node = m_nodes[output_mesh.trifacelist[3 * i + ii]];
+			auto node = m_nodes[trifacelist[3 * i + ii]];
 			node->m_nfaces++;
 			triface->m_nodes.push_back(node);
 
@@ -91,10 +115,14 @@ void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME, const s
 
 	// Create Tets
 	vector<shared_ptr<Node>> tet_nodes;
-	for (int i = 0; i < output_mesh.numberoftetrahedra; i++) {
+	const vector<shared_ptr<Tetrahedron> > *rest = nullptr;
+	if (m_rest_source != nullptr && (int)m_rest_source->m_tets.size() == output_mesh.getTetCount()) {
+		rest = &m_rest_source->m_tets;
+	}
+	for (int i = 0; i < output_mesh.getTetCount(); i++) {
 		tet_nodes.clear();
 		for (int ii = 0; ii < 4; ii++) {
-			tet_nodes.push_back(m_nodes[output_mesh.tetrahedronlist[4 * i + ii]]);
+			tet_nodes.push_back(m_nodes[tetrahedronlist[4 * i + ii]]);
 		}
 
 		shared_ptr<Tetrahedron> tet;
@@ -110,7 +138,12 @@ void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME, const s
 		}
 
 		tet->i = i;
-		tet->precompute();
+		if (rest != nullptr && typeid(*(*rest)[i]) == typeid(*tet)) {
+			tet->precompute(*(*rest)[i]);
+		}
+		else {
+			tet->precompute();
+		}
 		//tet->setInvertiblity(m_isInvertible);
 		m_tets.push_back(tet);
 	}
@@ -132,6 +165,7 @@ void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME, const s
 			//triface->isFlat = true;
 		}
 	}
+	m_rest_source = nullptr;
 }
 
 void SoftBody::init() {
@@ -169,6 +203,10 @@ void SoftBody::init() {
 		eleBuf[3 * i + 2] = 3 * i + 2;
 	}
 
+	if (GLSL::isHeadless()) {
+		return;
+	}
+
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
 	glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
@@ -283,6 +321,7 @@ void SoftBody::transform(Vector3d dx) {
 		auto node = m_nodes[i];
 		node->x = node->x + dx;
 	}
+	m_isNodeGridValid = false;
 }
 
 void SoftBody::transform(Matrix4d E) {
@@ -290,6 +329,404 @@ void SoftBody::transform(Matrix4d E) {
 		auto node = m_nodes[i];
 		node->update(E);
 	}
+	m_isNodeGridValid = false;
+}
+
+const SpatialGrid & SoftBody::getNodeGrid() {
+	if (!m_isNodeGridValid) {
+		vector<Vector3d> x(m_nodes.size());
+		for (int i = 0; i < (int)m_nodes.size(); i++) {
+			x[i] = m_nodes[i]->x;
+		}
+		m_node_grid.build(x);
+		m_isNodeGridValid = true;
+	}
+	return m_node_grid;
+}
+
+void SoftBody::computeTetGrid(SpatialGrid &grid, bool isRest) const {
+	vector<Vector3d> lo(m_tets.size());
+	vector<Vector3d> hi(m_tets.size());
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		auto tet = m_tets[i];
+		lo[i] = hi[i] = isRest ? tet->m_nodes[0]->x0 : tet->m_nodes[0]->x;
+		for (int k = 1; k < 4; k++) {
+			const Vector3d &xk = isRest ? tet->m_nodes[k]->x0 : tet->m_nodes[k]->x;
+			lo[i] = lo[i].cwiseMin(xk);
+			hi[i] = hi[i].cwiseMax(xk);
+		}
+		// Points on a face still find the tet after rounding
+		double pad = 1.0e-6 * (hi[i] - lo[i]).maxCoeff();
+		lo[i].array() -= pad;
+		hi[i].array() += pad;
+	}
+	grid.build(lo, hi);
+}
+
+void SoftBody::addMultigridLevel(const string &TETGEN_FLAGS) {
+	// Levels only carry geometry for the prolongation, they are never simulated or drawn, so
+	// the tet mesh is kept as it is without nodes, tets or precomputation
+	shared_ptr<const TetMesh> level;
+	if (m_mesh_name.empty()) {
+		level = MeshRegistry::getTetBox(m_box_sides(0), m_box_sides(1), m_box_sides(2), TETGEN_FLAGS);
+	}
+	else {
+		level = MeshRegistry::getTetMesh(m_resource_dir, m_mesh_name, TETGEN_FLAGS, true);
+	}
+	m_mg_levels.push_back(level);
+}
+
+int SoftBody::getMultigridNodeCount(int level) const {
+	// Levels past the coarsest one available keep the coarsest mesh
+	if (level > (int)m_mg_levels.size()) {
+		level = (int)m_mg_levels.size();
+	}
+	if (level == 0) {
+		return (int)m_nodes.size();
+	}
+	return m_mg_levels[level - 1]->getNodeCount();
+}
+
+static Vector3d getRestPoint(const TetMesh &mesh, int i) {
+	const double *x = mesh.getPoints() + 3 * i;
+	return Vector3d(x[0], x[1], x[2]);
+}
+
+void SoftBody::computeMultigridProlongation(int level, int row, int col, vector<T> &P_) const {
+	// Maps the DOFs of multigrid level "level" (starting at col) to level - 1 (starting at row)
+	// with the barycentric weights of the rest configuration
+	if (level > (int)m_mg_levels.size()) {
+		int n = getMultigridNodeCount(level);
+		for (int i = 0; i < 3 * n; ++i) {
+			P_.push_back(T(row + i, col + i, 1.0));
+		}
+		return;
+	}
+
+	int nfine = getMultigridNodeCount(level - 1);
+	vector<Vector3d> fine_x(nfine);
+	for (int i = 0; i < nfine; ++i) {
+		fine_x[i] = (level == 1) ? m_nodes[i]->x0 : getRestPoint(*m_mg_levels[level - 2], i);
+	}
+
+	const TetMesh &coarse = *m_mg_levels[level - 1];
+	const int *coarse_tets = coarse.getTets();
+	int ntets = coarse.getTetCount();
+	vector<Vector3d> lo(ntets);
+	vector<Vector3d> hi(ntets);
+	for (int j = 0; j < ntets; ++j) {
+		lo[j] = hi[j] = getRestPoint(coarse, coarse_tets[4 * j]);
+		for (int k = 1; k < 4; ++k) {
+			Vector3d xk = getRestPoint(coarse, coarse_tets[4 * j + k]);
+			lo[j] = lo[j].cwiseMin(xk);
+			hi[j] = hi[j].cwiseMax(xk);
+		}
+		// Points on a face still find the tet after rounding, as in computeTetGrid()
+		double pad = 1.0e-6 * (hi[j] - lo[j]).maxCoeff();
+		lo[j].array() -= pad;
+		hi[j].array() += pad;
+	}
+	SpatialGrid grid;
+	grid.build(lo, hi);
+	vector<int> candidates;
+
+	auto computeWeight = [&](int j, const Vector3d &p) {
+		const int *tet = coarse_tets + 4 * j;
+		return Tetrahedron::computeBarycentricWeight(getRestPoint(coarse, tet[0]), getRestPoint(coarse, tet[1]),
+			getRestPoint(coarse, tet[2]), getRestPoint(coarse, tet[3]), p);
+	};
+
+	for (int i = 0; i < nfine; ++i) {
+		// Pick the first enclosing tet, or the tet with the closest box if the node lies outside of
+		// the coarse mesh
+		Vector4d weight;
+		int tet = -1;
+		grid.query(fine_x[i], candidates);
+		for (int j = 0; j < (int)candidates.size(); ++j) {
+			Vector4d w = computeWeight(candidates[j], fine_x[i]);
+			if (w.minCoeff() >= 0.0) {
+				weight = w;
+				tet = candidates[j];
+				break;
+			}
+		}
+
+		if (tet < 0) {
+			tet = grid.nearest(fine_x[i]);
+			weight = computeWeight(tet, fine_x[i]);
+		}
+
+		for (int k = 0; k < 4; ++k) {
+			int idx = coarse_tets[4 * tet + k];
+			for (int d = 0; d < 3; ++d) {
+				P_.push_back(T(row + 3 * i + d, col + 3 * idx + d, weight(k)));
+			}
+		}
+	}
+}
+
+static void dissect(vector<int> &nodes, const vector<vector<int> > &adjacency, const vector<shared_ptr<Node> > &all_nodes, vector<char> &side, vector<int> &order) {
+	// Recursive coordinate bisection; nodes of the left half that touch the right half form
+	// the separator and are eliminated after both halves
+	if ((int)nodes.size() <= 32) {
+		order.insert(order.end(), nodes.begin(), nodes.end());
+		return;
+	}
+
+	Vector3d xmin = all_nodes[nodes[0]]->x0;
+	Vector3d xmax = xmin;
+	for (int i = 1; i < (int)nodes.size(); ++i) {
+		xmin = xmin.cwiseMin(all_nodes[nodes[i]]->x0);
+		xmax = xmax.cwiseMax(all_nodes[nodes[i]]->x0);
+	}
+	int axis;
+	(xmax - xmin).maxCoeff(&axis);
+
+	int mid = (int)nodes.size() / 2;
+	nth_element(nodes.begin(), nodes.begin() + mid, nodes.end(), [&](int a, int b) {
+		return all_nodes[a]->x0(axis) < all_nodes[b]->x0(axis);
+	});
+
+	for (int i = mid; i < (int)nodes.size(); ++i) {
+		side[nodes[i]] = 1;
+	}
+
+	vector<int> left, right, separator;
+	for (int i = 0; i < mid; ++i) {
+		bool isSeparator = false;
+		for (int j = 0; j < (int)adjacency[nodes[i]].size(); ++j) {
+			if (side[adjacency[nodes[i]][j]] == 1) {
+				isSeparator = true;
+				break;
+			}
+		}
+		if (isSeparator) {
+			separator.push_back(nodes[i]);
+		}
+		else {
+			left.push_back(nodes[i]);
+		}
+	}
+	right.assign(nodes.begin() + mid, nodes.end());
+
+	for (int i = 0; i < (int)right.size(); ++i) {
+		side[right[i]] = 0;
+	}
+
+	if (left.empty() || right.empty()) {
+		order.insert(order.end(), nodes.begin(), nodes.end());
+		return;
+	}
+
+	dissect(left, adjacency, all_nodes, side, order);
+	dissect(right, adjacency, all_nodes, side, order);
+	sort(separator.begin(), separator.end());
+	order.insert(order.end(), separator.begin(), separator.end());
+}
+
+void SoftBody::computeNestedDissection(vector<int> &order) const {
+	int n = (int)m_nodes.size();
+	if (n == 0) {
+		return;
+	}
+
+	// Node graph of the tet mesh
+	vector<vector<int> > adjacency(n);
+	for (int i = 0; i < (int)m_tets.size(); ++i) {
+		auto tet = m_tets[i];
+		for (int a = 0; a < 4; ++a) {
+			for (int b = 0; b < 4; ++b) {
+				if (a != b) {
+					adjacency[tet->m_nodes[a]->i].push_back(tet->m_nodes[b]->i);
+				}
+			}
+		}
+	}
+
+	vector<int> nodes(n);
+	for (int i = 0; i < n; ++i) {
+		nodes[i] = i;
+	}
+	vector<char> side(n, 0);
+	vector<int> node_order;
+	node_order.reserve(n);
+	dissect(nodes, adjacency, m_nodes, side, node_order);
+
+	for (int i = 0; i < n; ++i) {
+		int idxR = m_nodes[node_order[i]]->idxR;
+		for (int j = 0; j < 3; ++j) {
+			order.push_back(idxR + j);
+		}
+	}
+}
+
+void SoftBody::subcycle(int nsub, double h, Vector3d grav, const SparseMatrix<double, RowMajor> &G, const VectorXd &rhsG, int nrc,
+	const VectorXd &q0, const VectorXd &qdot0, VectorXd &q1, VectorXd &qdot1, VectorXd &reaction) {
+	// The damping of a soft body is not part of the coupled step, see SolverSparse::initAssembly
+	subcycle_(nsub, h, grav, 0.0, nullptr, G, rhsG, nrc, q0, qdot0, q1, qdot1, reaction);
+	if (next != nullptr) {
+		next->subcycle(nsub, h, grav, G, rhsG, nrc, q0, qdot0, q1, qdot1, reaction);
+	}
+}
+
+void SoftBody::subcycle_(int nsub, double h, Vector3d grav, double damping, const function<void()> &collide,
+	const SparseMatrix<double, RowMajor> &G, const VectorXd &rhsG, int nrc,
+	const VectorXd &q0, const VectorXd &qdot0, VectorXd &q1, VectorXd &qdot1, VectorXd &reaction) {
+	int n = 3 * (int)m_nodes.size();
+	if (n == 0 || nsub <= 1) {
+		return;
+	}
+
+	// The nodes are numbered contiguously, see countDofs()
+	int idxR0 = m_nodes[0]->idxR;
+	int idxM0 = m_nodes[0]->idxM;
+	double hs = h / nsub;
+	m_isNodeGridValid = false;
+
+	// Fixed nodes stay where they are, as in scatterDofs()
+	vector<int> free(n, -1);
+	int nfree = 0;
+	for (int i = 0; i < n; ++i) {
+		if (!m_nodes[i / 3]->fixed) {
+			free[i] = nfree++;
+		}
+	}
+	if (nfree == 0) {
+		return;
+	}
+
+	// The equality rows on this body, the attachments and sliding nodes. Their other DOFs keep
+	// the velocity of qdot1, the coarse step for the rigid ones, and go to the right-hand side.
+	vector<T> Ga_;
+	vector<T> Gc_;
+	vector<double> rhsa;
+	for (int k = 0; k < G.outerSize(); ++k) {
+		bool isOwn = false;
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(G, k); it; ++it) {
+			int col = (int)it.col() - idxR0;
+			isOwn = isOwn || (col >= 0 && col < n && free[col] >= 0);
+		}
+		if (!isOwn) {
+			continue;
+		}
+		int row = (int)rhsa.size();
+		double r = rhsG(k);
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(G, k); it; ++it) {
+			int col = (int)it.col() - idxR0;
+			if (col >= 0 && col < n) {
+				if (free[col] >= 0) {
+					Ga_.push_back(T(row, free[col], it.value()));
+				}
+			}
+			else {
+				r -= it.value() * qdot1(it.col());
+				if (it.col() < nrc) {
+					Gc_.push_back(T(row, (int)it.col(), it.value()));
+				}
+			}
+		}
+		rhsa.push_back(r);
+	}
+	int na = (int)rhsa.size();
+	int nkkt = nfree + na;
+
+	VectorXd x = q0.segment(idxR0, n);
+	VectorXd v = qdot0.segment(idxR0, n);
+	for (int i = 0; i < n; ++i) {
+		if (free[i] < 0) {
+			v(i) = 0.0;
+		}
+	}
+	VectorXd f(idxM0 + n);
+	VectorXd b(nkkt);
+	VectorXd impulse = VectorXd::Zero(na);
+	vector<T> K_;
+	vector<T> A_;
+	SparseMatrix<double> A(nkkt, nkkt);
+	SparseLU<SparseMatrix<double> > lu;
+
+	for (int s = 0; s < nsub; ++s) {
+		for (int i = 0; i < (int)m_nodes.size(); ++i) {
+			m_nodes[i]->x = x.segment<3>(3 * i);
+			m_nodes[i]->v = v.segment<3>(3 * i);
+		}
+
+		f.setZero();
+		K_.clear();
+		computeForce_(grav, f);
+		computeStiffnessSparse_(K_);
+
+		// [M + hs D - hs^2 K, Ga'; Ga, 0] [v1; lambda] = [M v0 + hs f; rhsa] on the free DOFs
+		A_.clear();
+		for (int i = 0; i < n; ++i) {
+			if (free[i] >= 0) {
+				double m = m_nodes[i / 3]->m;
+				A_.push_back(T(free[i], free[i], m + hs * damping));
+				b(free[i]) = m * v(i) + hs * f(idxM0 + i);
+			}
+		}
+		for (int k = 0; k < (int)K_.size(); ++k) {
+			int row = free[K_[k].row() - idxM0];
+			int col = free[K_[k].col() - idxM0];
+			if (row >= 0 && col >= 0) {
+				A_.push_back(T(row, col, -hs * hs * K_[k].value()));
+			}
+		}
+		for (int k = 0; k < (int)Ga_.size(); ++k) {
+			A_.push_back(T(nfree + Ga_[k].row(), Ga_[k].col(), Ga_[k].value()));
+			A_.push_back(T(Ga_[k].col(), nfree + Ga_[k].row(), Ga_[k].value()));
+		}
+		for (int a = 0; a < na; ++a) {
+			b(nfree + a) = rhsa[a];
+		}
+		A.setFromTriplets(A_.begin(), A_.end());
+
+		if (s == 0) {
+			lu.analyzePattern(A);
+		}
+		lu.factorize(A);
+		if (lu.info() != Success) {
+			cerr << "SoftBody::subcycle: factorization failed, keeping the start of the step" << endl;
+			return;
+		}
+		VectorXd sol = lu.solve(b);
+		impulse += sol.tail(na);
+
+		for (int i = 0; i < n; ++i) {
+			if (free[i] >= 0) {
+				v(i) = sol(free[i]);
+			}
+		}
+		x += hs * v;
+
+		// Same floor test as scatterDofs()
+		for (int i = 0; i < (int)m_nodes.size(); ++i) {
+			if (m_isCollisionWithFloor && !m_nodes[i]->fixed && x(3 * i + 1) < m_floor_y && v(3 * i + 1) < 0.0) {
+				x(3 * i + 1) = m_floor_y;
+				v(3 * i + 1) = 0.0;
+			}
+		}
+		if (collide) {
+			for (int i = 0; i < (int)m_nodes.size(); ++i) {
+				m_nodes[i]->x = x.segment<3>(3 * i);
+				m_nodes[i]->v = v.segment<3>(3 * i);
+			}
+			collide();
+			for (int i = 0; i < (int)m_nodes.size(); ++i) {
+				if (!m_nodes[i]->fixed) {
+					v.segment<3>(3 * i) = m_nodes[i]->v;
+				}
+			}
+		}
+	}
+
+	q1.segment(idxR0, n) = x;
+	qdot1.segment(idxR0, n) = v;
+
+	// The attachments push the coarse DOFs back with -Gc' lambda
+	for (int k = 0; k < (int)Gc_.size(); ++k) {
+		reaction(Gc_[k].col()) -= Gc_[k].value() * impulse(Gc_[k].row());
+	}
 }
 
 void SoftBody::updatePosNor() {
@@ -299,11 +736,10 @@ void SoftBody::updatePosNor() {
 		//vec->update();
 	}
 
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_nodes.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		auto node = m_nodes[i];
 		node->clearNormals();
-	}
+	});
 	
 
 	for (int i = 0; i < (int)m_trifaces.size(); i++) {
@@ -394,8 +830,13 @@ void SoftBody::setAttachmentsByLine(Vector3d direction, Vector3d orig, shared_pt
 	Vector3d xa, xb, xc, xd;
 	int numIntersects = 0;
 
-	for (int i = 0; i < (int)m_tets.size(); i++) {
-		auto tet = m_tets[i];
+	SpatialGrid grid;
+	computeTetGrid(grid, false);
+	vector<int> tets;
+	grid.queryRay(orig, direction, tets);
+
+	for (int i = 0; i < (int)tets.size(); i++) {
+		auto tet = m_tets[tets[i]];
 		xa = tet->m_nodes[0]->x;
 		xb = tet->m_nodes[1]->x;
 		xc = tet->m_nodes[2]->x;
@@ -433,16 +874,20 @@ void SoftBody::setAttachmentsByLine(Vector3d direction, Vector3d orig, shared_pt
 }
 
 void SoftBody::setAttachmentsByLine(std::shared_ptr<Line> l, std::shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
-		auto node = m_nodes[i];
+	vector<int> ids;
+	getNodeGrid().query(l->getMin(), l->getMax(), ids);
+	for (int i = 0; i < (int)ids.size(); i++) {
+		auto node = m_nodes[ids[i]];
 		if (l->isInLine(node)) {
 			setAttachments(node->i, body);
 		}
 	}
 }
 void SoftBody::setAttachmentsByLine(std::shared_ptr<Line> l) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
-		auto node = m_nodes[i];
+	vector<int> ids;
+	getNodeGrid().query(l->getMin(), l->getMax(), ids);
+	for (int i = 0; i < (int)ids.size(); i++) {
+		auto node = m_nodes[ids[i]];
 		if (l->isInLine(node)) {
 			setAttachments(node->i, l->getBody());
 		}
@@ -450,7 +895,10 @@ void SoftBody::setAttachmentsByLine(std::shared_ptr<Line> l) {
 }
 
 void SoftBody::setAttachmentsByXYSurface(double z, double range, Vector2d xrange, Vector2d yrange, shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(xrange(0), yrange(0), z - range), Vector3d(xrange(1), yrange(1), z + range), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -461,7 +909,10 @@ void SoftBody::setAttachmentsByXYSurface(double z, double range, Vector2d xrange
 }
 
 void SoftBody::setAttachmentsByYZSurface(double x, double range, Vector2d yrange, Vector2d zrange, shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(x - range, yrange(0), zrange(0)), Vector3d(x + range, yrange(1), zrange(1)), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -473,7 +924,11 @@ void SoftBody::setAttachmentsByYZSurface(double x, double range, Vector2d yrange
 }
 
 void SoftBody::setAttachmentsByYZCircle(double x, double range, Vector2d O, double r, shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	double rr = sqrt(r * r + 0.0001);
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(x - range, O(0) - rr, O(1) - rr), Vector3d(x + range, O(0) + rr, O(1) + rr), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 		double diff = pow((xi.y() - O(0)), 2) + pow((xi(2) - O.y()), 2) - r * r;
@@ -485,7 +940,11 @@ void SoftBody::setAttachmentsByYZCircle(double x, double range, Vector2d O, doub
 }
 
 void SoftBody::setAttachmentsByXZCircle(double y, double range, Vector2d O, double r, shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	double rr = sqrt(r * r + 0.0001);
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(O(0) - rr, y - range, O(1) - rr), Vector3d(O(0) + rr, y + range, O(1) + rr), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 		double diff = pow((xi(0) - O(0)), 2) + pow((xi(2) - O.y()), 2) - r * r;
@@ -497,7 +956,10 @@ void SoftBody::setAttachmentsByXZCircle(double y, double range, Vector2d O, doub
 }
 
 void SoftBody::setAttachmentsByXZSurface(double y, double range, Eigen::Vector2d xrange, Eigen::Vector2d zrange, shared_ptr<Body> body) {
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(xrange(0), y - range, zrange(0)), Vector3d(xrange(1), y + range, zrange(1)), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -513,7 +975,10 @@ void SoftBody::setSlidingNodesByXYSurface(double z, Eigen::Vector2d xrange, Eige
 	z_axis << 0.0, 0.0, 1.0;
 	z_axis *= dir;
 
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(xrange(0), yrange(0), z - 0.0001), Vector3d(xrange(1), yrange(1), z + 0.0001), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -528,7 +993,10 @@ void SoftBody::setSlidingNodesByYZSurface(double x, Eigen::Vector2d yrange, Eige
 	x_axis << 1.0, 0.0, 0.0;
 	x_axis *= dir;
 
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(x - 0.0001, yrange(0), zrange(0)), Vector3d(x + 0.0001, yrange(1), zrange(1)), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -541,7 +1009,11 @@ void SoftBody::setSlidingNodesByYZSurface(double x, Eigen::Vector2d yrange, Eige
 void SoftBody::setSlidingNodesByYZCircle(double x, double range_x, Eigen::Vector2d O, double r, std::shared_ptr<Body> body) {
 	Vector3d x_axis;
 
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	double rr = sqrt(r * r + 0.01);
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(x - range_x, O(0) - rr, O(1) - rr), Vector3d(x + range_x, O(0) + rr, O(1) + rr), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 		x_axis << 0.0, O(0) - xi(1), O(1) - xi(2);
@@ -569,7 +1041,10 @@ void SoftBody::setSlidingNodesByXZSurface(double y, Eigen::Vector2d xrange, Eige
 	y_axis << 0.0, 1.0, 0.0;
 	y_axis *= dir;
 
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	vector<int> ids;
+	getNodeGrid().query(Vector3d(xrange(0), y - 0.0001, zrange(0)), Vector3d(xrange(1), y + 0.0001, zrange(1)), ids);
+	for (int k = 0; k < (int)ids.size(); k++) {
+		int i = ids[k];
 		auto node = m_nodes[i];
 		Vector3d xi = node->x;
 
@@ -610,19 +1085,17 @@ void SoftBody::gatherDDofs(VectorXd &ydot, int nr) {
 }
 
 void SoftBody::scatterDofs(VectorXd &y, int nr) {
-	m_isCollided = false;
 	// Scatters q and qdot from y
+	atomic<bool> isCollided(false);
 
 	// Update points
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_compared_nodes.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_compared_nodes.size(); ++i) {
+	parallelFor(0, (int)m_compared_nodes.size(), [&](int i) {
 		{
 			m_compared_nodes[i]->update();
 		}
-	}
+	});
 
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_nodes.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		int idxR = m_nodes[i]->idxR;
 		{
 			if (!m_nodes[i]->fixed) {
@@ -633,12 +1106,14 @@ void SoftBody::scatterDofs(VectorXd &y, int nr) {
 					if (m_nodes[i]->x.y() < m_floor_y && m_nodes[i]->v.y() < 0.0) { //
 						y.segment<3>(idxR).y() = m_floor_y;
 						y.segment<3>(nr + idxR).y() = 0.0;
-						m_isCollided = true;
+						isCollided = true;
 					}					
 				}			
 			}
 		}
-	}
+	});
+	m_isCollided = isCollided;
+	m_isNodeGridValid = false;
 	
 	if (next != nullptr) {
 		next->scatterDofs(y, nr);
@@ -647,8 +1122,7 @@ void SoftBody::scatterDofs(VectorXd &y, int nr) {
 
 void SoftBody::scatterDDofs(VectorXd &ydot, int nr) {
 	// Scatters qdot and qddot from ydot
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_nodes.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		int idxR = m_nodes[i]->idxR;
 		{
 			if (!m_nodes[i]->fixed) {
@@ -666,7 +1140,7 @@ void SoftBody::scatterDDofs(VectorXd &ydot, int nr) {
 				}
 			}
 		}
-	}
+	});
 	updatePosNor();
 	if (next != nullptr) {
 		next->scatterDDofs(ydot, nr);
@@ -713,6 +1187,7 @@ void SoftBody::computeForce(Vector3d grav, VectorXd &f) {
 
 void SoftBody::computeForce_(Vector3d grav, VectorXd &f) {
 	// Computes force vector
+	PROFILE_ZONE("SoftBody::computeForce");
 
 	if (m_isGravity) {
 		for (int i = 0; i < (int)m_nodes.size(); i++) {
@@ -745,6 +1220,7 @@ void SoftBody::computeStiffness(MatrixXd &K) {
 }
 
 void SoftBody::computeStiffness_(MatrixXd &K) {
+	PROFILE_ZONE("SoftBody::computeStiffness");
 	for (int i = 0; i < (int)m_tets.size(); i++) {
 		auto tet = m_tets[i];
 		{
@@ -762,6 +1238,46 @@ void SoftBody::computeStiffnessSparse(vector<T> &K_) {
 	}
 }
 
+void SoftBody::computeStiffnessDiagonal(VectorXd &d) {
+	computeStiffnessDiagonal_(d);
+
+	if (next != nullptr) {
+		next->computeStiffnessDiagonal(d);
+	}
+}
+
+void SoftBody::computeStiffnessDiagonal_(VectorXd &d) {
+	PROFILE_ZONE("SoftBody::computeStiffnessDiagonal");
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		m_tets[i]->computeForceDifferentials();
+		m_tets[i]->assembleGlobalStiffnessDiagonal(d);
+	}
+}
+
+void SoftBody::computeStiffnessProd(const VectorXd &x, VectorXd &y) {
+	computeStiffnessProd_(x, y);
+
+	if (next != nullptr) {
+		next->computeStiffnessProd(x, y);
+	}
+}
+
+void SoftBody::computeStiffnessProd_(const VectorXd &x, VectorXd &y) {
+	// The tets index their nodes locally, from the first DOF of this body
+	int n = 3 * (int)m_nodes.size();
+	if (n == 0) {
+		return;
+	}
+	int idxM0 = m_nodes[0]->idxM - 3 * m_nodes[0]->i;
+	VectorXd dx = x.segment(idxM0, n);
+	VectorXd df = VectorXd::Zero(n);
+
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		m_tets[i]->applyStiffness(dx, df);
+	}
+	y.segment(idxM0, n) += df;
+}
+
 void SoftBody::computeForceDamping(VectorXd &f, MatrixXd &D) {
 	// Computes maximal damping vector and matrix
 	int n_nodes = (int)m_nodes.size();
@@ -799,6 +1315,7 @@ void SoftBody::computeForceDampingSparse(VectorXd &f, vector<T> &D_) {
 
 
 void SoftBody::computeStiffnessSparse_(vector<T> &K_) {
+	PROFILE_ZONE("SoftBody::computeStiffness");
 	VectorXd df(3 * m_nodes.size());
 	VectorXd Dx = df;
 
@@ -881,3 +1398,24 @@ void SoftBody::exportObj(std::ofstream& outfile)
 		outfile << "f " << eleBuf[i] + 1 << "//" << eleBuf[i] + 1 << " " << eleBuf[i + 1] + 1 << "//" << eleBuf[i + 1] + 1 << " " << eleBuf[i + 2] + 1 << "//" << eleBuf[i + 2] + 1 << endl;
 	}
 }
+
+void SoftBody::getTrajectoryTopology(int &nverts, vector<int> &tris) const
+{
+	nverts = (int)m_nodes.size();
+	tris.resize(3 * m_trifaces.size());
+	for (int i = 0; i < (int)m_trifaces.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			tris[3 * i + k] = m_trifaces[i]->m_nodes[k]->i;
+		}
+	}
+}
+
+void SoftBody::getTrajectoryPositions(vector<double> &x) const
+{
+	x.resize(3 * m_nodes.size());
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			x[3 * i + k] = m_nodes[i]->x(k);
+		}
+	}
+}
@@ -7,12 +7,14 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <functional>
 
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 
 #include "MLCommon.h"
+#include "SpatialGrid.h"
 
 class MatrixStack;
 class Program;
@@ -22,6 +24,7 @@ class FaceTriangle;
 class Tetrahedron;
 class Vector;
 class Line;
+class TetMesh;
 
 typedef Eigen::Triplet<double> T;
 class SoftBody {
@@ -33,6 +36,11 @@ public:
 
 	void insertAdditionalPoints() {}
 	virtual void load(const std::string &RESOURCE_DIR, const std::string &MESH_NAME, const std::string &TETGEN_FLAGS);
+	// A box of the given sides centered at the origin instead of a mesh file
+	virtual void loadBox(const std::string &RESOURCE_DIR, Eigen::Vector3d sides, const std::string &TETGEN_FLAGS);
+	// A soft body of the same mesh, material and type whose tets lend their volume and stiffness
+	// to the next load, see World::clone()
+	void setRestSource(std::shared_ptr<const SoftBody> source) { m_rest_source = source; }
 	virtual void init();
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
 	void updatePosNor();
@@ -47,6 +55,11 @@ public:
 	virtual void computeForce(Vector3d grav, Eigen::VectorXd &f);
 	virtual void computeStiffness(Eigen::MatrixXd &K);
 	virtual void computeStiffnessSparse(std::vector<T> &K_);
+	// d += diag(K), after computing the element stiffness matrices of the tet state of the last
+	// computeForce()
+	virtual void computeStiffnessDiagonal(Eigen::VectorXd &d);
+	// y += K * x one tet at a time, with the element matrices of the last computeStiffnessDiagonal()
+	virtual void computeStiffnessProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
 	void computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D);
 	void computeForceDampingSparse(Eigen::VectorXd &f, std::vector<T> &D_);
 
@@ -80,11 +93,37 @@ public:
 	inline bool getInvertiblity() { return m_isInvertible; }
 
 	inline const std::vector<std::shared_ptr<Node> > & getNodes() const { return m_nodes; }
+	const Eigen::Vector3d & getBoxSides() const { return m_box_sides; }
 	inline const std::vector<std::shared_ptr<Tetrahedron> > & getTets() const { return m_tets; }
 	inline const std::vector<std::shared_ptr<FaceTriangle> > & getFaces() const { return m_trifaces; }
 
 	void transform(Vector3d dx);
 	void transform(Matrix4d E);
+
+	// Grid over the current node positions, rebuilt after the nodes have moved
+	const SpatialGrid & getNodeGrid();
+	// Grid over the tet bounding boxes, in the rest or the current configuration
+	void computeTetGrid(SpatialGrid &grid, bool isRest) const;
+
+	// multigrid hierarchy, finest first, built from the same input mesh with coarser tetgen flags
+	void addMultigridLevel(const std::string &TETGEN_FLAGS);
+	int getMultigridLevels() const { return (int)m_mg_levels.size(); }
+	int getMultigridNodeCount(int level) const;
+	void computeMultigridProlongation(int level, int row, int col, std::vector<T> &P_) const;
+
+	// fill-reducing elimination order of the reduced DOFs
+	void computeNestedDissection(std::vector<int> &order) const;
+
+	// multi-rate, integrates [t, t + h] in nsub implicit substeps. G and rhsG are the equality rows
+	// of the coarse step, the ones on this body hold it to the DOFs below nrc at their velocity in
+	// qdot1, and their impulse on those DOFs is added to reaction.
+	virtual void subcycle(int nsub, double h, Vector3d grav, const Eigen::SparseMatrix<double, Eigen::RowMajor> &G, const Eigen::VectorXd &rhsG, int nrc,
+		const Eigen::VectorXd &q0, const Eigen::VectorXd &qdot0, Eigen::VectorXd &q1, Eigen::VectorXd &qdot1, Eigen::VectorXd &reaction);
+	// subcycle() of this body alone, damping is the nodal damping of the coupled step and collide,
+	// if any, may stop nodes after the floor test of every substep
+	void subcycle_(int nsub, double h, Vector3d grav, double damping, const std::function<void()> &collide,
+		const Eigen::SparseMatrix<double, Eigen::RowMajor> &G, const Eigen::VectorXd &rhsG, int nrc,
+		const Eigen::VectorXd &q0, const Eigen::VectorXd &qdot0, Eigen::VectorXd &q1, Eigen::VectorXd &qdot1, Eigen::VectorXd &reaction);
 	// attached 
 	std::vector<std::shared_ptr<Node> > m_attach_nodes;
 	std::vector<std::shared_ptr<Body> > m_attach_bodies;
@@ -107,8 +146,13 @@ public:
 	bool m_isCollided;
 
 	void exportObj(std::ofstream& outfile);
+	// Boundary triangles as node indices, and the node positions
+	void getTrajectoryTopology(int &nverts, std::vector<int> &tris) const;
+	void getTrajectoryPositions(std::vector<double> &x) const;
 
 protected:
+	void build(const std::string &RESOURCE_DIR, const TetMesh &output_mesh);
+
 	int m_type;
 	bool m_isInvertible;
 	bool m_isGravity;
@@ -122,6 +166,14 @@ protected:
 
 	std::vector<std::shared_ptr<Node> > m_nodes;	
 	std::vector<std::shared_ptr<Tetrahedron> > m_tets;
+	std::vector<std::shared_ptr<const TetMesh> > m_mg_levels;	// rest geometry only, shared through the MeshRegistry
+	std::shared_ptr<const SoftBody> m_rest_source;
+	SpatialGrid m_node_grid;
+	bool m_isNodeGridValid;
+
+	std::string m_resource_dir;
+	std::string m_mesh_name;
+	Eigen::Vector3d m_box_sides;	// generated box when m_mesh_name is empty
 
 	std::vector<unsigned int> eleBuf;
 	std::vector<float> posBuf;
@@ -141,6 +193,8 @@ protected:
 
 	virtual void draw_(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
 	virtual void computeStiffnessSparse_(std::vector<T> &K_);
+	virtual void computeStiffnessDiagonal_(Eigen::VectorXd &d);
+	virtual void computeStiffnessProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y);
 	virtual void computeStiffness_(Eigen::MatrixXd &K);
 	virtual void computeForce_(Vector3d grav, Eigen::VectorXd &f);
 };
@@ -46,6 +46,13 @@ void SoftBodyCorotationalLinear::computeStiffness_(MatrixXd &K) {
 
 }
 
+void SoftBodyCorotationalLinear::computeStiffnessDiagonal_(VectorXd &d) {
+	// RKR is up to date after computeForce_()
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		m_tets[i]->assembleGlobalStiffnessDiagonal(d);
+	}
+}
+
 void SoftBodyCorotationalLinear::computeStiffnessSparse_(vector<T> &K_) {
 	for (int i = 0; i < (int)m_tets.size(); i++) {
 		auto tet = m_tets[i];		
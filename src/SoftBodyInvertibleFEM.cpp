@@ -4,6 +4,7 @@
 #include "Node.h"
 #include "Body.h"
 #include "Tetrahedron.h"
+#include "ParallelFor.h"
 
 using namespace std;
 using namespace Eigen;
@@ -34,11 +35,10 @@ void SoftBodyInvertibleFEM::computeForce_(Vector3d grav, VectorXd &f) {
 
 	// Elastic Forces
 	if (m_isElasticForce) {
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_tets.size(), MIN_ITERATOR_NUM))
-		for (int i = 0; i < (int)m_tets.size(); i++) {
+		parallelFor(0, (int)m_tets.size(), [&](int i) {
 			auto tet = m_tets[i];
 			tet->computeElasticForces();			
-		}
+		});
 
 		for (int i = 0; i < (int)m_tets.size(); i++) {
 			auto tet = m_tets[i];
@@ -51,11 +51,10 @@ void SoftBodyInvertibleFEM::computeForce_(Vector3d grav, VectorXd &f) {
 
 
 void SoftBodyInvertibleFEM::computeStiffness_(MatrixXd &K) {
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_tets.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_tets.size(); i++) {
+	parallelFor(0, (int)m_tets.size(), [&](int i) {
 		auto tet = m_tets[i];
 		tet->computeForceDifferentials();
-	}
+	});
 
 	for (int i = 0; i < (int)m_tets.size(); i++) {
 		auto tet = m_tets[i];
@@ -90,14 +89,24 @@ void SoftBodyInvertibleFEM::computeStiffnessSparse_(vector<T> &K_) {
 	//	}
 	//}
 
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_tets.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_tets.size(); i++) {
+	parallelFor(0, (int)m_tets.size(), [&](int i) {
 		auto tet = m_tets[i];
 		tet->computeForceDifferentials();
-	}
+	});
 
 	for (int i = 0; i < (int)m_tets.size(); i++) {
 		auto tet = m_tets[i];
 		tet->assembleGlobalStiffnessMatrixSparse(K_);
 	}
-}
\ No newline at end of file
+}
+
+void SoftBodyInvertibleFEM::computeStiffnessDiagonal_(VectorXd &d) {
+	parallelFor(0, (int)m_tets.size(), [&](int i) {
+		auto tet = m_tets[i];
+		tet->computeForceDifferentials();
+	});
+
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		m_tets[i]->assembleGlobalStiffnessDiagonal(d);
+	}
+}
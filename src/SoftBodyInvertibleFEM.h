@@ -17,6 +17,7 @@ public:
 protected:
 	void computeForce_(Vector3d grav, Eigen::VectorXd &f);
 	void computeStiffnessSparse_(std::vector<T> &K_);
+	void computeStiffnessDiagonal_(Eigen::VectorXd &d);
 	void computeStiffness_(Eigen::MatrixXd &K);
 private:
 
@@ -11,10 +11,14 @@ public:
 	void computeMass(Eigen::MatrixXd &M){}
     void computeForce(Eigen::Vector3d grav, Eigen::VectorXd &f){}
     void computeStiffness(Eigen::MatrixXd &K){}
+    void computeStiffnessDiagonal(Eigen::VectorXd &d){}
+    void computeStiffnessProd(const Eigen::VectorXd &x, Eigen::VectorXd &y){}
     void gatherDofs(Eigen::VectorXd &y, int nr){}
     void gatherDDofs(Eigen::VectorXd &ydot, int nr){}
     void scatterDofs(Eigen::VectorXd &y, int nr){}
     void scatterDDofs(Eigen::VectorXd &ydot, int nr){}
+    void subcycle(int nsub, double h, Eigen::Vector3d grav, const Eigen::SparseMatrix<double, Eigen::RowMajor> &G, const Eigen::VectorXd &rhsG, int nrc,
+        const Eigen::VectorXd &q0, const Eigen::VectorXd &qdot0, Eigen::VectorXd &q1, Eigen::VectorXd &qdot1, Eigen::VectorXd &reaction) {}
 
 protected:
 	void draw_(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const {}
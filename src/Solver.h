@@ -23,6 +23,7 @@ class SoftBody;
 class Spring;
 class Constraint;
 class MeshEmbedding;
+class Telemetry;
 
 typedef Eigen::Triplet<double> T;
 
@@ -81,6 +82,9 @@ public:
 	virtual void initMatrix(int nm, int nr, int nem, int ner, int nim, int nir) {}
 	virtual void reset();
 
+	// Receives a record per step, see Telemetry
+	void setTelemetry(std::shared_ptr<Telemetry> telemetry) { m_telemetry = telemetry; }
+
 protected:
 	std::shared_ptr<Solution> m_solutions;
 	std::shared_ptr<World> m_world;
@@ -104,6 +108,7 @@ protected:
 	std::shared_ptr<Constraint> constraint0;
 	std::shared_ptr<Spring> spring0;
 	std::shared_ptr<MeshEmbedding> meshembedding0;
+	std::shared_ptr<Telemetry> m_telemetry;
 
 	int m_ntets;
 
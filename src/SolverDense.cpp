@@ -14,6 +14,8 @@
 #include "ConstraintAttachSpring.h"
 #include "QuadProgMosek.h"
 #include "ChronoTimer.h"
+#include "Profiler.h"
+#include "Telemetry.h"
 
 using namespace std;
 using namespace Eigen;
@@ -90,6 +92,7 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 	{
 	case REDMAX_EULER:
 	{
+		PROFILE_ZONE("SolverDense::dynamics");
 		if (step == 0) {
 			// constant during simulation
 			nr = m_world->nr;
@@ -169,35 +172,45 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 			softbody0->computeMass(Mm);
 		}
 
-		body0->computeGrav(grav, fm);
-		body0->computeForceDamping(tmp, Dm);
+		{
+			PROFILE_ZONE("SolverDense::forces");
+			body0->computeGrav(grav, fm);
+			body0->computeForceDamping(tmp, Dm);
 
-		deformable0->computeForce(grav, fm);
-		deformable0->computeForceDamping(grav, tmp, Dm);
+			deformable0->computeForce(grav, fm);
+			deformable0->computeForceDamping(grav, tmp, Dm);
 		
-		softbody0->computeForce(grav, fm);
-		softbody0->computeStiffness(K);
+			softbody0->computeForce(grav, fm);
+			softbody0->computeStiffness(K);
 			
-		joint0->computeForceStiffness(fr, Kr);
-		joint0->computeForceDamping(tmp, Dr);
-		joint0->computeJacobian(J, Jdot);
-	
-		deformable0->computeJacobian(J);
-		softbody0->computeJacobian(J);
+			joint0->computeForceStiffness(fr, Kr);
+			joint0->computeForceDamping(tmp, Dr);
 		
-		spring0->computeForceStiffnessDamping(fm, Km, Dm);
+			spring0->computeForceStiffnessDamping(fm, Km, Dm);
+		}
+
+		{
+			PROFILE_ZONE("SolverDense::jacobian");
+			joint0->computeJacobian(J, Jdot);
+	
+			deformable0->computeJacobian(J);
+			softbody0->computeJacobian(J);
+		}
 	
 		q0 = y.segment(0, nr);
 		qdot0 = y.segment(nr, nr);
 
-		Mr = J.transpose() * (Mm - h * h * K) * J;
-		//mat_to_file(K, "DenseK");
+		{
+			PROFILE_ZONE("SolverDense::reduce");
+			Mr = J.transpose() * (Mm - h * h * K) * J;
+			//mat_to_file(K, "DenseK");
 
-		Mr = 0.5 * (Mr + Mr.transpose());			
-		//cout << "Mr" << endl << Mr << endl;		
+			Mr = 0.5 * (Mr + Mr.transpose());			
+			//cout << "Mr" << endl << Mr << endl;		
 
-		fr_ = Mr * qdot0 + h * (J.transpose() * (fm - Mm * Jdot * qdot0) + fr);
-		MDKr_ = Mr + J.transpose() * (h * Dm - hsquare * Km)*J + h * Dr - hsquare * Kr;
+			fr_ = Mr * qdot0 + h * (J.transpose() * (fm - Mm * Jdot * qdot0) + fr);
+			MDKr_ = Mr + J.transpose() * (h * Dm - hsquare * Km)*J + h * Dr - hsquare * Kr;
+		}
 		//mat_to_file(Mr, "Mr");
 		//mat_to_file(J, "J");
 		//mat_to_file(Km, "Km");
@@ -207,6 +220,7 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 		//mat_to_file(K, "K");
 
 		if (ne > 0) {
+			PROFILE_ZONE("SolverDense::constraints");
 			constraint0->computeJacEqM(Gm, Gmdot, gm, gmdot, gmddot);
 			constraint0->computeJacEqR(Gr, Grdot, gr, grdot, grddot);
 			G.block(0, 0, nem, nr) = Gm * J;
@@ -219,6 +233,7 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 		}
 
 		if (ni > 0) {
+			PROFILE_ZONE("SolverDense::constraints");
 			// Check for active inequality constraint
 			constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
 			constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
@@ -254,9 +269,11 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 		}
 
 		if (ne == 0 && ni == 0) {	// No constraints	
+			PROFILE_ZONE("SolverDense::solve");
 			qdot1 = MDKr_.ldlt().solve(fr_);
 		}
 		else if (ne > 0 && ni == 0) {  // Just equality
+			PROFILE_ZONE("SolverDense::solve");
 			int rows = MDKr_.rows() + G.rows();
 			int cols = MDKr_.cols() + G.rows();
 			MatrixXd LHS(rows, cols);
@@ -283,9 +300,10 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 			constraint0->scatterForceEqR(Gr.transpose(), l.segment(nem, l.rows() - nem) / h);
 		}
 		else if (ne == 0 && ni > 0) {  // Just inequality
+			PROFILE_ZONE("SolverDense::qp");
 			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
+			program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
@@ -313,9 +331,10 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
             }
 		}
 		else {  // Both equality and inequality
+			PROFILE_ZONE("SolverDense::qp");
 			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
+			program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
@@ -360,14 +379,17 @@ Eigen::VectorXd SolverDense::dynamics(Eigen::VectorXd y)
 		ydotk.segment(0, nr) = qdot1;
 		ydotk.segment(nr, nr) = qddot;
 
-		joint0->scatterDofs(yk, nr);
-		joint0->scatterDDofs(ydotk, nr);
+		{
+			PROFILE_ZONE("SolverDense::scatter");
+			joint0->scatterDofs(yk, nr);
+			joint0->scatterDDofs(ydotk, nr);
 
-		deformable0->scatterDofs(yk, nr);
-		deformable0->scatterDDofs(ydotk, nr);
+			deformable0->scatterDofs(yk, nr);
+			deformable0->scatterDDofs(ydotk, nr);
 
-		softbody0->scatterDofs(yk, nr);
-		softbody0->scatterDDofs(ydotk, nr);
+			softbody0->scatterDofs(yk, nr);
+			softbody0->scatterDDofs(ydotk, nr);
+		}
 
 		/*Energy ener = m_world->computeEnergy();
 		cout << "V" << ener.V << endl;
@@ -521,7 +543,7 @@ shared_ptr<Solution> SolverDense::solve() {
 			else if (ne == 0 && ni > 0) {  // Just inequality
 				shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 				program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-				program_->setParamInt(MSK_IPAR_LOG, 10);
+				program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 				program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
@@ -552,7 +574,7 @@ shared_ptr<Solution> SolverDense::solve() {
 			else {  // Both equality and inequality
 				shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 				program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-				program_->setParamInt(MSK_IPAR_LOG, 10);
+				program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 				program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
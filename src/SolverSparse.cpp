@@ -17,14 +17,47 @@
 #include "ConstraintAttachSpring.h"
 #include "QuadProgMosek.h"
 #include "MeshEmbedding.h"
+#include "Node.h"
+#include "ParallelFor.h"
+#include "Profiler.h"
+#include "Telemetry.h"
+#include "AssetCache.h"
 
 //#include <unsupported/Eigen/src/IterativeSolvers/MINRES.h>
 #include <unsupported/Eigen/src/IterativeSolvers/Scaling.h>
 #include <unsupported/Eigen/src/IterativeSolvers/GMRES.h>
+#include <chrono>
+#include <limits>
+#include <sstream>
 
 using namespace std;
 using namespace Eigen;
 
+const char *const SPARSE_SOLVER_NAMES[] = { "CG", "CG_ILUT", "QR", "BICG", "BICG_ILUT", "SLDLT", "LU", "PARDISO_LU", "PARDISO_LDLT", "MINRES_SOLVER", "GMRES_SOLVER", "SUPER_LU", "MULTIGRID", "MATRIX_FREE", "AUTO" };
+
+// Solvers that AUTO times on the equality constrained system
+static const SparseSolver AUTO_CANDIDATES[] = { LU, SLDLT, QR, PARDISO_LU, PARDISO_LDLT,
+#ifdef REDMAX_SUPERLU
+	SUPER_LU,
+#endif
+	CG, CG_ILUT, BICG, BICG_ILUT, MINRES_SOLVER, GMRES_SOLVER, MULTIGRID };
+
+static const int AUTO_NCANDIDATES = sizeof(AUTO_CANDIDATES) / sizeof(AUTO_CANDIDATES[0]);
+
+// Producers of the per-step forces and matrices, in the order their outputs are merged
+enum AssemblyTask { TASK_BODY, TASK_DEFORMABLE, TASK_SOFTBODY, TASK_MESHEMBEDDING, TASK_SPRING, TASK_COUNT };
+
+static bool isDirectSolver(SparseSolver s) {
+	return s == SLDLT || s == LU || s == QR || s == PARDISO_LU || s == PARDISO_LDLT || s == SUPER_LU;
+}
+
+static void printTelemetry(const TelemetryRecord &r) {
+	cout << "step " << r.step << " t " << r.time << ": " << (r.solver == TELEMETRY_QP ? "QP" : SPARSE_SOLVER_NAMES[r.solver])
+		<< " " << r.rows << "x" << r.cols << " nnz " << r.nonzeros << ", " << r.iterations << " iterations, residual " << r.residual
+		<< ", active " << r.nem << "/" << r.ner << "/" << r.nim << "/" << r.nir << ", reuse " << r.reuse
+		<< ", |g| " << r.drift << ", energy drift " << r.energy_drift << endl;
+}
+
 void SolverSparse::initMatrix(int nm, int nr, int nem, int ner, int nim, int nir) {
 	ni = nim + nir;
 	int nre = nr + ne;
@@ -165,6 +198,185 @@ void SolverSparse::initMatrix(int nm, int nr, int nem, int ner, int nim, int nir
 	Crdot.setZero();
 }
 
+void SolverSparse::initMultigrid() {
+	// Collect the FEM meshes that carry a multigrid hierarchy
+	vector<shared_ptr<SoftBody> > meshes;
+	int nlevels = 0;
+	for (auto softbody = softbody0; softbody != nullptr; softbody = softbody->next) {
+		if (softbody->getMultigridLevels() > 0) {
+			meshes.push_back(softbody);
+		}
+	}
+	for (auto embedding = meshembedding0; embedding != nullptr; embedding = embedding->next) {
+		auto coarse = embedding->getCoarseMesh();
+		if (coarse != nullptr && coarse->getMultigridLevels() > 0) {
+			meshes.push_back(coarse);
+		}
+	}
+	for (int i = 0; i < (int)meshes.size(); ++i) {
+		nlevels = MAX(nlevels, meshes[i]->getMultigridLevels());
+	}
+
+	// All other reduced DOFs (joints, deformables, meshes without levels) pass through every level
+	vector<bool> isFEM(nr, false);
+	for (int i = 0; i < (int)meshes.size(); ++i) {
+		int idxR = meshes[i]->getNodes()[0]->idxR;
+		for (int j = 0; j < 3 * (int)meshes[i]->getNodes().size(); ++j) {
+			isFEM[idxR + j] = true;
+		}
+	}
+	vector<int> pass;
+	for (int i = 0; i < nr; ++i) {
+		if (!isFEM[i]) {
+			pass.push_back(i);
+		}
+	}
+	int npass = (int)pass.size();
+
+	m_prolongations.clear();
+	int nfine = nr;
+	for (int l = 1; l <= nlevels; ++l) {
+		vector<T> P_;
+		for (int k = 0; k < npass; ++k) {
+			P_.push_back(T(l == 1 ? pass[k] : k, k, 1.0));
+		}
+
+		int row = npass;
+		int col = npass;
+		for (int i = 0; i < (int)meshes.size(); ++i) {
+			int row_i = (l == 1) ? meshes[i]->getNodes()[0]->idxR : row;
+			meshes[i]->computeMultigridProlongation(l, row_i, col, P_);
+			row += 3 * meshes[i]->getMultigridNodeCount(l - 1);
+			col += 3 * meshes[i]->getMultigridNodeCount(l);
+		}
+
+		SparseMatrix<double> P(nfine, col);
+		P.setFromTriplets(P_.begin(), P_.end());
+		m_prolongations.push_back(P);
+		nfine = col;
+	}
+
+	cg_mg.preconditioner().setProlongations(m_prolongations);
+	cg_mg.preconditioner().setASize(nr);
+	mr_mg.preconditioner().setProlongations(m_prolongations);
+	mr_mg.preconditioner().setASize(nr);
+}
+
+void SolverSparse::initAssembly() {
+	// Builds the task graph of the per-step assembly. The subsystems only read the shared
+	// body state, so the force/stiffness producers, the joint terms, the Jacobian and the
+	// constraint Jacobians are independent of each other.
+	if (m_pool == nullptr) {
+		m_pool = getParallelPool();
+	}
+
+	m_task_f.assign(TASK_COUNT, VectorXd::Zero(nm));
+	m_task_tmp.assign(TASK_COUNT + 1, VectorXd::Zero(nm));
+	m_task_D.assign(TASK_COUNT, vector<T>());
+	m_task_K.assign(TASK_COUNT, vector<T>());
+	m_task_Kdiag.assign(TASK_COUNT, VectorXd::Zero(nm));
+
+	vector<shared_ptr<SpringDamper> > springs;
+	for (shared_ptr<Spring> spring = spring0; spring != nullptr; spring = spring->next) {
+		shared_ptr<SpringDamper> spring_damper = dynamic_pointer_cast<SpringDamper>(spring);
+		if (spring_damper != nullptr) {
+			springs.push_back(spring_damper);
+		}
+	}
+	m_spring_batch.init(springs);
+
+	m_assembly.clear();
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: bodies");
+		m_task_f[TASK_BODY].setZero();
+		m_task_D[TASK_BODY].clear();
+		body0->computeGrav(grav, m_task_f[TASK_BODY]);
+		body0->computeForceDampingSparse(m_task_tmp[TASK_BODY], m_task_D[TASK_BODY]);
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: deformables");
+		m_task_f[TASK_DEFORMABLE].setZero();
+		m_task_D[TASK_DEFORMABLE].clear();
+		deformable0->computeForce(grav, m_task_f[TASK_DEFORMABLE]);
+		deformable0->computeForceDampingSparse(grav, m_task_tmp[TASK_DEFORMABLE], m_task_D[TASK_DEFORMABLE]);
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: soft bodies");
+		if (m_nsubsteps > 1) {
+			// Multi-rate, the substeps assemble their own, see SoftBody::subcycle()
+			return;
+		}
+		// Force and stiffness share the per-tet state, so they stay in one task
+		m_task_f[TASK_SOFTBODY].setZero();
+		m_task_K[TASK_SOFTBODY].clear();
+		softbody0->computeForce(grav, m_task_f[TASK_SOFTBODY]);
+		if (!m_matrix_free) {
+			softbody0->computeStiffnessSparse(m_task_K[TASK_SOFTBODY]);
+		}
+		else {
+			// Element matrices for the stiffness products and the preconditioner
+			m_task_Kdiag[TASK_SOFTBODY].setZero();
+			softbody0->computeStiffnessDiagonal(m_task_Kdiag[TASK_SOFTBODY]);
+		}
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: mesh embeddings");
+		if (m_nsubsteps > 1) {
+			return;
+		}
+		m_task_f[TASK_MESHEMBEDDING].setZero();
+		m_task_D[TASK_MESHEMBEDDING].clear();
+		m_task_K[TASK_MESHEMBEDDING].clear();
+		meshembedding0->computeForce(grav, m_task_f[TASK_MESHEMBEDDING]);
+		meshembedding0->computeForceDampingSparse(m_task_tmp[TASK_MESHEMBEDDING], m_task_D[TASK_MESHEMBEDDING]);
+		if (!m_matrix_free) {
+			meshembedding0->computeStiffnessSparse(m_task_K[TASK_MESHEMBEDDING]);
+		}
+		else {
+			m_task_Kdiag[TASK_MESHEMBEDDING].setZero();
+			meshembedding0->computeStiffnessDiagonal(m_task_Kdiag[TASK_MESHEMBEDDING]);
+		}
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: springs");
+		m_task_f[TASK_SPRING].setZero();
+		m_task_D[TASK_SPRING].clear();
+		// Fills the per-spring caches that the calls below and the products read
+		m_spring_batch.evaluate();
+		if (m_matrix_free) {
+			// Only the force is kept, K and D are applied through the spring products
+			m_task_K[TASK_SPRING].clear();
+			spring0->computeForceStiffnessDampingSparse(m_task_f[TASK_SPRING], m_task_K[TASK_SPRING], m_task_D[TASK_SPRING]);
+			m_task_K[TASK_SPRING].clear();
+			m_task_D[TASK_SPRING].clear();
+		}
+		else {
+			spring0->computeForceStiffnessDampingSparse(m_task_f[TASK_SPRING], Km_, m_task_D[TASK_SPRING]);
+		}
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: joints");
+		joint0->computeForceStiffnessSparse(fr, Kr_);
+		joint0->computeForceDampingSparse(m_task_tmp[TASK_COUNT], Dr_);
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: jacobian");
+		// First get dense jacobian (only a small part of the matrix)
+		joint0->computeJacobian(J_dense, Jdot_dense);
+	});
+	m_assembly.addTask([this]() {
+		PROFILE_ZONE("assembly: constraint jacobians");
+		if (ne > 0) {
+			constraint0->computeJacEqMSparse(Gm_, Gmdot_, gm, gmdot, gmddot);
+			constraint0->computeJacEqRSparse(Gr_, Grdot_, gr, grdot, grddot);
+		}
+		if (ni > 0) {
+			constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
+			constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
+		}
+	});
+}
+
 VectorXd SolverSparse::dynamics(VectorXd y)
 {
 	//SparseMatrix<double, RowMajor> G_sp;
@@ -172,7 +384,9 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 	{
 	case REDMAX_EULER:
 	{
+		PROFILE_ZONE("SolverSparse::dynamics");
 		if (step == 0) {
+			PROFILE_ZONE("SolverSparse::init");
 			// constant during simulation
 			isCollided = false;
 			nr = m_world->nr;
@@ -188,6 +402,7 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			ni = nim + nir;
 
 			m_ntets = m_world->m_ntets;
+			m_nsubsteps = m_world->computeSoftBodySubsteps();
 
 			Mm_sp.resize(nm, nm);
 			Mm_sp.data().squeeze();
@@ -258,6 +473,39 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			joint0->computeHyperReducedJacobian(JrR, JrR_select);
 			//cout << JrR << endl;
 			//cout << JrR_select << endl;
+
+			if (m_sparse_solver == MULTIGRID || m_sparse_solver == AUTO) {
+				initMultigrid();
+			}
+
+			if (m_nsubsteps > 1 && (m_world->nrc == nr || m_world->nim + m_world->nir > 0)) {
+				// Nothing to substep, or the QP that would need every DOF in one step
+				if (getVerbosity() >= 1 && m_world->nrc < nr) {
+					cout << "multi-rate: scene has inequality constraints, soft bodies step at the coarse step" << endl;
+				}
+				m_nsubsteps = 1;
+			}
+			if (m_mr_reaction.size() != nr) {
+				m_mr_reaction.setZero(nr);
+			}
+
+			m_matrix_free = (m_sparse_solver == MATRIX_FREE);
+			if (m_matrix_free && m_nsubsteps > 1) {
+				// The coarse step is a direct solve on the rigid DOFs
+				if (getVerbosity() >= 1) {
+					cout << "MATRIX_FREE: multi-rate scene, assembling the matrices" << endl;
+				}
+				m_matrix_free = false;
+			}
+			if (m_matrix_free && ((nR < nr && ne == 0) || m_world->nim + m_world->nir > 0)) {
+				// The hyper reduced solve of the unconstrained step and the QP take assembled matrices
+				if (getVerbosity() >= 1) {
+					cout << "MATRIX_FREE: scene has hyper reduced coordinates or inequality constraints, assembling the matrices" << endl;
+				}
+				m_matrix_free = false;
+			}
+
+			initAssembly();
 		}
 
 		nim = m_world->nim;
@@ -268,6 +516,13 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 		q0 = y.segment(0, nr);
 		qdot0 = y.segment(nr, nr);
 
+		// Filled in as the step goes and pushed at its end
+		bool isTelemetry = (m_telemetry != nullptr || m_capture != nullptr || getVerbosity() >= 2);
+		m_record = TelemetryRecord();
+		m_record.step = m_step_offset + step;
+		m_record.time = m_world->getTime();
+		m_record.residual = -1.0;
+
 		initMatrix(nm, nr, nem, ner, nim, nir);
 
 		if (step == 0) {
@@ -320,88 +575,94 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 		}
 
 			
-		body0->computeGrav(grav, fm);
-		body0->computeForceDampingSparse(tmp, Dm_);
-		deformable0->computeForce(grav, fm);
-		deformable0->computeForceDampingSparse(grav, tmp, Dm_);
-
-		softbody0->computeForce(grav, fm);
-		softbody0->computeStiffnessSparse(K_);
-
-		meshembedding0->computeForce(grav, fm);
-		meshembedding0->computeForceDampingSparse(tmp, Dm_);
-		meshembedding0->computeStiffnessSparse(K_);
-		joint0->computeForceStiffnessSparse(fr, Kr_);
-		joint0->computeForceDampingSparse(tmp, Dr_);
+		// Every subsystem writes into its own buffers, which are merged in a fixed order below
+		// so that the result does not depend on the number of threads
+		{
+			PROFILE_ZONE("SolverSparse::assembly");
+			m_assembly.run(m_pool);
+		}
 
-		//// First get dense jacobian (only a small part of the matrix)
-		joint0->computeJacobian(J_dense, Jdot_dense);
+		{
+			PROFILE_ZONE("SolverSparse::triplets");
+			for (int k = 0; k < TASK_COUNT; ++k) {
+				fm += m_task_f[k];
+				Dm_.insert(Dm_.end(), m_task_D[k].begin(), m_task_D[k].end());
+				K_.insert(K_.end(), m_task_K[k].begin(), m_task_K[k].end());
+			}
 	
-		//// Push back the dense part
-		if (step == 0) {
-			for (int i = 0; i < J_dense.rows(); ++i) {
-				for (int j = 0; j < J_dense.cols(); ++j) {
-					J_.push_back(T(i, j, J_dense(i, j)));
-					Jdot_.push_back(T(i, j, Jdot_dense(i, j)));
+			//// Push back the dense part
+			if (step == 0) {
+				for (int i = 0; i < J_dense.rows(); ++i) {
+					for (int j = 0; j < J_dense.cols(); ++j) {
+						J_.push_back(T(i, j, J_dense(i, j)));
+						Jdot_.push_back(T(i, j, Jdot_dense(i, j)));
+					}
 				}
 			}
-		}
-		else {
-			int idx = J_vec_idx;
-			for (int i = 0; i < J_dense.rows(); ++i) {
-				for (int j = 0; j < J_dense.cols(); ++j) {
-					J_[idx] = (T(i, j, J_dense(i, j)));
-					Jdot_.push_back(T(i, j, Jdot_dense(i, j)));
-					idx++;
+			else {
+				int idx = J_vec_idx;
+				for (int i = 0; i < J_dense.rows(); ++i) {
+					for (int j = 0; j < J_dense.cols(); ++j) {
+						J_[idx] = (T(i, j, J_dense(i, j)));
+						Jdot_.push_back(T(i, j, Jdot_dense(i, j)));
+						idx++;
+					}
 				}
 			}
-		}
-
-		spring0->computeForceStiffnessDampingSparse(fm, Km_, Dm_);
 
-		Km_sp.setFromTriplets(Km_.begin(), Km_.end());
-		Dm_sp.setFromTriplets(Dm_.begin(), Dm_.end());
-		Dr_sp.setFromTriplets(Dr_.begin(), Dr_.end());
-		K_sp.setFromTriplets(K_.begin(), K_.end()); // check
-		//cout << "K" << K_.size() << endl;
+			Km_sp.setFromTriplets(Km_.begin(), Km_.end());
+			Dm_sp.setFromTriplets(Dm_.begin(), Dm_.end());
+			Dr_sp.setFromTriplets(Dr_.begin(), Dr_.end());
+			K_sp.setFromTriplets(K_.begin(), K_.end()); // check
+			//cout << "K" << K_.size() << endl;
 
-		Kr_sp.setFromTriplets(Kr_.begin(), Kr_.end());
-		J_sp.setFromTriplets(J_.begin(), J_.end()); // check
+			Kr_sp.setFromTriplets(Kr_.begin(), Kr_.end());
+			J_sp.setFromTriplets(J_.begin(), J_.end()); // check
 
-		Jdot_sp.setFromTriplets(Jdot_.begin(), Jdot_.end());
+			Jdot_sp.setFromTriplets(Jdot_.begin(), Jdot_.end());
 
-		J_t_sp = J_sp.transpose();
+			J_t_sp = J_sp.transpose();
+		}
 
 		/*MatrixXd JrR;
 		JrR.resize(2, 1);
 		JrR << 1.0, 2.0;*/
 
-		JmR = MatrixXd(J_sp * JrR);
-		JmRdot = MatrixXd(Jdot_sp * JrR);
+		if (m_matrix_free) {
+			PROFILE_ZONE("SolverSparse::reduce");
+			// Mr * qdot0 through the element products, no reduced matrix is formed
+			fr_ = h * (J_t_sp * (fm - Mm_sp * Jdot_sp * qdot0) + fr);
+			applyReduced(qdot0, fr_, false);
+		}
+		else {
+			PROFILE_ZONE("SolverSparse::reduce");
+			JmR = MatrixXd(J_sp * JrR);
+			JmRdot = MatrixXd(Jdot_sp * JrR);
 
-		Mr_sp = J_t_sp * (Mm_sp - hsquare * K_sp) * J_sp;
-		
-		//Mr_sp_temp = Mr_sp.transpose();
-		//Mr_sp += Mr_sp_temp;
-		//Mr_sp *= 0.5;
+			Mr_sp = J_t_sp * (Mm_sp - hsquare * K_sp) * J_sp;
 
-		fr_ = Mr_sp * qdot0 + h * (J_t_sp * (fm - Mm_sp * Jdot_sp * qdot0) + fr); 
-		MDKr_sp = Mr_sp + J_t_sp * (h * Dm_sp - hsquare * Km_sp) * J_sp + h * Dr_sp - hsquare * Kr_sp;
-		//cout << MatrixXd(MDKr_sp) << endl << endl;
-		//cout << "Mr_sp"<< endl << MatrixXd(Mr_sp) << endl << endl;
-		//cout << "J_sp" << endl << MatrixXd(J_sp) << endl << endl;
-		//cout << "fr_"<< (fr_) << endl << endl;
-		//cout <<"fm"<< fm << endl << endl;
-		
-		JmR = MatrixXd(J_sp * JrR);
-		JmRdot = MatrixXd(Jdot_sp * JrR);
+			//Mr_sp_temp = Mr_sp.transpose();
+			//Mr_sp += Mr_sp_temp;
+			//Mr_sp *= 0.5;
 
-		Mr_sp = J_t_sp * (Mm_sp - hsquare * K_sp) * J_sp;
-		MatrixXd JmR_t = JmR.transpose();
-		MatrixXd MR = MatrixXd(JmR_t * (Mm_sp - hsquare * K_sp) * JmR);
+			fr_ = Mr_sp * qdot0 + h * (J_t_sp * (fm - Mm_sp * Jdot_sp * qdot0) + fr); 
+			MDKr_sp = Mr_sp + J_t_sp * (h * Dm_sp - hsquare * Km_sp) * J_sp + h * Dr_sp - hsquare * Kr_sp;
+			//cout << MatrixXd(MDKr_sp) << endl << endl;
+			//cout << "Mr_sp"<< endl << MatrixXd(Mr_sp) << endl << endl;
+			//cout << "J_sp" << endl << MatrixXd(J_sp) << endl << endl;
+			//cout << "fr_"<< (fr_) << endl << endl;
+			//cout <<"fm"<< fm << endl << endl;
 
-		VectorXd fR_ = MR * JrR_select.transpose() * qdot0 + h * (JmR_t * (fm - Mm_sp * Jdot_sp * qdot0) + JrR_select.transpose() * fr);
-		MatrixXd MDKR_ = MR + JmR_t * (h * Dm_sp - hsquare * Km_sp) * JmR;
+			JmR = MatrixXd(J_sp * JrR);
+			JmRdot = MatrixXd(Jdot_sp * JrR);
+
+			Mr_sp = J_t_sp * (Mm_sp - hsquare * K_sp) * J_sp;
+			MatrixXd JmR_t = JmR.transpose();
+			MatrixXd MR = MatrixXd(JmR_t * (Mm_sp - hsquare * K_sp) * JmR);
+
+			fR_ = MR * JrR_select.transpose() * qdot0 + h * (JmR_t * (fm - Mm_sp * Jdot_sp * qdot0) + JrR_select.transpose() * fr);
+			MDKR_ = MR + JmR_t * (h * Dm_sp - hsquare * Km_sp) * JmR;
+		}
 
 
 		//Mr_sp_temp = Mr_sp.transpose();
@@ -418,9 +679,7 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 		cout << qdot1 << endl;*/
 
 		if (ne > 0) {
-			constraint0->computeJacEqMSparse(Gm_, Gmdot_, gm, gmdot, gmddot);		
-			constraint0->computeJacEqRSparse(Gr_, Grdot_, gr, grdot, grddot);
-			
+			PROFILE_ZONE("SolverSparse::constraints");
 			rowsEM.clear();
 			rowsER.clear();
 			constraint0->getEqActiveList(rowsEM, rowsER);
@@ -436,11 +695,6 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 				Gr_sp.setFromTriplets(Gr_.begin(), Gr_.end());
 				Grdot_sp.setFromTriplets(Grdot_.begin(), Grdot_.end());
 
-				MatrixXd m_Gm = MatrixXd(Gm_sp)(m_rowsEM, Eigen::all);
-				//cout << m_Gm << endl << endl;
-				
-
-				MatrixXd m_Gr = MatrixXd(Gr_sp)(m_rowsER, Eigen::all);
 				VectorXd m_gm = gm(m_rowsEM);
 				//cout << m_gm << endl << endl;
 
@@ -449,21 +703,35 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 				VectorXd m_grdot = grdot(m_rowsER);
 				VectorXd m_gmddot = gmddot(m_rowsEM);
 				VectorXd m_grddot = grddot(m_rowsER);
-				MatrixXd GmJ = m_Gm * MatrixXd(J_sp);
-				//cout << "J" << endl << MatrixXd(J_sp) << endl;
-
-				G.resize(GmJ.rows() + m_Gr.rows(), m_Gr.cols());
-				///G_sp.resize(GmJ.rows() + m_Gr.rows(), m_Gr.cols());
-				G << GmJ, m_Gr;
-				//G_sp = G.sparseView();
-				rhsG.resize(G.rows());
-				VectorXd g(G.rows());
+				// G = [Gm J; Gr] on the active rows, picked out with selection matrices so that
+				// nothing dense of size nm is formed
+				vector<T> select_;
+				for (int i = 0; i < nem; ++i) {
+					select_.push_back(T(i, rowsEM[i], 1.0));
+				}
+				SparseMatrix<double> Sm(ne, Gm_sp.rows());
+				Sm.setFromTriplets(select_.begin(), select_.end());
+				select_.clear();
+				for (int i = 0; i < ner; ++i) {
+					select_.push_back(T(nem + i, rowsER[i], 1.0));
+				}
+				SparseMatrix<double> Sr(ne, Gr_sp.rows());
+				Sr.setFromTriplets(select_.begin(), select_.end());
+				G_sp = Sm * (Gm_sp * J_sp) + Sr * Gr_sp;
+				G_sp_tp = G_sp.transpose();
+				if (!m_matrix_free) {
+					// The matrix-free solve only reads G_sp
+					G = MatrixXd(G_sp);
+					GR = G * JrR;
+				}
+
+				rhsG.resize(ne);
+				VectorXd g(ne);
 				g << m_gm, m_gr;
-				VectorXd gdot(G.rows());
+				m_record.drift = g.norm();
+				VectorXd gdot(ne);
 				gdot << m_gmdot, m_grdot;
 				rhsG = -  gdot - 5.0 * g;
-
-				GR = G * JrR;
 			}
 
 			//Gm_sp.setFromTriplets(Gm_.begin(), Gm_.end());
@@ -486,12 +754,8 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 		}
 
 		if (ni > 0) {
+			PROFILE_ZONE("SolverSparse::constraints");
 			// Check for active inequality constraint
-			//constraint0->computeJacIneqMSparse(Cm, Cmdot, cm, cmdot, cmddot);
-			//constraint0->computeJacIneqRSparse(Cr, Crdot, cr, crdot, crddot);
-			constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
-			constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
-
 			rowsR.clear();
 			rowsM.clear();
 
@@ -523,12 +787,45 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			}
 		}
 
-		if (ne == 0 && ni == 0) {	// No constraints
-			ConjugateGradient< SparseMatrix<double> > cg;
-			cg.setMaxIterations(100000);
-			cg.setTolerance(1e-10);
-			cg.compute(MDKr_sp);
-			qdot1 = cg.solveWithGuess(fr_, qdot0);
+		m_compact = false;
+		if (m_islands != nullptr) {
+			PROFILE_ZONE("SolverSparse::islands");
+			m_compact = compactIslands();
+		}
+
+		if (m_nsubsteps > 1) {	// Multi-rate, no inequalities, see step 0
+			PROFILE_ZONE("SolverSparse::solve");
+			solveMultiRate();
+		}
+		else if (m_matrix_free) {	// No inequalities, see step 0
+			PROFILE_ZONE("SolverSparse::solve");
+			solveMatrixFree();
+			m_record.solver = MATRIX_FREE;
+			m_record.rows = m_record.cols = nr + ne;
+		}
+		else if (ne == 0 && ni == 0) {	// No constraints
+			PROFILE_ZONE("SolverSparse::solve");
+			if (m_sparse_solver == MULTIGRID) {
+				cg_mg.setMaxIterations(1000);
+				cg_mg.setTolerance(m_tol_cg);
+				cg_mg.compute(MDKr_sp);
+				qdot1 = cg_mg.solveWithGuess(fr_, qdot0);
+				m_record.solver = MULTIGRID;
+				m_record.iterations = (int)cg_mg.iterations();
+				m_record.residual = cg_mg.error();
+			}
+			else {
+				ConjugateGradient< SparseMatrix<double> > cg;
+				cg.setMaxIterations(100000);
+				cg.setTolerance(m_tol_cg);
+				cg.compute(MDKr_sp);
+				qdot1 = cg.solveWithGuess(fr_, qdot0);
+				m_record.solver = CG;
+				m_record.iterations = (int)cg.iterations();
+				m_record.residual = cg.error();
+			}
+			m_record.rows = m_record.cols = nr;
+			m_record.nonzeros = MDKr_sp.nonZeros();
 			
 			if (nR < nr) {
 				qdot1 = JrR * (MDKR_.ldlt().solve(fR_));
@@ -537,6 +834,7 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			//cout << qdot1 << endl;
 		}
 		else if (ne > 0 && ni == 0) {  // Just equality
+			PROFILE_ZONE("SolverSparse::solve");
 			//int rows = nr + ne;
 			//int cols = nr + ne;
 
@@ -557,42 +855,7 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			
 			*/
 			int nre = nr + ne;
-			lhs_left_tp.resize(nr, nre);
-			lhs_right_tp.resize(ne, nre);
-			lhs_left.resize(nre, nr);
-			lhs_right.resize(nre, ne);
-
-			LHS_sp.resize(nre, nre);
-			guess.segment(0, nr) = qdot0;
-			SparseMatrix<double> Gtemp = G.sparseView();
-			SparseMatrix<double> Gtemp_tp = Gtemp.transpose();
-			// Assemble sparse matrices
-			MDKr_sp_tp = MDKr_sp.transpose();
-			//G_sp_tp = G_sp.transpose();
-
-			// Combine MDKr' and G' by column
-			lhs_left_tp.leftCols(nr) = MDKr_sp_tp;
-			//lhs_left_tp.rightCols(ne) = G_sp_tp;
-			lhs_left_tp.rightCols(ne) = Gtemp_tp;
-
-			// Combine G and Z by column
-			//lhs_right_tp.leftCols(nr) = G_sp;
-			//lhs_right_tp.rightCols(ne) = zero;
-			lhs_right_tp.leftCols(nr) = Gtemp;
-			zero.resize(ne, ne);
-			lhs_right_tp.rightCols(ne) = zero;
-
-
-			lhs_left = lhs_left_tp.transpose();  // rows x nr
-			lhs_right = lhs_right_tp.transpose(); // rows x ne
-
-			LHS_sp.leftCols(nr) = lhs_left;
-			LHS_sp.rightCols(ne) = lhs_right;
-			
-			rhs.resize(nre);
-			rhs.segment(0, nr) = fr_;
-			rhs.segment(nr, ne) = rhsG;
-
+			assembleEquality();
 
 			//cout << MatrixXd(LHS_sp) << endl << endl;
 			//cout << rhs << endl << endl;
@@ -600,236 +863,48 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			//VectorXd sol = LHS.ldlt().solve(rhs);
 			//qdot1 = sol.segment(0, nr);
 			//VectorXd l = sol.segment(nr, sol.rows() - nr);
-			switch (m_sparse_solver)
-			{
-			case CG: 
-				{
-					ConjugateGradient< SparseMatrix<double>, Lower | Upper> cg;
-					//cg.setMaxIterations(2000);
-					cg.setTolerance(1e-3);
-					cg.compute(LHS_sp);
-					qdot1 = cg.solveWithGuess(rhs, guess).segment(0, nr);
-					
-					//std::cout << "#iterations:     " << cg.iterations() << std::endl;
-					//std::cout << "estimated error: " << cg.error() << std::endl;
-					break;
-				}
-			case CG_ILUT: 
-				{
-					ConjugateGradient< SparseMatrix<double>, Lower | Upper, IncompleteLUT<double>> cg;
-					cg.preconditioner().setDroptol(0.01);
-					cg.setMaxIterations(1000);
-					cg.setTolerance(1e-3);
-					cg.compute(LHS_sp);
-					qdot1 = cg.solveWithGuess(rhs, guess).segment(0, nr);
-					break;
-				}	
-			case MINRES_SOLVER:
-				{					
-					VectorXd diagAinv(nr);
-
-					for (int j = 0; j< MDKr_sp.outerSize(); ++j)
-					{
-						typename SparseMatrix<double>::InnerIterator it(MDKr_sp, j);
-						while (it && it.index() != j) ++it;
-						if (it && it.index() == j && it.value() != 0.0)
-							diagAinv(j) = 1.0 / it.value();
-						else
-							diagAinv(j) = 1.0;
-					}
-
-					SparseMatrix<double> B_sp = G_sp * diagAinv.asDiagonal() * G_sp_tp;
-					
-					//Eigen::SimplicialLDLT< Eigen::SparseMatrix<double, Eigen::ColMajor>> pre_solver;
-					//pre_solver.compute(B_sp);
-					//SparseMatrix<double> I_sp(ne, ne);
-					//I_sp.setIdentity();
-					//SparseMatrix<double> D_sp = pre_solver.solve(I_sp);
-					if (step == 0) {
-						D_sp.reserve(5000);
-					}
-					D_sp = MatrixXd(B_sp).inverse().sparseView();
-					D_sp.makeCompressed();
-					//MatrixXd A = diagA.asDiagonal();
-					//MatrixXd P(nr + ne, nr + ne);
-					//P.setZero();
-					//P.block(0, 0, nr, nr) = A;
-					//P.block(nr, nr, ne, ne) = B;
-
-					//MINRES<SparseMatrix<double>, Lower, SaddlePointPreconditioner<double> > mr;
-					mr.setMaxIterations(1000);
-					mr.setTolerance(1e-6);
-					mr.compute(LHS_sp);					
-
-					mr.preconditioner().setADiagMatrix(diagAinv);
-					
-					mr.preconditioner().setDMatrix(D_sp);
-
-
-					if (step == 0) {
-						//mr.preconditioner().precompute();
-					}
-					//mr.preconditioner().factor();
 
-					qdot1 = mr.solve(rhs).segment(0, nr);
-
-					//std::cout << "#iterations:     " << mr.iterations() << std::endl;
-					//std::cout << "estimated error: " << mr.error() << std::endl;
-	
-					/*for (int i = 1; i < 201; i++) {
-						mr.setMaxIterations(i*50);
-						qdot1 = mr.solve(rhs).segment(0, nr);
-						error_vec(i - 1) = (qdot1 - x_exact).norm();
-						std::cout << "#iterations:     " << mr.iterations() << std::endl;
-						std::cout << "estimated error: " << mr.error() << std::endl;
-					}*/
-
-					break;
-				}
-				
-			case GMRES_SOLVER:
-				{
-					GMRES<SparseMatrix<double>> gm;
-					gm.compute(LHS_sp);
-					gm.setTolerance(1e-3);
-					qdot1 = gm.solveWithGuess(rhs, guess).segment(0, nr);
-					break;
+			// Until AUTO has settled on a solver, every candidate is tried on this system
+			SparseSolver sparse_solver = m_sparse_solver;
+			if (sparse_solver == AUTO) {
+				if (m_auto_solver == AUTO && !m_auto_cache_checked) {
+					loadAutoChoice();
 				}
-			case BICG:
-				{
-					BiCGSTAB<SparseMatrix<double> >  BCGST;
-					BCGST.compute(LHS_sp);
-					BCGST.setTolerance(1e-3);
-					qdot1 = BCGST.solveWithGuess(rhs, guess).segment(0, nr);
-					break;
-				}
-			case BICG_ILUT: 
-				{
-					BiCGSTAB<SparseMatrix<double>, IncompleteLUT<double>>  BCGST;
-					BCGST.preconditioner().setDroptol(0.001);
-					BCGST.compute(LHS_sp);
-					BCGST.setTolerance(1e-3);
-					qdot1 = BCGST.solveWithGuess(rhs, guess).segment(0, nr);
-					break;
-				}
-			case SLDLT:
-				{
-					SimplicialLDLT<SparseMatrix<double>, Lower, NaturalOrdering<int> > sldlt;
-
-					sldlt.compute(LHS_sp);
-					qdot1 = sldlt.solve(rhs).segment(0, nr);
-					break;
-				}			
-			case LU: 
-				{
-					LHS_sp.makeCompressed();
-					if (step == 0) {
-						solver.analyzePattern(LHS_sp);
-					}
-					solver.compute(LHS_sp);
-					if (solver.info() != Success) {
-						// decomposition failed
-
-						cout << "decomposition failed" << endl << endl;
-						exit(1);
-					}
-
-					solver.factorize(LHS_sp);
-					qdot1 = solver.solve(rhs).segment(0, nr);
-					//cout << qdot1 << endl;
-					break;
-				}		
-			case PARDISO_LU:
-				{
-					PardisoLU<Eigen::SparseMatrix<double>> solver;
-					solver.compute(LHS_sp);
-					qdot1 = solver.solve(rhs).segment(0, nr);
-					cout << MatrixXd(LHS_sp) << endl << endl;
-					cout << rhs << endl << endl;
-					if (nR < nr) {
-						MatrixXd LHS_hr(nR + ne, nR + ne);
-						LHS_hr.setZero();
-						LHS_hr.block(0, 0, nR, nR) = MDKR_;
-						LHS_hr.block(nR, 0, ne, nR) = GR;
-						LHS_hr.block(0, nR, nR, ne) = GR.transpose();
-
-						VectorXd rhs_hr(nR + ne);
-						rhs_hr.setZero();
-
-						rhs_hr.segment(0, nR) = fR_;
-						rhs_hr.segment(nR, ne) = rhsG;
-						PardisoLU<Eigen::SparseMatrix<double>> solver;
-						solver.compute(LHS_hr.sparseView());
-						qdot1 = JrR * solver.solve(rhs_hr).segment(0, nR);
+				sparse_solver = m_auto_solver;
+			}
 
-					}
+			if (sparse_solver == AUTO || isDirectSolver(sparse_solver)) {
+				permuteEquality(m_compact ? m_awake_ordering : m_world->getOrdering());
+			}
 
-				}
-				break;
-			case PARDISO_LDLT:
-				{
-					PardisoLDLT<SparseMatrix<double>> pldlt;
-					pldlt.compute(LHS_sp);
-					qdot1 = pldlt.solve(rhs).segment(0, nr);
-					break;
-				}
-			case QR:
-				{
-					SparseQR< SparseMatrix<double>, COLAMDOrdering<int>> sqr(LHS_sp);
-					assert(sqr.info() == Success);
-					qdot1 = sqr.solve(rhs).segment(0, nr);
-					break;
-				}
-			case SUPER_LU:
-				{
-#ifdef REDMAX_SUPERLU
+			VectorXd sol;
+			if (sparse_solver == AUTO) {
+				tuneEquality(sol);
+			}
+			else if (!solveEquality(sparse_solver, sol)) {
+				// decomposition failed
+				cout << "decomposition failed" << endl << endl;
+				exit(1);
+			}
+			qdot1 = sol.segment(0, nr);
+			if (m_capture != nullptr) {
+				m_capture_sol = sol;
+			}
 
-                    SuperLU< SparseMatrix<double>> slu(LHS_sp);
-                    assert(slu.info() == Success);
-                    qdot1 = slu.solve(rhs).segment(0, nr);
-                    break;
-#endif
-				}
-			default:
-				{
-					shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
-					program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-					program_->setParamInt(MSK_IPAR_LOG, 10);
-					program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
-					program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
-					program_->setNumberOfVariables(nr);
-					program_->setObjectiveMatrix(MDKr_sp);
-
-					program_->setObjectiveVector(-fr_);
-
-					program_->setNumberOfEqualities(ne);
-					program_->setEqualityMatrix(G_sp);
-
-					program_->setEqualityVector(rhsG);
-
-					bool success = program_->solve();
-                    if(success){
-                        VectorXd sol = program_->getPrimalSolution();
-                        qdot1 = sol.segment(0, nr);
-                        VectorXd l = program_->getDualEquality();
-                        constraint0->scatterForceEqM(MatrixXd(Gm_sp.transpose()), l.segment(0, nem) / h);
-                        constraint0->scatterForceEqR(MatrixXd(Gr_sp.transpose()), l.segment(nem, l.rows() - nem) / h);
-                    }else{
-                        cout << "Solve failed!" << endl;
-                    }
-				}
-				break;
+			m_record.solver = sparse_solver;
+			m_record.rows = m_record.cols = nre;
+			m_record.nonzeros = LHS_sp.nonZeros();
+			if (isTelemetry) {
+				// The true residual, whatever the solver estimated
+				double norm = rhs.norm();
+				m_record.residual = (LHS_sp * sol - rhs).norm() / (norm > 0.0 ? norm : 1.0);
 			}
 		}
 		else if (ne == 0 && ni > 0) {  // Just inequality
+			PROFILE_ZONE("SolverSparse::qp");
 			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
+			program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
@@ -842,6 +917,9 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			program_->setObjectiveMatrix(MDKr_sp);
 			program_->setObjectiveVector(-fr_);
 			program_->setNumberOfInequalities(ni);
+			m_record.solver = TELEMETRY_QP;
+			m_record.rows = m_record.cols = nr;
+			m_record.nonzeros = MDKr_sp.nonZeros();
 			program_->setInequalityMatrix(C.sparseView());
 
 			VectorXd cvec(ni);
@@ -857,9 +935,10 @@ VectorXd SolverSparse::dynamics(VectorXd y)
             }
 		}
 		else {  // Both equality and inequality
+			PROFILE_ZONE("SolverSparse::qp");
 			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
 			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
+			program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
 			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
@@ -868,6 +947,9 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
 			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
 			program_->setNumberOfVariables(nr);
+			m_record.solver = TELEMETRY_QP;
+			m_record.rows = m_record.cols = nr;
+			m_record.nonzeros = MDKr_sp.nonZeros();
 
 			program_->setObjectiveMatrix(MDKr_sp);
 			program_->setObjectiveVector(-fr_);
@@ -892,32 +974,78 @@ VectorXd SolverSparse::dynamics(VectorXd y)
                 cout << "Solve failed!" << endl;
             }
 		}
-		qddot = (qdot1 - qdot0) / h;
+		if (m_compact) {
+			expandIslands();
+		}
 		q1 = q0 + h * qdot1;
+		if (m_tape != nullptr) {
+			PROFILE_ZONE("SolverSparse::tape");
+			recordStep();
+		}
+		if (m_nsubsteps > 1) {
+			PROFILE_ZONE("SolverSparse::subcycle");
+			// Multi-rate: the soft bodies substep the coarse step against the attachments, which
+			// move with the coarse velocities, and push back on the next coarse step
+			SparseMatrix<double, RowMajor> Grow(0, nr);
+			VectorXd rhsGrow(0);
+			if (ne > 0) {
+				Grow = G_sp;
+				rhsGrow = rhsG;
+			}
+			m_mr_reaction.setZero();
+			softbody0->subcycle(m_nsubsteps, h, grav, Grow, rhsGrow, m_world->nrc, q0, qdot0, q1, qdot1, m_mr_reaction);
+			meshembedding0->subcycle(m_nsubsteps, h, grav, Grow, rhsGrow, m_world->nrc, q0, qdot0, q1, qdot1, m_mr_reaction);
+		}
+		qddot = (qdot1 - qdot0) / h;
 		yk.segment(0, nr) = q1;
 		yk.segment(nr, nr) = qdot1;
 
 		ydotk.segment(0, nr) = qdot1;
 		ydotk.segment(nr, nr) = qddot;
 
-		joint0->scatterDofs(yk, nr);
-		joint0->scatterDDofs(ydotk, nr);
-		joint0->reparam();
-		joint0->gatherDofs(yk, nr);
+		{
+			PROFILE_ZONE("SolverSparse::scatter");
+			joint0->scatterDofs(yk, nr);
+			joint0->scatterDDofs(ydotk, nr);
+			joint0->reparam();
+			joint0->gatherDofs(yk, nr);
 
-		deformable0->scatterDofs(yk, nr);
-		deformable0->scatterDDofs(ydotk, nr);
+			deformable0->scatterDofs(yk, nr);
+			deformable0->scatterDDofs(ydotk, nr);
 
-		softbody0->scatterDofs(yk, nr);
-		softbody0->scatterDDofs(ydotk, nr);
+			softbody0->scatterDofs(yk, nr);
+			softbody0->scatterDDofs(ydotk, nr);
 
-		meshembedding0->scatterDofs(yk, nr);
-		meshembedding0->scatterDDofs(ydotk, nr);
+			meshembedding0->scatterDofs(yk, nr);
+			meshembedding0->scatterDDofs(ydotk, nr);
+		}
+		if (m_islands != nullptr) {
+			// After the floor contacts have stopped the nodes
+			m_islands->update(yk.segment(nr, nr));
+		}
 
-		//Energy ener = m_world->computeEnergy();
-		/*cout << "V" << ener.V << endl;
-		cout << "K" << ener.K << endl;
-		cout << " sum " << ener.V + ener.K << endl;*/
+		if (isTelemetry) {
+			m_record.nem = nem;
+			m_record.ner = ner;
+			m_record.nim = nim;
+			m_record.nir = nir;
+			m_record.reuse = m_lu_reuse;
+			Energy ener = m_world->computeEnergy();
+			if (step == 0 && m_step_offset == 0) {
+				m_energy0 = ener.K + ener.V;
+			}
+			m_record.energy_drift = ener.K + ener.V - m_energy0;
+			if (m_telemetry != nullptr) {
+				m_telemetry->push(m_record);
+			}
+			if (getVerbosity() >= 2) {
+				printTelemetry(m_record);
+			}
+			if (m_capture != nullptr && m_capture->isCaptured(m_record)) {
+				captureStep();
+			}
+		}
+		m_lu_reuse = 0;
 
 		step++;
 		return yk;
@@ -933,3 +1061,896 @@ VectorXd SolverSparse::dynamics(VectorXd y)
 	}
 }
 
+void SolverSparse::applyReduced(const VectorXd &v, VectorXd &y, bool isDamping) {
+	// y += Mr * v, or y += MDKr * v with the damping and spring terms. The FEM and spring
+	// stiffness go through the element products, Mm and Dm are block diagonal.
+	m_mf_x.noalias() = J_sp * v;
+	m_mf_y.noalias() = Mm_sp * m_mf_x;
+	m_mf_K.setZero(nm);
+	softbody0->computeStiffnessProd(m_mf_x, m_mf_K);
+	meshembedding0->computeStiffnessProd(m_mf_x, m_mf_K);
+	if (isDamping) {
+		spring0->computeStiffnessProd(m_mf_x, m_mf_K);
+		m_mf_D.setZero(nm);
+		spring0->computeDampingProd(m_mf_x, m_mf_D);
+		m_mf_y.noalias() += h * (Dm_sp * m_mf_x);
+		m_mf_y += h * m_mf_D;
+	}
+	m_mf_y -= hsquare * m_mf_K;
+	y.noalias() += J_t_sp * m_mf_y;
+	if (isDamping) {
+		y.noalias() += h * (Dr_sp * v);
+		y.noalias() -= hsquare * (Kr_sp * v);
+	}
+}
+
+void SolverSparse::solveMatrixFree() {
+	// CG on MDKr without constraints, MINRES on [MDKr G'; G 0] with them. Both are preconditioned
+	// with diag(J' (Mm + h Dm - h^2 Km) J + h Dr - h^2 Kr), and the constraint block with a sparse
+	// factorization of G diag(.)^-1 G'. Km is the FEM element diagonal from the assembly.
+	VectorXd Kmdiag = m_task_Kdiag[TASK_SOFTBODY] + m_task_Kdiag[TASK_MESHEMBEDDING];
+	VectorXd diagAinv = J_t_sp.cwiseAbs2() * (Mm_sp.diagonal() + h * Dm_sp.diagonal() - hsquare * Kmdiag);
+	diagAinv += h * Dr_sp.diagonal() - hsquare * Kr_sp.diagonal();
+	for (int j = 0; j < nr; ++j) {
+		diagAinv(j) = (diagAinv(j) > 0.0) ? 1.0 / diagAinv(j) : 1.0;
+	}
+	m_kkt.setAOperator(nr, [this](const VectorXd &x, VectorXd &y) { applyReduced(x, y, true); });
+
+	if (ne == 0) {
+		m_kkt.clearGMatrix();
+		SparseMatrix<double> D0(0, 0);
+		ConjugateGradient<KKTOperator, Lower | Upper, SaddlePointPreconditioner<double> > cg;
+		cg.setMaxIterations(100000);
+		cg.setTolerance(m_tol_cg);
+		cg.compute(m_kkt);
+		cg.preconditioner().setADiagMatrix(diagAinv);
+		cg.preconditioner().setDMatrix(D0);
+		qdot1 = cg.solveWithGuess(fr_, qdot0);
+		m_record.iterations = (int)cg.iterations();
+		m_record.residual = cg.error();
+		return;
+	}
+
+	// G_sp holds the active rows, see dynamics()
+	m_kkt.setGMatrix(G_sp);
+	SparseMatrix<double> S = G_sp * diagAinv.asDiagonal() * G_sp_tp;
+
+	int nre = nr + ne;
+	rhs.resize(nre);
+	rhs.segment(0, nr) = fr_;
+	rhs.segment(nr, ne) = rhsG;
+	VectorXd guess_mf = VectorXd::Zero(nre);
+	guess_mf.segment(0, nr) = qdot0;
+
+	MINRES<KKTOperator, Lower | Upper, SaddlePointPreconditioner<double> > mr_mf;
+	mr_mf.setMaxIterations(1000);
+	mr_mf.setTolerance(m_tol_minres);
+	mr_mf.compute(m_kkt);
+	mr_mf.preconditioner().setADiagMatrix(diagAinv);
+	mr_mf.preconditioner().setSchurMatrix(S);
+	VectorXd sol = mr_mf.solveWithGuess(rhs, guess_mf);
+	qdot1 = sol.segment(0, nr);
+	m_record.iterations = (int)mr_mf.iterations();
+	m_record.residual = mr_mf.error();
+}
+
+void SolverSparse::solveMultiRate() {
+	// [MDKr G'; G 0] on the DOFs below nrc and the rows of G on them alone. The soft bodies keep
+	// their start velocity here, the rows that attach them are solved in the substeps, and the
+	// impulse of those rows over the previous step stands in for them.
+	int nrc = m_world->nrc;
+	SparseMatrix<double, RowMajor> Grow(0, nr);
+	if (ne > 0) {
+		Grow = G_sp;
+	}
+	vector<int> rows;
+	for (int k = 0; k < Grow.outerSize(); ++k) {
+		bool isCoarse = true;
+		bool isEmpty = true;
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(Grow, k); it; ++it) {
+			isCoarse = isCoarse && it.col() < nrc;
+			isEmpty = false;
+		}
+		if (isCoarse && !isEmpty) {
+			rows.push_back(k);
+		}
+	}
+	int nce = (int)rows.size();
+	int nc = nrc + nce;
+
+	vector<T> A_;
+	for (int k = 0; k < MDKr_sp.outerSize(); ++k) {
+		for (SparseMatrix<double>::InnerIterator it(MDKr_sp, k); it; ++it) {
+			if (it.row() < nrc && it.col() < nrc) {
+				A_.push_back(T((int)it.row(), (int)it.col(), it.value()));
+			}
+		}
+	}
+	VectorXd b(nc);
+	for (int a = 0; a < nce; ++a) {
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(Grow, rows[a]); it; ++it) {
+			A_.push_back(T(nrc + a, (int)it.col(), it.value()));
+			A_.push_back(T((int)it.col(), nrc + a, it.value()));
+		}
+		b(nrc + a) = rhsG(rows[a]);
+	}
+	SparseMatrix<double> A(nc, nc);
+	A.setFromTriplets(A_.begin(), A_.end());
+
+	VectorXd qdot0s = qdot0;
+	qdot0s.head(nrc).setZero();
+	b.head(nrc) = fr_.head(nrc) - (MDKr_sp * qdot0s).head(nrc) + m_mr_reaction.head(nrc);
+
+	SparseLU<SparseMatrix<double> > lu;
+	lu.compute(A);
+	if (lu.info() != Success) {
+		// decomposition failed
+		cout << "decomposition failed" << endl << endl;
+		exit(1);
+	}
+	VectorXd sol = lu.solve(b);
+	qdot1 = qdot0;
+	qdot1.head(nrc) = sol.head(nrc);
+
+	m_record.solver = LU;
+	m_record.rows = m_record.cols = nc;
+	m_record.nonzeros = A.nonZeros();
+}
+
+void SolverSparse::saveState(vector<double> &state) const {
+	// steps, energy0, AUTO solver, trial, then the accumulated time and validity of each solver,
+	// and the multi-rate reaction of the soft bodies
+	int n = (int)m_auto_time.size();
+	state.resize(5 + 2 * n + m_mr_reaction.size());
+	state[0] = m_step_offset + step;
+	state[1] = m_energy0;
+	state[2] = m_auto_solver;
+	state[3] = m_auto_trial;
+	state[4] = n;
+	for (int i = 0; i < n; ++i) {
+		state[5 + i] = m_auto_time[i];
+		state[5 + n + i] = m_auto_valid[i];
+	}
+	for (int i = 0; i < (int)m_mr_reaction.size(); ++i) {
+		state[5 + 2 * n + i] = m_mr_reaction(i);
+	}
+}
+
+bool SolverSparse::restoreState(const vector<double> &state) {
+	if (state.size() < 5 || state.size() < 5 + 2 * (size_t)state[4] || step != 0) {
+		cerr << "SolverSparse: cannot restore the state" << endl;
+		return false;
+	}
+	int n = (int)state[4];
+	m_step_offset = (int)state[0];
+	m_energy0 = state[1];
+	m_auto_solver = (SparseSolver)(int)state[2];
+	m_auto_trial = (int)state[3];
+	m_auto_time.assign(state.begin() + 5, state.begin() + 5 + n);
+	m_auto_valid.resize(n);
+	for (int i = 0; i < n; ++i) {
+		m_auto_valid[i] = state[5 + n + i] != 0.0;
+	}
+	// Older states have no reaction
+	m_mr_reaction = Map<const VectorXd>(state.data() + 5 + 2 * n, state.size() - 5 - 2 * n);
+	// A locked in choice is kept over the one of the cache
+	m_auto_cache_checked = (m_auto_solver != AUTO || m_auto_trial > 0);
+	return true;
+}
+
+void SolverSparse::assembleEquality() {
+	// LHS_sp = [MDKr G'; G 0] and rhs = [fr; rhsG], built column block by column block
+	int nre = nr + ne;
+	lhs_left_tp.resize(nr, nre);
+	lhs_right_tp.resize(ne, nre);
+	lhs_left.resize(nre, nr);
+	lhs_right.resize(nre, ne);
+
+	LHS_sp.resize(nre, nre);
+	guess.segment(0, nr) = qdot0;
+	SparseMatrix<double> Gtemp = G.sparseView();
+	SparseMatrix<double> Gtemp_tp = Gtemp.transpose();
+	G_sp = Gtemp;
+	G_sp_tp = Gtemp_tp;
+	// Assemble sparse matrices
+	MDKr_sp_tp = MDKr_sp.transpose();
+
+	// Combine MDKr' and G' by column
+	lhs_left_tp.leftCols(nr) = MDKr_sp_tp;
+	lhs_left_tp.rightCols(ne) = Gtemp_tp;
+
+	// Combine G and Z by column
+	lhs_right_tp.leftCols(nr) = Gtemp;
+	zero.resize(ne, ne);
+	lhs_right_tp.rightCols(ne) = zero;
+
+	lhs_left = lhs_left_tp.transpose();  // rows x nr
+	lhs_right = lhs_right_tp.transpose(); // rows x ne
+
+	LHS_sp.leftCols(nr) = lhs_left;
+	LHS_sp.rightCols(ne) = lhs_right;
+
+	rhs.resize(nre);
+	rhs.segment(0, nr) = fr_;
+	rhs.segment(nr, ne) = rhsG;
+}
+
+void SolverSparse::permuteEquality(const VectorXi &ordering) {
+	// Direct solvers factorize the system in the kinematic/nested dissection order,
+	// with the constraint rows last
+	int nre = nr + ne;
+	VectorXi order(nre);
+	order.segment(0, nr) = ordering;
+	for (int i = nr; i < nre; ++i) {
+		order(i) = i;
+	}
+	m_perm.indices() = order;
+	LHS_perm_sp = m_perm.transpose() * LHS_sp * m_perm;
+	LHS_perm_sp.makeCompressed();
+	rhs_perm = m_perm.transpose() * rhs;
+}
+
+void SolverSparse::recordStep() {
+	// The linearization of this step around its state, see AdjointTape::backward()
+	if (m_matrix_free || ni > 0 || nR < nr || m_nsubsteps > 1) {
+		m_tape->invalidate();
+		return;
+	}
+	AdjointStep s;
+	s.h = h;
+	s.A = MDKr_sp;
+	if (ne > 0) {
+		s.G = G;
+	}
+	else {
+		s.G.resize(0, nr);
+	}
+	// b = Mr qdot0 + h (J' (fm - Mm Jdot qdot0) + fr), with the force Jacobians of MDKr. Of the
+	// damping forces only the springs' lands in fm, as Ds J qdot0 with Ds the D blocks of
+	// SpringDamper::computeFKD(); the other dampers only add to MDKr.
+	SparseMatrix<double> Ds_sp(nm, nm);
+	Ds_sp.setFromTriplets(m_task_D[TASK_SPRING].begin(), m_task_D[TASK_SPRING].end());
+	s.Bq = h * (J_t_sp * (K_sp + Km_sp) * J_sp + Kr_sp);
+	s.Bv = Mr_sp - h * (J_t_sp * (Mm_sp * Jdot_sp - Ds_sp * J_sp));
+	s.q0 = q0;
+	s.qdot1 = qdot1;
+	// Same joints as Joint::computeForceStiffnessSparse()
+	s.joint.setConstant(nr, -1);
+	int njoints = 0;
+	for (shared_ptr<Joint> joint = joint0; joint != nullptr; joint = joint->next, ++njoints) {
+		if (joint->presc == nullptr && joint->m_ndof > 0) {
+			s.joint.segment(joint->idxR, joint->m_ndof).setConstant(njoints);
+		}
+	}
+	m_tape->push(s, njoints);
+}
+
+bool SolverSparse::compactIslands() {
+	// Leaves the DOFs of the sleeping islands out of MDKr, fr, G and rhsG, expandIslands() puts
+	// them back with zero velocity. The steps that need every DOF wake the islands instead.
+	if (m_matrix_free || ni > 0 || nR < nr || m_nsubsteps > 1 || m_tape != nullptr || m_capture != nullptr ||
+		m_sparse_solver == MULTIGRID || (m_sparse_solver == AUTO && m_auto_solver == AUTO)) {
+		m_islands->wakeAll();
+		return false;
+	}
+	MatrixXd Gactive = (ne > 0) ? G : MatrixXd(0, nr);
+	m_islands->build(MDKr_sp, Gactive);
+
+	// A constraint that turns on or off wakes everything
+	vector<int> rows;
+	if (ne > 0) {
+		rows = rowsEM;
+		rows.push_back(-1);
+		rows.insert(rows.end(), rowsER.begin(), rowsER.end());
+	}
+	if (rows != m_sleep_rows) {
+		m_islands->wakeAll();
+		m_sleep_rows.swap(rows);
+	}
+
+	// So does a change of the torque on a joint of the island
+	VectorXd tau = VectorXd::Zero(nr);
+	for (shared_ptr<Joint> joint = joint0; joint != nullptr; joint = joint->next) {
+		if (joint->m_ndof > 0) {
+			tau.segment(joint->idxR, joint->m_ndof) = joint->m_tau;
+		}
+	}
+	if (m_sleep_tau.size() == nr) {
+		for (int i = 0; i < nr; ++i) {
+			if (tau(i) != m_sleep_tau(i)) {
+				m_islands->wake(i);
+			}
+		}
+	}
+	m_sleep_tau.swap(tau);
+
+	// A soft body that starts touching the floor
+	vector<shared_ptr<SoftBody> > bodies;
+	for (shared_ptr<SoftBody> body = softbody0; body != nullptr; body = body->next) {
+		bodies.push_back(body);
+	}
+	for (shared_ptr<MeshEmbedding> embedding = meshembedding0; embedding != nullptr; embedding = embedding->next) {
+		bodies.push_back(embedding->getCoarseMesh());
+	}
+	m_sleep_contacts.resize(bodies.size(), false);
+	for (int k = 0; k < (int)bodies.size(); ++k) {
+		bool isCollided = bodies[k] != nullptr && bodies[k]->m_isCollided;
+		if (isCollided && !m_sleep_contacts[k] && !bodies[k]->getNodes().empty()) {
+			m_islands->wake(bodies[k]->getNodes()[0]->idxR);
+		}
+		m_sleep_contacts[k] = isCollided;
+	}
+
+	// And a prescribed motion or a drift that the constraint rows ask to correct
+	for (int i = 0; i < ne; ++i) {
+		if (fabs(rhsG(i)) <= m_islands->getThreshold()) {
+			continue;
+		}
+		for (int j = 0; j < nr; ++j) {
+			if (G(i, j) != 0.0) {
+				m_islands->wake(j);
+				break;
+			}
+		}
+	}
+
+	if (m_islands->getSleepingCount() == 0) {
+		return false;
+	}
+
+	const VectorXi &awake = m_islands->getAwake();
+	int na = (int)awake.size();
+	VectorXi index = VectorXi::Constant(nr, -1);
+	for (int i = 0; i < na; ++i) {
+		index(awake(i)) = i;
+	}
+	m_full_nr = nr;
+	m_full_ne = ne;
+	m_full_MDKr.swap(MDKr_sp);
+	m_full_qdot0.swap(qdot0);
+	m_full_fr.swap(fr_);
+	m_full_G.swap(G);
+	m_full_rhsG.swap(rhsG);
+
+	vector<T> triplets;
+	triplets.reserve(m_full_MDKr.nonZeros());
+	for (int j = 0; j < m_full_MDKr.outerSize(); ++j) {
+		for (SparseMatrix<double>::InnerIterator it(m_full_MDKr, j); it; ++it) {
+			if (index(it.row()) >= 0 && index(it.col()) >= 0) {
+				triplets.push_back(T(index(it.row()), index(it.col()), it.value()));
+			}
+		}
+	}
+	MDKr_sp.resize(na, na);
+	MDKr_sp.setFromTriplets(triplets.begin(), triplets.end());
+	qdot0 = m_full_qdot0(awake);
+	fr_ = m_full_fr(awake);
+
+	// The rows of a sleeping island go with it
+	vector<int> awakeRows;
+	for (int i = 0; i < m_full_ne; ++i) {
+		for (int j = 0; j < m_full_nr; ++j) {
+			if (m_full_G(i, j) != 0.0) {
+				if (index(j) >= 0) {
+					awakeRows.push_back(i);
+				}
+				break;
+			}
+		}
+	}
+	G = m_full_G(awakeRows, awake);
+	rhsG = m_full_rhsG(awakeRows);
+	nr = na;
+	ne = (int)awakeRows.size();
+	m_full_guess.swap(guess);
+	guess.setZero(nr + ne);
+
+	const VectorXi &ordering = m_world->getOrdering();
+	m_awake_ordering.resize(na);
+	int k = 0;
+	for (int i = 0; i < (int)ordering.size(); ++i) {
+		if (index(ordering(i)) >= 0) {
+			m_awake_ordering(k++) = index(ordering(i));
+		}
+	}
+	return true;
+}
+
+void SolverSparse::expandIslands() {
+	VectorXd qdot = VectorXd::Zero(m_full_nr);
+	qdot(m_islands->getAwake()) = qdot1;
+	qdot1.swap(qdot);
+	nr = m_full_nr;
+	ne = m_full_ne;
+	MDKr_sp.swap(m_full_MDKr);
+	qdot0.swap(m_full_qdot0);
+	fr_.swap(m_full_fr);
+	G.swap(m_full_G);
+	rhsG.swap(m_full_rhsG);
+	guess.swap(m_full_guess);
+}
+
+void SolverSparse::captureStep() {
+	// The matrix-free steps never assemble MDKr, and the QP steps have no KKT system
+	int s = m_record.step;
+	bool isKKT = (!m_matrix_free && ne > 0 && ni == 0);
+	if (!m_matrix_free) {
+		m_capture->write(s, "MDKr", MDKr_sp);
+	}
+	m_capture->write(s, "fr", MatrixXd(fr_));
+	m_capture->write(s, "qdot0", MatrixXd(qdot0));
+	m_capture->write(s, "qdot1", MatrixXd(qdot1));
+	m_capture->write(s, "order", MatrixXd(m_world->getOrdering().cast<double>()));
+	if (ne > 0) {
+		// Same rows as G, which the matrix-free steps do not form
+		m_capture->write(s, "G", SparseMatrix<double>(G_sp));
+		m_capture->write(s, "rhsG", MatrixXd(rhsG));
+	}
+	if (ni > 0) {
+		m_capture->write(s, "C", SparseMatrix<double>(C.sparseView()));
+		m_capture->write(s, "rhsC", MatrixXd(rhsC));
+	}
+	if (isKKT) {
+		m_capture->write(s, "LHS", LHS_sp);
+		m_capture->write(s, "rhs", MatrixXd(rhs));
+		m_capture->write(s, "sol", MatrixXd(m_capture_sol));
+	}
+	nlohmann::json info;
+	info["h"] = h;
+	info["nr"] = nr;
+	info["ne"] = ne;
+	info["ni"] = ni;
+	info["kkt"] = isKKT;
+	info["matrix_free"] = m_matrix_free;
+	info["tolerances"] = { m_tol_iterative, m_tol_cg, m_tol_minres };
+	m_capture->writeInfo(m_record, info);
+}
+
+bool SolverSparse::replay(SparseSolver sparse_solver, const SparseMatrix<double> &MDKr, const MatrixXd &G, const VectorXd &fr,
+	const VectorXd &rhsG, const VectorXi &order, const VectorXd &qdot0, VectorXd &sol, TelemetryRecord &record)
+{
+	if (sparse_solver == AUTO || sparse_solver == MULTIGRID) {
+		return false;
+	}
+#ifndef REDMAX_SUPERLU
+	if (sparse_solver == SUPER_LU) {
+		return false;
+	}
+#endif
+	nr = nR = (int)MDKr.rows();
+	ne = (int)G.rows();
+	ni = 0;
+	if ((sparse_solver == MINRES_SOLVER || sparse_solver == MATRIX_FREE) && ne == 0) {
+		// The preconditioner has no constraint block
+		return false;
+	}
+	step = 0;
+	MDKr_sp = MDKr;
+	this->G = G;
+	fr_ = fr;
+	this->rhsG = rhsG;
+	this->qdot0 = qdot0;
+	guess.setZero(nr + ne);
+	assembleEquality();
+	if (isDirectSolver(sparse_solver)) {
+		permuteEquality(order);
+	}
+
+	m_record = TelemetryRecord();
+	m_lu_reuse = 0;
+	if (!solveEquality(sparse_solver, sol)) {
+		return false;
+	}
+	double norm = rhs.norm();
+	m_record.solver = sparse_solver;
+	m_record.rows = m_record.cols = nr + ne;
+	m_record.nonzeros = LHS_sp.nonZeros();
+	m_record.reuse = m_lu_reuse;
+	m_record.residual = (LHS_sp * sol - rhs).norm() / (norm > 0.0 ? norm : 1.0);
+	record = m_record;
+	return true;
+}
+
+bool SolverSparse::solveEquality(SparseSolver sparse_solver, VectorXd &sol) {
+	// Solves the KKT system LHS_sp * sol = rhs assembled by dynamics(), sol = [qdot1; lambda]
+	switch (sparse_solver)
+	{
+	case CG: 
+		{
+			ConjugateGradient< SparseMatrix<double>, Lower | Upper> cg;
+			//cg.setMaxIterations(2000);
+			cg.setTolerance(getTolerance(m_tol_iterative));
+			cg.compute(LHS_sp);
+			sol = cg.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)cg.iterations();
+			break;
+		}
+	case CG_ILUT: 
+		{
+			ConjugateGradient< SparseMatrix<double>, Lower | Upper, IncompleteLUT<double>> cg;
+			cg.preconditioner().setDroptol(0.01);
+			cg.setMaxIterations(1000);
+			cg.setTolerance(getTolerance(m_tol_iterative));
+			cg.compute(LHS_sp);
+			sol = cg.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)cg.iterations();
+			break;
+		}	
+	case MATRIX_FREE:	// scenes that need the assembled system, see dynamics()
+	case MINRES_SOLVER:
+		{					
+			VectorXd diagAinv(nr);
+
+			for (int j = 0; j< MDKr_sp.outerSize(); ++j)
+			{
+				typename SparseMatrix<double>::InnerIterator it(MDKr_sp, j);
+				while (it && it.index() != j) ++it;
+				if (it && it.index() == j && it.value() != 0.0)
+					diagAinv(j) = 1.0 / it.value();
+				else
+					diagAinv(j) = 1.0;
+			}
+
+			SparseMatrix<double> B_sp = G_sp * diagAinv.asDiagonal() * G_sp_tp;
+			
+			//Eigen::SimplicialLDLT< Eigen::SparseMatrix<double, Eigen::ColMajor>> pre_solver;
+			//pre_solver.compute(B_sp);
+			//SparseMatrix<double> I_sp(ne, ne);
+			//I_sp.setIdentity();
+			//SparseMatrix<double> D_sp = pre_solver.solve(I_sp);
+			if (step == 0) {
+				D_sp.reserve(5000);
+			}
+			D_sp = MatrixXd(B_sp).inverse().sparseView();
+			D_sp.makeCompressed();
+			//MatrixXd A = diagA.asDiagonal();
+			//MatrixXd P(nr + ne, nr + ne);
+			//P.setZero();
+			//P.block(0, 0, nr, nr) = A;
+			//P.block(nr, nr, ne, ne) = B;
+
+			//MINRES<SparseMatrix<double>, Lower, SaddlePointPreconditioner<double> > mr;
+			mr.setMaxIterations(1000);
+			mr.setTolerance(getTolerance(m_tol_minres));
+			mr.compute(LHS_sp);					
+
+			mr.preconditioner().setADiagMatrix(diagAinv);
+			
+			mr.preconditioner().setDMatrix(D_sp);
+
+
+			if (step == 0) {
+				//mr.preconditioner().precompute();
+			}
+			//mr.preconditioner().factor();
+
+			sol = mr.solve(rhs);
+			m_record.iterations = (int)mr.iterations();
+	
+			/*for (int i = 1; i < 201; i++) {
+				mr.setMaxIterations(i*50);
+				sol = mr.solve(rhs);
+				error_vec(i - 1) = (qdot1 - x_exact).norm();
+				std::cout << "#iterations:     " << mr.iterations() << std::endl;
+				std::cout << "estimated error: " << mr.error() << std::endl;
+			}*/
+
+			break;
+		}
+		
+	case MULTIGRID:
+		{
+			// MINRES with a V-cycle on the reduced block and a sparse factorization of
+			// G * diag(A)^-1 * G' on the constraint block
+			VectorXd diagAinv = MDKr_sp.diagonal();
+			for (int j = 0; j < nr; ++j) {
+				diagAinv(j) = (diagAinv(j) != 0.0) ? 1.0 / diagAinv(j) : 1.0;
+			}
+			SparseMatrix<double> S = G_sp * diagAinv.asDiagonal() * G_sp_tp;
+			
+			mr_mg.setMaxIterations(1000);
+			mr_mg.setTolerance(getTolerance(m_tol_minres));
+			mr_mg.compute(LHS_sp);
+			mr_mg.preconditioner().setSchurMatrix(S);
+			sol = mr_mg.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)mr_mg.iterations();
+			break;
+		}
+	case GMRES_SOLVER:
+		{
+			GMRES<SparseMatrix<double>> gm;
+			gm.compute(LHS_sp);
+			gm.setTolerance(getTolerance(m_tol_iterative));
+			sol = gm.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)gm.iterations();
+			break;
+		}
+	case BICG:
+		{
+			BiCGSTAB<SparseMatrix<double> >  BCGST;
+			BCGST.compute(LHS_sp);
+			BCGST.setTolerance(getTolerance(m_tol_iterative));
+			sol = BCGST.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)BCGST.iterations();
+			break;
+		}
+	case BICG_ILUT: 
+		{
+			BiCGSTAB<SparseMatrix<double>, IncompleteLUT<double>>  BCGST;
+			BCGST.preconditioner().setDroptol(0.001);
+			BCGST.compute(LHS_sp);
+			BCGST.setTolerance(getTolerance(m_tol_iterative));
+			sol = BCGST.solveWithGuess(rhs, guess);
+			m_record.iterations = (int)BCGST.iterations();
+			break;
+		}
+	case SLDLT:
+		{
+			SimplicialLDLT<SparseMatrix<double>, Lower, NaturalOrdering<int> > sldlt;
+
+			sldlt.compute(LHS_perm_sp);
+			sol = m_perm * sldlt.solve(rhs_perm);
+			break;
+		}			
+	case LU: 
+		{
+			// The symbolic analysis is redone only when the pattern changes, G is built with
+			// sparseView() and may drop entries
+			const int *outer = LHS_perm_sp.outerIndexPtr();
+			const int *inner = LHS_perm_sp.innerIndexPtr();
+			int nouter = LHS_perm_sp.outerSize() + 1;
+			int nnz = (int)LHS_perm_sp.nonZeros();
+			bool isSamePattern = ((int)m_lu_outer.size() == nouter && (int)m_lu_inner.size() == nnz &&
+				equal(outer, outer + nouter, m_lu_outer.begin()) && equal(inner, inner + nnz, m_lu_inner.begin()));
+			if (isSamePattern) {
+				m_lu_reuse++;
+			}
+			else {
+				solver.analyzePattern(LHS_perm_sp);
+				m_lu_outer.assign(outer, outer + nouter);
+				m_lu_inner.assign(inner, inner + nnz);
+			}
+			solver.factorize(LHS_perm_sp);
+			if (solver.info() != Success) {
+				m_lu_outer.clear();
+				return false;
+			}
+			sol = m_perm * solver.solve(rhs_perm);
+			//cout << qdot1 << endl;
+			break;
+		}		
+	case PARDISO_LU:
+		{
+			PardisoLU<Eigen::SparseMatrix<double>> solver;
+			solver.compute(LHS_perm_sp);
+			sol = m_perm * solver.solve(rhs_perm);
+			if (getVerbosity() >= 3) {
+				cout << MatrixXd(LHS_sp) << endl << endl;
+				cout << rhs << endl << endl;
+			}
+			if (nR < nr) {
+				MatrixXd LHS_hr(nR + ne, nR + ne);
+				LHS_hr.setZero();
+				LHS_hr.block(0, 0, nR, nR) = MDKR_;
+				LHS_hr.block(nR, 0, ne, nR) = GR;
+				LHS_hr.block(0, nR, nR, ne) = GR.transpose();
+
+				VectorXd rhs_hr(nR + ne);
+				rhs_hr.setZero();
+
+				rhs_hr.segment(0, nR) = fR_;
+				rhs_hr.segment(nR, ne) = rhsG;
+				PardisoLU<Eigen::SparseMatrix<double>> solver;
+				solver.compute(LHS_hr.sparseView());
+				VectorXd sol_hr = solver.solve(rhs_hr);
+				sol.segment(0, nr) = JrR * sol_hr.segment(0, nR);
+				sol.segment(nr, ne) = sol_hr.segment(nR, ne);
+
+			}
+
+		}
+		break;
+	case PARDISO_LDLT:
+		{
+			PardisoLDLT<SparseMatrix<double>> pldlt;
+			pldlt.compute(LHS_perm_sp);
+			sol = m_perm * pldlt.solve(rhs_perm);
+			break;
+		}
+	case QR:
+		{
+			SparseQR< SparseMatrix<double>, NaturalOrdering<int>> sqr(LHS_perm_sp);
+			assert(sqr.info() == Success);
+			sol = m_perm * sqr.solve(rhs_perm);
+			break;
+		}
+	case SUPER_LU:
+		{
+#ifdef REDMAX_SUPERLU
+
+                    SuperLU< SparseMatrix<double>> slu;
+                    slu.options().ColPerm = NATURAL;
+                    slu.compute(LHS_perm_sp);
+                    assert(slu.info() == Success);
+                    sol = m_perm * slu.solve(rhs_perm);
+                    break;
+#endif
+		}
+	default:
+		{
+			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
+			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
+			program_->setParamInt(MSK_IPAR_LOG, getVerbosity() >= 2 ? 10 : 0);
+			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
+			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
+			program_->setNumberOfVariables(nr);
+			program_->setObjectiveMatrix(MDKr_sp);
+
+			program_->setObjectiveVector(-fr_);
+
+			program_->setNumberOfEqualities(ne);
+			program_->setEqualityMatrix(G_sp);
+
+			program_->setEqualityVector(rhsG);
+
+			bool success = program_->solve();
+                    if(success){
+                        VectorXd l = program_->getDualEquality();
+                        sol.resize(nr + ne);
+                        sol << program_->getPrimalSolution(), l;
+                        constraint0->scatterForceEqM(MatrixXd(Gm_sp.transpose()), l.segment(0, nem) / h);
+                        constraint0->scatterForceEqR(MatrixXd(Gr_sp.transpose()), l.segment(nem, l.rows() - nem) / h);
+                    }else{
+                        cout << "Solve failed!" << endl;
+                        sol = VectorXd::Zero(nr + ne);
+                        sol.segment(0, nr) = qdot1;
+                    }
+		}
+		break;
+	}
+	return true;
+}
+
+double SolverSparse::getTolerance(double tol) const {
+	// Under AUTO the iterative solvers run to the residual the trials hold them to, both in the
+	// trials and once one is locked in, so the timed solves are the ones the steps then make
+	return (m_sparse_solver == AUTO) ? min(tol, m_auto_residual) : tol;
+}
+
+void SolverSparse::tuneEquality(VectorXd &sol) {
+	// Times every candidate on the current system. A candidate is dropped as soon as its
+	// relative residual misses the target; the most accurate solution drives this step.
+	if (m_auto_trial == 0) {
+		m_auto_time.assign(AUTO, 0.0);
+		m_auto_valid.assign(AUTO, false);
+		for (int k = 0; k < AUTO_NCANDIDATES; ++k) {
+			m_auto_valid[AUTO_CANDIDATES[k]] = true;
+		}
+	}
+
+	double rhs_norm = rhs.norm() > 0.0 ? rhs.norm() : 1.0;
+	double best_residual = numeric_limits<double>::infinity();
+
+	for (int k = 0; k < AUTO_NCANDIDATES; ++k) {
+		SparseSolver s = AUTO_CANDIDATES[k];
+		if (!m_auto_valid[s]) {
+			continue;
+		}
+
+		VectorXd x;
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		bool success = solveEquality(s, x);
+		m_auto_time[s] += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+		double residual = numeric_limits<double>::infinity();
+		if (success && x.rows() == rhs.rows() && x.allFinite()) {
+			residual = (LHS_sp * x - rhs).norm() / rhs_norm;
+		}
+		if (!(residual <= m_auto_residual)) {
+			m_auto_valid[s] = false;
+		}
+		if (residual < best_residual) {
+			best_residual = residual;
+			sol = x;
+		}
+	}
+
+	if (best_residual == numeric_limits<double>::infinity()) {
+		cout << "AUTO: no solver succeeded" << endl;
+		exit(1);
+	}
+
+	if (++m_auto_trial < m_auto_ntrials) {
+		return;
+	}
+
+	// Lock in the fastest solver that met the target in every trial
+	m_auto_solver = LU;
+	double best_time = numeric_limits<double>::infinity();
+	for (int k = 0; k < AUTO_NCANDIDATES; ++k) {
+		SparseSolver s = AUTO_CANDIDATES[k];
+		if (m_auto_valid[s] && m_auto_time[s] < best_time) {
+			best_time = m_auto_time[s];
+			m_auto_solver = s;
+		}
+	}
+
+	if (getVerbosity() >= 1) {
+		if (best_time == numeric_limits<double>::infinity()) {
+			cout << "AUTO: no solver reached residual " << m_auto_residual << ", using LU" << endl;
+		}
+		else {
+			cout << "AUTO: " << SPARSE_SOLVER_NAMES[m_auto_solver] << " (" << best_time / m_auto_ntrials << " s per step)" << endl;
+		}
+	}
+	saveAutoChoice();
+}
+
+string SolverSparse::getSceneKey() const {
+	// The choice of solver depends on the structure of the scene, not on the state, so the
+	// constraint rows are all counted, active or not
+	stringstream key;
+	key << "type" << m_world->m_type << "_nr" << m_world->nr << "_nm" << m_world->nm << "_nem" << m_world->nem << "_ner" << m_world->ner
+		<< "_nim" << m_world->nim << "_nir" << m_world->nir << "_ntets" << m_world->m_ntets;
+	return key.str();
+}
+
+string SolverSparse::getDefaultAutoCacheFile() {
+	string dir = AssetCache::getDirectory();
+	if (dir.empty()) {
+		return "";
+	}
+	return dir + "/solver_cache.txt";
+}
+
+void SolverSparse::loadAutoChoice() {
+	m_auto_cache_checked = true;
+	if (m_auto_cache_file.empty()) {
+		return;
+	}
+
+	ifstream in(m_auto_cache_file);
+	if (!in.good()) {
+		return;
+	}
+
+	// One "<key> <solver>" pair per line, the last entry for a key wins
+	string key = getSceneKey();
+	string k, name;
+	while (in >> k >> name) {
+		if (k != key) {
+			continue;
+		}
+		for (int i = 0; i < AUTO_NCANDIDATES; ++i) {
+			if (name == SPARSE_SOLVER_NAMES[AUTO_CANDIDATES[i]]) {
+				m_auto_solver = AUTO_CANDIDATES[i];
+			}
+		}
+	}
+
+	if (m_auto_solver != AUTO && getVerbosity() >= 1) {
+		cout << "AUTO: " << SPARSE_SOLVER_NAMES[m_auto_solver] << " (from " << m_auto_cache_file << ")" << endl;
+	}
+}
+
+void SolverSparse::saveAutoChoice() const {
+	if (m_auto_cache_file.empty()) {
+		return;
+	}
+
+	size_t slash = m_auto_cache_file.find_last_of("/\\");
+	if (slash != string::npos) {
+		AssetCache::makeDirectory(m_auto_cache_file.substr(0, slash));
+	}
+	ofstream out(m_auto_cache_file, ios::app);
+	if (!out.good()) {
+		cerr << "Cannot write " << m_auto_cache_file << endl;
+		return;
+	}
+	out << getSceneKey() << " " << SPARSE_SOLVER_NAMES[m_auto_solver] << endl;
+}
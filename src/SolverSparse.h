@@ -4,20 +4,102 @@
 #include "Solver.h"
 #include <unsupported/Eigen/src/IterativeSolvers/MINRES.h>
 #include "KKTSolver.h"
+#include "MultigridPreconditioner.h"
+#include "TaskGraph.h"
+#include "SpringDamperBatch.h"
+#include "Telemetry.h"
+#include "SystemCapture.h"
+#include "Adjoint.h"
+#include "Islands.h"
+
+class ThreadPool;
 
 
 
 
 class SolverSparse : public Solver {
 public:
-	SolverSparse() {}
-	SolverSparse(std::shared_ptr<World> world, Integrator integrator, SparseSolver solver) : Solver(world, integrator), m_sparse_solver(solver) {}
+	SolverSparse() : m_sparse_solver(AUTO), m_matrix_free(false), m_tol_iterative(1e-3), m_tol_cg(1e-10), m_tol_minres(1e-6),
+		m_auto_solver(AUTO), m_auto_ntrials(3), m_auto_trial(0), m_auto_residual(1e-6), m_auto_cache_file(getDefaultAutoCacheFile()), m_auto_cache_checked(false),
+		m_lu_reuse(0), m_energy0(0.0), m_step_offset(0), m_compact(false), m_full_nr(0), m_full_ne(0) {}
+	SolverSparse(std::shared_ptr<World> world, Integrator integrator, SparseSolver solver) : Solver(world, integrator), m_sparse_solver(solver), m_matrix_free(false),
+		m_tol_iterative(1e-3), m_tol_cg(1e-10), m_tol_minres(1e-6),
+		m_auto_solver(AUTO), m_auto_ntrials(3), m_auto_trial(0), m_auto_residual(1e-6), m_auto_cache_file(getDefaultAutoCacheFile()), m_auto_cache_checked(false),
+		m_lu_reuse(0), m_energy0(0.0), m_step_offset(0), m_compact(false), m_full_nr(0), m_full_ne(0) {}
 	Eigen::VectorXd dynamics(Eigen::VectorXd y);
 	void initMatrix(int nm, int nr, int nem, int ner, int nim, int nir);
+	void initMultigrid();
+	void initAssembly();
+
+	// The pool that runs the step assembly, may be shared between solvers
+	void setThreadPool(std::shared_ptr<ThreadPool> pool) { m_pool = pool; }
+
+	// Tolerances of the iterative solvers on the constrained system, the unconstrained CG and MINRES
+	void setTolerances(double tol_iterative, double tol_cg, double tol_minres) { m_tol_iterative = tol_iterative; m_tol_cg = tol_cg; m_tol_minres = tol_minres; }
+
+	// AUTO times the candidates for ntrials constrained steps and keeps the fastest one whose relative
+	// residual stays below residual. An empty cache_file disables the cache.
+	void setAutoTuning(int ntrials, double residual, const std::string &cache_file) { m_auto_ntrials = ntrials; m_auto_residual = residual; m_auto_cache_file = cache_file; }
+	// solver_cache.txt in the AssetCache directory, empty when there is none
+	static std::string getDefaultAutoCacheFile();
+	SparseSolver getSparseSolver() const { return m_sparse_solver == AUTO ? m_auto_solver : m_sparse_solver; }
+
+	// Dumps the systems of the selected steps, see SystemCapture
+	void setCapture(std::shared_ptr<SystemCapture> capture) { m_capture = capture; }
+
+	// Sleeping, the DOFs of the islands at rest are left out of the solve, see Islands
+	void setIslands(std::shared_ptr<Islands> islands) { m_islands = islands; }
+
+	// Differentiable mode, every step is recorded on the tape, see Adjoint.h
+	void setTape(std::shared_ptr<AdjointTape> tape) { m_tape = tape; }
+
+	// The state that outlives a step: the step count, the AUTO trials and choice and the initial
+	// energy of the telemetry. The matrices are rebuilt by the first step after a restore.
+	void saveState(std::vector<double> &state) const;
+	// Before the first step, returns false when the state is malformed
+	bool restoreState(const std::vector<double> &state);
+
+	// Solves a captured system [MDKr G'; G 0] [qdot1; lambda] = [fr; rhsG] the way a step does, without
+	// a World. order is the ordering of the reduced dofs, qdot0 the initial guess. Fills the solver,
+	// size, iterations, reuse and residual of record. MULTIGRID and AUTO need the World.
+	bool replay(SparseSolver sparse_solver, const Eigen::SparseMatrix<double> &MDKr, const Eigen::MatrixXd &G, const Eigen::VectorXd &fr,
+		const Eigen::VectorXd &rhsG, const Eigen::VectorXi &order, const Eigen::VectorXd &qdot0, Eigen::VectorXd &sol, TelemetryRecord &record);
 
 private:
+	void assembleEquality();
+	void permuteEquality(const Eigen::VectorXi &ordering);
+	bool solveEquality(SparseSolver sparse_solver, Eigen::VectorXd &sol);
+	void captureStep();
+	void recordStep();
+	bool compactIslands();
+	void expandIslands();
+	void tuneEquality(Eigen::VectorXd &sol);
+	double getTolerance(double tol) const;
+	std::string getSceneKey() const;
+	void loadAutoChoice();
+	void saveAutoChoice() const;
+	void applyReduced(const Eigen::VectorXd &v, Eigen::VectorXd &y, bool isDamping);
+	void solveMatrixFree();
+	void solveMultiRate();
+
 	bool isCollided;
+	int m_nsubsteps;	// soft body substeps per step
+	Eigen::VectorXd m_mr_reaction;	// multi-rate, impulse of the soft bodies on the coarse DOFs over the last step
 	SparseSolver m_sparse_solver;
+	bool m_matrix_free;		// MATRIX_FREE and the scene allows it
+	double m_tol_iterative;
+	double m_tol_cg;
+	double m_tol_minres;
+
+	// AUTO
+	SparseSolver m_auto_solver;		// AUTO until a solver has been locked in
+	int m_auto_ntrials;
+	int m_auto_trial;
+	double m_auto_residual;
+	std::string m_auto_cache_file;
+	bool m_auto_cache_checked;
+	std::vector<double> m_auto_time;	// accumulated seconds per SparseSolver
+	std::vector<bool> m_auto_valid;
 	Eigen::SparseMatrix<double> Mm_sp;
 	std::vector<T> Mm_;
 
@@ -68,6 +150,8 @@ private:
 	std::vector<T> Kr_;
 	Eigen::VectorXd fr;
 	Eigen::VectorXd fr_;
+	Eigen::VectorXd fR_;	// HR
+	Eigen::MatrixXd MDKR_;	// HR
 
 	Eigen::SparseMatrix<double> Gm_sp;
 	std::vector<T> Gm_;
@@ -143,9 +227,64 @@ private:
 	Eigen::MatrixXd Cr;
 	Eigen::MatrixXd Crdot;
 	//
-	Eigen::SparseLU<Eigen::SparseMatrix<double> > solver;
+	Eigen::SparseLU<Eigen::SparseMatrix<double>, Eigen::NaturalOrdering<int> > solver;
+	std::vector<int> m_lu_outer;	// pattern of the last symbolic analysis
+	std::vector<int> m_lu_inner;
+	int m_lu_reuse;		// factorizations of this step that kept it
+
+	// Fill-reducing ordering from World::computeOrdering(), applied as LHS_perm_sp = P' * LHS_sp * P
+	Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> m_perm;
+	Eigen::SparseMatrix<double> LHS_perm_sp;
+	Eigen::VectorXd rhs_perm;
 	Eigen::MINRES<Eigen::SparseMatrix<double>, Eigen::Lower, SaddlePointPreconditioner<double> > mr;
 
+	// Multigrid
+	std::vector<Eigen::SparseMatrix<double> > m_prolongations;
+	Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper, MultigridPreconditioner<double> > cg_mg;
+	Eigen::MINRES<Eigen::SparseMatrix<double>, Eigen::Lower, MultigridPreconditioner<double> > mr_mg;
+
 	Eigen::SparseMatrix<double> D_sp;
 
+	// Matrix-free, [MDKr G'; G 0] applied through the element products
+	typedef KKTMatrix<double, Eigen::IdentityPreconditioner, Eigen::SparseMatrix<double>, Eigen::SparseMatrix<double, Eigen::RowMajor> > KKTOperator;
+	KKTOperator m_kkt;
+	Eigen::VectorXd m_mf_x;		// nm x 1
+	Eigen::VectorXd m_mf_y;
+	Eigen::VectorXd m_mf_K;
+	Eigen::VectorXd m_mf_D;
+
+	// Parallel assembly
+	std::shared_ptr<ThreadPool> m_pool;
+	TaskGraph m_assembly;
+	std::vector<Eigen::VectorXd> m_task_f;		// per task force, nm x 1
+	std::vector<Eigen::VectorXd> m_task_tmp;	// per task scratch for the unused damping forces
+	std::vector<std::vector<T> > m_task_D;
+	std::vector<std::vector<T> > m_task_K;
+	std::vector<Eigen::VectorXd> m_task_Kdiag;	// per task diag(Km) of the matrix-free solve, nm x 1
+	SpringDamperBatch m_spring_batch;
+
+	// Telemetry of the current step
+	TelemetryRecord m_record;
+	double m_energy0;	// K + V of the first step
+	int m_step_offset;	// steps taken before the restored state
+
+	std::shared_ptr<SystemCapture> m_capture;
+	Eigen::VectorXd m_capture_sol;	// [qdot1; lambda] of the equality solve
+	std::shared_ptr<AdjointTape> m_tape;
+
+	std::shared_ptr<Islands> m_islands;
+	bool m_compact;				// this step solves for the awake DOFs only
+	int m_full_nr;				// the system of all DOFs, kept while the step is compact
+	int m_full_ne;
+	Eigen::SparseMatrix<double> m_full_MDKr;
+	Eigen::VectorXd m_full_qdot0;
+	Eigen::VectorXd m_full_fr;
+	Eigen::MatrixXd m_full_G;
+	Eigen::VectorXd m_full_rhsG;
+	Eigen::VectorXd m_full_guess;
+	Eigen::VectorXi m_awake_ordering;
+	std::vector<int> m_sleep_rows;		// active equality rows of the last step
+	Eigen::VectorXd m_sleep_tau;		// joint torques of the last step
+	std::vector<bool> m_sleep_contacts;	// floor contact of each soft body in the last step
+
 };
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "rmpch.h"
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace Eigen;
+
+SpatialGrid::SpatialGrid() :
+	m_origin(Vector3d::Zero()),
+	m_dims(Vector3i::Zero()),
+	m_cell(1.0)
+{
+
+}
+
+void SpatialGrid::clear() {
+	m_lo.clear();
+	m_hi.clear();
+	m_cell_start.clear();
+	m_cell_items.clear();
+	m_dims.setZero();
+}
+
+void SpatialGrid::build(const vector<Vector3d> &lo, const vector<Vector3d> &hi, double cell) {
+	clear();
+	m_lo = lo;
+	m_hi = hi;
+	int n = size();
+	if (n == 0) {
+		return;
+	}
+
+	Vector3d xmin = lo[0];
+	Vector3d xmax = hi[0];
+	double extent = 0.0;
+	for (int i = 0; i < n; ++i) {
+		xmin = xmin.cwiseMin(lo[i]);
+		xmax = xmax.cwiseMax(hi[i]);
+		extent += (hi[i] - lo[i]).maxCoeff();
+	}
+	Vector3d box = xmax - xmin;
+
+	if (cell <= 0.0) {
+		// About the size of an item, or a few items per cell for point sets
+		cell = max(extent / n, box.maxCoeff() / cbrt((double)n));
+	}
+	if (cell <= 0.0) {
+		cell = 1.0;
+	}
+
+	// Keep the number of cells linear in the number of items
+	long long ncells;
+	while (true) {
+		for (int k = 0; k < 3; ++k) {
+			m_dims(k) = (int)floor(box(k) / cell) + 1;
+		}
+		ncells = (long long)m_dims(0) * m_dims(1) * m_dims(2);
+		if (ncells <= 8 * (long long)n + 64) {
+			break;
+		}
+		cell *= 1.5;
+	}
+	m_origin = xmin;
+	m_cell = cell;
+
+	// Count, then fill. Items are visited in order, so every cell lists them ascending.
+	m_cell_start.assign(ncells + 1, 0);
+	for (int i = 0; i < n; ++i) {
+		Vector3i c0 = getCell(lo[i]);
+		Vector3i c1 = getCell(hi[i]);
+		for (int z = c0(2); z <= c1(2); ++z) {
+			for (int y = c0(1); y <= c1(1); ++y) {
+				for (int x = c0(0); x <= c1(0); ++x) {
+					m_cell_start[getCellIndex(x, y, z) + 1]++;
+				}
+			}
+		}
+	}
+	for (long long c = 0; c < ncells; ++c) {
+		m_cell_start[c + 1] += m_cell_start[c];
+	}
+
+	m_cell_items.resize(m_cell_start[ncells]);
+	vector<int> cursor(m_cell_start.begin(), m_cell_start.end() - 1);
+	for (int i = 0; i < n; ++i) {
+		Vector3i c0 = getCell(lo[i]);
+		Vector3i c1 = getCell(hi[i]);
+		for (int z = c0(2); z <= c1(2); ++z) {
+			for (int y = c0(1); y <= c1(1); ++y) {
+				for (int x = c0(0); x <= c1(0); ++x) {
+					m_cell_items[cursor[getCellIndex(x, y, z)]++] = i;
+				}
+			}
+		}
+	}
+}
+
+Vector3i SpatialGrid::getCell(const Vector3d &p) const {
+	Vector3i c;
+	for (int k = 0; k < 3; ++k) {
+		double f = floor((p(k) - m_origin(k)) / m_cell);
+		c(k) = (f < 0.0) ? 0 : (f >= m_dims(k) ? m_dims(k) - 1 : (int)f);
+	}
+	return c;
+}
+
+void SpatialGrid::collect(int c, const Vector3d &lo, const Vector3d &hi, vector<int> &items) const {
+	for (int k = m_cell_start[c]; k < m_cell_start[c + 1]; ++k) {
+		int i = m_cell_items[k];
+		if ((m_lo[i].array() <= hi.array()).all() && (m_hi[i].array() >= lo.array()).all()) {
+			items.push_back(i);
+		}
+	}
+}
+
+void SpatialGrid::sortUnique(vector<int> &items) {
+	sort(items.begin(), items.end());
+	items.erase(unique(items.begin(), items.end()), items.end());
+}
+
+void SpatialGrid::query(const Vector3d &lo, const Vector3d &hi, vector<int> &items) const {
+	items.clear();
+	if (empty()) {
+		return;
+	}
+
+	Vector3i c0 = getCell(lo);
+	Vector3i c1 = getCell(hi);
+	for (int z = c0(2); z <= c1(2); ++z) {
+		for (int y = c0(1); y <= c1(1); ++y) {
+			for (int x = c0(0); x <= c1(0); ++x) {
+				collect(getCellIndex(x, y, z), lo, hi, items);
+			}
+		}
+	}
+	sortUnique(items);
+}
+
+static bool clipRay(const Vector3d &pos, const Vector3d &dir, const Vector3d &lo, const Vector3d &hi, double &t0, double &t1) {
+	// Slab test, [t0, t1] is the part of the ray inside the box
+	t0 = 0.0;
+	t1 = numeric_limits<double>::infinity();
+	for (int k = 0; k < 3; ++k) {
+		if (dir(k) == 0.0) {
+			if (pos(k) < lo(k) || pos(k) > hi(k)) {
+				return false;
+			}
+			continue;
+		}
+		double ta = (lo(k) - pos(k)) / dir(k);
+		double tb = (hi(k) - pos(k)) / dir(k);
+		t0 = max(t0, min(ta, tb));
+		t1 = min(t1, max(ta, tb));
+	}
+	return t0 <= t1;
+}
+
+void SpatialGrid::queryRay(const Vector3d &pos, const Vector3d &dir, vector<int> &items) const {
+	items.clear();
+	if (empty()) {
+		return;
+	}
+
+	double t0, t1;
+	Vector3d gmax = m_origin + m_dims.cast<double>() * m_cell;
+	if (!clipRay(pos, dir, m_origin, gmax, t0, t1)) {
+		return;
+	}
+
+	// Walk the cells along the ray
+	Vector3i c = getCell(pos + t0 * dir);
+	Vector3i step;
+	Vector3d tnext, tdelta;
+	for (int k = 0; k < 3; ++k) {
+		if (dir(k) > 0.0) {
+			step(k) = 1;
+			tnext(k) = (m_origin(k) + (c(k) + 1) * m_cell - pos(k)) / dir(k);
+			tdelta(k) = m_cell / dir(k);
+		}
+		else if (dir(k) < 0.0) {
+			step(k) = -1;
+			tnext(k) = (m_origin(k) + c(k) * m_cell - pos(k)) / dir(k);
+			tdelta(k) = -m_cell / dir(k);
+		}
+		else {
+			step(k) = 0;
+			tnext(k) = numeric_limits<double>::infinity();
+			tdelta(k) = numeric_limits<double>::infinity();
+		}
+	}
+
+	while (true) {
+		int cell = getCellIndex(c(0), c(1), c(2));
+		for (int k = m_cell_start[cell]; k < m_cell_start[cell + 1]; ++k) {
+			int i = m_cell_items[k];
+			double ta, tb;
+			if (clipRay(pos, dir, m_lo[i], m_hi[i], ta, tb)) {
+				items.push_back(i);
+			}
+		}
+
+		int k;
+		tnext.minCoeff(&k);
+		if (tnext(k) > t1) {
+			break;
+		}
+		c(k) += step(k);
+		if (c(k) < 0 || c(k) >= m_dims(k)) {
+			break;
+		}
+		tnext(k) += tdelta(k);
+	}
+	sortUnique(items);
+}
+
+int SpatialGrid::nearest(const Vector3d &p) const {
+	if (empty()) {
+		return -1;
+	}
+
+	// Search rings of cells around p. Items only found in ring r + 1 are at least r cells away.
+	Vector3i c = getCell(p);
+	int best = -1;
+	double best_d2 = numeric_limits<double>::infinity();
+	int rmax = m_dims.maxCoeff();
+	for (int r = 0; r <= rmax; ++r) {
+		Vector3i c0 = (c.array() - r).max(0);
+		Vector3i c1 = (c.array() + r).min(m_dims.array() - 1);
+		for (int z = c0(2); z <= c1(2); ++z) {
+			for (int y = c0(1); y <= c1(1); ++y) {
+				for (int x = c0(0); x <= c1(0); ++x) {
+					if (max(abs(x - c(0)), max(abs(y - c(1)), abs(z - c(2)))) != r) {
+						continue;
+					}
+					int cell = getCellIndex(x, y, z);
+					for (int k = m_cell_start[cell]; k < m_cell_start[cell + 1]; ++k) {
+						int i = m_cell_items[k];
+						double d2 = (p - p.cwiseMax(m_lo[i]).cwiseMin(m_hi[i])).squaredNorm();
+						if (d2 < best_d2 || (d2 == best_d2 && i < best)) {
+							best_d2 = d2;
+							best = i;
+						}
+					}
+				}
+			}
+		}
+		if (best != -1 && best_d2 <= (r * m_cell) * (r * m_cell)) {
+			break;
+		}
+	}
+	return best;
+}
@@ -0,0 +1,56 @@
+#pragma once
+// SpatialGrid Uniform grid over axis-aligned boxes
+//    Every item (a point or the bounding box of an element) is registered in all cells its box
+//    overlaps, stored compressed as one item list per cell. Queries return candidate items in
+//    ascending order, so callers that pick the first match keep the result of a linear scan.
+
+#ifndef REDUCEDCOORD_SRC_SPATIALGRID_H_
+#define REDUCEDCOORD_SRC_SPATIALGRID_H_
+#define EIGEN_USE_MKL_ALL
+
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class SpatialGrid
+{
+public:
+	SpatialGrid();
+	virtual ~SpatialGrid() {}
+
+	// cell <= 0 picks the cell size from the item sizes and counts
+	void build(const std::vector<Eigen::Vector3d> &lo, const std::vector<Eigen::Vector3d> &hi, double cell = 0.0);
+	void build(const std::vector<Eigen::Vector3d> &points, double cell = 0.0) { build(points, points, cell); }
+	void clear();
+
+	// Items whose box overlaps [lo, hi]
+	void query(const Eigen::Vector3d &lo, const Eigen::Vector3d &hi, std::vector<int> &items) const;
+	// Items whose box contains p
+	void query(const Eigen::Vector3d &p, std::vector<int> &items) const { query(p, p, items); }
+	// Items whose box is hit by the ray pos + t * dir, t >= 0
+	void queryRay(const Eigen::Vector3d &pos, const Eigen::Vector3d &dir, std::vector<int> &items) const;
+	// Item with the closest box to p, the smallest index on ties, -1 if the grid is empty
+	int nearest(const Eigen::Vector3d &p) const;
+
+	int size() const { return (int)m_lo.size(); }
+	bool empty() const { return m_lo.empty(); }
+
+private:
+	Eigen::Vector3i getCell(const Eigen::Vector3d &p) const;
+	int getCellIndex(int x, int y, int z) const { return (z * m_dims(1) + y) * m_dims(0) + x; }
+	void collect(int c, const Eigen::Vector3d &lo, const Eigen::Vector3d &hi, std::vector<int> &items) const;
+	static void sortUnique(std::vector<int> &items);
+
+	std::vector<Eigen::Vector3d> m_lo;
+	std::vector<Eigen::Vector3d> m_hi;
+
+	Eigen::Vector3d m_origin;
+	Eigen::Vector3i m_dims;
+	double m_cell;
+
+	std::vector<int> m_cell_start;		// items of cell c are m_cell_items[m_cell_start[c] ... m_cell_start[c + 1])
+	std::vector<int> m_cell_items;
+};
+
+#endif // REDUCEDCOORD_SRC_SPATIALGRID_H_
@@ -43,7 +43,7 @@ void Spring::computeForceStiffnessDampingSparse(Eigen::VectorXd &f, std::vector<
 	}
 }
 
-void Spring::computeStiffnessProd(VectorXd x, VectorXd &y) {
+void Spring::computeStiffnessProd(const VectorXd &x, VectorXd &y) {
 	// Computes y=K*x
 	computeStiffnessProd_(x, y);
 	if (next != nullptr) {
@@ -51,7 +51,7 @@ void Spring::computeStiffnessProd(VectorXd x, VectorXd &y) {
 	}
 }
 
-void Spring::computeDampingProd(VectorXd x, VectorXd &y) {
+void Spring::computeDampingProd(const VectorXd &x, VectorXd &y) {
 	// Computes y=D*x
 	computeDampingProd_(x, y);
 	if (next != nullptr) {
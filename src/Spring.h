@@ -29,8 +29,8 @@ public:
 	void computeForceStiffnessDamping(Eigen::VectorXd &f, Eigen::MatrixXd &K, Eigen::MatrixXd &D);
 	void computeForceStiffnessDampingSparse(Eigen::VectorXd &f, std::vector<T> &K_, std::vector<T> &D_);
 
-	void computeStiffnessProd(Eigen::VectorXd x, Eigen::VectorXd &y);
-	void computeDampingProd(Eigen::VectorXd x, Eigen::VectorXd &y);
+	void computeStiffnessProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeDampingProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
 	void init();
 	void update();	
@@ -45,8 +45,8 @@ public:
 protected:
 	virtual void computeForceStiffnessDampingSparse_(Eigen::VectorXd &f, std::vector<T> &K_, std::vector<T> &D_) {}
 	virtual void computeForceStiffnessDamping_(Eigen::VectorXd &f, Eigen::MatrixXd &K, Eigen::MatrixXd &D) {}
-	virtual void computeStiffnessProd_(Eigen::VectorXd x, Eigen::VectorXd &y) {}
-	virtual void computeDampingProd_(Eigen::VectorXd x, Eigen::VectorXd &y) {}
+	virtual void computeStiffnessProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y) {}
+	virtual void computeDampingProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y) {}
 	virtual void computeEnergies_(Vector3d grav, Energy &ener) {}
 	virtual void draw_(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const {}
 
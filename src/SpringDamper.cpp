@@ -8,7 +8,9 @@ using namespace std;
 using namespace Eigen;
 using json = nlohmann::json;
 
-SpringDamper::SpringDamper() {
+SpringDamper::SpringDamper() :
+m_isFKDValid(false)
+{
 
 }
 
@@ -17,7 +19,8 @@ SpringDamper::SpringDamper(shared_ptr<Body> body0, Vector3d r0, shared_ptr<Body>
 Spring(),
 m_body0(body0), m_body1(body1), 
 m_r0(r0), m_r1(r1),
-m_K(1.0), m_L(0.0), m_damping(1.0)
+m_K(1.0), m_L(0.0), m_damping(1.0),
+m_isFKDValid(false)
 {
 	for (int i = 0; i < 2; i++) {
 		auto node = make_shared<Node>();
@@ -64,7 +67,13 @@ void SpringDamper::init_() {
 	// Set the nodal positions
 	m_nodes[0]->x0 = x0.segment<3>(0);
 	m_nodes[1]->x0 = x1.segment<3>(0);
-	
+
+	// Unless set explicitly, the rest length is the initial length. It is fixed here rather than
+	// at the first evaluation, so that a restored or cloned world keeps the rest length of the
+	// scene instead of taking it from the restored pose.
+	if (m_L == 0.0) {
+		m_L = (x1 - x0).norm();
+	}
 }
 
 void SpringDamper::load(const string &RESOURCE_DIR) {
@@ -102,19 +111,15 @@ void SpringDamper::computeEnergies_(Vector3d grav, Energy &ener) {
 	Vector3d x1_w = E1.block<3, 4>(0, 0)*temp1;
 
 	m_l = (x1_w - x0_w).norm();
-	if (m_L == 0.0) {
-		m_L = m_l;
-	}
 
 	double e = (m_l - m_L) / m_L;
 	ener.V = ener.V + 0.5 * m_K * e * e;
 	
 }
 
-void SpringDamper::computeStiffnessProd_(VectorXd x, VectorXd &y) {
-	Vector12d f_;
-	Matrix12d K_, D_;
-	computeFKD(f_, K_, D_);
+void SpringDamper::computeStiffnessProd_(const VectorXd &x, VectorXd &y) {
+	computeFKD();
+	const Matrix12d &K_ = m_fkd_K;
 	int idxM0, idxM1;
 	if (m_body0 != nullptr) {
 		idxM0 = m_body0->idxM;
@@ -138,10 +143,9 @@ void SpringDamper::computeStiffnessProd_(VectorXd x, VectorXd &y) {
 	}
 }
 
-void SpringDamper::computeDampingProd_(VectorXd x, VectorXd &y) {
-	Vector12d f_;
-	Matrix12d K_, D_;
-	computeFKD(f_, K_, D_);
+void SpringDamper::computeDampingProd_(const VectorXd &x, VectorXd &y) {
+	computeFKD();
+	const Matrix12d &D_ = m_fkd_D;
 	int idxM0, idxM1;
 	if (m_body0 != nullptr) {
 		idxM0 = m_body0->idxM;
@@ -166,9 +170,10 @@ void SpringDamper::computeDampingProd_(VectorXd x, VectorXd &y) {
 }
 
 void SpringDamper::computeForceStiffnessDamping_(VectorXd &f, MatrixXd &K, MatrixXd &D) {
-	Vector12d f_;
-	Matrix12d K_, D_;
-	computeFKD(f_, K_, D_);
+	computeFKD();
+	const Vector12d &f_ = m_fkd_f;
+	const Matrix12d &K_ = m_fkd_K;
+	const Matrix12d &D_ = m_fkd_D;
 
 	int idxM0, idxM1;
 
@@ -210,9 +215,10 @@ void SpringDamper::computeForceStiffnessDamping_(VectorXd &f, MatrixXd &K, Matri
 }
 
 void SpringDamper::computeForceStiffnessDampingSparse_(VectorXd &f, std::vector<T> &K, std::vector<T> &D) {
-	Vector12d f_;
-	Matrix12d K_, D_;
-	computeFKD(f_, K_, D_);
+	computeFKD();
+	const Vector12d &f_ = m_fkd_f;
+	const Matrix12d &K_ = m_fkd_K;
+	const Matrix12d &D_ = m_fkd_D;
 
 	int idxM0, idxM1;
 
@@ -264,7 +270,36 @@ void SpringDamper::computeForceStiffnessDampingSparse_(VectorXd &f, std::vector<
 	}
 }
 
-void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
+bool SpringDamper::isFKDValid() const {
+	if (!m_isFKDValid) {
+		return false;
+	}
+	if (m_body0 != nullptr && (m_body0->E_wi != m_fkd_E0 || m_body0->phi != m_fkd_phi0)) {
+		return false;
+	}
+	if (m_body1 != nullptr && (m_body1->E_wi != m_fkd_E1 || m_body1->phi != m_fkd_phi1)) {
+		return false;
+	}
+	return true;
+}
+
+void SpringDamper::setFKDKey() {
+	if (m_body0 != nullptr) {
+		m_fkd_E0 = m_body0->E_wi;
+		m_fkd_phi0 = m_body0->phi;
+	}
+	if (m_body1 != nullptr) {
+		m_fkd_E1 = m_body1->E_wi;
+		m_fkd_phi1 = m_body1->phi;
+	}
+	m_isFKDValid = true;
+}
+
+void SpringDamper::computeFKD() {
+	if (isFKDValid()) {
+		return;
+	}
+
 	Matrix4d E0, E1;
 	E0.setIdentity();
 	E1.setIdentity();
@@ -293,9 +328,6 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	dx_w = x1_w - x0_w;
 	m_l = dx_w.norm();
 
-	if (m_L == 0.0) {
-		m_L = m_l;
-	}
 
 	Matrix3d R0, R1;
 	R0 = E0.block<3, 3>(0, 0);
@@ -311,6 +343,23 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	v1_w.noalias() = R1 * G1 * phi1;
 
 	double v = (dx_w / m_l).transpose() * (v1_w - v0_w);
+	double fs = m_K * (m_l - m_L) / m_L - m_damping * v;
+
+	computeFKD(R0, R1, E0.block<3, 1>(0, 3), E1.block<3, 1>(0, 3), m_r0, m_r1, x0_w, x1_w,
+		m_l, fs, m_K, m_L, m_damping, m_fkd_f, m_fkd_K, m_fkd_D);
+	setFKDKey();
+}
+
+void SpringDamper::computeFKD(const Matrix3d &R0, const Matrix3d &R1, const Vector3d &p0, const Vector3d &p1,
+	const Vector3d &r0, const Vector3d &r1, const Vector3d &x0_w, const Vector3d &x1_w,
+	double l, double fs, double K_s, double L, double damping,
+	Vector12d &f, Matrix12d &K, Matrix12d &D) 
+{
+	Vector3d dx_w = x1_w - x0_w;
+
+	Matrix3x6d G0, G1;
+	G0 = SE3::gamma(r0);
+	G1 = SE3::gamma(r1);
 
 	Vector6d fx_0, fx_1;
 	fx_0.noalias() = -G0.transpose() * R0.transpose() * dx_w;
@@ -319,14 +368,13 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	Vector12d fx, fn;
 	fx << fx_0, fx_1;
 
-	fn = (1.0 / m_l) *fx;
-	double fs = m_K * (m_l - m_L) / m_L - m_damping * v;
+	fn = (1.0 / l) *fx;
 
 	f = -fs * fn;
 
 	// Kn0
 	Vector3d ddxinvdx0, ddxinvdx1;
-	ddxinvdx0 = dx_w / (m_l * m_l * m_l);
+	ddxinvdx0 = dx_w / (l * l * l);
 	ddxinvdx1 = -ddxinvdx0;
 
 	Vector6d ddxinvdE0, ddxinvdE1;
@@ -340,13 +388,10 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	//cout << Kn0 << endl;
 	// Kn1
 	Kn1.setZero();
-	Vector3d p0, p1;
-	p0 = E0.block<3, 1>(0, 3);
-	p1 = E1.block<3, 1>(0, 3);
 
 	Matrix3d x0b, x1b;
-	x0b = SE3::bracket3(m_r0);
-	x1b = SE3::bracket3(m_r1);
+	x0b = SE3::bracket3(r0);
+	x1b = SE3::bracket3(r1);
 
 	Matrix3d I3;
 	I3.setIdentity();
@@ -371,12 +416,12 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	Kn1.block<3, 3>(0, 9).noalias() = x0b * Kn1.block<3, 3>(3, 9);
 	Kn1.block<3, 3>(9, 9) = I3;
 	Kn1.block<3, 3>(6, 9) = x1b;
-	Kn1 /= m_l;
+	Kn1 /= l;
 	// Stiffness term for vector part
 	Kn = Kn0 + Kn1;
 
 	// Stiffness scalar part
-	Vector3d dfsdx0 = - m_K / m_L * dx_w/ m_l;
+	Vector3d dfsdx0 = - K_s / L * dx_w/ l;
 	Vector6d dfsdE0 = dfsdx0.transpose() * R0 * G0;
 	Vector6d dfsdE1 = -dfsdx0.transpose() * R1 * G1;
 
@@ -389,9 +434,9 @@ void SpringDamper::computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D) {
 	K = K_sym; // symmetrize
 	
 	// Damping scalar part
-	Vector3d dir_w = dx_w / m_l;
+	Vector3d dir_w = dx_w / l;
 	Vector6d dfmdphi0, dfmdphi1;
-	Vector3d dfmdv0 = m_damping * dir_w;
+	Vector3d dfmdv0 = damping * dir_w;
 	dfmdphi0.noalias() = dfmdv0.transpose() * R0 * G0;
 	dfmdphi1.noalias() = -dfmdv0.transpose() * R1 * G1;
 	Vector12d dfmdphi;
@@ -10,6 +10,7 @@
 
 class Body;
 class Node;
+class SpringDamperBatch;
 
 typedef Eigen::Triplet<double> T;
 
@@ -21,9 +22,9 @@ public:
 	SpringDamper(std::shared_ptr<Body> body0, Vector3d r0, std::shared_ptr<Body> body1, Vector3d r1);
 	virtual ~SpringDamper() {}
 
-	void setStiffness(double K) { m_K = K; }
-	void setDamping(double damping) { m_damping = damping; }
-	void setRestLength(double L) { m_L = L; }
+	void setStiffness(double K) { m_K = K; m_isFKDValid = false; }
+	void setDamping(double damping) { m_damping = damping; m_isFKDValid = false; }
+	void setRestLength(double L) { m_L = L; m_isFKDValid = false; }
 
 	void init_();
 	void load(const std::string &RESOURCE_DIR);
@@ -31,12 +32,24 @@ public:
 	void update_();
 	void computeEnergies_(Vector3d grav, Energy &ener);
 
+	friend class SpringDamperBatch;
+
 private:
-	void computeFKD(Vector12d &f, Matrix12d &K, Matrix12d &D);
+	// Updates m_fkd_f, m_fkd_K and m_fkd_D unless the attached bodies are where they were
+	// at the last evaluation
+	void computeFKD();
+	bool isFKDValid() const;
+	void setFKDKey();
+
+	// f, K and D from the world attachment points, the length and the scalar force
+	static void computeFKD(const Matrix3d &R0, const Matrix3d &R1, const Vector3d &p0, const Vector3d &p1,
+		const Vector3d &r0, const Vector3d &r1, const Vector3d &x0_w, const Vector3d &x1_w,
+		double l, double fs, double K_s, double L, double damping,
+		Vector12d &f, Matrix12d &K, Matrix12d &D);
 
 protected:
-	void computeStiffnessProd_(Eigen::VectorXd x, Eigen::VectorXd &y);
-	void computeDampingProd_(Eigen::VectorXd x, Eigen::VectorXd &y);
+	void computeStiffnessProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeDampingProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y);
 	void computeForceStiffnessDamping_(Eigen::VectorXd &f, Eigen::MatrixXd &K, Eigen::MatrixXd &D);
 	void computeForceStiffnessDampingSparse_(Eigen::VectorXd &f, std::vector<T> &K_, std::vector<T> &D_);
 
@@ -50,6 +63,16 @@ protected:
 	Vector3d m_r0;
 	Vector3d m_r1;
 
+	// Last evaluation of computeFKD() and the body state it was computed for
+	Vector12d m_fkd_f;
+	Matrix12d m_fkd_K;
+	Matrix12d m_fkd_D;
+	Matrix4d m_fkd_E0;
+	Matrix4d m_fkd_E1;
+	Vector6d m_fkd_phi0;
+	Vector6d m_fkd_phi1;
+	bool m_isFKDValid;
+
 };
 
 
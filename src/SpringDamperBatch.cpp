@@ -0,0 +1,144 @@
+#include "rmpch.h"
+#include "SpringDamperBatch.h"
+
+#include "Body.h"
+#include "SpringDamper.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace Eigen;
+
+typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowsXd;
+
+// y = R * x for every column, R holds the rotations row by row
+static void rotate(const RowsXd &R, const RowsXd &x, RowsXd &y) {
+	for (int a = 0; a < 3; ++a) {
+		y.row(a) = R.row(3 * a).cwiseProduct(x.row(0)) + R.row(3 * a + 1).cwiseProduct(x.row(1)) + R.row(3 * a + 2).cwiseProduct(x.row(2));
+	}
+}
+
+// y = a x b for every column
+static void cross(const RowsXd &a, const RowsXd &b, RowsXd &y) {
+	y.row(0) = a.row(1).cwiseProduct(b.row(2)) - a.row(2).cwiseProduct(b.row(1));
+	y.row(1) = a.row(2).cwiseProduct(b.row(0)) - a.row(0).cwiseProduct(b.row(2));
+	y.row(2) = a.row(0).cwiseProduct(b.row(1)) - a.row(1).cwiseProduct(b.row(0));
+}
+
+void SpringDamperBatch::init(const vector<shared_ptr<SpringDamper> > &springs) {
+	m_springs = springs;
+	m_n = (int)springs.size();
+
+	m_r0.resize(3, m_n);
+	m_r1.resize(3, m_n);
+	for (int i = 0; i < m_n; ++i) {
+		m_r0.col(i) = springs[i]->m_r0;
+		m_r1.col(i) = springs[i]->m_r1;
+	}
+	m_K.resize(m_n);
+	m_L.resize(m_n);
+	m_damping.resize(m_n);
+
+	m_R0.resize(9, m_n);
+	m_R1.resize(9, m_n);
+	m_p0.resize(3, m_n);
+	m_p1.resize(3, m_n);
+	m_w0.resize(3, m_n);
+	m_w1.resize(3, m_n);
+	m_v0.resize(3, m_n);
+	m_v1.resize(3, m_n);
+
+	m_x0_w.resize(3, m_n);
+	m_x1_w.resize(3, m_n);
+	m_dx_w.resize(3, m_n);
+	m_v0_w.resize(3, m_n);
+	m_v1_w.resize(3, m_n);
+	m_tmp.resize(3, m_n);
+	m_l.resize(m_n);
+	m_fs.resize(m_n);
+}
+
+void SpringDamperBatch::gather() {
+	for (int i = 0; i < m_n; ++i) {
+		const SpringDamper &s = *m_springs[i];
+		Matrix4d E0, E1;
+		E0.setIdentity();
+		E1.setIdentity();
+		Vector6d phi0, phi1;
+		phi0.setZero();
+		phi1.setZero();
+
+		if (s.m_body0 != nullptr) {
+			E0 = s.m_body0->E_wi;
+			phi0 = s.m_body0->phi;
+		}
+		if (s.m_body1 != nullptr) {
+			E1 = s.m_body1->E_wi;
+			phi1 = s.m_body1->phi;
+		}
+
+		for (int a = 0; a < 3; ++a) {
+			for (int b = 0; b < 3; ++b) {
+				m_R0(3 * a + b, i) = E0(a, b);
+				m_R1(3 * a + b, i) = E1(a, b);
+			}
+		}
+		m_p0.col(i) = E0.block<3, 1>(0, 3);
+		m_p1.col(i) = E1.block<3, 1>(0, 3);
+		m_w0.col(i) = phi0.segment<3>(0);
+		m_w1.col(i) = phi1.segment<3>(0);
+		m_v0.col(i) = phi0.segment<3>(3);
+		m_v1.col(i) = phi1.segment<3>(3);
+
+		m_K(i) = s.m_K;
+		m_L(i) = s.m_L;
+		m_damping(i) = s.m_damping;
+	}
+}
+
+void SpringDamperBatch::evaluate() {
+	if (m_n == 0) {
+		return;
+	}
+	gather();
+
+	// Attachment points x = R * r + p and their velocities R * (w x r + v)
+	rotate(m_R0, m_r0, m_x0_w);
+	m_x0_w += m_p0;
+	rotate(m_R1, m_r1, m_x1_w);
+	m_x1_w += m_p1;
+	m_dx_w = m_x1_w - m_x0_w;
+
+	cross(m_w0, m_r0, m_tmp);
+	m_tmp += m_v0;
+	rotate(m_R0, m_tmp, m_v0_w);
+	cross(m_w1, m_r1, m_tmp);
+	m_tmp += m_v1;
+	rotate(m_R1, m_tmp, m_v1_w);
+
+	m_l = (m_dx_w.row(0).array().square() + m_dx_w.row(1).array().square() + m_dx_w.row(2).array().square()).sqrt().transpose();
+
+	// Scalar force from the stretch and the rate along the spring
+	m_tmp = m_v1_w - m_v0_w;
+	ArrayXd v = (m_dx_w.row(0).cwiseProduct(m_tmp.row(0)) + m_dx_w.row(1).cwiseProduct(m_tmp.row(1)) + m_dx_w.row(2).cwiseProduct(m_tmp.row(2))).array().transpose() / m_l;
+	m_fs = m_K * (m_l - m_L) / m_L - m_damping * v;
+
+	parallelFor(0, m_n, [&](int i) {
+		SpringDamper &s = *m_springs[i];
+		Matrix3d R0, R1;
+		for (int a = 0; a < 3; ++a) {
+			for (int b = 0; b < 3; ++b) {
+				R0(a, b) = m_R0(3 * a + b, i);
+				R1(a, b) = m_R1(3 * a + b, i);
+			}
+		}
+		Vector3d p0 = m_p0.col(i);
+		Vector3d p1 = m_p1.col(i);
+		Vector3d x0_w = m_x0_w.col(i);
+		Vector3d x1_w = m_x1_w.col(i);
+
+		s.m_l = m_l(i);
+		SpringDamper::computeFKD(R0, R1, p0, p1, s.m_r0, s.m_r1, x0_w, x1_w,
+			m_l(i), m_fs(i), m_K(i), m_L(i), m_damping(i), s.m_fkd_f, s.m_fkd_K, s.m_fkd_D);
+		s.setFKDKey();
+	});
+}
@@ -0,0 +1,62 @@
+#pragma once
+// SpringDamperBatch Evaluates f, K and D of many SpringDampers at once
+//    The body frames, twists and spring parameters are gathered into structure-of-arrays form,
+//    one row per component and one column per spring, so the attachment points, lengths,
+//    rates and scalar forces are computed row by row over all springs. The 12x12 blocks are
+//    then filled in parallel and stored in the per-spring caches, where the force, stiffness
+//    and damping product calls of the step pick them up.
+
+#ifndef REDUCEDCOORD_SRC_SPRINGDAMPERBATCH_H_
+#define REDUCEDCOORD_SRC_SPRINGDAMPERBATCH_H_
+#define EIGEN_USE_MKL_ALL
+
+#include <vector>
+#include <memory>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+
+class SpringDamper;
+
+class SpringDamperBatch
+{
+public:
+	SpringDamperBatch() : m_n(0) {}
+	virtual ~SpringDamperBatch() {}
+
+	void init(const std::vector<std::shared_ptr<SpringDamper> > &springs);
+	void evaluate();
+
+	int size() const { return m_n; }
+
+private:
+	typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowsXd;
+
+	void gather();
+
+	int m_n;
+	std::vector<std::shared_ptr<SpringDamper> > m_springs;
+
+	// Parameters
+	RowsXd m_r0;		// 3 x n
+	RowsXd m_r1;
+	Eigen::ArrayXd m_K;
+	Eigen::ArrayXd m_L;
+	Eigen::ArrayXd m_damping;
+
+	// Body state, R row by row (9 x n), p, w and v (3 x n)
+	RowsXd m_R0, m_p0, m_w0, m_v0;
+	RowsXd m_R1, m_p1, m_w1, m_v1;
+
+	// Per spring results
+	RowsXd m_x0_w;		// 3 x n
+	RowsXd m_x1_w;
+	RowsXd m_dx_w;
+	RowsXd m_v0_w;
+	RowsXd m_v1_w;
+	RowsXd m_tmp;
+	Eigen::ArrayXd m_l;
+	Eigen::ArrayXd m_fs;
+};
+
+#endif // REDUCEDCOORD_SRC_SPRINGDAMPERBATCH_H_
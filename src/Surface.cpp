@@ -1,29 +1,30 @@
 #include "rmpch.h"
-#define TETLIBRARY
-#include <tetgen.h>
 #include "Surface.h"
 #include "Node.h"
 #include "FaceTriangle.h"
+#include "ParallelFor.h"
+#include "MeshRegistry.h"
+#include "TetMesh.h"
 
 using namespace std;
 using namespace Eigen;
 using json = nlohmann::json;
 
 void Surface::load(const string &RESOURCE_DIR, const string &MESH_NAME, const string &TETGEN_FLAGS) {
-	// Tetrahedralize 3D mesh
-	tetgenio input_mesh, output_mesh;
-	input_mesh.load_ply((char *)(RESOURCE_DIR + MESH_NAME).c_str());
-	tetrahedralize((char *)TETGEN_FLAGS.c_str(), &input_mesh, &output_mesh);//"pqz"
+	// Tetrahedralize 3D mesh, or load the cached result
+	shared_ptr<const TetMesh> output_mesh = MeshRegistry::getTetMesh(RESOURCE_DIR, MESH_NAME, TETGEN_FLAGS, false);//"pqz"
+	const double *pointlist = output_mesh->getPoints();
+	const int *trifacelist = output_mesh->getFaces();
 
 	double r = 0.01;
 	
 	// Create Nodes
-	for (int i = 0; i < output_mesh.numberofpoints; i++) {
+	for (int i = 0; i < output_mesh->getNodeCount(); i++) {
 		auto node = make_shared<Node>();
 		node->r = r;
-		node->x0 << output_mesh.pointlist[3 * i + 0],
-			output_mesh.pointlist[3 * i + 1],
-			output_mesh.pointlist[3 * i + 2];
+		node->x0 << pointlist[3 * i + 0],
+			pointlist[3 * i + 1],
+			pointlist[3 * i + 2];
 
 		node->x = node->x0;
 		node->v0.setZero();
@@ -35,11 +36,11 @@ void Surface::load(const string &RESOURCE_DIR, const string &MESH_NAME, const st
 	}
 	
 	// Create Faces
-	for (int i = 0; i < output_mesh.numberoftrifaces; i++) {
+	for (int i = 0; i < output_mesh->getFaceCount(); i++) {
 		auto triface = make_shared<FaceTriangle>();
 
 		for (int ii = 0; ii < 3; ii++) {
-			auto node = m_nodes[output_mesh.trifacelist[3 * i + ii]];
+			auto node = m_nodes[trifacelist[3 * i + ii]];
 			node->m_nfaces++;
 			triface->m_nodes.push_back(node);
 
@@ -74,6 +75,10 @@ void Surface::init() {
 		eleBuf[3 * i + 2] = 3 * i + 2;
 	}
 
+	if (GLSL::isHeadless()) {
+		return;
+	}
+
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
 	glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
@@ -136,11 +141,10 @@ void Surface::draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Progra
 
 void Surface::updatePosNor() {
 
-#pragma omp parallel for num_threads(getThreadsNumber((int)m_nodes.size(), MIN_ITERATOR_NUM))
-	for (int i = 0; i < (int)m_nodes.size(); i++) {
+	parallelFor(0, (int)m_nodes.size(), [&](int i) {
 		auto node = m_nodes[i];
 		node->clearNormals();
-	}
+	});
 
 
 	for (int i = 0; i < (int)m_trifaces.size(); i++) {
@@ -211,3 +215,24 @@ void Surface::exportObj(std::ofstream& outfile)
 		outfile << "f " << eleBuf[i]+1 << "//" << eleBuf[i] + 1 << " " << eleBuf[i+1] + 1 << "//" << eleBuf[i+1] + 1 << " " << eleBuf[i+2] + 1 << "//" << eleBuf[i+2] + 1 << endl;
 	}
 }
+
+void Surface::getTrajectoryTopology(int &nverts, vector<int> &tris) const
+{
+	nverts = (int)m_nodes.size();
+	tris.resize(3 * m_trifaces.size());
+	for (int i = 0; i < (int)m_trifaces.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			tris[3 * i + k] = m_trifaces[i]->m_nodes[k]->i;
+		}
+	}
+}
+
+void Surface::getTrajectoryPositions(vector<double> &x) const
+{
+	x.resize(3 * m_nodes.size());
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			x[3 * i + k] = m_nodes[i]->x(k);
+		}
+	}
+}
@@ -39,6 +39,9 @@ public:
 	double m_floor_y;
 
 	void exportObj(std::ofstream& outfile);
+	// Boundary triangles as node indices, and the node positions
+	void getTrajectoryTopology(int &nverts, std::vector<int> &tris) const;
+	void getTrajectoryPositions(std::vector<double> &x) const;
 protected:
 	Vector3f m_color;
 
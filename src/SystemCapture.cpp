@@ -0,0 +1,325 @@
+#include "rmpch.h"
+#include "SystemCapture.h"
+#include "AssetCache.h"
+
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+using namespace Eigen;
+
+// Bumped whenever the binary layout changes
+static const uint32_t MATRIX_VERSION = 1;
+
+enum MatrixLayout { LAYOUT_CSR = 0, LAYOUT_DENSE = 1 };
+
+struct MatrixHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t layout;
+	uint32_t pad;
+	int64_t rows;
+	int64_t cols;
+	int64_t nonzeros;	// rows * cols when dense
+};
+
+static bool isText(const string &FILE) {
+	return FILE.size() >= 4 && FILE.compare(FILE.size() - 4, 4, ".mtx") == 0;
+}
+
+static bool writeBinary(const string &FILE, const MatrixHeader &header, const vector<pair<const void *, size_t> > &blocks) {
+	ofstream out(FILE.c_str(), ios::binary | ios::trunc);
+	if (!out) {
+		cerr << "SystemCapture: cannot open " << FILE << endl;
+		return false;
+	}
+	out.write((const char *)&header, sizeof(header));
+	for (int i = 0; i < (int)blocks.size(); ++i) {
+		out.write((const char *)blocks[i].first, blocks[i].second);
+	}
+	return (bool)out;
+}
+
+static MatrixHeader makeHeader(MatrixLayout layout, int64_t rows, int64_t cols, int64_t nonzeros) {
+	MatrixHeader header;
+	memcpy(header.magic, "RMMX", 4);
+	header.version = MATRIX_VERSION;
+	header.layout = layout;
+	header.pad = 0;
+	header.rows = rows;
+	header.cols = cols;
+	header.nonzeros = nonzeros;
+	return header;
+}
+
+bool writeMatrix(const string &FILE, const SparseMatrix<double> &A) {
+	SparseMatrix<double, RowMajor> R = A;
+	R.makeCompressed();
+	if (!isText(FILE)) {
+		MatrixHeader header = makeHeader(LAYOUT_CSR, R.rows(), R.cols(), R.nonZeros());
+		vector<pair<const void *, size_t> > blocks;
+		blocks.push_back(make_pair((const void *)R.outerIndexPtr(), (R.rows() + 1) * sizeof(int)));
+		blocks.push_back(make_pair((const void *)R.innerIndexPtr(), R.nonZeros() * sizeof(int)));
+		blocks.push_back(make_pair((const void *)R.valuePtr(), R.nonZeros() * sizeof(double)));
+		return writeBinary(FILE, header, blocks);
+	}
+
+	std::FILE *out = fopen(FILE.c_str(), "w");
+	if (out == nullptr) {
+		cerr << "SystemCapture: cannot open " << FILE << endl;
+		return false;
+	}
+	fprintf(out, "%%%%MatrixMarket matrix coordinate real general\n");
+	fprintf(out, "%d %d %d\n", (int)R.rows(), (int)R.cols(), (int)R.nonZeros());
+	for (int i = 0; i < R.outerSize(); ++i) {
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(R, i); it; ++it) {
+			fprintf(out, "%d %d %.17g\n", i + 1, (int)it.index() + 1, it.value());
+		}
+	}
+	fclose(out);
+	return true;
+}
+
+bool writeMatrix(const string &FILE, const MatrixXd &A) {
+	if (!isText(FILE)) {
+		MatrixHeader header = makeHeader(LAYOUT_DENSE, A.rows(), A.cols(), A.size());
+		vector<pair<const void *, size_t> > blocks;
+		blocks.push_back(make_pair((const void *)A.data(), A.size() * sizeof(double)));
+		return writeBinary(FILE, header, blocks);
+	}
+
+	std::FILE *out = fopen(FILE.c_str(), "w");
+	if (out == nullptr) {
+		cerr << "SystemCapture: cannot open " << FILE << endl;
+		return false;
+	}
+	fprintf(out, "%%%%MatrixMarket matrix array real general\n");
+	fprintf(out, "%d %d\n", (int)A.rows(), (int)A.cols());
+	for (int k = 0; k < A.size(); ++k) {
+		fprintf(out, "%.17g\n", A.data()[k]);
+	}
+	fclose(out);
+	return true;
+}
+
+// Reads either layout, one of S or D is filled
+static bool readAny(const string &FILE, SparseMatrix<double> &S, MatrixXd &D, bool &isDense) {
+	ifstream in(FILE.c_str(), ios::binary);
+	if (!in) {
+		cerr << "SystemCapture: cannot open " << FILE << endl;
+		return false;
+	}
+	char magic[4] = { 0, 0, 0, 0 };
+	in.read(magic, 4);
+	in.seekg(0);
+
+	if (memcmp(magic, "RMMX", 4) == 0) {
+		MatrixHeader header;
+		if (!in.read((char *)&header, sizeof(header)) || header.version != MATRIX_VERSION ||
+			header.rows < 0 || header.cols < 0 || header.nonzeros < 0) {
+			cerr << "SystemCapture: " << FILE << " has an unknown version" << endl;
+			return false;
+		}
+		isDense = (header.layout == LAYOUT_DENSE);
+		if (isDense) {
+			D.resize(header.rows, header.cols);
+			in.read((char *)D.data(), D.size() * sizeof(double));
+			return (bool)in;
+		}
+		vector<int> outer(header.rows + 1), inner(header.nonzeros);
+		vector<double> values(header.nonzeros);
+		in.read((char *)outer.data(), outer.size() * sizeof(int));
+		in.read((char *)inner.data(), inner.size() * sizeof(int));
+		in.read((char *)values.data(), values.size() * sizeof(double));
+		if (!in) {
+			cerr << "SystemCapture: " << FILE << " is truncated" << endl;
+			return false;
+		}
+		Map<SparseMatrix<double, RowMajor> > R(header.rows, header.cols, header.nonzeros, outer.data(), inner.data(), values.data());
+		S = R;
+		return true;
+	}
+
+	string line;
+	getline(in, line);
+	if (line.compare(0, 14, "%%MatrixMarket") != 0) {
+		cerr << "SystemCapture: " << FILE << " is not a matrix" << endl;
+		return false;
+	}
+	isDense = (line.find("array") != string::npos);
+	bool isSymmetric = (line.find("symmetric") != string::npos);
+	while (getline(in, line) && (line.empty() || line[0] == '%')) {
+	}
+	istringstream size(line);
+	int rows = 0, cols = 0, nonzeros = 0;
+	size >> rows >> cols >> nonzeros;
+
+	if (isDense) {
+		D.resize(rows, cols);
+		for (int k = 0; k < D.size(); ++k) {
+			in >> D.data()[k];
+		}
+		return (bool)in;
+	}
+	vector<Triplet<double> > triplets;
+	triplets.reserve(isSymmetric ? 2 * nonzeros : nonzeros);
+	for (int k = 0; k < nonzeros; ++k) {
+		int i, j;
+		double v;
+		if (!(in >> i >> j >> v)) {
+			cerr << "SystemCapture: " << FILE << " is truncated" << endl;
+			return false;
+		}
+		triplets.push_back(Triplet<double>(i - 1, j - 1, v));
+		if (isSymmetric && i != j) {
+			triplets.push_back(Triplet<double>(j - 1, i - 1, v));
+		}
+	}
+	S.resize(rows, cols);
+	S.setFromTriplets(triplets.begin(), triplets.end());
+	return true;
+}
+
+bool readMatrix(const string &FILE, SparseMatrix<double> &A) {
+	MatrixXd D;
+	bool isDense = false;
+	if (!readAny(FILE, A, D, isDense)) {
+		return false;
+	}
+	if (isDense) {
+		A = D.sparseView(0.0);
+	}
+	return true;
+}
+
+bool readMatrix(const string &FILE, MatrixXd &A) {
+	SparseMatrix<double> S;
+	bool isDense = false;
+	if (!readAny(FILE, S, A, isDense)) {
+		return false;
+	}
+	if (!isDense) {
+		A = MatrixXd(S);
+	}
+	return true;
+}
+
+SystemCapture::SystemCapture(const string &DIR) :
+	m_dir(DIR),
+	m_max(100),
+	m_count(0),
+	m_text(false),
+	m_dir_checked(false)
+{
+
+}
+
+void SystemCapture::addSteps(int first, int last) {
+	m_steps.push_back(make_pair(first, last));
+}
+
+bool SystemCapture::addSteps(const string &LIST) {
+	stringstream ss(LIST);
+	string item;
+	while (getline(ss, item, ',')) {
+		if (item.empty()) {
+			continue;
+		}
+		size_t dash = item.find('-', 1);
+		char *end = nullptr;
+		int first = (int)strtol(item.c_str(), &end, 10);
+		int last = first;
+		if (dash != string::npos) {
+			last = (int)strtol(item.c_str() + dash + 1, &end, 10);
+		}
+		if (end == nullptr || *end != '\0' || last < first) {
+			cerr << "SystemCapture: bad step range " << item << endl;
+			return false;
+		}
+		addSteps(first, last);
+	}
+	return true;
+}
+
+bool SystemCapture::isCaptured(const TelemetryRecord &record) const {
+	if (m_count >= m_max) {
+		return false;
+	}
+	for (int i = 0; i < (int)m_steps.size(); ++i) {
+		if (record.step >= m_steps[i].first && record.step <= m_steps[i].second) {
+			return true;
+		}
+	}
+	return m_trigger && m_trigger(record);
+}
+
+string SystemCapture::getFile(int step, const string &NAME) const {
+	char name[32];
+	snprintf(name, sizeof(name), "/step_%06d_", step);
+	return m_dir + name + NAME + (m_text ? ".mtx" : ".bin");
+}
+
+void SystemCapture::write(int step, const string &NAME, const SparseMatrix<double> &A) {
+	if (!m_dir_checked) {
+		AssetCache::makeDirectory(m_dir);
+		m_dir_checked = true;
+	}
+	writeMatrix(getFile(step, NAME), A);
+}
+
+void SystemCapture::write(int step, const string &NAME, const MatrixXd &A) {
+	if (!m_dir_checked) {
+		AssetCache::makeDirectory(m_dir);
+		m_dir_checked = true;
+	}
+	writeMatrix(getFile(step, NAME), A);
+}
+
+void SystemCapture::writeInfo(const TelemetryRecord &record, const nlohmann::json &info) {
+	char name[32];
+	snprintf(name, sizeof(name), "/step_%06d.json", record.step);
+	string file = m_dir + name;
+	ofstream out(file.c_str());
+	if (!out) {
+		cerr << "SystemCapture: cannot open " << file << endl;
+		return;
+	}
+	nlohmann::json j = info;
+	j["step"] = record.step;
+	j["time"] = record.time;
+	j["solver"] = record.solver;
+	j["iterations"] = record.iterations;
+	j["residual"] = record.residual;
+	j["active"] = { record.nem, record.ner, record.nim, record.nir };
+	j["format"] = m_text ? "mtx" : "bin";
+	out << j.dump(1, '\t') << endl;
+	m_count++;
+}
+
+shared_ptr<SystemCapture> SystemCapture::fromEnvironment() {
+	const char *env = getenv("REDMAX_CAPTURE");
+	if (env == nullptr || env[0] == '\0') {
+		return nullptr;
+	}
+	auto capture = make_shared<SystemCapture>(env);
+	const char *steps = getenv("REDMAX_CAPTURE_STEPS");
+	if (steps != nullptr) {
+		capture->addSteps(steps);
+	}
+	const char *residual = getenv("REDMAX_CAPTURE_RESIDUAL");
+	const char *iterations = getenv("REDMAX_CAPTURE_ITERATIONS");
+	if (residual != nullptr || iterations != nullptr) {
+		double maxResidual = residual != nullptr ? atof(residual) : -1.0;
+		int maxIterations = iterations != nullptr ? atoi(iterations) : -1;
+		capture->setTrigger([maxResidual, maxIterations](const TelemetryRecord &r) {
+			return (maxResidual >= 0.0 && r.residual > maxResidual) || (maxIterations >= 0 && r.iterations > maxIterations);
+		});
+	}
+	const char *max = getenv("REDMAX_CAPTURE_MAX");
+	if (max != nullptr) {
+		capture->setMaxCaptures(atoi(max));
+	}
+	const char *text = getenv("REDMAX_CAPTURE_TEXT");
+	capture->setText(text != nullptr && atoi(text) != 0);
+	return capture;
+}
@@ -0,0 +1,82 @@
+#pragma once
+// SystemCapture Dumps the systems of selected steps for offline solver tuning
+//    On the selected steps, or when the trigger fires on the telemetry record of a step,
+//    SolverSparse writes MDKr, G, C, the right hand sides, the ordering, qdot0 and the solution
+//    into DIR as step_<step>_<NAME> files, and the assembled LHS and rhs of the equality solves.
+//    A step_<step>.json next to them describes the step. tools/replay.cpp runs the solvers on them.
+//
+//    The files are either MatrixMarket text (.mtx, coordinate for sparse matrices, array for
+//    dense ones) or the same content in binary (.bin): a header, then the compressed rows of a
+//    sparse matrix (row offsets, column indices, values) or the column-major values of a dense
+//    one. Little-endian only.
+//
+//    $REDMAX_CAPTURE names the directory for the solver of the Scene. $REDMAX_CAPTURE_STEPS lists
+//    steps and ranges ("0,100-120"), $REDMAX_CAPTURE_RESIDUAL and $REDMAX_CAPTURE_ITERATIONS fire
+//    the trigger above a residual or an iteration count, $REDMAX_CAPTURE_MAX caps the number of
+//    captured steps (100) and $REDMAX_CAPTURE_TEXT=1 writes MatrixMarket text.
+
+#ifndef REDUCEDCOORD_SRC_SYSTEMCAPTURE_H_
+#define REDUCEDCOORD_SRC_SYSTEMCAPTURE_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define EIGEN_DONT_ALIGN_STATICALLY
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <nlohmann/json.hpp>
+
+#include "Telemetry.h"
+
+class SystemCapture
+{
+public:
+	SystemCapture(const std::string &DIR);
+	virtual ~SystemCapture() {}
+
+	// Steps first to last, both included
+	void addSteps(int first, int last);
+	// Parses "0,100-120" into addSteps() calls
+	bool addSteps(const std::string &LIST);
+	// Also captures the steps for which trigger returns true
+	void setTrigger(std::function<bool(const TelemetryRecord &)> trigger) { m_trigger = trigger; }
+	void setMaxCaptures(int max) { m_max = max; }
+	void setText(bool isText) { m_text = isText; }
+
+	// Whether the step of the record is captured, once the record is complete
+	bool isCaptured(const TelemetryRecord &record) const;
+
+	void write(int step, const std::string &NAME, const Eigen::SparseMatrix<double> &A);
+	void write(int step, const std::string &NAME, const Eigen::MatrixXd &A);
+	// Closes the capture of a step with its description, and counts it
+	void writeInfo(const TelemetryRecord &record, const nlohmann::json &info);
+
+	const std::string & getDirectory() const { return m_dir; }
+	int getCount() const { return m_count; }
+
+	// Captures into $REDMAX_CAPTURE, null when it is not set
+	static std::shared_ptr<SystemCapture> fromEnvironment();
+
+private:
+	std::string getFile(int step, const std::string &NAME) const;
+
+	std::string m_dir;
+	std::vector<std::pair<int, int> > m_steps;
+	std::function<bool(const TelemetryRecord &)> m_trigger;
+	int m_max;
+	int m_count;
+	bool m_text;
+	bool m_dir_checked;
+};
+
+// The .mtx or .bin file, by extension
+bool writeMatrix(const std::string &FILE, const Eigen::SparseMatrix<double> &A);
+bool writeMatrix(const std::string &FILE, const Eigen::MatrixXd &A);
+// Either format and layout, dense files are read into a sparse matrix and the other way around
+bool readMatrix(const std::string &FILE, Eigen::SparseMatrix<double> &A);
+bool readMatrix(const std::string &FILE, Eigen::MatrixXd &A);
+
+#endif // REDUCEDCOORD_SRC_SYSTEMCAPTURE_H_
@@ -0,0 +1,62 @@
+#include "rmpch.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+int TaskGraph::addTask(const function<void()> &task, const vector<int> &deps) {
+	int id = (int)m_tasks.size();
+	Task t;
+	t.func = task;
+	t.ndeps = (int)deps.size();
+	m_tasks.push_back(t);
+
+	for (int k = 0; k < (int)deps.size(); ++k) {
+		if (deps[k] < 0 || deps[k] >= id) {
+			cerr << "TaskGraph: task " << id << " depends on unknown task " << deps[k] << endl;
+			exit(1);
+		}
+		m_tasks[deps[k]].successors.push_back(id);
+	}
+	return id;
+}
+
+void TaskGraph::run(shared_ptr<ThreadPool> pool) {
+	int ntasks = (int)m_tasks.size();
+	if (pool == nullptr || pool->getThreadCount() == 0) {
+		for (int i = 0; i < ntasks; ++i) {
+			m_tasks[i].func();
+		}
+		return;
+	}
+
+	m_counters.reset(new atomic<int>[ntasks]);
+	for (int i = 0; i < ntasks; ++i) {
+		m_counters[i] = m_tasks[i].ndeps;
+	}
+	m_remaining = ntasks;
+
+	for (int i = 0; i < ntasks; ++i) {
+		if (m_tasks[i].ndeps == 0) {
+			start(pool.get(), i);
+		}
+	}
+	pool->wait(m_remaining);
+}
+
+void TaskGraph::start(ThreadPool *pool, int i) {
+	pool->push([this, pool, i]() {
+		m_tasks[i].func();
+
+		// Release the successors whose last dependency this was
+		const vector<int> &successors = m_tasks[i].successors;
+		for (int k = 0; k < (int)successors.size(); ++k) {
+			if (--m_counters[successors[k]] == 0) {
+				start(pool, successors[k]);
+			}
+		}
+		if (--m_remaining == 0) {
+			pool->notify();
+		}
+	});
+}
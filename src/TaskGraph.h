@@ -0,0 +1,45 @@
+#pragma once
+// TaskGraph Dependency graph of tasks executed on a ThreadPool
+//    A task may only depend on tasks added before it, so the ids are a topological order and
+//    running without a pool simply executes the tasks by id. The graph can be run repeatedly.
+
+#ifndef REDUCEDCOORD_SRC_TASKGRAPH_H_
+#define REDUCEDCOORD_SRC_TASKGRAPH_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+class TaskGraph
+{
+public:
+	TaskGraph() : m_remaining(0) {}
+	virtual ~TaskGraph() {}
+
+	// Adds a task that starts once all tasks in deps have finished, returns its id
+	int addTask(const std::function<void()> &task, const std::vector<int> &deps = std::vector<int>());
+
+	// Runs every task and returns when all of them have finished
+	void run(std::shared_ptr<ThreadPool> pool);
+
+	void clear() { m_tasks.clear(); }
+	int getTaskCount() const { return (int)m_tasks.size(); }
+
+private:
+	struct Task {
+		std::function<void()> func;
+		std::vector<int> successors;
+		int ndeps;
+	};
+
+	void start(ThreadPool *pool, int i);
+
+	std::vector<Task> m_tasks;
+	std::unique_ptr<std::atomic<int>[]> m_counters;	// dependencies left per task during run()
+	std::atomic<int> m_remaining;
+};
+
+#endif // REDUCEDCOORD_SRC_TASKGRAPH_H_
@@ -0,0 +1,108 @@
+#include "rmpch.h"
+#include "Telemetry.h"
+
+using namespace std;
+
+// Bumped whenever the record layout changes
+static const uint32_t TELEMETRY_VERSION = 1;
+
+static_assert(sizeof(TelemetryRecord) == 80, "TelemetryRecord is written as is");
+
+struct TelemetryHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;		// of a record
+	uint32_t pad;
+};
+
+static int getDefaultVerbosity() {
+	const char *env = getenv("REDMAX_VERBOSE");
+	if (env != nullptr && env[0] != '\0') {
+		return atoi(env);
+	}
+	return 1;
+}
+
+static int s_verbosity = getDefaultVerbosity();
+
+void setVerbosity(int verbosity) {
+	s_verbosity = verbosity;
+}
+
+int getVerbosity() {
+	return s_verbosity;
+}
+
+Telemetry::Telemetry(int capacity) :
+	m_ring(max(1, capacity)),
+	m_next(0),
+	m_count(0)
+{
+
+}
+
+Telemetry::~Telemetry() {
+	closeLog();
+}
+
+bool Telemetry::openLog(const string &FILE) {
+	closeLog();
+	m_log.open(FILE.c_str(), ios::binary | ios::trunc);
+	if (!m_log) {
+		cerr << "Telemetry: cannot open " << FILE << endl;
+		return false;
+	}
+	TelemetryHeader header;
+	memcpy(header.magic, "RMTL", 4);
+	header.version = TELEMETRY_VERSION;
+	header.size = sizeof(TelemetryRecord);
+	header.pad = 0;
+	m_log.write((const char *)&header, sizeof(header));
+	return true;
+}
+
+void Telemetry::closeLog() {
+	if (m_log.is_open()) {
+		m_log.close();
+	}
+}
+
+void Telemetry::push(const TelemetryRecord &record) {
+	m_ring[m_next] = record;
+	m_next = (m_next + 1) % (int)m_ring.size();
+	m_count = min(m_count + 1, (int)m_ring.size());
+	if (m_log.is_open()) {
+		m_log.write((const char *)&record, sizeof(record));
+	}
+}
+
+const TelemetryRecord & Telemetry::getRecord(int k) const {
+	int first = (m_next - m_count + (int)m_ring.size()) % (int)m_ring.size();
+	return m_ring[(first + k) % (int)m_ring.size()];
+}
+
+bool Telemetry::readLog(const string &FILE, vector<TelemetryRecord> &records) {
+	records.clear();
+	ifstream in(FILE.c_str(), ios::binary);
+	TelemetryHeader header;
+	if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, "RMTL", 4) != 0 ||
+		header.version != TELEMETRY_VERSION || header.size != sizeof(TelemetryRecord)) {
+		return false;
+	}
+	// A run that did not close the log may end in a partial record, which is dropped
+	TelemetryRecord record;
+	while (in.read((char *)&record, sizeof(record))) {
+		records.push_back(record);
+	}
+	return true;
+}
+
+shared_ptr<Telemetry> Telemetry::fromEnvironment() {
+	const char *env = getenv("REDMAX_TELEMETRY");
+	if (env == nullptr || env[0] == '\0') {
+		return nullptr;
+	}
+	auto telemetry = make_shared<Telemetry>();
+	telemetry->openLog(env);
+	return telemetry;
+}
@@ -0,0 +1,78 @@
+#pragma once
+// Telemetry Per step record of the solve, kept in a ring buffer and optionally logged
+//    Every step of SolverSparse fills one record: the solver, the size of the system, the
+//    iterations and residual, the active constraint rows, the factorizations that reused their
+//    symbolic analysis, the constraint drift |g| and the energy drift. The ring keeps the last
+//    records, the log keeps all of them as fixed size binary records after a short header.
+//    $REDMAX_TELEMETRY names a log for the solver of the Scene. Little-endian only.
+//
+//    The verbosity of the console output is set here as well: 0 prints errors only, 1 status
+//    messages (the default), 2 one line per step, 3 the assembled systems. $REDMAX_VERBOSE
+//    sets the start value.
+
+#ifndef REDUCEDCOORD_SRC_TELEMETRY_H_
+#define REDUCEDCOORD_SRC_TELEMETRY_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Solver of a step that went through the MOSEK QP
+const int TELEMETRY_QP = -1;
+
+struct TelemetryRecord
+{
+	int32_t step;
+	int32_t solver;			// SparseSolver, or TELEMETRY_QP
+	double time;
+	int32_t rows;
+	int32_t cols;
+	int64_t nonzeros;		// 0 when matrix free
+	int32_t iterations;		// 0 for direct solvers
+	int32_t reuse;			// factorizations that reused the symbolic analysis
+	double residual;		// relative, negative when unknown
+	int32_t nem;			// active constraint rows
+	int32_t ner;
+	int32_t nim;
+	int32_t nir;
+	double drift;			// |g| of the equality constraints
+	double energy_drift;	// K + V minus the first step
+};
+
+class Telemetry
+{
+public:
+	Telemetry(int capacity = 1024);
+	virtual ~Telemetry();
+
+	// Also appends every record to FILE until closeLog()
+	bool openLog(const std::string &FILE);
+	void closeLog();
+
+	void push(const TelemetryRecord &record);
+
+	// Records in the ring, k = 0 is the oldest
+	int getCount() const { return m_count; }
+	const TelemetryRecord & getRecord(int k) const;
+
+	static bool readLog(const std::string &FILE, std::vector<TelemetryRecord> &records);
+
+	// Logs to $REDMAX_TELEMETRY, null when it is not set
+	static std::shared_ptr<Telemetry> fromEnvironment();
+
+private:
+	Telemetry(const Telemetry &);
+	Telemetry & operator=(const Telemetry &);
+
+	std::vector<TelemetryRecord> m_ring;
+	int m_next;
+	int m_count;
+	std::ofstream m_log;
+};
+
+void setVerbosity(int verbosity);
+int getVerbosity();
+
+#endif // REDUCEDCOORD_SRC_TELEMETRY_H_
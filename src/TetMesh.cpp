@@ -0,0 +1,208 @@
+#include "rmpch.h"
+#include "TetMesh.h"
+
+#define TETLIBRARY
+#include <tetgen.h>
+#include <cstdint>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Bumped whenever the file layout or the meaning of the cached data changes
+static const uint32_t TETMESH_VERSION = 1;
+
+struct TetMeshHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	int32_t npoints;
+	int32_t ntets;
+	int32_t nfaces;
+	int32_t pad;
+};
+
+static bool fileExists(const string &FILE) {
+	struct stat st;
+	return stat(FILE.c_str(), &st) == 0;
+}
+
+TetMesh::TetMesh() :
+	m_npoints(0),
+	m_ntets(0),
+	m_nfaces(0),
+	m_points(nullptr),
+	m_tets(nullptr),
+	m_faces(nullptr)
+{
+
+}
+
+TetMesh::~TetMesh() {
+	clear();
+}
+
+void TetMesh::clear() {
+	m_file.close();
+	m_pointbuf.clear();
+	m_tetbuf.clear();
+	m_facebuf.clear();
+	m_npoints = m_ntets = m_nfaces = 0;
+	m_points = nullptr;
+	m_tets = nullptr;
+	m_faces = nullptr;
+}
+
+void TetMesh::load(const string &RESOURCE_DIR, const string &MESH_NAME, const string &TETGEN_FLAGS, bool isAdditionalNodes) {
+	clear();
+	string PLY_FILE = RESOURCE_DIR + MESH_NAME;
+	string NODE_FILE = isAdditionalNodes ? PLY_FILE + ".a.node" : "";
+
+	// Key of the output: layout version, flags and the input files
+	unsigned long long hash = AssetCache::HASH_INIT;
+	AssetCache::hashBytes(hash, &TETMESH_VERSION, sizeof(TETMESH_VERSION));
+	AssetCache::hashBytes(hash, TETGEN_FLAGS.c_str(), TETGEN_FLAGS.size() + 1);
+	bool isHashed = AssetCache::hashFile(hash, PLY_FILE);
+	if (!NODE_FILE.empty() && fileExists(NODE_FILE)) {
+		AssetCache::hashBytes(hash, "a", 1);
+		isHashed = isHashed && AssetCache::hashFile(hash, NODE_FILE);
+	}
+
+	string cache_file = isHashed ? AssetCache::getFile(hash, ".tet") : "";
+	if (!cache_file.empty() && map(cache_file, hash)) {
+		return;
+	}
+
+	generate(PLY_FILE, NODE_FILE, TETGEN_FLAGS);
+
+	if (!cache_file.empty()) {
+		save(cache_file, hash);
+	}
+}
+
+void TetMesh::loadBox(double sx, double sy, double sz, const string &TETGEN_FLAGS) {
+	clear();
+
+	// The box is generated, so the key is its size instead of a file
+	unsigned long long hash = AssetCache::HASH_INIT;
+	double sides[3] = { sx, sy, sz };
+	AssetCache::hashBytes(hash, &TETMESH_VERSION, sizeof(TETMESH_VERSION));
+	AssetCache::hashBytes(hash, TETGEN_FLAGS.c_str(), TETGEN_FLAGS.size() + 1);
+	AssetCache::hashBytes(hash, "box", 3);
+	AssetCache::hashBytes(hash, sides, sizeof(sides));
+
+	string cache_file = AssetCache::getFile(hash, ".tet");
+	if (!cache_file.empty() && map(cache_file, hash)) {
+		return;
+	}
+
+	// Centered at the origin, one quad per face
+	static const int quads[6][4] = {
+		{ 0, 3, 2, 1 }, { 4, 5, 6, 7 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 1, 2, 6, 5 }, { 0, 4, 7, 3 }
+	};
+	tetgenio input_mesh;
+	input_mesh.firstnumber = 0;
+	input_mesh.numberofpoints = 8;
+	input_mesh.pointlist = new REAL[3 * 8];
+	for (int i = 0; i < 8; i++) {
+		input_mesh.pointlist[3 * i + 0] = ((i & 1) ^ ((i >> 1) & 1) ? 0.5 : -0.5) * sx;
+		input_mesh.pointlist[3 * i + 1] = ((i >> 1) & 1 ? 0.5 : -0.5) * sy;
+		input_mesh.pointlist[3 * i + 2] = ((i >> 2) & 1 ? 0.5 : -0.5) * sz;
+	}
+	input_mesh.numberoffacets = 6;
+	input_mesh.facetlist = new tetgenio::facet[6];
+	input_mesh.facetmarkerlist = new int[6];
+	for (int i = 0; i < 6; i++) {
+		tetgenio::facet &f = input_mesh.facetlist[i];
+		tetgenio::init(&f);
+		f.numberofpolygons = 1;
+		f.polygonlist = new tetgenio::polygon[1];
+		tetgenio::init(&f.polygonlist[0]);
+		f.polygonlist[0].numberofvertices = 4;
+		f.polygonlist[0].vertexlist = new int[4];
+		for (int k = 0; k < 4; k++) {
+			f.polygonlist[0].vertexlist[k] = quads[i][k];
+		}
+		input_mesh.facetmarkerlist[i] = 0;
+	}
+	run(TETGEN_FLAGS, &input_mesh, nullptr);
+
+	if (!cache_file.empty()) {
+		save(cache_file, hash);
+	}
+}
+
+void TetMesh::generate(const string &PLY_FILE, const string &NODE_FILE, const string &TETGEN_FLAGS) {
+	// Tetrahedralize 3D mesh
+	tetgenio input_mesh, additional_node;
+	input_mesh.load_ply((char *)PLY_FILE.c_str());
+	if (!NODE_FILE.empty()) {
+		// Takes the name without ".node"
+		string base = NODE_FILE.substr(0, NODE_FILE.size() - 5);
+		additional_node.load_node((char *)base.c_str());
+	}
+	run(TETGEN_FLAGS, &input_mesh, NODE_FILE.empty() ? nullptr : &additional_node);
+}
+
+void TetMesh::run(const string &TETGEN_FLAGS, tetgenio *input_mesh, tetgenio *additional_node) {
+	tetgenio output_mesh;
+	tetrahedralize((char *)TETGEN_FLAGS.c_str(), input_mesh, &output_mesh, additional_node);
+
+	m_npoints = output_mesh.numberofpoints;
+	m_ntets = output_mesh.numberoftetrahedra;
+	m_nfaces = output_mesh.numberoftrifaces;
+	m_pointbuf.assign(output_mesh.pointlist, output_mesh.pointlist + 3 * m_npoints);
+	m_tetbuf.assign(output_mesh.tetrahedronlist, output_mesh.tetrahedronlist + 4 * m_ntets);
+	m_facebuf.assign(output_mesh.trifacelist, output_mesh.trifacelist + 3 * m_nfaces);
+	m_points = m_pointbuf.data();
+	m_tets = m_tetbuf.data();
+	m_faces = m_facebuf.data();
+}
+
+bool TetMesh::map(const string &FILE, unsigned long long hash) {
+	if (!m_file.open(FILE)) {
+		return false;
+	}
+
+	TetMeshHeader header;
+	size_t size = m_file.size();
+	if (size < sizeof(header)) {
+		m_file.close();
+		return false;
+	}
+	memcpy(&header, m_file.data(), sizeof(header));
+
+	size_t expected = sizeof(header) + 3 * sizeof(double) * (size_t)max(header.npoints, 0) +
+		sizeof(int32_t) * (4 * (size_t)max(header.ntets, 0) + 3 * (size_t)max(header.nfaces, 0));
+	bool isValid = memcmp(header.magic, "RMTM", 4) == 0 && header.version == TETMESH_VERSION &&
+		header.hash == hash && header.npoints >= 0 && header.ntets >= 0 && header.nfaces >= 0 && size == expected;
+	if (!isValid) {
+		m_file.close();
+		return false;
+	}
+
+	m_npoints = header.npoints;
+	m_ntets = header.ntets;
+	m_nfaces = header.nfaces;
+	m_points = (const double *)(m_file.data() + sizeof(header));
+	m_tets = (const int *)(m_points + 3 * m_npoints);
+	m_faces = m_tets + 4 * m_ntets;
+	return true;
+}
+
+bool TetMesh::save(const string &FILE, unsigned long long hash) const {
+	TetMeshHeader header;
+	memcpy(header.magic, "RMTM", 4);
+	header.version = TETMESH_VERSION;
+	header.hash = hash;
+	header.npoints = m_npoints;
+	header.ntets = m_ntets;
+	header.nfaces = m_nfaces;
+	header.pad = 0;
+
+	vector<pair<const void *, size_t> > blocks;
+	blocks.push_back(make_pair((const void *)&header, sizeof(header)));
+	blocks.push_back(make_pair((const void *)m_points, 3 * sizeof(double) * m_npoints));
+	blocks.push_back(make_pair((const void *)m_tets, 4 * sizeof(int32_t) * m_ntets));
+	blocks.push_back(make_pair((const void *)m_faces, 3 * sizeof(int32_t) * m_nfaces));
+	return AssetCache::write(FILE, blocks);
+}
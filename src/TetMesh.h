@@ -0,0 +1,61 @@
+#pragma once
+// TetMesh Nodes, tets and boundary faces of a tetrahedralized mesh
+//    The output of TetGen is cached by a hash of its input: the PLY file, the optional
+//    ".a.node" file of additional points and the TetGen flags. A cached mesh is a compact
+//    binary file in the AssetCache that is memory mapped on later runs. Generated boxes are
+//    cached the same way, keyed by their sides.
+
+#ifndef REDUCEDCOORD_SRC_TETMESH_H_
+#define REDUCEDCOORD_SRC_TETMESH_H_
+
+#include <string>
+#include <vector>
+
+#include "AssetCache.h"
+
+class tetgenio;
+
+class TetMesh
+{
+public:
+	TetMesh();
+	virtual ~TetMesh();
+
+	// Loads RESOURCE_DIR + MESH_NAME, with the points of RESOURCE_DIR + MESH_NAME + ".a.node"
+	// if isAdditionalNodes is set
+	void load(const std::string &RESOURCE_DIR, const std::string &MESH_NAME, const std::string &TETGEN_FLAGS, bool isAdditionalNodes);
+	// Tetrahedralizes a box of the given sides centered at the origin
+	void loadBox(double sx, double sy, double sz, const std::string &TETGEN_FLAGS);
+
+	int getNodeCount() const { return m_npoints; }
+	int getTetCount() const { return m_ntets; }
+	int getFaceCount() const { return m_nfaces; }
+	const double * getPoints() const { return m_points; }		// 3 per node
+	const int * getTets() const { return m_tets; }			// 4 per tet
+	const int * getFaces() const { return m_faces; }			// 3 per face
+
+private:
+	TetMesh(const TetMesh &);
+	TetMesh & operator=(const TetMesh &);
+
+	void generate(const std::string &PLY_FILE, const std::string &NODE_FILE, const std::string &TETGEN_FLAGS);
+	void run(const std::string &TETGEN_FLAGS, tetgenio *input_mesh, tetgenio *additional_node);
+	bool map(const std::string &FILE, unsigned long long hash);
+	bool save(const std::string &FILE, unsigned long long hash) const;
+	void clear();
+
+	int m_npoints;
+	int m_ntets;
+	int m_nfaces;
+	const double *m_points;
+	const int *m_tets;
+	const int *m_faces;
+
+	// Either a mapped cache file or the TetGen output
+	MappedFile m_file;
+	std::vector<double> m_pointbuf;
+	std::vector<int> m_tetbuf;
+	std::vector<int> m_facebuf;
+};
+
+#endif // REDUCEDCOORD_SRC_TETMESH_H_
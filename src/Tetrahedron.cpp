@@ -45,6 +45,14 @@ void Tetrahedron::precompute() {
 	}
 }
 
+void Tetrahedron::precompute(const Tetrahedron &rest) {
+	this->W = rest.W;
+	m_mass = rest.m_mass;
+	for (int i = 0; i < 4; i++) {
+		m_nodes[i]->m += this->m_mass * 0.25;
+	}
+}
+
 Matrix3d Tetrahedron::computeDeformationGradient() {
 	for (int i = 0; i < (int)m_nodes.size() - 1; i++) {
 		this->Ds.col(i) = m_nodes[i]->x - m_nodes[3]->x;
@@ -54,7 +62,7 @@ Matrix3d Tetrahedron::computeDeformationGradient() {
 	return this->F;
 }
 
-Matrix3d Tetrahedron::computeDeformationGradientDifferential(VectorXd dx) {
+Matrix3d Tetrahedron::computeDeformationGradientDifferential(const VectorXd &dx) {
 	for (int i = 0; i < (int)m_nodes.size() - 1; i++) {
 		this->dDs.col(i) = dx.segment<3>(3 * m_nodes[i]->i) - dx.segment<3>(3 * m_nodes[3]->i);
 	}
@@ -95,7 +103,7 @@ void Tetrahedron::assembleGlobalForceVector(Eigen::VectorXd &f) {
 	}
 }
 
-void Tetrahedron::computeForceDifferentials(VectorXd dx, VectorXd& df) {
+void Tetrahedron::computeForceDifferentials(const VectorXd &dx, VectorXd &df) {
 	this->F = computeDeformationGradient();
 	this->dF = computeDeformationGradientDifferential(dx);	
 	this->dP = computePKStressDerivative(F, dF, m_mu, m_lambda);
@@ -174,6 +182,23 @@ void Tetrahedron::assembleGlobalStiffnessMatrixSparse(vector<T> &K_) {
 	}
 }
 
+void Tetrahedron::assembleGlobalStiffnessDiagonal(VectorXd &d) const {
+	for (int i = 0; i < 4; ++i) {
+		d.segment<3>(m_nodes[i]->idxM) += this->K.block<3, 3>(3 * i, 3 * i).diagonal();
+	}
+}
+
+void Tetrahedron::applyStiffness(const VectorXd &dx, VectorXd &df) const {
+	Vector12d dxe;
+	for (int i = 0; i < 4; ++i) {
+		dxe.segment<3>(3 * i) = dx.segment<3>(3 * m_nodes[i]->i);
+	}
+	Vector12d dfe = this->K * dxe;
+	for (int i = 0; i < 4; ++i) {
+		df.segment<3>(3 * m_nodes[i]->i) += dfe.segment<3>(3 * i);
+	}
+}
+
 void Tetrahedron::assembleGlobalStiffnessMatrixDense(MatrixXd &K_global) {
 	int i = m_nodes[0]->idxM;
 	int j = m_nodes[1]->idxM;
@@ -433,6 +458,28 @@ Vector4d Tetrahedron::computeBarycentricWeightAndSave(const shared_ptr<Node>& p)
 	return weight;
 }
 
+Vector4d Tetrahedron::computeRestBarycentricWeight(const Vector3d &p0) const {
+	// Same as computeBarycentricWeightAndSave, but in the rest configuration and without saving
+	return computeBarycentricWeight(m_nodes[0]->x0, m_nodes[1]->x0, m_nodes[2]->x0, m_nodes[3]->x0, p0);
+}
+
+Vector4d Tetrahedron::computeBarycentricWeight(const Vector3d &x0, const Vector3d &x1, const Vector3d &x2, const Vector3d &x3, const Vector3d &p) {
+	Vector3d vap = p - x0;
+	Vector3d vbp = p - x1;
+
+	Vector3d vab = x1 - x0;
+	Vector3d vac = x2 - x0;
+	Vector3d vad = x3 - x0;
+
+	Vector3d vbc = x2 - x1;
+	Vector3d vbd = x3 - x1;
+
+	double v = 1.0 / vab.dot(vac.cross(vad));
+	Vector4d weight;
+	weight << vbp.dot(vbd.cross(vbc)) * v, vap.dot(vac.cross(vad)) * v, vap.dot(vad.cross(vab)) * v, vap.dot(vab.cross(vac)) * v;
+	return weight;
+}
+
 double Tetrahedron::ScalarTripleProduct(const Vector3d &a, const Vector3d &b, const Vector3d &c) {
 	return a.dot(b.cross(c));
 }
@@ -20,15 +20,18 @@ public:
 	Tetrahedron(double young, double poisson, double density, Material material, const std::vector<std::shared_ptr<Node>> &nodes);
 	virtual ~Tetrahedron() {}
 	virtual void precompute();
+	// Same as precompute() for a tet with the rest shape and material of rest, whose volume and
+	// stiffness are copied instead of computed
+	virtual void precompute(const Tetrahedron &rest);
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
 	Matrix3d computeDeformationGradient();
-	Matrix3d computeDeformationGradientDifferential(Eigen::VectorXd dx);
+	Matrix3d computeDeformationGradientDifferential(const Eigen::VectorXd &dx);
 
 	Matrix3d computePKStress(Matrix3d F, double mu, double lambda);
 	Matrix3d computePKStressDerivative(Matrix3d F, Matrix3d dF, double mu, double lambda);
 
 	virtual void computeForceDifferentials(Eigen::MatrixXd &K_global);
-	virtual void computeForceDifferentials(Eigen::VectorXd dx, Eigen::VectorXd &df);
+	virtual void computeForceDifferentials(const Eigen::VectorXd &dx, Eigen::VectorXd &df);
 	virtual void computeForceDifferentialsSparse(Eigen::VectorXd dx, int row, int col, std::vector<T> &K_);
 	virtual void computeForceDifferentialsSparse(std::vector<T> &K_) {}
 	virtual void computeForceDifferentials();
@@ -37,6 +40,10 @@ public:
 	void assembleGlobalStiffnessMatrixDense(Eigen::MatrixXd &K_global);
 	void assembleGlobalStiffnessMatrixSparse(std::vector<T> &K_);
 	void assembleGlobalForceVector(Eigen::VectorXd &f);
+	// d += diag(K) at the nodes, and df += K dx with dx and df indexed by the nodes of the body,
+	// both with the K of the last computeForceDifferentials()
+	virtual void assembleGlobalStiffnessDiagonal(Eigen::VectorXd &d) const;
+	virtual void applyStiffness(const Eigen::VectorXd &dx, Eigen::VectorXd &df) const;
 
 	virtual void computeElasticForces();
 	virtual void computeElasticForces(Eigen::VectorXd &f);
@@ -47,6 +54,9 @@ public:
 
 	void addEnclosedPoint(const std::shared_ptr<Node>& p) { m_enclosed_points.push_back(p); }
 	Vector4d computeBarycentricWeightAndSave(const std::shared_ptr<Node>& p);
+	Vector4d computeRestBarycentricWeight(const Vector3d &p0) const;
+	// Barycentric weights of p in the tet of corners x0 ... x3
+	static Vector4d computeBarycentricWeight(const Vector3d &x0, const Vector3d &x1, const Vector3d &x2, const Vector3d &x3, const Vector3d &p);
 	double computeEnergy();
 	double ScalarTripleProduct(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c);
 	Vector3d computePositionByBarycentricWeight(const Vector4d &weight);
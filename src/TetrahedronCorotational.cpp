@@ -81,6 +81,15 @@ void TetrahedronCorotational::precompute() {
 	this->Kexx = this->Ke * this->xx;
 }
 
+void TetrahedronCorotational::precompute(const Tetrahedron &rest) {
+	Tetrahedron::precompute(rest);
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		this->xx.segment<3>(3 * i) = m_nodes[i]->x0;
+	}
+	this->Ke = static_cast<const TetrahedronCorotational &>(rest).Ke;
+	this->Kexx = this->Ke * this->xx;
+}
+
 void TetrahedronCorotational::computeElasticForces(VectorXd &f) {
 	this->F = computeDeformationGradient();
 	this->R = gs3(this->F);
@@ -136,6 +145,36 @@ void TetrahedronCorotational::computeForceDifferentials(MatrixXd &K_global) {
 	K_global.block<3, 3>(l, l) += this->RKR.block<3, 3>(9, 9);
 }
 
+void TetrahedronCorotational::computeForceDifferentials(const VectorXd &dx, VectorXd &df) {
+	// df = RKR * dx, RKR is updated in computeElasticForces()
+	Vector12d dxe;
+	for (int i = 0; i < 4; ++i) {
+		dxe.segment<3>(3 * i) = dx.segment<3>(3 * m_nodes[i]->i);
+	}
+	Vector12d dfe = this->RKR * dxe;
+	for (int i = 0; i < 4; ++i) {
+		df.segment<3>(3 * m_nodes[i]->i) += dfe.segment<3>(3 * i);
+	}
+}
+
+void TetrahedronCorotational::assembleGlobalStiffnessDiagonal(VectorXd &d) const {
+	// RKR is updated in computeElasticForces()
+	for (int i = 0; i < 4; ++i) {
+		d.segment<3>(m_nodes[i]->idxM) += this->RKR.block<3, 3>(3 * i, 3 * i).diagonal();
+	}
+}
+
+void TetrahedronCorotational::applyStiffness(const VectorXd &dx, VectorXd &df) const {
+	Vector12d dxe;
+	for (int i = 0; i < 4; ++i) {
+		dxe.segment<3>(3 * i) = dx.segment<3>(3 * m_nodes[i]->i);
+	}
+	Vector12d dfe = this->RKR * dxe;
+	for (int i = 0; i < 4; ++i) {
+		df.segment<3>(3 * m_nodes[i]->i) += dfe.segment<3>(3 * i);
+	}
+}
+
 void TetrahedronCorotational::computeForceDifferentialsSparse(vector<T> &K_) {
 	int a = m_nodes[0]->idxM;
 	int b = m_nodes[1]->idxM;
@@ -14,8 +14,12 @@ public:
 	virtual ~TetrahedronCorotational() {}
 	void computeElasticForces(Eigen::VectorXd &f);
 	void computeForceDifferentials(Eigen::MatrixXd &K);
+	void computeForceDifferentials(const Eigen::VectorXd &dx, Eigen::VectorXd &df);
 	void computeForceDifferentialsSparse(std::vector<T> &K_);
+	void assembleGlobalStiffnessDiagonal(Eigen::VectorXd &d) const;
+	void applyStiffness(const Eigen::VectorXd &dx, Eigen::VectorXd &df) const;
 	void precompute();
+	void precompute(const Tetrahedron &rest);
 
 protected:
 	Matrix12d Ke;		// precomputed stiffness matrix for coratational linear material
@@ -30,6 +30,13 @@ void TetrahedronInvertible::precompute() {
 
 }
 
+void TetrahedronInvertible::precompute(const Tetrahedron &rest) {
+	Tetrahedron::precompute(rest);
+	const TetrahedronInvertible &tet = static_cast<const TetrahedronInvertible &>(rest);
+	m_delta_L = tet.m_delta_L;
+	m_delta_U = tet.m_delta_U;
+}
+
 //Matrix3x4d TetrahedronInvertible::computeAreaWeightedVertexNormals() {
 //	Vector3d va, vb, vc, vd;
 //	va = m_nodes[0]->x;
@@ -229,7 +236,7 @@ void TetrahedronInvertible::computeElasticForces() {
 
 }
 
-void TetrahedronInvertible::computeForceDifferentials(VectorXd dx, VectorXd &df) {
+void TetrahedronInvertible::computeForceDifferentials(const VectorXd &dx, VectorXd &df) {
 
 	this->dF = computeDeformationGradientDifferential(dx);
 	Matrix3d UTdFV;
@@ -17,7 +17,7 @@ public:
 	void computeElasticForces();
 
 	void computeForceDifferentials(Eigen::MatrixXd &K);
-	void computeForceDifferentials(Eigen::VectorXd dx, Eigen::VectorXd &df);
+	void computeForceDifferentials(const Eigen::VectorXd &dx, Eigen::VectorXd &df);
 	void computeForceDifferentials(Eigen::VectorXd dx, int row, int col, Eigen::MatrixXd &K);
 	void computeForceDifferentialsSparse(Eigen::VectorXd dx, int row, int col, std::vector<T> &K_);
 	void computeForceDifferentials();
@@ -25,6 +25,7 @@ public:
 	Matrix3d clampHessian(Matrix3d &hessian, int clamped);
 	void setInvertiblity(bool isInvertible) { m_isInvertible = isInvertible; }
 	void precompute();
+	void precompute(const Tetrahedron &rest);
 
 protected:
 	bool m_isInvertible;
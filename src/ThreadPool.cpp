@@ -0,0 +1,142 @@
+#include "rmpch.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// The pool and worker index of the current thread, -1 outside of any pool
+static thread_local ThreadPool *t_pool = nullptr;
+static thread_local int t_index = -1;
+// Number of tasks nested on the current thread
+static thread_local int t_depth = 0;
+
+ThreadPool::ThreadPool(int nthreads) :
+	m_nworkers(nthreads > 0 ? nthreads : max(1, (int)thread::hardware_concurrency())),
+	m_queued(0),
+	m_pending(0),
+	m_next(0),
+	m_stop(false)
+{
+	for (int i = 0; i < m_nworkers + 1; ++i) {
+		m_queues.push_back(unique_ptr<Queue>(new Queue()));
+	}
+
+	m_workers.reserve(m_nworkers);
+	for (int i = 0; i < m_nworkers; ++i) {
+		m_workers.push_back(thread(&ThreadPool::run, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		lock_guard<mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (int i = 0; i < (int)m_workers.size(); ++i) {
+		m_workers[i].join();
+	}
+}
+
+int ThreadPool::getQueueIndex() const {
+	if (t_pool == this) {
+		return t_index;
+	}
+	return m_nworkers;
+}
+
+void ThreadPool::push(const function<void()> &task) {
+	int i = getQueueIndex();
+	if (i == m_nworkers) {
+		// Outside threads spread their tasks over the workers
+		i = (int)(m_next++ % m_nworkers);
+	}
+
+	++m_pending;
+	{
+		lock_guard<mutex> lock(m_queues[i]->mtx);
+		m_queues[i]->tasks.push_back(task);
+	}
+	++m_queued;
+	notify();
+}
+
+bool ThreadPool::pop(int i, function<void()> &task) {
+	// Own tasks first, newest first
+	int nqueues = (int)m_queues.size();
+	if (i < m_nworkers) {
+		lock_guard<mutex> lock(m_queues[i]->mtx);
+		if (!m_queues[i]->tasks.empty()) {
+			task = move(m_queues[i]->tasks.back());
+			m_queues[i]->tasks.pop_back();
+			--m_queued;
+			return true;
+		}
+	}
+
+	// Then steal the oldest task of another worker
+	for (int k = 1; k < nqueues; ++k) {
+		int j = (i + k) % nqueues;
+		lock_guard<mutex> lock(m_queues[j]->mtx);
+		if (!m_queues[j]->tasks.empty()) {
+			task = move(m_queues[j]->tasks.front());
+			m_queues[j]->tasks.pop_front();
+			--m_queued;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::isRunningTask() {
+	return t_depth > 0;
+}
+
+void ThreadPool::execute(function<void()> &task) {
+	++t_depth;
+	task();
+	--t_depth;
+	task = nullptr;
+	if (--m_pending == 0) {
+		notify();
+	}
+}
+
+void ThreadPool::wait(const atomic<int> &remaining) {
+	int i = getQueueIndex();
+	function<void()> task;
+	while (remaining > 0) {
+		if (pop(i, task)) {
+			execute(task);
+			continue;
+		}
+		unique_lock<mutex> lock(m_mtx);
+		m_cv.wait(lock, [&] { return remaining <= 0 || m_queued > 0; });
+	}
+}
+
+void ThreadPool::notify() {
+	// Taking the lock orders the counter update before a waiter re-checks its predicate
+	{
+		lock_guard<mutex> lock(m_mtx);
+	}
+	m_cv.notify_all();
+}
+
+void ThreadPool::run(int i) {
+	t_pool = this;
+	t_index = i;
+
+	function<void()> task;
+	while (true) {
+		if (pop(i, task)) {
+			execute(task);
+			continue;
+		}
+		unique_lock<mutex> lock(m_mtx);
+		m_cv.wait(lock, [&] { return m_stop || m_queued > 0; });
+		if (m_stop && m_queued == 0) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+// ThreadPool Work-stealing pool of worker threads
+//    Every worker owns a deque. Tasks pushed from a worker go to the back of its own deque and
+//    are popped LIFO; idle workers steal from the front of the other deques. Tasks pushed
+//    from outside the pool are spread round robin. A thread that waits for tasks to finish
+//    runs queued tasks itself instead of blocking, so waiting inside a task does not deadlock.
+
+#ifndef REDUCEDCOORD_SRC_THREADPOOL_H_
+#define REDUCEDCOORD_SRC_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// nthreads <= 0 starts one worker per hardware thread
+	ThreadPool(int nthreads = 0);
+	virtual ~ThreadPool();
+
+	void push(const std::function<void()> &task);
+
+	// Runs queued tasks on the calling thread until remaining drops to zero
+	void wait(const std::atomic<int> &remaining);
+
+	// Waits for every task pushed so far
+	void wait() { wait(m_pending); }
+
+	// Wakes up the threads blocked in wait() after a counter they wait on has changed
+	void notify();
+
+	int getThreadCount() const { return m_nworkers; }
+
+	// True while the calling thread runs a task of any pool, including tasks run inside wait()
+	static bool isRunningTask();
+
+private:
+	struct Queue {
+		std::mutex mtx;
+		std::deque<std::function<void()> > tasks;
+	};
+
+	int getQueueIndex() const;
+	bool pop(int i, std::function<void()> &task);
+	void execute(std::function<void()> &task);
+	void run(int i);
+
+	const int m_nworkers;
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<Queue> > m_queues;	// one per worker, the last one for outside threads
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::atomic<int> m_queued;
+	std::atomic<int> m_pending;
+	std::atomic<unsigned int> m_next;
+	bool m_stop;
+};
+
+#endif // REDUCEDCOORD_SRC_THREADPOOL_H_
@@ -0,0 +1,532 @@
+#include "rmpch.h"
+#include "Trajectory.h"
+#include "AssetCache.h"
+
+#include <cmath>
+
+using namespace std;
+
+static const uint32_t TRAJECTORY_VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+static const size_t CHUNK_HEADER_SIZE = 16;
+static const size_t TRAILER_SIZE = 16;
+static const size_t FRAME_PREFIX_SIZE = 32;
+
+static uint32_t makeTag(const char *s) {
+	return (uint32_t)(unsigned char)s[0] | ((uint32_t)(unsigned char)s[1] << 8) | ((uint32_t)(unsigned char)s[2] << 16) | ((uint32_t)(unsigned char)s[3] << 24);
+}
+
+static const uint32_t TAG_TOPO = makeTag("TOPO");
+static const uint32_t TAG_FRAME = makeTag("FRAM");
+static const uint32_t TAG_INDEX = makeTag("INDX");
+
+template <typename T>
+static void append(vector<char> &buf, const T &value) {
+	const char *p = (const char *)&value;
+	buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static T extract(const char *&p) {
+	T value;
+	memcpy(&value, p, sizeof(T));
+	p += sizeof(T);
+	return value;
+}
+
+static void appendVarint(vector<char> &buf, int64_t value) {
+	// Zigzag, then 7 bits per byte
+	uint64_t u = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	while (u >= 0x80) {
+		buf.push_back((char)(u | 0x80));
+		u >>= 7;
+	}
+	buf.push_back((char)u);
+}
+
+static bool extractVarint(const char *&p, const char *end, int64_t &value) {
+	uint64_t u = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (p == end) {
+			return false;
+		}
+		unsigned char b = (unsigned char)*p++;
+		u |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			value = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+TrajectoryWriter::TrajectoryWriter() :
+	m_encoding(FLOAT32),
+	m_quantum(1.0e-5),
+	m_keyframe(30),
+	m_nverts(-1),
+	m_lastkey(0)
+{
+
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+	close();
+}
+
+bool TrajectoryWriter::open(const string &FILE, Encoding encoding, double quantum, int keyframe) {
+	close();
+	m_out.open(FILE.c_str(), ios::binary | ios::trunc);
+	if (!m_out) {
+		cerr << "Cannot open trajectory " << FILE << endl;
+		return false;
+	}
+	m_encoding = encoding;
+	m_quantum = quantum > 0.0 ? quantum : 1.0e-5;
+	m_keyframe = max(1, keyframe);
+	m_nverts = -1;
+	m_lastkey = 0;
+	m_prev.clear();
+	m_index.clear();
+
+	vector<char> header;
+	header.insert(header.end(), "RMTJ", "RMTJ" + 4);
+	append(header, TRAJECTORY_VERSION);
+	append(header, (uint64_t)0);
+	m_out.write(header.data(), header.size());
+	return true;
+}
+
+bool TrajectoryWriter::resume(const string &FILE, int frame, Encoding encoding, double quantum, int keyframe) {
+	close();
+	ifstream in(FILE.c_str(), ios::binary);
+	char header[HEADER_SIZE];
+	if (!in || !in.read(header, HEADER_SIZE) || memcmp(header, "RMTJ", 4) != 0) {
+		return open(FILE, encoding, quantum, keyframe);
+	}
+	uint32_t version;
+	memcpy(&version, header + 4, sizeof(version));
+	if (version != TRAJECTORY_VERSION) {
+		cerr << FILE << " has trajectory version " << version << ", starting it over" << endl;
+		return open(FILE, encoding, quantum, keyframe);
+	}
+	in.seekg(0, ios::end);
+	uint64_t size = (uint64_t)in.tellg();
+
+	// Keep the chunks up to the first frame of the restart, the index of a closed file, or
+	// the frame cut off by a crash
+	m_encoding = encoding;
+	m_quantum = quantum > 0.0 ? quantum : 1.0e-5;
+	m_keyframe = max(1, keyframe);
+	m_nverts = -1;
+	m_lastkey = 0;
+	m_prev.clear();
+	m_index.clear();
+	uint64_t offset = HEADER_SIZE;
+	vector<char> payload;
+	while (offset + CHUNK_HEADER_SIZE <= size) {
+		char chunk[CHUNK_HEADER_SIZE];
+		in.seekg(offset);
+		if (!in.read(chunk, CHUNK_HEADER_SIZE)) {
+			break;
+		}
+		const char *p = chunk;
+		uint32_t tag = extract<uint32_t>(p);
+		extract<uint32_t>(p);
+		uint64_t length = extract<uint64_t>(p);
+		if (offset + CHUNK_HEADER_SIZE + length > size) {
+			break;
+		}
+
+		if (tag == TAG_TOPO && m_index.empty() && length >= 2 * sizeof(uint32_t)) {
+			payload.resize(sizeof(uint32_t));
+			in.read(payload.data(), sizeof(uint32_t));
+			p = payload.data();
+			m_nverts = (int)extract<uint32_t>(p);
+		}
+		else if (tag == TAG_FRAME && length >= FRAME_PREFIX_SIZE) {
+			payload.resize(FRAME_PREFIX_SIZE);
+			in.read(payload.data(), FRAME_PREFIX_SIZE);
+			p = payload.data();
+			IndexEntry entry;
+			entry.frame = extract<int32_t>(p);
+			entry.time = extract<double>(p);
+			Encoding e = (Encoding)extract<uint8_t>(p);
+			bool isKey = extract<uint8_t>(p) != 0;
+			extract<uint16_t>(p);
+			extract<uint32_t>(p);
+			double q = extract<double>(p);
+			if (entry.frame >= frame) {
+				break;
+			}
+			if (isKey) {
+				m_lastkey = (int)m_index.size();
+			}
+			entry.key = m_lastkey;
+			entry.offset = offset;
+			m_index.push_back(entry);
+			m_encoding = e;
+			m_quantum = q;
+		}
+		else {
+			break;
+		}
+		offset += CHUNK_HEADER_SIZE + length;
+	}
+	in.close();
+
+	if (!AssetCache::truncateFile(FILE, offset)) {
+		cerr << "Cannot cut " << FILE << " at frame " << frame << endl;
+		return false;
+	}
+
+	// The deltas continue from the last frame that was kept
+	if (m_encoding == QUANTIZED_DELTA && !m_index.empty()) {
+		TrajectoryReader reader;
+		vector<double> x;
+		if (!reader.open(FILE) || !reader.readFrame(reader.getFrameCount() - 1, x)) {
+			cerr << "Cannot read the last frame of " << FILE << endl;
+			return false;
+		}
+		m_prev.resize(x.size());
+		for (int i = 0; i < (int)x.size(); ++i) {
+			m_prev[i] = (int64_t)llround(x[i] / m_quantum);
+		}
+	}
+
+	m_out.open(FILE.c_str(), ios::binary | ios::in | ios::out);
+	if (!m_out) {
+		cerr << "Cannot open trajectory " << FILE << endl;
+		return false;
+	}
+	m_out.seekp(0, ios::end);
+	return true;
+}
+
+void TrajectoryWriter::close() {
+	if (!m_out.is_open()) {
+		return;
+	}
+
+	// Frame index, then a trailer that points at it
+	uint64_t offset = (uint64_t)m_out.tellp();
+	m_payload.clear();
+	append(m_payload, (uint32_t)m_index.size());
+	for (int i = 0; i < (int)m_index.size(); ++i) {
+		append(m_payload, m_index[i]);
+	}
+	writeChunk(TAG_INDEX, m_payload);
+
+	vector<char> trailer;
+	append(trailer, offset);
+	trailer.insert(trailer.end(), "RMTE", "RMTE" + 4);
+	append(trailer, (uint32_t)0);
+	m_out.write(trailer.data(), trailer.size());
+	m_out.close();
+}
+
+void TrajectoryWriter::writeChunk(uint32_t tag, const vector<char> &payload) {
+	vector<char> header;
+	append(header, tag);
+	append(header, (uint32_t)0);
+	append(header, (uint64_t)payload.size());
+	m_out.write(header.data(), header.size());
+	m_out.write(payload.data(), payload.size());
+}
+
+void TrajectoryWriter::writeTopology(int nverts, const vector<int> &tris) {
+	m_nverts = nverts;
+	m_payload.clear();
+	append(m_payload, (uint32_t)nverts);
+	append(m_payload, (uint32_t)(tris.size() / 3));
+	const char *p = (const char *)tris.data();
+	m_payload.insert(m_payload.end(), p, p + tris.size() * sizeof(int));
+	writeChunk(TAG_TOPO, m_payload);
+}
+
+void TrajectoryWriter::writeFrame(int frame, double time, const vector<double> &x) {
+	if (m_nverts < 0 || (int)x.size() != 3 * m_nverts) {
+		cerr << "Trajectory frame " << frame << " does not match the topology" << endl;
+		return;
+	}
+
+	int n = 3 * m_nverts;
+	int k = (int)m_index.size();
+	bool isKey = (m_encoding != QUANTIZED_DELTA) || k == 0 || k - m_lastkey >= m_keyframe;
+	if (isKey) {
+		m_lastkey = k;
+	}
+
+	IndexEntry entry;
+	entry.frame = frame;
+	entry.key = m_lastkey;
+	entry.time = time;
+	entry.offset = (uint64_t)m_out.tellp();
+	m_index.push_back(entry);
+
+	m_payload.clear();
+	append(m_payload, (int32_t)frame);
+	append(m_payload, time);
+	append(m_payload, (uint8_t)m_encoding);
+	append(m_payload, (uint8_t)isKey);
+	append(m_payload, (uint16_t)0);
+	append(m_payload, (uint32_t)m_nverts);
+	append(m_payload, m_quantum);
+	append(m_payload, (uint32_t)0);
+
+	if (m_encoding == FLOAT64) {
+		const char *p = (const char *)x.data();
+		m_payload.insert(m_payload.end(), p, p + n * sizeof(double));
+	}
+	else if (m_encoding == FLOAT32) {
+		for (int i = 0; i < n; ++i) {
+			append(m_payload, (float)x[i]);
+		}
+	}
+	else {
+		m_prev.resize(n, 0);
+		for (int i = 0; i < n; ++i) {
+			int64_t q = (int64_t)llround(x[i] / m_quantum);
+			appendVarint(m_payload, isKey ? q : q - m_prev[i]);
+			m_prev[i] = q;
+		}
+	}
+	writeChunk(TAG_FRAME, m_payload);
+	m_out.flush();
+}
+
+TrajectoryReader::TrajectoryReader() :
+	m_nverts(0),
+	m_cached(-1)
+{
+
+}
+
+bool TrajectoryReader::open(const string &FILE) {
+	m_in.close();
+	m_in.clear();
+	m_nverts = 0;
+	m_tris.clear();
+	m_index.clear();
+	m_cached = -1;
+
+	m_in.open(FILE.c_str(), ios::binary);
+	char header[HEADER_SIZE];
+	if (!m_in || !m_in.read(header, HEADER_SIZE) || memcmp(header, "RMTJ", 4) != 0) {
+		cerr << FILE << " is not a trajectory" << endl;
+		return false;
+	}
+	uint32_t version;
+	memcpy(&version, header + 4, sizeof(version));
+	if (version != TRAJECTORY_VERSION) {
+		cerr << FILE << " has trajectory version " << version << endl;
+		return false;
+	}
+
+	if (!readIndex()) {
+		// No index, the writer was not closed
+		m_index.clear();
+		if (!scan()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TrajectoryReader::readIndex() {
+	m_in.clear();
+	m_in.seekg(0, ios::end);
+	uint64_t size = (uint64_t)m_in.tellg();
+	if (size < HEADER_SIZE + TRAILER_SIZE) {
+		return false;
+	}
+
+	char trailer[TRAILER_SIZE];
+	m_in.seekg(size - TRAILER_SIZE);
+	if (!m_in.read(trailer, TRAILER_SIZE) || memcmp(trailer + 8, "RMTE", 4) != 0) {
+		return false;
+	}
+	uint64_t offset;
+	memcpy(&offset, trailer, sizeof(offset));
+
+	char chunk[CHUNK_HEADER_SIZE];
+	m_in.seekg(offset);
+	if (!m_in.read(chunk, CHUNK_HEADER_SIZE)) {
+		return false;
+	}
+	const char *p = chunk;
+	uint32_t tag = extract<uint32_t>(p);
+	extract<uint32_t>(p);
+	uint64_t length = extract<uint64_t>(p);
+	if (tag != TAG_INDEX || offset + CHUNK_HEADER_SIZE + length + TRAILER_SIZE != size) {
+		return false;
+	}
+
+	vector<char> payload(length);
+	if (!m_in.read(payload.data(), length) || length < sizeof(uint32_t)) {
+		return false;
+	}
+	p = payload.data();
+	uint32_t nframes = extract<uint32_t>(p);
+	if (length != sizeof(uint32_t) + nframes * sizeof(IndexEntry)) {
+		return false;
+	}
+	m_index.resize(nframes);
+	memcpy(m_index.data(), p, nframes * sizeof(IndexEntry));
+
+	// The topology comes first
+	m_in.seekg(HEADER_SIZE);
+	if (!m_in.read(chunk, CHUNK_HEADER_SIZE)) {
+		return nframes == 0;
+	}
+	p = chunk;
+	tag = extract<uint32_t>(p);
+	extract<uint32_t>(p);
+	length = extract<uint64_t>(p);
+	if (tag == TAG_TOPO) {
+		payload.resize(length);
+		if (!m_in.read(payload.data(), length)) {
+			return false;
+		}
+		p = payload.data();
+		m_nverts = (int)extract<uint32_t>(p);
+		uint32_t ntris = extract<uint32_t>(p);
+		m_tris.resize(3 * ntris);
+		memcpy(m_tris.data(), p, m_tris.size() * sizeof(int));
+	}
+	return true;
+}
+
+bool TrajectoryReader::scan() {
+	m_in.clear();
+	m_in.seekg(0, ios::end);
+	uint64_t size = (uint64_t)m_in.tellg();
+	uint64_t offset = HEADER_SIZE;
+	int lastkey = 0;
+	vector<char> payload;
+
+	while (offset + CHUNK_HEADER_SIZE <= size) {
+		char chunk[CHUNK_HEADER_SIZE];
+		m_in.seekg(offset);
+		if (!m_in.read(chunk, CHUNK_HEADER_SIZE)) {
+			break;
+		}
+		const char *p = chunk;
+		uint32_t tag = extract<uint32_t>(p);
+		extract<uint32_t>(p);
+		uint64_t length = extract<uint64_t>(p);
+		if (offset + CHUNK_HEADER_SIZE + length > size) {
+			// Cut off by the end of the run
+			break;
+		}
+
+		if (tag == TAG_TOPO) {
+			payload.resize(length);
+			m_in.read(payload.data(), length);
+			p = payload.data();
+			m_nverts = (int)extract<uint32_t>(p);
+			uint32_t ntris = extract<uint32_t>(p);
+			m_tris.resize(3 * ntris);
+			memcpy(m_tris.data(), p, m_tris.size() * sizeof(int));
+		}
+		else if (tag == TAG_FRAME && length >= FRAME_PREFIX_SIZE) {
+			payload.resize(FRAME_PREFIX_SIZE);
+			m_in.read(payload.data(), FRAME_PREFIX_SIZE);
+			p = payload.data();
+			IndexEntry entry;
+			entry.frame = extract<int32_t>(p);
+			entry.time = extract<double>(p);
+			extract<uint8_t>(p);
+			bool isKey = extract<uint8_t>(p) != 0;
+			if (isKey) {
+				lastkey = (int)m_index.size();
+			}
+			entry.key = lastkey;
+			entry.offset = offset;
+			m_index.push_back(entry);
+		}
+		else if (tag == TAG_INDEX) {
+			break;
+		}
+		offset += CHUNK_HEADER_SIZE + length;
+	}
+	return true;
+}
+
+bool TrajectoryReader::decode(uint64_t offset, vector<int64_t> &q, vector<double> &x) {
+	char chunk[CHUNK_HEADER_SIZE];
+	m_in.clear();
+	m_in.seekg(offset);
+	if (!m_in.read(chunk, CHUNK_HEADER_SIZE)) {
+		return false;
+	}
+	const char *p = chunk;
+	uint32_t tag = extract<uint32_t>(p);
+	extract<uint32_t>(p);
+	uint64_t length = extract<uint64_t>(p);
+	if (tag != TAG_FRAME || length < FRAME_PREFIX_SIZE) {
+		return false;
+	}
+
+	vector<char> payload(length);
+	if (!m_in.read(payload.data(), length)) {
+		return false;
+	}
+	p = payload.data();
+	const char *end = p + length;
+	extract<int32_t>(p);
+	extract<double>(p);
+	int encoding = extract<uint8_t>(p);
+	bool isKey = extract<uint8_t>(p) != 0;
+	extract<uint16_t>(p);
+	int nverts = (int)extract<uint32_t>(p);
+	double quantum = extract<double>(p);
+	extract<uint32_t>(p);
+
+	int n = 3 * nverts;
+	x.resize(n);
+	if (encoding == TrajectoryWriter::FLOAT64) {
+		if (end - p < (ptrdiff_t)(n * sizeof(double))) {
+			return false;
+		}
+		memcpy(x.data(), p, n * sizeof(double));
+	}
+	else if (encoding == TrajectoryWriter::FLOAT32) {
+		if (end - p < (ptrdiff_t)(n * sizeof(float))) {
+			return false;
+		}
+		for (int i = 0; i < n; ++i) {
+			x[i] = extract<float>(p);
+		}
+	}
+	else {
+		q.resize(n, 0);
+		for (int i = 0; i < n; ++i) {
+			int64_t value;
+			if (!extractVarint(p, end, value)) {
+				return false;
+			}
+			q[i] = isKey ? value : q[i] + value;
+			x[i] = q[i] * quantum;
+		}
+	}
+	return true;
+}
+
+bool TrajectoryReader::readFrame(int k, vector<double> &x) {
+	if (k < 0 || k >= getFrameCount()) {
+		return false;
+	}
+
+	// Delta frames are decoded forward from their key frame, or from the last frame read
+	int key = m_index[k].key;
+	int start = (m_cached >= key && m_cached < k) ? m_cached + 1 : key;
+	for (int j = start; j <= k; ++j) {
+		if (!decode(m_index[j].offset, m_q, x)) {
+			m_cached = -1;
+			return false;
+		}
+	}
+	m_cached = k;
+	return true;
+}
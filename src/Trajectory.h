@@ -0,0 +1,105 @@
+#pragma once
+// Trajectory Chunked binary file of a deforming triangle mesh
+//    The file is a header followed by chunks. The topology chunk holds the triangles once,
+//    every frame chunk holds the vertex positions of one frame, and the index chunk at the end
+//    lists the offset of every frame for random access. Positions are stored as float64,
+//    float32, or as integers of a fixed quantum, optionally as the difference to the previous
+//    frame with a full key frame every few frames. Integers are written as zigzag varints, so
+//    small motions take a byte or two per coordinate. Files of runs that did not close the
+//    writer have no index; the reader then scans the chunks. A restarted run resumes the file:
+//    the frames from the restart on are cut off and the index is rebuilt from the frames that
+//    remain. Little-endian only.
+
+#ifndef REDUCEDCOORD_SRC_TRAJECTORY_H_
+#define REDUCEDCOORD_SRC_TRAJECTORY_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class TrajectoryWriter
+{
+public:
+	enum Encoding {
+		FLOAT64, FLOAT32, QUANTIZED, QUANTIZED_DELTA
+	};
+
+	TrajectoryWriter();
+	virtual ~TrajectoryWriter();
+
+	// quantum is the step of the quantized encodings, keyframe the distance between full frames
+	bool open(const std::string &FILE, Encoding encoding = FLOAT32, double quantum = 1.0e-5, int keyframe = 30);
+	// Keeps the topology and the frames before frame of an existing file and continues it in
+	// the encoding of those frames. Opens a new file when there is none.
+	bool resume(const std::string &FILE, int frame, Encoding encoding = FLOAT32, double quantum = 1.0e-5, int keyframe = 30);
+	void close();
+	bool isOpen() const { return m_out.is_open(); }
+	bool hasTopology() const { return m_nverts >= 0; }
+
+	// Must come before the first frame
+	void writeTopology(int nverts, const std::vector<int> &tris);
+	// 3 coordinates per vertex
+	void writeFrame(int frame, double time, const std::vector<double> &x);
+
+private:
+	struct IndexEntry {
+		int32_t frame;
+		int32_t key;
+		double time;
+		uint64_t offset;
+	};
+
+	void writeChunk(uint32_t tag, const std::vector<char> &payload);
+
+	std::ofstream m_out;
+	Encoding m_encoding;
+	double m_quantum;
+	int m_keyframe;
+	int m_nverts;
+	int m_lastkey;
+	std::vector<int64_t> m_prev;
+	std::vector<IndexEntry> m_index;
+	std::vector<char> m_payload;
+};
+
+class TrajectoryReader
+{
+public:
+	TrajectoryReader();
+	virtual ~TrajectoryReader() {}
+
+	bool open(const std::string &FILE);
+
+	int getVertexCount() const { return m_nverts; }
+	const std::vector<int> & getTriangles() const { return m_tris; }
+	int getFrameCount() const { return (int)m_index.size(); }
+	int getFrame(int k) const { return m_index[k].frame; }
+	double getTime(int k) const { return m_index[k].time; }
+
+	// Positions of the k-th stored frame
+	bool readFrame(int k, std::vector<double> &x);
+
+private:
+	struct IndexEntry {
+		int32_t frame;
+		int32_t key;
+		double time;
+		uint64_t offset;
+	};
+
+	bool readIndex();
+	bool scan();
+	bool decode(uint64_t offset, std::vector<int64_t> &q, std::vector<double> &x);
+
+	std::ifstream m_in;
+	int m_nverts;
+	std::vector<int> m_tris;
+	std::vector<IndexEntry> m_index;
+
+	// Last decoded frame, so that reading frames in order does not go back to the key frame
+	int m_cached;
+	std::vector<int64_t> m_q;
+};
+
+#endif // REDUCEDCOORD_SRC_TRAJECTORY_H_
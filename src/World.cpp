@@ -74,9 +74,18 @@ using json = nlohmann::json;
 #define EXPORT_SOFT
 //#define EXPORT_FINGERS
 
+const char *const WORLD_TYPE_NAMES[] = { "SERIAL_CHAIN", "DIFF_REVOLUTE_AXES", "BRANCHING", "SHPERICAL_JOINT", "LOOP",
+	"JOINT_TORQUE", "JOINT_LIMITS", "EQUALITY_CONSTRAINED_ANGLES", "EQUALITY_AND_LOOP", "HYBRID_DYNAMICS",
+	"EXTERNAL_WORLD_FORCE", "JOINT_STIFFNESS", "SPRINGS", "SOFT_BODIES", "COMPONENT", "WRAP_SPHERE", "WRAP_CYLINDER",
+	"WRAP_DOUBLECYLINDER", "SPLINE_CURVE_JOINT", "SPLINE_SURFACE_JOINT", "SOFT_BODIES_CUBE_INVERTIBLE",
+	"SOFT_BODIES_CYLINDER_INVERTIBLE", "SOFT_BODIES_CUBE_COROTATIONAL_LINEAR", "SOFT_BODIES_CYLINDER_COROTATIONAL_LINEAR",
+	"SPRING_DAMPER", "MESH_EMBEDDING", "HUMAN_BODY", "WORM", "CROSS", "STARFISH", "FREEJOINT", "STARFISH_2",
+	"TEST_MAXIMAL_HYBRID_DYNAMICS", "TEST_REDUCED_HYBRID_DYNAMICS", "FINGERS", "STARFISH3", "TEST_HYPER_REDUCED_COORDS",
+	"TEST_JOINT_UNIVERSAL", "TEST_CONSTRAINT_PRESC_BODY_ATTACH_POINT", "GENERATED" };
+
 World::World() :
-	nr(0), nm(0), nR(0), nem(0), ner(0), ne(0), nim(0), nir(0), m_nbodies(0), m_njoints(0), m_ndeformables(0), m_constraints(0), m_countS(0), m_countCM(0),
-	m_nsoftbodies(0), m_ncomps(0), m_nwraps(0), m_nsprings(0), m_nmeshembeddings(0)
+	nr(0), nm(0), nR(0), nrc(0), nem(0), ner(0), ne(0), nim(0), nir(0), m_nbodies(0), m_njoints(0), m_ndeformables(0), m_constraints(0), m_countS(0), m_countCM(0),
+	m_nsoftbodies(0), m_ncomps(0), m_nwraps(0), m_nsprings(0), m_nmeshembeddings(0), m_H(0.0), m_source(nullptr)
 {
 	m_energy.K = 0.0;
 	m_energy.V = 0.0;
@@ -86,14 +95,15 @@ World::World() :
 
 World::World(WorldType type) :
 	m_type(type),
-	nr(0), nm(0), nR(0),nem(0), ner(0), ne(0), nim(0), nir(0), m_nbodies(0), m_njoints(0), m_ndeformables(0), m_nconstraints(0), m_countS(0), m_countCM(0),
-	m_nsoftbodies(0), m_ncomps(0), m_nwraps(0), m_nsprings(0), m_nmeshembeddings(0)
+	nr(0), nm(0), nR(0), nrc(0), nem(0), ner(0), ne(0), nim(0), nir(0), m_nbodies(0), m_njoints(0), m_ndeformables(0), m_nconstraints(0), m_countS(0), m_countCM(0),
+	m_nsoftbodies(0), m_ncomps(0), m_nwraps(0), m_nsprings(0), m_nmeshembeddings(0), m_H(0.0), m_source(nullptr)
 {
 	m_energy.K = 0.0;
 	m_energy.V = 0.0;
 }
 
 void World::load(const std::string &RESOURCE_DIR) {
+	m_resource_dir = RESOURCE_DIR;
 
 	//read a JSON file
 	ifstream i(RESOURCE_DIR + "input.json");
@@ -1730,11 +1740,132 @@ void World::load(const std::string &RESOURCE_DIR) {
 		m_constraints.push_back(con0);
 		break;
 	}
+	case GENERATED:
+		loadGenerated(RESOURCE_DIR);
+		break;
 default:
 		break;
 	}
 }
 
+void World::loadGenerated(const string &RESOURCE_DIR) {
+	// A tree of 10x1x1 links in the XY plane, the children of link i are i * nbranches + 1
+	// and on. All joints bend about Z so that every loop closes a planar four-bar linkage.
+	int nlinks = m_params.nlinks;
+	int nbranches = max(1, m_params.nbranches);
+	if (nlinks < 1) {
+		cout << "GENERATED needs at least one link" << endl;
+		exit(1);
+	}
+
+	double density = 1.0;
+	double young = 1e3;
+	double possion = 0.40;
+	Vector3d sides(10.0, 1.0, 1.0);
+	Vector3d soft_sides(10.0, 1.5, 1.5);
+	m_h = m_params.nsoftbodies > 0 ? 1.0e-3 : 1.0e-2;
+	m_tspan << 0.0, 50.0;
+	m_t = 0.0;
+	m_grav << 0.0, -98, 0.0;
+	m_stiffness = 5.0e3;
+
+	// World frames of the joints and bodies, computed here because the loops and soft
+	// bodies are placed before init()
+	vector<Matrix4d> E_wj(nlinks), E_wi(nlinks);
+	Matrix4d E_ji = SE3::RpToE(Matrix3d::Identity(), Vector3d(5.0, 0.0, 0.0));
+	for (int i = 0; i < nlinks; i++) {
+		auto body = addBody(density, sides, Vector3d(5.0, 0.0, 0.0), Matrix3d::Identity(), RESOURCE_DIR, "box10_1_1.obj");
+		if (i == 0) {
+			addJointRevolute(body, Vector3d::UnitZ(), Vector3d(0.0, 0.0, 0.0), Matrix3d::Identity(), 0.0, RESOURCE_DIR);
+			E_wj[i] = Matrix4d::Identity();
+		}
+		else {
+			// Siblings fan out, a chain curls slowly
+			int parent = (i - 1) / nbranches;
+			int k = (i - 1) % nbranches;
+			double q = nbranches == 1 ? M_PI / 8.0 : -M_PI / 4.0 + M_PI / 2.0 * k / (nbranches - 1);
+			addJointRevolute(body, Vector3d::UnitZ(), Vector3d(10.0, 0.0, 0.0), Matrix3d::Identity(), q, RESOURCE_DIR, m_joints[parent]);
+			E_wj[i] = E_wj[parent] * SE3::RpToE(SE3::aaToMat(Vector3d::UnitZ(), q), Vector3d(10.0, 0.0, 0.0));
+		}
+		E_wi[i] = E_wj[i] * E_ji;
+	}
+
+	// Each loop pins the end of a great-grandchild to its ancestor, the loops share no joint
+	vector<bool> isUsed(nlinks, false);
+	int nloops = 0;
+	for (int a = 0; a < nlinks && nloops < m_params.nloops; a++) {
+		int c = a * nbranches + 1;
+		int g = c * nbranches + 1;
+		int gg = g * nbranches + 1;
+		if (gg >= nlinks || isUsed[c] || isUsed[g] || isUsed[gg]) {
+			continue;
+		}
+		isUsed[c] = isUsed[g] = isUsed[gg] = true;
+
+		Vector3d xB(5.0, 0.0, 0.0);
+		Vector4d x_w = E_wi[gg] * xB.homogeneous();
+		Vector4d xA = SE3::inverse(E_wi[a]) * x_w;
+		auto constraint = make_shared<ConstraintLoop>(m_bodies[a], m_bodies[gg]);
+		constraint->setPositions(xA.segment<3>(0), xB);
+		m_constraints.push_back(constraint);
+		m_nconstraints++;
+		nloops++;
+	}
+	if (nloops < m_params.nloops) {
+		cout << "GENERATED: only " << nloops << " of " << m_params.nloops << " loops fit in the tree" << endl;
+	}
+
+	// Soft boxes around the joint between a link and its first child, TetGen's volume bound
+	// sets the tet count
+	double volume = soft_sides.prod() / max(1, m_params.ntets);
+	ostringstream flags;
+	flags << "pq1.414zQa" << fixed << setprecision(8) << volume;
+	for (int k = 0; k < m_params.nsoftbodies; k++) {
+		int a = k % nlinks;
+		int c = a * nbranches + 1;
+		int b = c < nlinks ? c : a;
+		auto softbody = addSoftBodyBox(0.001 * density, young, possion, CO_ROTATED, RESOURCE_DIR, flags.str(), soft_sides);
+		softbody->transform(Matrix4d(E_wj[a] * SE3::RpToE(Matrix3d::Identity(), Vector3d(10.0, 0.0, 0.0))));
+		softbody->setColor(Vector3f(255.0, 204.0, 153.0) / 255.0);
+		m_generated_ends.push_back(Vector2i(a, b));
+	}
+
+	// Springs between the centers of two links, or from a point above the only link
+	double mass = sides.prod() * density;
+	for (int k = 0; k < m_params.nsprings; k++) {
+		int a = k % nlinks;
+		int b = (a + 1 + k / nlinks) % nlinks;
+		if (a == b) {
+			Vector3d x_w = E_wi[a].block<3, 1>(0, 3) + Vector3d(0.0, 10.0, 0.0);
+			addDeformableSpring(mass, 2, nullptr, x_w, m_bodies[a], Vector3d::Zero());
+		}
+		else {
+			addDeformableSpring(mass, 2, m_bodies[a], Vector3d::Zero(), m_bodies[b], Vector3d::Zero());
+		}
+	}
+	for (int i = 0; i < (int)m_deformables.size(); i++) {
+		m_deformables[i]->load(RESOURCE_DIR);
+	}
+}
+
+void World::initGenerated() {
+	// The end faces of each soft box hold on to the links at either end
+	for (int k = 0; k < (int)m_generated_ends.size(); k++) {
+		auto softbody = m_softbodies[k];
+		const vector<shared_ptr<Node> > &nodes = softbody->getNodes();
+		double half = 0.5 * softbody->getBoxSides()(0) * (1.0 - 1.0e-6);
+		for (int i = 0; i < (int)nodes.size(); i++) {
+			double x = nodes[i]->x0(0);
+			if (x <= -half) {
+				softbody->setAttachments(i, m_bodies[m_generated_ends[k](0)]);
+			}
+			else if (x >= half) {
+				softbody->setAttachments(i, m_bodies[m_generated_ends[k](1)]);
+			}
+		}
+	}
+}
+
 shared_ptr<ConstraintPrescJoint> World::addConstraintPrescJoint(shared_ptr<Joint> j) {
 	auto con = make_shared<ConstraintPrescJoint>(j, REDMAX_EULER);
 	m_nconstraints++;
@@ -1756,16 +1887,42 @@ shared_ptr<ConstraintPrescBodyAttachPoint> World::addConstraintPrescBodyAttachPo
 	return con;
 }
 
+shared_ptr<const SoftBody> World::getRestSoftBody() const {
+	// Clones add their objects in the same order as the world they are cloned from
+	if (m_source == nullptr || m_nsoftbodies >= (int)m_source->m_softbodies.size()) {
+		return nullptr;
+	}
+	return m_source->m_softbodies[m_nsoftbodies];
+}
+
+shared_ptr<const MeshEmbedding> World::getRestMeshEmbedding() const {
+	if (m_source == nullptr || m_nmeshembeddings >= (int)m_source->m_meshembeddings.size()) {
+		return nullptr;
+	}
+	return m_source->m_meshembeddings[m_nmeshembeddings];
+}
+
 shared_ptr<SoftBody> World::addSoftBody(double density, double young, double possion, Material material, const string &RESOURCE_DIR, const string &TETGEN_FLAGS, string file_name) {
 	auto softbody = make_shared<SoftBody>(density, young, possion, material);
+	softbody->setRestSource(getRestSoftBody());
 	softbody->load(RESOURCE_DIR, file_name, TETGEN_FLAGS);
 	m_softbodies.push_back(softbody);
 	m_nsoftbodies++;
 	return softbody;
 }
 
+shared_ptr<SoftBody> World::addSoftBodyBox(double density, double young, double possion, Material material, const string &RESOURCE_DIR, const string &TETGEN_FLAGS, Vector3d sides) {
+	auto softbody = make_shared<SoftBody>(density, young, possion, material);
+	softbody->setRestSource(getRestSoftBody());
+	softbody->loadBox(RESOURCE_DIR, sides, TETGEN_FLAGS);
+	m_softbodies.push_back(softbody);
+	m_nsoftbodies++;
+	return softbody;
+}
+
 shared_ptr<SoftBodyInvertibleFEM> World::addSoftBodyInvertibleFEM(double density, double young, double possion, Material material, const string &RESOURCE_DIR, const string &TETGEN_FLAGS, string file_name) {
 	auto softbody = make_shared<SoftBodyInvertibleFEM>(density, young, possion, material);
+	softbody->setRestSource(getRestSoftBody());
 	softbody->load(RESOURCE_DIR, file_name, TETGEN_FLAGS);
 	m_softbodies.push_back(softbody);
 	m_nsoftbodies++;
@@ -1774,6 +1931,7 @@ shared_ptr<SoftBodyInvertibleFEM> World::addSoftBodyInvertibleFEM(double density
 
 shared_ptr<SoftBodyCorotationalLinear> World::addSoftBodyCorotationalLinearFEM(double density, double young, double possion, Material material, const string &RESOURCE_DIR, const string &TETGEN_FLAGS, string file_name) {
 	auto softbody = make_shared<SoftBodyCorotationalLinear>(density, young, possion, material);
+	softbody->setRestSource(getRestSoftBody());
 	softbody->load(RESOURCE_DIR, file_name, TETGEN_FLAGS);
 	m_softbodies.push_back(softbody);
 	m_nsoftbodies++;
@@ -1967,6 +2125,7 @@ shared_ptr<MeshEmbedding> World::addMeshEmbedding(
 {
 	
 	auto mesh_embedding = make_shared<MeshEmbedding>(density, young, possion, material, soft_body_type);
+	mesh_embedding->setRestSource(getRestMeshEmbedding());
 	mesh_embedding->load(RESOURCE_DIR, coarse_mesh, TETGEN_FLAGS_0, dense_mesh, TETGEN_FLAGS_1);
 
 	m_nmeshembeddings++;
@@ -2148,6 +2307,11 @@ void World::init() {
 		}
 	}
 
+	// The springs take their attachment points and rest lengths from the initial pose
+	if (m_njoints > 0) {
+		m_joints[0]->update();
+	}
+
 	for (int i = 0; i < m_nsprings; ++i) {
 		m_springs[i]->init();
 		if (i < m_nsprings - 1) {
@@ -2299,6 +2463,11 @@ void World::init() {
 		}
 	}	
 
+	if (m_type == GENERATED) {
+		initGenerated();
+	}
+
+	nrc = nr;
 	for (int i = 0; i < m_nsoftbodies; i++) {
 		m_softbodies[i]->countDofs(nm, nr);
 		m_softbodies[i]->init();
@@ -2357,6 +2526,54 @@ void World::init() {
 	if (m_nconstraints == 0) {
 		addConstraintNull();
 	}
+
+	computeOrdering();
+}
+
+void World::computeOrdering() {
+	// Elimination order for the direct solvers: the kinematic tree leaf-to-root,
+	// then the remaining rigid/deformable DOFs, then each FEM mesh by nested dissection.
+	// Constraint rows are appended last by the solver.
+	vector<int> order;
+	order.reserve(nr);
+	for (int i = 0; i < m_njoints; i++) {
+		if (m_joints[i]->getBody() != nullptr && m_joints[i]->getParent() == nullptr) {
+			m_joints[i]->computePostorder(order);
+		}
+	}
+
+	vector<int> fem_order;
+	for (int i = 0; i < m_nsoftbodies; i++) {
+		m_softbodies[i]->computeNestedDissection(fem_order);
+	}
+	for (int i = 0; i < m_nmeshembeddings; i++) {
+		if (m_meshembeddings[i]->getCoarseMesh() != nullptr) {
+			m_meshembeddings[i]->getCoarseMesh()->computeNestedDissection(fem_order);
+		}
+	}
+
+	vector<bool> isPlaced(nr, false);
+	for (int i = 0; i < (int)order.size(); ++i) {
+		isPlaced[order[i]] = true;
+	}
+	for (int i = 0; i < (int)fem_order.size(); ++i) {
+		isPlaced[fem_order[i]] = true;
+	}
+	for (int i = 0; i < nr; ++i) {
+		if (!isPlaced[i]) {
+			order.push_back(i);
+		}
+	}
+	order.insert(order.end(), fem_order.begin(), fem_order.end());
+
+	m_ordering = Eigen::Map<Eigen::VectorXi>(order.data(), order.size());
+}
+
+int World::computeSoftBodySubsteps() const {
+	if (m_H <= m_h) {
+		return 1;
+	}
+	return max(1, (int)round(m_H / m_h));
 }
 
 void World::update() {
@@ -2365,9 +2582,133 @@ void World::update() {
 	m_springs[0]->update();
 }
 
+shared_ptr<World> World::clone() const {
+	// The objects point to each other through parents, next links and constraints, and the
+	// scenes move them around after creating them, so the copy is built the way this world was
+	// rather than copied object by object. The expensive immutable parts are shared instead of
+	// rebuilt: the tet meshes come from the MeshRegistry, and the soft bodies and embeddings
+	// take the rest volumes, stiffness matrices and weights of their counterparts here.
+	auto world = make_shared<World>(m_type);
+	world->setSceneParams(m_params);
+	world->m_source = this;
+	world->load(m_resource_dir);
+	world->m_source = nullptr;
+	world->setGrav(m_grav);
+	world->setCoarseStep(m_H);
+	world->init();
+
+	vector<double> state;
+	saveState(state);
+	world->restoreState(state);
+	return world;
+}
+
+static int countNodes(const vector<shared_ptr<SoftBody> > &softbodies) {
+	int n = 0;
+	for (int i = 0; i < (int)softbodies.size(); ++i) {
+		n += (int)softbodies[i]->getNodes().size();
+	}
+	return n;
+}
+
+void World::saveState(vector<double> &state) const {
+	int nnodes = countNodes(m_softbodies);
+	int ncons = (int)m_constraints.size();
+	int nsoft = (int)(m_softbodies.size() + m_meshembeddings.size());
+	state.resize(4 + 2 * nr + 6 * nnodes + 4 * ncons + nsoft);
+	state[0] = nr;
+	state[1] = nnodes;
+	state[2] = ncons;
+	state[3] = m_t;
+
+	// Same as Scene::init, without the reparameterization
+	VectorXd y = VectorXd::Zero(2 * nr);
+	m_joints[0]->gatherDofs(y, nr);
+	m_deformables[0]->gatherDofs(y, nr);
+	m_softbodies[0]->gatherDofs(y, nr);
+	m_meshembeddings[0]->gatherDofs(y, nr);
+	Map<VectorXd> ymap(state.data() + 4, 2 * nr);
+	ymap = y;
+
+	double *s = state.data() + 4 + 2 * nr;
+	for (int i = 0; i < (int)m_softbodies.size(); ++i) {
+		const vector<shared_ptr<Node> > &nodes = m_softbodies[i]->getNodes();
+		for (int k = 0; k < (int)nodes.size(); ++k) {
+			Map<Vector3d> x(s), v(s + 3);
+			x = nodes[k]->x;
+			v = nodes[k]->v;
+			s += 6;
+		}
+	}
+	for (int i = 0; i < ncons; ++i) {
+		s[0] = m_constraints[i]->activeM;
+		s[1] = m_constraints[i]->activeR;
+		s[2] = m_constraints[i]->activeEM;
+		s[3] = m_constraints[i]->activeER;
+		s += 4;
+	}
+	// The floor contact of the last scatter, which the next step of a coarse mesh depends on
+	for (int i = 0; i < (int)m_softbodies.size(); ++i) {
+		*s++ = m_softbodies[i]->m_isCollided;
+	}
+	for (int i = 0; i < (int)m_meshembeddings.size(); ++i) {
+		shared_ptr<SoftBody> coarse = m_meshembeddings[i]->getCoarseMesh();
+		*s++ = (coarse != nullptr && coarse->m_isCollided);
+	}
+}
+
+bool World::restoreState(const vector<double> &state) {
+	int nnodes = countNodes(m_softbodies);
+	int ncons = (int)m_constraints.size();
+	int nsoft = (int)(m_softbodies.size() + m_meshembeddings.size());
+	if (state.size() != (size_t)(4 + 2 * nr + 6 * nnodes + 4 * ncons + nsoft) ||
+		(int)state[0] != nr || (int)state[1] != nnodes || (int)state[2] != ncons) {
+		cerr << "World: the state does not match this world" << endl;
+		return false;
+	}
+	m_t = state[3];
+
+	VectorXd y = Map<const VectorXd>(state.data() + 4, 2 * nr);
+	m_joints[0]->scatterDofs(y, nr);
+	m_deformables[0]->scatterDofs(y, nr);
+	m_softbodies[0]->scatterDofs(y, nr);
+	m_meshembeddings[0]->scatterDofs(y, nr);
+
+	// The scatter skips the fixed nodes and pushes the others out of the floor, so the nodes
+	// are set again from the saved values
+	const double *s = state.data() + 4 + 2 * nr;
+	for (int i = 0; i < (int)m_softbodies.size(); ++i) {
+		const vector<shared_ptr<Node> > &nodes = m_softbodies[i]->getNodes();
+		for (int k = 0; k < (int)nodes.size(); ++k) {
+			nodes[k]->x = Map<const Vector3d>(s);
+			nodes[k]->v = Map<const Vector3d>(s + 3);
+			s += 6;
+		}
+	}
+	for (int i = 0; i < ncons; ++i) {
+		m_constraints[i]->activeM = s[0] != 0.0;
+		m_constraints[i]->activeR = s[1] != 0.0;
+		m_constraints[i]->activeEM = s[2] != 0.0;
+		m_constraints[i]->activeER = s[3] != 0.0;
+		s += 4;
+	}
+	for (int i = 0; i < (int)m_softbodies.size(); ++i) {
+		m_softbodies[i]->m_isCollided = *s++ != 0.0;
+	}
+	for (int i = 0; i < (int)m_meshembeddings.size(); ++i) {
+		shared_ptr<SoftBody> coarse = m_meshembeddings[i]->getCoarseMesh();
+		if (coarse != nullptr) {
+			coarse->m_isCollided = *s != 0.0;
+		}
+		s++;
+	}
+	update();
+	return true;
+}
+
 int World::getNsteps() {
 	// Computes the number of results
-	int nsteps = int((m_tspan(1) - m_tspan(0)) / m_h);
+	int nsteps = int((m_tspan(1) - m_tspan(0)) / getH());
 	return nsteps;
 }
 
@@ -4186,9 +4527,6 @@ void World::sceneAttachPoint(double t) {
 }
 
 // Export
-Json::Value jsonworld;
-Json::Value frames(Json::arrayValue);
-
 int World::getBrenderCount() const
 {
 	return 1;
@@ -4207,11 +4545,12 @@ vector<string> World::getBrenderExtensions() const
 	vector<string> extensions;
 	
 #ifdef EXPORT_RIGIDS
-	string obj = "json";
+	// One JSON document per line: the header, then a line per frame
+	string obj = "ndjson";
 #endif
 
 #ifdef EXPORT_SOFT
-	string obj = "obj";
+	string obj = "rmtraj";
 #endif
 	extensions.push_back(obj);
 
@@ -4221,23 +4560,71 @@ vector<string> World::getBrenderExtensions() const
 vector<int> World::getBrenderTypes() const
 {
 	vector<int> types;
-	///int mytype;
 #ifdef EXPORT_RIGIDS
-	mytype = Brenderable::ResetAppend;
-	types.push_back(mytype);
+	// The first export starts a new file, the others append their frame
+	types.push_back(export_part == 0 ? Brenderable::ResetAppend : Brenderable::Append);
 #endif
 #ifdef EXPORT_SOFT
-	types.push_back(Brenderable::Truncate);
+	types.push_back(Brenderable::Trajectory);
 #endif // EXPORT_SOFT
 	return types;
 }
 
-void World::exportBrender(vector< shared_ptr< ofstream > > outfiles, int frame, double time) const
+static void exportPoseLine(ostream &outfile, const Json::Value &value)
 {
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+	writer->write(value, &outfile);
+	outfile << "\n";
+}
 
-	ofstream &outfile = *outfiles[0];
+void World::exportPoses(ostream &outfile, int frame, const vector<string> &names, const vector<string> &objs) const
+{
+	if (export_part == 0)
+	{
+		// Header, written once
+		Json::Value header(Json::objectValue);
+		Json::Value objs_json(Json::arrayValue);
+		for (int i = 0; i < (int)objs.size(); ++i) {
+			objs_json[i] = objs[i];
+		}
+		header["objs"] = objs_json;
+
+		Json::Value states(Json::arrayValue);
+		for (int i = 0; i < (int)m_bodies.size(); ++i)
+		{
+			Json::Value vi(Json::objectValue);
+			vi["obj"] = i;
+			vi["name"] = names[i];
+			states.append(vi);
+		}
+		header["states"] = states;
+
+		Json::Value v(Json::objectValue);
+		v["header"] = header;
+		exportPoseLine(outfile, v);
+	}
+
+	// The last export only marks the end, every frame is already in the file
+	if (export_part == 0 || export_part == 1)
+	{
+		Json::Value v(Json::objectValue);
+		v["frame"] = frame;
+
+		for (int i = 0; i < (int)m_bodies.size(); ++i)
+		{
+			v[names[i]] = m_bodies[i]->exportJson();
+		}
+
+		exportPoseLine(outfile, v);
+	}
+}
+
+void World::exportBrender(vector< shared_ptr< ostream > > outfiles, int frame, double time) const
+{
 #ifdef EXPORT_FINGERS
-	Json::Value states(Json::arrayValue);
+	ostream &outfile = *outfiles[0];
 	vector<string> mybodyname_vec;
 	string mybody = "elbow";
 	mybodyname_vec.push_back(mybody);
@@ -4282,145 +4669,67 @@ void World::exportBrender(vector< shared_ptr< ofstream > > outfiles, int frame,
 	mybody = "pinky_finger_3";
 	mybodyname_vec.push_back(mybody);
 	std::string resource_dir = "D:/Research/Muscles/Projects/ReducedCoordRigidBodyFEM/resources/";
-	
-	if (export_part == 0)
-	{
-		Json::Value objs(Json::arrayValue);
-		objs[0] = resource_dir + "36.obj";
-		objs[1] = resource_dir + "wrist.obj";
-		objs[2] = resource_dir + "11_5.obj";
-		objs[3] = resource_dir + "6.obj";
-		objs[4] = resource_dir + "4.obj";
-		objs[5] = resource_dir + "12.obj";
-		objs[6] = resource_dir + "7.obj";
-		objs[7] = resource_dir + "4.obj";
-
-		objs[8] = resource_dir + "3_5.obj";
-		objs[9] = resource_dir + "11.obj";
-		objs[10] = resource_dir + "7.obj";
-		objs[11] = resource_dir + "4_5.obj";
-		objs[12] = resource_dir + "3_5.obj";
-
-		objs[13] = resource_dir + "10.obj";
-		objs[14] = resource_dir + "6_5.obj";
-		objs[15] = resource_dir + "4_2.obj";
-		objs[16] = resource_dir + "3_3.obj";
-		objs[17] = resource_dir + "9.obj";
-		objs[18] = resource_dir + "4.obj";
-		objs[19] = resource_dir + "3.obj";
-		objs[20] = resource_dir + "2_8.obj";
-
-		jsonworld["header"]["objs"] = objs;
-		
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			Json::Value vi(Json::objectValue);
-			vi["obj"] = i;
-			vi["name"] = mybodyname_vec[i];
-			states.append(vi);
-		}
-		jsonworld["header"]["states"] = states;
-
-		Json::Value v(Json::objectValue);
-		v["frame"] = frame;
-
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			v[mybodyname_vec[i]] = m_bodies[i]->exportJson();
-		}
 
-		frames.append(v);
-
-	}
-	// print frame
-	else if (export_part == 1)
-	{
-		Json::Value v(Json::objectValue);
-		v["frame"] = frame;
-
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			v[mybodyname_vec[i]] = m_bodies[i]->exportJson();
-		}
-
-		frames.append(v);
-	}
-	else {
-		jsonworld["body"] = frames;
-		*(outfiles[0]) << jsonworld;
-	}
+	vector<string> objs;
+	objs.push_back(resource_dir + "36.obj");
+	objs.push_back(resource_dir + "wrist.obj");
+	objs.push_back(resource_dir + "11_5.obj");
+	objs.push_back(resource_dir + "6.obj");
+	objs.push_back(resource_dir + "4.obj");
+	objs.push_back(resource_dir + "12.obj");
+	objs.push_back(resource_dir + "7.obj");
+	objs.push_back(resource_dir + "4.obj");
+
+	objs.push_back(resource_dir + "3_5.obj");
+	objs.push_back(resource_dir + "11.obj");
+	objs.push_back(resource_dir + "7.obj");
+	objs.push_back(resource_dir + "4_5.obj");
+	objs.push_back(resource_dir + "3_5.obj");
+
+	objs.push_back(resource_dir + "10.obj");
+	objs.push_back(resource_dir + "6_5.obj");
+	objs.push_back(resource_dir + "4_2.obj");
+	objs.push_back(resource_dir + "3_3.obj");
+	objs.push_back(resource_dir + "9.obj");
+	objs.push_back(resource_dir + "4.obj");
+	objs.push_back(resource_dir + "3.obj");
+	objs.push_back(resource_dir + "2_8.obj");
+
+	exportPoses(outfile, frame, mybodyname_vec, objs);
 #endif // EXPORT_FINGERS
 
 #ifdef EXPORT_STARFISH_BONES
-	Json::Value states(Json::arrayValue);
+	ostream &outfile = *outfiles[0];
 	vector<string> mybodyname_vec;
-	string mybody;
-
-	for (int i = 0; i < m_bodies.size(); ++i) {
-		mybody = to_string(i);
-		mybodyname_vec.push_back(mybody);
-	}
-
+	vector<string> objs;
 	std::string resource_dir = "D:/Research/Muscles/Projects/ReducedCoordRigidBodyFEM/resources/";
 
-	if (export_part == 0)
-	{
-		Json::Value objs(Json::arrayValue);
-		for (int i = 0; i < m_bodies.size(); ++i) {
-			objs[i] = resource_dir + "starfish_bone.obj";
-		}
-
-		jsonworld["header"]["objs"] = objs;
-
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			Json::Value vi(Json::objectValue);
-			vi["obj"] = i;
-			vi["name"] = mybodyname_vec[i];
-			states.append(vi);
-		}
-		jsonworld["header"]["states"] = states;
-
-		Json::Value v(Json::objectValue);
-		v["frame"] = frame;
-
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			v[mybodyname_vec[i]] = m_bodies[i]->exportJson();
-		}
-
-		frames.append(v);
-
+	for (int i = 0; i < (int)m_bodies.size(); ++i) {
+		mybodyname_vec.push_back(to_string(i));
+		objs.push_back(resource_dir + "starfish_bone.obj");
 	}
-	// print frame
-	else if (export_part == 1)
-	{
-		Json::Value v(Json::objectValue);
-		v["frame"] = frame;
-
-		for (int i = 0; i < m_bodies.size(); ++i)
-		{
-			v[mybodyname_vec[i]] = m_bodies[i]->exportJson();
-		}
 
-		frames.append(v);
-	}
-	else {
-		jsonworld["body"] = frames;
-		*(outfiles[0]) << jsonworld;
-	}
+	exportPoses(outfile, frame, mybodyname_vec, objs);
 #endif // EXPORT_STARFISH_BONES
+}
 
-
+void World::getTrajectoryTopology(int i, int &nverts, vector<int> &tris) const
+{
 #ifdef EXPORT_COARSE_MESH
-
-	m_meshembeddings[0]->getCoarseMesh()->exportObj(outfile);
-
+	m_meshembeddings[0]->getCoarseMesh()->getTrajectoryTopology(nverts, tris);
 #endif // EXPORT_COARSE_MESH
 #ifdef EXPORT_DENSE_MESH
-	m_meshembeddings[0]->getDenseMesh()->exportObj(outfile);
-
+	m_meshembeddings[0]->getDenseMesh()->getTrajectoryTopology(nverts, tris);
 #endif // EXPORT_DENSE_MESH
+}
 
-	
+void World::getTrajectoryPositions(int i, vector<double> &x) const
+{
+#ifdef EXPORT_COARSE_MESH
+	m_meshembeddings[0]->getCoarseMesh()->getTrajectoryPositions(x);
+#endif // EXPORT_COARSE_MESH
+#ifdef EXPORT_DENSE_MESH
+	m_meshembeddings[0]->updateDenseMesh();
+	m_meshembeddings[0]->getDenseMesh()->getTrajectoryPositions(x);
+#endif // EXPORT_DENSE_MESH
 }
@@ -96,8 +96,12 @@ enum WorldType {
 	STARFISH3,
 	TEST_HYPER_REDUCED_COORDS,
 	TEST_JOINT_UNIVERSAL,
-	TEST_CONSTRAINT_PRESC_BODY_ATTACH_POINT
+	TEST_CONSTRAINT_PRESC_BODY_ATTACH_POINT,
+	GENERATED		// sized by SceneParams, see World::setSceneParams()
 };
+// In the order of WorldType
+extern const char *const WORLD_TYPE_NAMES[];
+const int WORLD_TYPE_COUNT = GENERATED + 1;
 
 typedef int BoneIndex_t;
 const BoneIndex_t INVALID_BONEINDEX = -1;
@@ -140,6 +144,17 @@ struct Floor {
 	}
 };
 
+// Sizes of a GENERATED world, for scaling studies
+struct SceneParams {
+	int nlinks;			// rigid links joined by revolute joints
+	int nbranches;		// children per link, 1 for a serial chain
+	int nloops;			// loop constraints, each closing a four-bar linkage in the tree
+	int nsoftbodies;	// soft boxes spanning a link and its first child
+	int ntets;			// approximate number of tets per soft body
+	int nsprings;		// springs between pairs of links
+	SceneParams() : nlinks(10), nbranches(1), nloops(1), nsoftbodies(1), ntets(500), nsprings(2) {}
+};
+
 class World : public Brenderable
 {
 public:
@@ -228,6 +243,16 @@ public:
 		const std::string &TETGEN_FLAGS,
 		std::string file_name);
 
+	// Soft body from a generated box of the given sides, centered at the origin
+	std::shared_ptr<SoftBody> addSoftBodyBox(
+		double density,
+		double young,
+		double possion,
+		Material material,
+		const std::string &RESOURCE_DIR,
+		const std::string &TETGEN_FLAGS,
+		Vector3d sides);
+
 	std::shared_ptr<SoftBodyInvertibleFEM> addSoftBodyInvertibleFEM(
 		double density,
 		double young,
@@ -374,9 +399,29 @@ public:
 	void deactivateListOfPrescConstraints(Eigen::VectorXi mcon, Eigen::VectorXi rcon);
 	Energy computeEnergy();
 
+	// Used by load() for GENERATED worlds
+	void setSceneParams(const SceneParams &params) { m_params = params; }
+	const SceneParams & getSceneParams() const { return m_params; }
+
 	void load(const std::string &RESOURCE_DIR);
 	void init();
+	void computeOrdering();
 	void update();
+
+	// A new world of the same type and state, after load() and init() of this one. The copy is
+	// rebuilt from the scene description, so changes made to the objects after load() are lost.
+	// It shares the shapes, tet meshes and embedding weights of this world and takes the rest
+	// volumes and stiffness of its tets, so none of them is recomputed; the state of saveState()
+	// is copied.
+	std::shared_ptr<World> clone() const;
+
+	// The state as a flat buffer: the time, y, the x and v of every soft body node, fixed ones
+	// included, the activity of every constraint and the floor contact of the soft bodies. The
+	// buffer is resized only when the world changes shape, and a world accepts the states of
+	// its clones.
+	void saveState(std::vector<double> &state) const;
+	// Returns false when the state comes from a world of another shape
+	bool restoreState(const std::vector<double> &state);
 	
 	void draw(
 		std::shared_ptr<MatrixStack> MV, 
@@ -396,12 +441,24 @@ public:
 	std::vector<std::string> getBrenderNames() const;
 	std::vector<std::string> getBrenderExtensions() const;
 	std::vector<int> getBrenderTypes() const;
-	void exportBrender(std::vector< std::shared_ptr< std::ofstream > > outfiles, int frame, double time) const;
+	void exportBrender(std::vector< std::shared_ptr< std::ostream > > outfiles, int frame, double time) const;
+	void getTrajectoryTopology(int i, int &nverts, std::vector<int> &tris) const;
+	void getTrajectoryPositions(int i, std::vector<double> &x) const;
+	// Appends the poses of the bodies as JSON lines, after a header on the first export
+	void exportPoses(std::ostream &outfile, int frame, const std::vector<std::string> &names, const std::vector<std::string> &objs) const;
 
 	void setTime(double t) { m_t = t; }
 	double getTime() const { return m_t; }
-	double getH() const { return m_h; }
-	void incrementTime() { m_t += m_h; }
+	// the step of the solver, the coarse step when multi-rate
+	double getH() const { return m_h * computeSoftBodySubsteps(); }
+
+	// multi-rate, the rigid DOFs and the constraints step at H and the soft bodies substep it at
+	// the step of the scene, 0 for single-rate
+	void setCoarseStep(double H) { m_H = H; }
+	double getCoarseStep() const { return m_H; }
+	// soft body substeps per step of the solver, H rounded to a multiple of the step of the scene
+	int computeSoftBodySubsteps() const;
+	void incrementTime() { m_t += getH(); }
 
 	void setGrav(Eigen::Vector3d grav) { m_grav = grav; }
 	Vector3d getGrav() const { return m_grav; }
@@ -420,11 +477,13 @@ public:
 	std::shared_ptr<MeshEmbedding> getMeshEmbedding0() const { return m_meshembeddings[0]; }
 
 	Vector2d getTspan() const { return m_tspan; }
+	const Eigen::VectorXi & getOrdering() const { return m_ordering; }
 	int getNsteps();
 
 	int nm;
 	int nr;
 	int nR;
+	int nrc;	// reduced DOFs before the soft bodies, the ones of the coarse step
 	int nem;
 	int ner;
 	int ne;
@@ -452,6 +511,12 @@ public:
 	WorldType m_type;
 
 private:
+	void loadGenerated(const std::string &RESOURCE_DIR);
+	void initGenerated();
+	// The objects of m_source that the next soft body and embedding correspond to
+	std::shared_ptr<const SoftBody> getRestSoftBody() const;
+	std::shared_ptr<const MeshEmbedding> getRestMeshEmbedding() const;
+
 	Energy m_energy;		// the energy in current state
 	Energy m_energy0;		// the energy in initial state
 
@@ -460,11 +525,18 @@ private:
 	double m_damping;
 	double m_t;
 	double m_h;
+	double m_H;			// multi-rate coarse step, 0 when single-rate
 	Eigen::Vector2d m_tspan;	
+	Eigen::VectorXi m_ordering;	// fill-reducing elimination order of the reduced DOFs
 	bool isleftleg;
 	bool isrightleg;
 
 	double m_Hexpected;		// used to check correctness
+
+	SceneParams m_params;
+	std::string m_resource_dir;	// of the last load(), for clone()
+	const World *m_source;		// the world being cloned during the load() of a clone
+	std::vector<Eigen::Vector2i> m_generated_ends;	// links holding the -x and +x ends of each generated soft body
 	
 	// These are the actual objects that are created
 	std::vector<std::shared_ptr<Body>> m_bodies;
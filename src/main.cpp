@@ -274,11 +274,9 @@ void stepWorld() {
 
 int main(int argc, char **argv)
 {
-#ifdef _WIN32
+	// Eigen is called from our own worker threads, so it must not spawn threads itself
 	Eigen::initParallel();
-	omp_set_num_threads(1);
 	Eigen::setNbThreads(1);
-#endif
 
 	if(argc < 2) {
 		cout << "Please specify the resource directory." << endl;
@@ -9,7 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstdlib>
-#ifdef _WIN32
+#ifdef REDMAX_OPENMP
 #include <omp.h>
 #endif
 #ifdef _MEX_
@@ -36,6 +36,7 @@
 #include "SE3.h"
 #include "MatlabDebug.h"
 #include "Shape.h"
+#include "MeshRegistry.h"
 #include "BrenderManager.h"
 #include "Program.h"
 #include "MatrixStack.h"
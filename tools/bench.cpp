@@ -0,0 +1,396 @@
+// Runs the scenes headlessly with every applicable sparse solver and reports their speed
+//    bench <resource dir> [--steps N] [--warmup N] [--threads N] [--scenes A,B,...] [--solvers A,B,...]
+//          [--generate L,B,C,K,T,S ...] [--output results.json] [--baseline baseline.json]
+//          [--tolerance 0.1] [--rss-tolerance 0.2]
+//    Each --generate adds a GENERATED world of L links with B children each, C loops, K soft
+//    bodies of about T tets and S springs; the DOF and constraint counts in the results give the
+//    scaling curves.
+//    Every scene is loaded once and its solvers start from the same saved state. Phase times need
+//    a build with REDMAX_WITH_PROFILE. The peak RSS is the peak of the process so far, so it is
+//    compared with the baseline only when a single scene is run with a single solver. Exits with 1
+//    when a result is slower, or larger, than the baseline by more than the tolerance. The tolerances
+//    of a baseline file, if any, are used unless they are given on the command line.
+//    tools/bench_baseline.json is the baseline of the scenes that run without the tet mesher, see
+//    its "command" for how it was made.
+
+#include "rmpch.h"
+
+#include <chrono>
+#include <map>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "World.h"
+#include "SolverSparse.h"
+#include "Joint.h"
+#include "Deformable.h"
+#include "SoftBody.h"
+#include "MeshEmbedding.h"
+#include "ParallelFor.h"
+#include "Profiler.h"
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+struct BenchCase {
+	WorldType type;
+	SceneParams params;
+	string name;
+};
+
+struct BenchResult {
+	string scene;
+	string solver;
+	int ndofs;			// reduced
+	int neqs;			// equality constraint rows
+	int nineqs;			// inequality constraint rows
+	double setup;		// seconds
+	double sps;			// steps per second
+	double rss;			// MB
+	vector<ProfileTotal> phases;
+};
+
+static double getPeakRSS() {
+	// MB
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.PeakWorkingSetSize / 1048576.0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1048576.0;
+#else
+	return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+static double getSeconds() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> split(const string &s) {
+	vector<string> items;
+	stringstream ss(s);
+	string item;
+	while (getline(ss, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static int findName(const char *const names[], int n, const string &name) {
+	for (int i = 0; i < n; ++i) {
+		if (name == names[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool isApplicable(SparseSolver solver, const shared_ptr<World> &world) {
+	bool isEquality = world->nem + world->ner > 0;
+	bool isInequality = world->nim + world->nir > 0;
+	if (solver == MATRIX_FREE) {
+		// Falls back to the assembled matrices otherwise
+		return (world->nR == world->nr || isEquality) && !isInequality;
+	}
+	if (!isEquality) {
+		// The unconstrained system is solved with CG or MULTIGRID whatever the choice
+		return solver == CG || solver == MULTIGRID;
+	}
+#ifndef REDMAX_SUPERLU
+	if (solver == SUPER_LU) {
+		return false;
+	}
+#endif
+	return true;
+}
+
+static BenchCase makeCase(WorldType type, const SceneParams &params) {
+	BenchCase c;
+	c.type = type;
+	c.params = params;
+	c.name = WORLD_TYPE_NAMES[type];
+	if (type == GENERATED) {
+		char name[128];
+		snprintf(name, sizeof(name), "GENERATED_L%d_B%d_C%d_K%d_T%d_S%d", params.nlinks, params.nbranches,
+			params.nloops, params.nsoftbodies, params.ntets, params.nsprings);
+		c.name = name;
+	}
+	return c;
+}
+
+static shared_ptr<World> createWorld(const BenchCase &c, const string &RESOURCE_DIR) {
+	auto world = make_shared<World>(c.type);
+	world->setSceneParams(c.params);
+	world->load(RESOURCE_DIR);
+	world->init();
+	return world;
+}
+
+static void gatherDofs(const shared_ptr<World> &world, VectorXd &y) {
+	// Same as Scene::init
+	y.resize(2 * world->nr);
+	y.setZero();
+	world->getJoint0()->reparam();
+	world->getJoint0()->gatherDofs(y, world->nr);
+	world->getDeformable0()->gatherDofs(y, world->nr);
+	world->getSoftBody0()->gatherDofs(y, world->nr);
+	world->getMeshEmbedding0()->gatherDofs(y, world->nr);
+}
+
+static BenchResult run(const BenchCase &c, const shared_ptr<World> &world, const vector<double> &state, double load,
+	SparseSolver solver, int nsteps, int nwarmup) {
+	BenchResult result;
+	result.scene = c.name;
+	result.solver = SPARSE_SOLVER_NAMES[solver];
+
+	// Back to where the world was after init(), the setup includes the load of the scene
+	double t0 = getSeconds() - load;
+	world->restoreState(state);
+	result.ndofs = world->nr;
+	result.neqs = world->nem + world->ner;
+	result.nineqs = world->nim + world->nir;
+	auto sparse = make_shared<SolverSparse>(world, REDMAX_EULER, solver);
+	// AUTO tunes every run from scratch
+	sparse->setAutoTuning(3, 1e-6, "");
+	VectorXd y;
+	gatherDofs(world, y);
+	for (int k = 0; k < nwarmup; ++k) {
+		y = sparse->dynamics(y);
+		world->update();
+		world->incrementTime();
+	}
+	result.setup = getSeconds() - t0;
+
+	Profiler::reset();
+	t0 = getSeconds();
+	for (int k = 0; k < nsteps; ++k) {
+		y = sparse->dynamics(y);
+		world->update();
+		world->incrementTime();
+		PROFILE_STEP();
+	}
+	double elapsed = getSeconds() - t0;
+	result.sps = elapsed > 0.0 ? nsteps / elapsed : 0.0;
+	result.rss = getPeakRSS();
+	Profiler::getTotals(result.phases);
+	for (int i = 0; i < (int)result.phases.size(); ++i) {
+		// Per step
+		result.phases[i].ms /= nsteps;
+	}
+	return result;
+}
+
+static json toJson(const BenchResult &result) {
+	json js;
+	js["scene"] = result.scene;
+	js["solver"] = result.solver;
+	js["dofs"] = result.ndofs;
+	js["equalities"] = result.neqs;
+	js["inequalities"] = result.nineqs;
+	js["setup_s"] = result.setup;
+	js["steps_per_second"] = result.sps;
+	js["peak_rss_mb"] = result.rss;
+	json phases = json::object();
+	for (int i = 0; i < (int)result.phases.size(); ++i) {
+		phases[result.phases[i].name] = result.phases[i].ms;
+	}
+	js["phases_ms_per_step"] = phases;
+	return js;
+}
+
+static int compare(const vector<BenchResult> &results, const string &BASELINE_FILE, double tolerance, double rss_tolerance) {
+	// Negative tolerances take the ones of the baseline, or 0.1 and 0.2
+	ifstream in(BASELINE_FILE.c_str());
+	if (!in) {
+		cerr << "Cannot open baseline " << BASELINE_FILE << endl;
+		return 1;
+	}
+	json baseline;
+	in >> baseline;
+	if (tolerance < 0.0) {
+		tolerance = baseline.value("tolerance", 0.1);
+	}
+	if (rss_tolerance < 0.0) {
+		rss_tolerance = baseline.value("rss_tolerance", 0.2);
+	}
+
+	map<string, json> base;
+	for (auto &js : baseline["results"]) {
+		base[js["scene"].get<string>() + " " + js["solver"].get<string>()] = js;
+	}
+
+	// The peak RSS of a result includes the results before it
+	bool isRSS = results.size() == 1;
+	int nregressions = 0;
+	cout << endl << "Against " << BASELINE_FILE << ", tolerance " << tolerance << ", RSS tolerance " << rss_tolerance << endl;
+	if (!isRSS) {
+		cout << "RSS not compared, run a single scene with a single solver for it" << endl;
+	}
+	for (int i = 0; i < (int)results.size(); ++i) {
+		const BenchResult &r = results[i];
+		auto it = base.find(r.scene + " " + r.solver);
+		if (it == base.end()) {
+			printf("%-44s %-14s no baseline\n", r.scene.c_str(), r.solver.c_str());
+			continue;
+		}
+		double sps = it->second["steps_per_second"];
+		double rss = it->second["peak_rss_mb"];
+		bool isSlower = r.sps < sps * (1.0 - tolerance);
+		bool isLarger = isRSS && r.rss > rss * (1.0 + rss_tolerance);
+		if (isRSS) {
+			printf("%-44s %-14s %+7.1f%% steps/s %+7.1f%% RSS %s\n", r.scene.c_str(), r.solver.c_str(),
+				sps > 0.0 ? 100.0 * (r.sps / sps - 1.0) : 0.0, rss > 0.0 ? 100.0 * (r.rss / rss - 1.0) : 0.0,
+				(isSlower || isLarger) ? "REGRESSION" : "ok");
+		}
+		else {
+			printf("%-44s %-14s %+7.1f%% steps/s %s\n", r.scene.c_str(), r.solver.c_str(),
+				sps > 0.0 ? 100.0 * (r.sps / sps - 1.0) : 0.0, isSlower ? "REGRESSION" : "ok");
+		}
+		if (isSlower || isLarger) {
+			nregressions++;
+		}
+	}
+	cout << nregressions << " regression(s)" << endl;
+	return nregressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		cout << "Usage: bench <resource dir> [--steps N] [--warmup N] [--threads N] [--scenes A,B,...] [--solvers A,B,...]" << endl;
+		cout << "             [--generate L,B,C,K,T,S ...] [--output results.json] [--baseline baseline.json]" << endl;
+		cout << "             [--tolerance 0.1] [--rss-tolerance 0.2]" << endl;
+		return 1;
+	}
+	string RESOURCE_DIR = argv[1];
+	if (RESOURCE_DIR.back() != '/' && RESOURCE_DIR.back() != '\\') {
+		RESOURCE_DIR += "/";
+	}
+
+	int nsteps = 100;
+	int nwarmup = 1;
+	double tolerance = -1.0;
+	double rss_tolerance = -1.0;
+	string OUTPUT_FILE, BASELINE_FILE;
+	vector<int> scenes, solvers;
+	vector<BenchCase> cases;
+	for (int i = 2; i < argc; ++i) {
+		string arg = argv[i];
+		string value = (i + 1 < argc) ? argv[i + 1] : "";
+		if (arg == "--steps") { nsteps = max(1, atoi(value.c_str())); ++i; }
+		else if (arg == "--warmup") { nwarmup = max(0, atoi(value.c_str())); ++i; }
+		else if (arg == "--threads") { setParallelThreads(atoi(value.c_str())); ++i; }
+		else if (arg == "--output") { OUTPUT_FILE = value; ++i; }
+		else if (arg == "--baseline") { BASELINE_FILE = value; ++i; }
+		else if (arg == "--tolerance") { tolerance = atof(value.c_str()); ++i; }
+		else if (arg == "--rss-tolerance") { rss_tolerance = atof(value.c_str()); ++i; }
+		else if (arg == "--generate") {
+			vector<string> sizes = split(value);
+			if (sizes.size() != 6) {
+				cerr << "--generate takes L,B,C,K,T,S" << endl;
+				return 1;
+			}
+			SceneParams params;
+			params.nlinks = atoi(sizes[0].c_str());
+			params.nbranches = atoi(sizes[1].c_str());
+			params.nloops = atoi(sizes[2].c_str());
+			params.nsoftbodies = atoi(sizes[3].c_str());
+			params.ntets = atoi(sizes[4].c_str());
+			params.nsprings = atoi(sizes[5].c_str());
+			cases.push_back(makeCase(GENERATED, params));
+			++i;
+		}
+		else if (arg == "--scenes" || arg == "--solvers") {
+			bool isScene = (arg == "--scenes");
+			vector<string> names = split(value);
+			for (int j = 0; j < (int)names.size(); ++j) {
+				int k = isScene ? findName(WORLD_TYPE_NAMES, WORLD_TYPE_COUNT, names[j]) : findName(SPARSE_SOLVER_NAMES, SPARSE_SOLVER_COUNT, names[j]);
+				if (k < 0) {
+					cerr << "Unknown " << (isScene ? "scene " : "solver ") << names[j] << endl;
+					return 1;
+				}
+				(isScene ? scenes : solvers).push_back(k);
+			}
+			++i;
+		}
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	if (scenes.empty() && cases.empty()) {
+		for (int k = 0; k < WORLD_TYPE_COUNT; ++k) {
+			scenes.push_back(k);
+		}
+	}
+	for (int i = 0; i < (int)scenes.size(); ++i) {
+		cases.push_back(makeCase((WorldType)scenes[i], SceneParams()));
+	}
+	if (solvers.empty()) {
+		for (int k = 0; k < SPARSE_SOLVER_COUNT; ++k) {
+			solvers.push_back(k);
+		}
+	}
+
+	GLSL::setHeadless(true);
+	Profiler::setEnabled(true);
+
+	vector<BenchResult> results;
+	printf("%-44s %-14s %8s %8s %10s %12s %10s\n", "scene", "solver", "dofs", "eqs", "setup s", "steps/s", "peak MB");
+	for (int i = 0; i < (int)cases.size(); ++i) {
+		// The constraint counts decide which solvers make a difference
+		double t0 = getSeconds();
+		shared_ptr<World> world = createWorld(cases[i], RESOURCE_DIR);
+		double load = getSeconds() - t0;
+		if (world->nr == 0) {
+			// Scenes that are only declared
+			continue;
+		}
+		vector<double> state;
+		world->saveState(state);
+		for (int j = 0; j < (int)solvers.size(); ++j) {
+			SparseSolver solver = (SparseSolver)solvers[j];
+			if (!isApplicable(solver, world)) {
+				continue;
+			}
+			BenchResult result = run(cases[i], world, state, load, solver, nsteps, nwarmup);
+			printf("%-44s %-14s %8d %8d %10.3f %12.2f %10.1f\n", result.scene.c_str(), result.solver.c_str(), result.ndofs, result.neqs,
+				result.setup, result.sps, result.rss);
+			for (int k = 0; k < (int)result.phases.size(); ++k) {
+				printf("    %-40s %10.4f ms/step\n", result.phases[k].name.c_str(), result.phases[k].ms);
+			}
+			results.push_back(result);
+		}
+	}
+
+	if (!OUTPUT_FILE.empty()) {
+		json js;
+		js["steps"] = nsteps;
+		js["warmup"] = nwarmup;
+		js["threads"] = getParallelThreads();
+		js["results"] = json::array();
+		for (int i = 0; i < (int)results.size(); ++i) {
+			js["results"].push_back(toJson(results[i]));
+		}
+		ofstream out(OUTPUT_FILE.c_str());
+		out << js.dump(1, '\t') << endl;
+	}
+
+	if (!BASELINE_FILE.empty()) {
+		return compare(results, BASELINE_FILE, tolerance, rss_tolerance);
+	}
+	return 0;
+}
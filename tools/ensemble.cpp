@@ -0,0 +1,169 @@
+// Runs many independent simulations of the scenes in one process, see src/Ensemble.h
+//    ensemble <resource dir> [--scenes A,B,...] [--generate L,B,C,K,T,S ...] [--runs N] [--steps N]
+//             [--solver NAME] [--threads N] [--export N] [--telemetry] [--seed N] [--jitter A]
+//             [--output DIR]
+//    Every scene and every --generate size is run --runs times, each run in DIR/run_<index>.
+//    The runs get the seeds N, N + 1, ... and start with every free joint coordinate moved by a
+//    uniform random offset in [-A, A] drawn from their seed, so that they differ. The
+//    aggregated results go to DIR/summary.json.
+
+#include "rmpch.h"
+
+#include <random>
+#include <sstream>
+
+#include "Ensemble.h"
+#include "Joint.h"
+#include "ParallelFor.h"
+
+using namespace std;
+using namespace Eigen;
+
+static vector<string> split(const string &s) {
+	vector<string> items;
+	stringstream ss(s);
+	string item;
+	while (getline(ss, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static int findName(const char *const names[], int n, const string &name) {
+	for (int i = 0; i < n; ++i) {
+		if (name == names[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		cout << "Usage: ensemble <resource dir> [--scenes A,B,...] [--generate L,B,C,K,T,S ...] [--runs N] [--steps N]" << endl;
+		cout << "                [--solver NAME] [--threads N] [--export N] [--telemetry] [--seed N] [--jitter A]" << endl;
+		cout << "                [--output DIR]" << endl;
+		return 1;
+	}
+	string RESOURCE_DIR = argv[1];
+	if (RESOURCE_DIR.back() != '/' && RESOURCE_DIR.back() != '\\') {
+		RESOURCE_DIR += "/";
+	}
+
+	int nruns = 4;
+	int nsteps = 100;
+	int every = 0;
+	unsigned int seed = 0;
+	double jitter = 0.0;
+	bool isTelemetry = false;
+	SparseSolver solver = AUTO;
+	string OUTPUT_DIR = "ensemble";
+	vector<EnsembleMember> cases;
+	for (int i = 2; i < argc; ++i) {
+		string arg = argv[i];
+		string value = (i + 1 < argc) ? argv[i + 1] : "";
+		if (arg == "--runs") { nruns = max(1, atoi(value.c_str())); ++i; }
+		else if (arg == "--steps") { nsteps = max(1, atoi(value.c_str())); ++i; }
+		else if (arg == "--threads") { setParallelThreads(atoi(value.c_str())); ++i; }
+		else if (arg == "--export") { every = max(0, atoi(value.c_str())); ++i; }
+		else if (arg == "--seed") { seed = (unsigned int)strtoul(value.c_str(), nullptr, 10); ++i; }
+		else if (arg == "--jitter") { jitter = max(0.0, atof(value.c_str())); ++i; }
+		else if (arg == "--jitter") { jitter = max(0.0, atof(value.c_str())); ++i; }
+		else if (arg == "--output") { OUTPUT_DIR = value; ++i; }
+		else if (arg == "--telemetry") { isTelemetry = true; }
+		else if (arg == "--solver") {
+			int k = findName(SPARSE_SOLVER_NAMES, SPARSE_SOLVER_COUNT, value);
+			if (k < 0) {
+				cerr << "Unknown solver " << value << endl;
+				return 1;
+			}
+			solver = (SparseSolver)k;
+			++i;
+		}
+		else if (arg == "--generate") {
+			vector<string> sizes = split(value);
+			if (sizes.size() != 6) {
+				cerr << "--generate takes L,B,C,K,T,S" << endl;
+				return 1;
+			}
+			EnsembleMember member;
+			member.type = GENERATED;
+			member.params.nlinks = atoi(sizes[0].c_str());
+			member.params.nbranches = atoi(sizes[1].c_str());
+			member.params.nloops = atoi(sizes[2].c_str());
+			member.params.nsoftbodies = atoi(sizes[3].c_str());
+			member.params.ntets = atoi(sizes[4].c_str());
+			member.params.nsprings = atoi(sizes[5].c_str());
+			cases.push_back(member);
+			++i;
+		}
+		else if (arg == "--scenes") {
+			vector<string> names = split(value);
+			for (int j = 0; j < (int)names.size(); ++j) {
+				int k = findName(WORLD_TYPE_NAMES, WORLD_TYPE_COUNT, names[j]);
+				if (k < 0) {
+					cerr << "Unknown scene " << names[j] << endl;
+					return 1;
+				}
+				EnsembleMember member;
+				member.type = (WorldType)k;
+				cases.push_back(member);
+			}
+			++i;
+		}
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	if (cases.empty()) {
+		cerr << "Nothing to run, give --scenes or --generate" << endl;
+		return 1;
+	}
+
+	Ensemble ensemble(RESOURCE_DIR, OUTPUT_DIR);
+	ensemble.setSolver(solver);
+	ensemble.setExportEvery(every);
+	ensemble.setTelemetry(isTelemetry);
+	if (jitter > 0.0) {
+		ensemble.setConfigure([jitter](int index, const EnsembleMember &member, shared_ptr<World> world) {
+			mt19937 rng(member.seed);
+			uniform_real_distribution<double> offset(-jitter, jitter);
+			for (shared_ptr<Joint> joint = world->getJoint0(); joint != nullptr; joint = joint->next) {
+				if (joint->presc != nullptr) {
+					continue;
+				}
+				for (int k = 0; k < joint->m_ndof; ++k) {
+					joint->m_q(k) += offset(rng);
+				}
+			}
+			world->update();
+		});
+	}
+	else if (nruns > 1) {
+		cout << "The runs of a scene are identical without --jitter" << endl;
+	}
+	for (int i = 0; i < (int)cases.size(); ++i) {
+		for (int r = 0; r < nruns; ++r) {
+			EnsembleMember member = cases[i];
+			member.nsteps = nsteps;
+			member.seed = seed + ensemble.getCount();
+			ensemble.add(member);
+		}
+	}
+
+	cout << ensemble.getCount() << " runs on " << getParallelThreads() << " threads" << endl;
+	ensemble.run();
+	const vector<EnsembleResult> &results = ensemble.getResults();
+	printf("%-6s %-24s %8s %10s %12s %14s\n", "run", "scene", "dofs", "seconds", "steps/s", "energy drift");
+	for (int i = 0; i < (int)results.size(); ++i) {
+		const EnsembleResult &r = results[i];
+		printf("%-6d %-24s %8d %10.3f %12.2f %14.6g\n", r.index, WORLD_TYPE_NAMES[cases[i / nruns].type], r.ndofs,
+			r.seconds, r.sps, r.energy - r.energy0);
+	}
+	printf("wall %.3f s\n", ensemble.getWallTime());
+	return ensemble.writeSummary() ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+// Runs the sparse solvers on systems captured by SystemCapture and reports their speed and accuracy
+//    replay <step json ...> [--solvers A,B,...] [--repeat N] [--tolerances IT,CG,MINRES] [--output results.json]
+//    Each argument is the step_<step>.json of a capture, e.g. capture/step_*.json. The system is
+//    solved as in the step that was captured. The first run includes the symbolic analysis, the
+//    reported time is the mean of the later runs, which may reuse it. The error is relative to the
+//    captured qdot1 and lambda. The QP steps, with active inequalities, and the matrix-free steps
+//    cannot be replayed.
+
+#include "rmpch.h"
+
+#include <chrono>
+#include <sstream>
+
+#include "SolverSparse.h"
+#include "SystemCapture.h"
+
+using namespace std;
+using namespace Eigen;
+using json = nlohmann::json;
+
+struct CapturedStep {
+	string name;
+	int step;
+	SparseMatrix<double> MDKr;
+	MatrixXd G;
+	VectorXd fr;
+	VectorXd rhsG;
+	VectorXi order;
+	VectorXd qdot0;
+	VectorXd sol;		// [qdot1; lambda], or qdot1 without constraints
+	double tol[3];
+};
+
+static double getSeconds() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static vector<string> split(const string &s) {
+	vector<string> items;
+	stringstream ss(s);
+	string item;
+	while (getline(ss, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static bool readVector(const string &FILE, VectorXd &v) {
+	MatrixXd A;
+	if (!readMatrix(FILE, A) || A.cols() > 1) {
+		return false;
+	}
+	v = A.col(0);
+	return true;
+}
+
+static bool load(const string &INFO_FILE, CapturedStep &c) {
+	ifstream in(INFO_FILE.c_str());
+	if (!in) {
+		cerr << "Cannot open " << INFO_FILE << endl;
+		return false;
+	}
+	json info;
+	in >> info;
+	c.name = INFO_FILE;
+	c.step = info["step"];
+	if (info["matrix_free"].get<bool>() || info["ni"].get<int>() > 0) {
+		cerr << INFO_FILE << ": " << (info["ni"].get<int>() > 0 ? "QP" : "matrix-free") << " step, skipped" << endl;
+		return false;
+	}
+	for (int k = 0; k < 3; ++k) {
+		c.tol[k] = info["tolerances"][k];
+	}
+
+	string prefix = INFO_FILE.substr(0, INFO_FILE.size() - 5) + "_";
+	string ext = (info["format"].get<string>() == "mtx") ? ".mtx" : ".bin";
+	VectorXd order;
+	bool isRead = readMatrix(prefix + "MDKr" + ext, c.MDKr) && readVector(prefix + "fr" + ext, c.fr) &&
+		readVector(prefix + "qdot0" + ext, c.qdot0) && readVector(prefix + "order" + ext, order);
+	int ne = info["ne"];
+	if (ne > 0) {
+		isRead = isRead && readMatrix(prefix + "G" + ext, c.G) && readVector(prefix + "rhsG" + ext, c.rhsG) &&
+			readVector(prefix + "sol" + ext, c.sol);
+	}
+	else {
+		c.G.resize(0, c.MDKr.cols());
+		c.rhsG.resize(0);
+		isRead = isRead && readVector(prefix + "qdot1" + ext, c.sol);
+	}
+	if (!isRead) {
+		cerr << INFO_FILE << ": incomplete capture, skipped" << endl;
+		return false;
+	}
+	c.order = order.cast<int>();
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		cout << "Usage: replay <step json ...> [--solvers A,B,...] [--repeat N] [--tolerances IT,CG,MINRES] [--output results.json]" << endl;
+		return 1;
+	}
+
+	int nrepeats = 3;
+	vector<double> tolerances;
+	string OUTPUT_FILE;
+	vector<string> files;
+	vector<int> solvers;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		string value = (i + 1 < argc) ? argv[i + 1] : "";
+		if (arg == "--repeat") { nrepeats = max(1, atoi(value.c_str())); ++i; }
+		else if (arg == "--output") { OUTPUT_FILE = value; ++i; }
+		else if (arg == "--tolerances") {
+			vector<string> tols = split(value);
+			if (tols.size() != 3) {
+				cerr << "--tolerances takes IT,CG,MINRES" << endl;
+				return 1;
+			}
+			for (int k = 0; k < 3; ++k) {
+				tolerances.push_back(atof(tols[k].c_str()));
+			}
+			++i;
+		}
+		else if (arg == "--solvers") {
+			vector<string> names = split(value);
+			for (int j = 0; j < (int)names.size(); ++j) {
+				int k = 0;
+				while (k < SPARSE_SOLVER_COUNT && names[j] != SPARSE_SOLVER_NAMES[k]) {
+					++k;
+				}
+				if (k == SPARSE_SOLVER_COUNT) {
+					cerr << "Unknown solver " << names[j] << endl;
+					return 1;
+				}
+				solvers.push_back(k);
+			}
+			++i;
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (solvers.empty()) {
+		for (int k = 0; k < SPARSE_SOLVER_COUNT; ++k) {
+			solvers.push_back(k);
+		}
+	}
+
+	json results = json::array();
+	printf("%-8s %-14s %8s %10s %12s %8s %12s %12s\n", "step", "solver", "rows", "nnz", "ms", "iters", "residual", "error");
+	for (int i = 0; i < (int)files.size(); ++i) {
+		CapturedStep c;
+		if (!load(files[i], c)) {
+			continue;
+		}
+		double norm = c.sol.norm() > 0.0 ? c.sol.norm() : 1.0;
+		for (int j = 0; j < (int)solvers.size(); ++j) {
+			SparseSolver s = (SparseSolver)solvers[j];
+			// A fresh solver per system, as a new scene would have
+			SolverSparse solver;
+			if (tolerances.empty()) {
+				solver.setTolerances(c.tol[0], c.tol[1], c.tol[2]);
+			}
+			else {
+				solver.setTolerances(tolerances[0], tolerances[1], tolerances[2]);
+			}
+
+			VectorXd sol;
+			TelemetryRecord record;
+			vector<double> times;
+			bool success = true;
+			for (int k = 0; k < nrepeats && success; ++k) {
+				double t0 = getSeconds();
+				success = solver.replay(s, c.MDKr, c.G, c.fr, c.rhsG, c.order, c.qdot0, sol, record);
+				times.push_back(getSeconds() - t0);
+			}
+			if (!success) {
+				printf("%-8d %-14s n/a\n", c.step, SPARSE_SOLVER_NAMES[s]);
+				continue;
+			}
+			double error = (sol.size() == c.sol.size()) ? (sol - c.sol).norm() / norm : -1.0;
+			double first = times[0];
+			double rest = 0.0;
+			for (int k = 1; k < (int)times.size(); ++k) {
+				rest += times[k];
+			}
+			double ms = 1e3 * (times.size() > 1 ? rest / (times.size() - 1) : first);
+			printf("%-8d %-14s %8d %10lld %12.4f %8d %12.3e %12.3e\n", c.step, SPARSE_SOLVER_NAMES[s], record.rows,
+				(long long)record.nonzeros, ms, record.iterations, record.residual, error);
+
+			json js;
+			js["capture"] = c.name;
+			js["step"] = c.step;
+			js["solver"] = SPARSE_SOLVER_NAMES[s];
+			js["rows"] = record.rows;
+			js["nonzeros"] = record.nonzeros;
+			js["first_ms"] = 1e3 * first;
+			js["ms"] = ms;
+			js["iterations"] = record.iterations;
+			js["reuse"] = record.reuse;
+			js["residual"] = record.residual;
+			js["error"] = error;
+			results.push_back(js);
+		}
+	}
+
+	if (!OUTPUT_FILE.empty()) {
+		json js;
+		js["repeat"] = nrepeats;
+		js["results"] = results;
+		ofstream out(OUTPUT_FILE.c_str());
+		out << js.dump(1, '\t') << endl;
+	}
+	return 0;
+}
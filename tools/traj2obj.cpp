@@ -0,0 +1,67 @@
+// Converts a trajectory written by BrenderManager into one OBJ file per frame
+//    traj2obj <trajectory> <output directory> [first frame] [last frame]
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Trajectory.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	if (argc < 3) {
+		cout << "Usage: traj2obj <trajectory> <output directory> [first frame] [last frame]" << endl;
+		return 1;
+	}
+
+	TrajectoryReader reader;
+	if (!reader.open(argv[1])) {
+		return 1;
+	}
+
+	// Named after the trajectory, as the per frame exports were
+	string name = argv[1];
+	size_t slash = name.find_last_of("/\\");
+	if (slash != string::npos) {
+		name = name.substr(slash + 1);
+	}
+	size_t dot = name.find_last_of('.');
+	if (dot != string::npos) {
+		name = name.substr(0, dot);
+	}
+
+	int first = (argc > 3) ? atoi(argv[3]) : 0;
+	int last = (argc > 4) ? atoi(argv[4]) : reader.getFrameCount() - 1;
+	const vector<int> &tris = reader.getTriangles();
+	vector<double> x;
+
+	for (int k = max(0, first); k <= last && k < reader.getFrameCount(); ++k) {
+		if (!reader.readFrame(k, x)) {
+			cerr << "Cannot read frame " << k << endl;
+			return 1;
+		}
+
+		char filename[512];
+		snprintf(filename, sizeof(filename), "%s/%06d_%s.obj", argv[2], reader.getFrame(k), name.c_str());
+		FILE *out = fopen(filename, "w");
+		if (out == nullptr) {
+			cerr << "Cannot open " << filename << endl;
+			return 1;
+		}
+		fprintf(out, "# frame %06d \n", reader.getFrame(k));
+		fprintf(out, "# time %f \n", reader.getTime(k));
+		fprintf(out, "# name %s \n", name.c_str());
+		for (int i = 0; i < reader.getVertexCount(); ++i) {
+			fprintf(out, "v %g %g %g\n", x[3 * i + 0], x[3 * i + 1], x[3 * i + 2]);
+		}
+		for (int i = 0; i < (int)tris.size(); i += 3) {
+			fprintf(out, "f %d %d %d\n", tris[i] + 1, tris[i + 1] + 1, tris[i + 2] + 1);
+		}
+		fclose(out);
+	}
+	return 0;
+}